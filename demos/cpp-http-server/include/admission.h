@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include "metrics.h"
+
+namespace http_server {
+namespace admission {
+
+// Sustained rate and burst of a token bucket; a rate of 0 disables it
+struct RateLimit {
+    double rate = 0;    // Requests per second
+    double burst = 0;   // Requests admitted back to back; 0 = max(1, rate)
+
+    bool enabled() const { return rate > 0; }
+};
+
+struct Settings {
+    RateLimit per_client;                        // One bucket per client address
+    RateLimit per_route[metrics::kRouteCount];   // Shared by every client
+    size_t client_table_size = 65536;            // Client buckets tracked at once
+    // Requests inside handlers at once (0 = unlimited), and how many more
+    // may wait up to queue_timeout_ms for a slot before getting 503
+    unsigned int max_concurrent = 0;
+    unsigned int queue_size = 0;
+    unsigned int queue_timeout_ms = 50;
+
+    bool enabled() const;
+};
+
+enum class Verdict : uint8_t {
+    ADMIT,
+    CLIENT_RATE,   // 429
+    ROUTE_RATE,    // 429
+    OVERLOADED,    // 503
+    QUEUED         // Waits for a concurrency slot; see Controller::enqueue
+};
+
+struct Decision {
+    Verdict verdict = Verdict::ADMIT;
+    uint32_t retry_after_seconds = 0;  // For the Retry-After header
+};
+
+// Token bucket in GCRA form: all of its state is one "theoretical arrival
+// time", so taking a token is a single compare-and-swap
+class Gcra {
+public:
+    Gcra() = default;
+    explicit Gcra(const RateLimit& limit);
+
+    bool enabled() const { return interval_ns_ != 0; }
+    // 0 if a token was taken from the bucket in tat, otherwise how many
+    // nanoseconds until one will be there
+    uint64_t take(std::atomic<uint64_t>& tat, uint64_t now_ns) const;
+
+private:
+    uint64_t interval_ns_ = 0;   // One token's worth of time
+    uint64_t tolerance_ns_ = 0;  // (burst - 1) tokens' worth
+};
+
+// Fixed-size, lock-free table of per-client buckets: four-way set
+// associative, one cache line per set. A client takes a free slot or one
+// whose bucket has refilled completely, which is indistinguishable from a
+// new one. When its set has neither the request is admitted untracked
+// rather than charged to someone else's bucket.
+class ClientBuckets {
+public:
+    explicit ClientBuckets(size_t slots);
+
+    // Gcra::take for client's bucket; untracked() counts the fallbacks
+    uint64_t take(const Gcra& gcra, uint64_t client, uint64_t now_ns);
+    uint64_t untracked() const { return untracked_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kWays = 4;
+
+    struct alignas(64) Set {
+        std::atomic<uint64_t> keys[kWays] = {};
+        std::atomic<uint64_t> tats[kWays] = {};
+    };
+
+    std::unique_ptr<Set[]> sets_;
+    size_t mask_;
+    std::atomic<uint64_t> untracked_{0};
+};
+
+// Bounds requests in flight. Over the limit, up to queue_size callers wait
+// for a slot for at most the timeout. acquire() blocks its thread; once
+// startQueue() has run, enqueue() instead parks the waiter and returns, and
+// the waker hands it the slot from release(), or its refusal from the
+// expiry thread.
+class ConcurrencyLimiter {
+public:
+    enum class Queued : uint8_t { ACQUIRED, QUEUED, REFUSED };
+    // Runs outside the limiter's lock; on acquired the waiter holds a slot
+    using Waker = std::function<void(void* waiter, bool acquired)>;
+
+    ConcurrencyLimiter(unsigned int limit, unsigned int queue_size, std::chrono::milliseconds timeout);
+    ~ConcurrencyLimiter();
+
+    bool tryAcquire();
+    bool acquire();
+    // park runs under the lock release() takes to wake the waiter, so the
+    // waker never sees a waiter that has not finished parking
+    Queued enqueue(void* waiter, const std::function<void()>& park);
+    void release();
+
+    void startQueue(Waker waker);
+    // Refuses every queued waiter, and enqueue() refuses until restarted
+    void stopQueue();
+    bool queueing() const { return queueing_.load(); }
+    bool queueFull() const { return waiting() >= queue_size_; }
+
+    unsigned int inFlight() const { return in_flight_.load(std::memory_order_relaxed); }
+    unsigned int waiting() const { return waiting_.load(std::memory_order_relaxed); }
+    bool saturated() const { return inFlight() >= limit_; }
+
+private:
+    struct Waiter {
+        void* waiter;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void expiryLoop();
+
+    const unsigned int limit_;
+    const unsigned int queue_size_;
+    const std::chrono::milliseconds timeout_;
+    std::atomic<unsigned int> in_flight_{0};
+    std::atomic<unsigned int> waiting_{0};
+    std::mutex mutex_;
+    std::condition_variable freed_;
+    // Oldest first; every waiter has the same timeout, so also by deadline
+    std::deque<Waiter> queue_;
+    std::atomic<bool> queueing_{false};
+    Waker waker_;
+    std::condition_variable queued_;
+    std::thread expiry_;
+};
+
+// Admission decisions for the HTTP layer, taken on a request's headers
+// before its body is read. Health and metrics are always admitted, and
+// event streams are not counted against the concurrency limit, since they
+// stay open for as long as the client follows them.
+class Controller {
+public:
+    explicit Controller(const Settings& settings);
+
+    bool enabled() const { return enabled_; }
+    // On ADMIT with counted set, release() must follow once the request ends.
+    // QUEUED only once startQueue() has run: the caller then passes the
+    // request to enqueue() instead of blocking for a slot.
+    Decision admit(metrics::Route route, uint64_t client, bool& counted);
+    // See ConcurrencyLimiter; refusals, at once or on timeout, count as
+    // OVERLOADED
+    ConcurrencyLimiter::Queued enqueue(void* waiter, const std::function<void()>& park);
+    void release();
+    void startQueue(ConcurrencyLimiter::Waker waker);
+    void stopQueue();
+    // Every concurrency slot is taken, so new requests queue or get 503
+    bool saturated() const { return limiter_ && limiter_->saturated(); }
+
+    uint64_t rejected(Verdict verdict) const;
+    void appendPrometheus(std::string& out) const;
+
+private:
+    uint64_t nowNanos() const;
+
+    bool enabled_;
+    std::chrono::steady_clock::time_point epoch_;
+    Gcra client_gcra_;
+    ClientBuckets client_buckets_;
+    Gcra route_gcra_[metrics::kRouteCount];
+    std::atomic<uint64_t> route_tats_[metrics::kRouteCount] = {};
+    std::unique_ptr<ConcurrencyLimiter> limiter_;
+    std::atomic<uint64_t> rejected_[4] = {};
+};
+
+// Bucket key for a client address: IPv4 and IPv6 addresses, ports ignored
+uint64_t clientKey(const struct sockaddr* address);
+
+} // namespace admission
+} // namespace http_server
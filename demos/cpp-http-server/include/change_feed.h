@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "task_manager.h"
+
+namespace http_server {
+
+enum class ChangeKind : uint8_t {
+    PUT,     // Created, updated or restored; task is the new version
+    DELETE
+};
+
+struct ChangeEvent {
+    uint64_t seq = 0;
+    ChangeKind kind = ChangeKind::PUT;
+    uint64_t id = 0;
+    TaskPtr task;  // nullptr for DELETE
+    // Wall clock at publish, in microseconds; followers measure their lag
+    // against it
+    int64_t published_us = 0;
+};
+
+// Result of ChangeFeed::read
+struct ChangeBatch {
+    std::vector<ChangeEvent> events;
+    uint64_t latest = 0;   // Newest sequence number published so far
+    // The reader's position is no longer in the ring (or never was): it
+    // has to reload the store and continue from latest
+    bool resync = false;
+};
+
+// Bounded, in-order record of store mutations for clients that follow the
+// store instead of polling it. TaskManager publishes with the shard lock
+// held, so events for any one task are in version order. Only the newest
+// capacity events are kept; each holds its task version alive until it
+// is overwritten.
+//
+// Writers on different shards do not serialize: each reserves its
+// sequence number with one fetch_add and fills its own slot, and latest()
+// moves over every filled slot in order, whichever writer gets there.
+class ChangeFeed {
+public:
+    static constexpr size_t kDefaultCapacity = 16384;
+
+    explicit ChangeFeed(size_t capacity = kDefaultCapacity);
+
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    void publishPut(TaskPtr task);
+    void publishDelete(uint64_t id);
+
+    // Up to max events with seq > since, oldest first
+    ChangeBatch read(uint64_t since, size_t max) const;
+    // Sequence numbers continue from the wall clock in microseconds, so a
+    // position saved against an earlier process reads as a resync rather
+    // than silently matching unrelated events
+    uint64_t latest() const { return latest_.load(); }
+    // Newest sequence number taken by a writer. Every change visible in the
+    // store is at or below it, though latest() may not have reached it yet.
+    uint64_t reserved() const { return reserved_.load(); }
+    // Blocks up to timeout for an event newer than since
+    bool waitForNewer(uint64_t since, std::chrono::milliseconds timeout) const;
+
+    // Called whenever latest() moves, possibly under a store shard lock: it
+    // must be quick and must not call back into the store. Set it before
+    // the feed is attached to a TaskManager.
+    void setListener(std::function<void()> listener) { listener_ = std::move(listener); }
+
+private:
+    struct Slot {
+        // Held only to write the event or copy it out; readers copy the
+        // TaskPtr, so the event cannot be read while it is replaced
+        std::mutex mutex;
+        ChangeEvent event;
+        std::atomic<uint64_t> published{0};  // event.seq, once it is filled
+    };
+
+    void append(ChangeKind kind, uint64_t id, TaskPtr task);
+    // Moves latest_ over the filled slots after it; true if it moved
+    bool advance();
+
+    const size_t capacity_;
+    std::unique_ptr<Slot[]> ring_;   // Slot seq % capacity
+    uint64_t first_seq_;             // Numbering starts after this
+    std::atomic<uint64_t> reserved_;
+    std::atomic<uint64_t> latest_;
+    // Only for waitForNewer; writers take it just to notify, when
+    // waiters_ says someone is there
+    mutable std::mutex mutex_;
+    mutable std::condition_variable published_;
+    mutable std::atomic<size_t> waiters_{0};
+    std::function<void()> listener_;
+};
+
+} // namespace http_server
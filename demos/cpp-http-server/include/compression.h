@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace http_server {
+namespace compression {
+
+// Content codings the server can produce. Which ones are compiled in
+// depends on zlib (gzip) and libbrotlienc (br) being found at build time.
+enum class Encoding : uint8_t {
+    IDENTITY,
+    GZIP,
+    BROTLI
+};
+
+constexpr size_t kEncodingCount = 3;
+
+// Content-Encoding token ("gzip", "br"); "identity" for IDENTITY
+const char* toString(Encoding encoding);
+bool isAvailable(Encoding encoding);
+
+// Best available coding the Accept-Encoding value allows, honouring q-values
+// and "*"; br wins ties with gzip. nullptr or "" means identity only.
+Encoding negotiate(const char* accept_encoding);
+
+struct Settings {
+    bool enabled = true;
+    size_t min_size = 1024;      // Smaller bodies are sent as-is
+    int gzip_level = 6;          // 1-9
+    int brotli_quality = 5;      // 0-11; 4-6 is the usual dynamic-content range
+};
+
+// One compression stream, for bodies written as they are produced. reset()
+// starts the next stream; gzip keeps its allocations, while Brotli has no
+// reset and builds a new encoder.
+class Compressor {
+public:
+    Compressor(Encoding encoding, int level);
+    ~Compressor();
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+    Encoding encoding() const { return encoding_; }
+    int level() const { return level_; }
+
+    // Appends the compressed form of input to out; finish ends the stream,
+    // after which only reset() is valid. False if the codec failed.
+    bool write(std::string_view input, std::string& out, bool finish);
+    void reset();
+
+private:
+    struct State;
+    Encoding encoding_;
+    int level_;
+    std::unique_ptr<State> state_;
+};
+
+// Compresses one whole body: gzip with this thread's compressor, Brotli in
+// one shot. False leaves out unspecified and the body should go out
+// uncompressed.
+bool compress(Encoding encoding, const Settings& settings, std::string_view input, std::string& out);
+
+// Compressed copies of immutable bodies, keyed by the object owning the
+// body (a task version) and the coding. Direct-mapped and bounded: a new
+// entry replaces whatever shared its slot. Owners are held weakly, so an
+// entry never outlives its match to a newer object at the same address.
+class BodyCache {
+public:
+    static constexpr size_t kDefaultSlots = 4096;
+
+    explicit BodyCache(size_t slots = kDefaultSlots);
+
+    std::shared_ptr<const std::string> find(const std::shared_ptr<const void>& owner, Encoding encoding) const;
+    void store(const std::shared_ptr<const void>& owner, Encoding encoding,
+               std::shared_ptr<const std::string> body);
+
+private:
+    struct Slot {
+        std::mutex mutex;
+        std::weak_ptr<const void> owner;
+        Encoding encoding = Encoding::IDENTITY;
+        std::shared_ptr<const std::string> body;
+    };
+
+    Slot& slotFor(const void* owner, Encoding encoding) const;
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+};
+
+} // namespace compression
+} // namespace http_server
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace http_server {
+
+// Epoch-based reclamation for lock-free read paths.
+//
+// Readers wrap each read-side critical section in a Guard. Writers unlink
+// objects from the shared structure and hand them to retire(); an object is
+// freed only after the global epoch has advanced twice past its retirement,
+// which guarantees no reader that could have seen it is still pinned.
+class EpochDomain {
+public:
+    class Guard {
+    public:
+        Guard();
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    static EpochDomain& instance();
+
+    template <typename T>
+    void retire(T* ptr) {
+        retire(ptr, [](void* p) { delete static_cast<T*>(p); });
+    }
+    void retire(void* ptr, void (*deleter)(void*));
+
+    // Try to advance the epoch and free whatever this thread retired that is
+    // now unreachable. Called automatically every few retirements.
+    size_t collect();
+
+    uint64_t currentEpoch() const { return global_epoch_.load(std::memory_order_acquire); }
+    size_t pendingRetired() const;
+
+    ~EpochDomain();
+
+private:
+    struct Retired {
+        void* ptr;
+        void (*deleter)(void*);
+        uint64_t epoch;
+    };
+
+    // One record per live thread; records are recycled, never freed
+    struct alignas(64) ThreadRecord {
+        std::atomic<uint64_t> state{0};   // (epoch << 1) | 1 while pinned, 0 otherwise
+        std::atomic<bool> in_use{false};
+        unsigned nesting = 0;
+        std::vector<Retired> retired;
+        ThreadRecord* next = nullptr;
+    };
+
+    friend class Guard;
+    friend struct ThreadRecordHolder;
+
+    static constexpr size_t kCollectInterval = 64;
+
+    EpochDomain() = default;
+
+    ThreadRecord& localRecord();
+    ThreadRecord* acquireRecord();
+    void releaseRecord(ThreadRecord* record);
+
+    void pin(ThreadRecord& record);
+    void unpin(ThreadRecord& record);
+    bool tryAdvance();
+    size_t freeExpired(ThreadRecord& record);
+
+    std::atomic<uint64_t> global_epoch_{2};
+    std::atomic<ThreadRecord*> records_{nullptr};
+};
+
+} // namespace http_server
@@ -1,32 +1,120 @@
 #pragma once
 
 #include <json/json.h>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 
 namespace http_server {
 
+// One reading of the process and its cgroup, taken off the request path
+struct ProcessSample {
+    std::chrono::system_clock::time_point taken;
+    uint64_t rss_bytes = 0;
+    uint64_t virtual_bytes = 0;
+    uint32_t threads = 0;
+    double cpu_seconds = 0;    // User plus system time since the process started
+    double cpu_percent = 0;    // Over the last interval; 100 = one core
+    // From the cgroup (v2, or v1 as a fallback); 0 = unlimited or unknown
+    uint64_t memory_limit_bytes = 0;
+    uint64_t memory_usage_bytes = 0;
+    double cpu_limit_cores = 0;
+};
+
+// Where the process is in its life, as the probes report it
+enum class ServingState : uint8_t {
+    RECOVERING,  // Replaying the data directory; live, not ready
+    SERVING,
+    DRAINING,    // Shutting down: finishing what is in flight, not ready
+    FAILED       // Cannot serve; liveness fails so the process is restarted
+};
+
+// Health, readiness and liveness probes plus process metrics. A sampler
+// thread reads /proc and the cgroup files at a fixed interval and publishes
+// an immutable snapshot; probes only load that snapshot and a few atomics,
+// so they never touch the filesystem or the task store.
 class HealthCheck {
 public:
-    HealthCheck();
-    ~HealthCheck() = default;
-    
+    static constexpr std::chrono::milliseconds kDefaultInterval{1000};
+
+    // Overridable for tests
+    struct Paths {
+        std::string proc_self = "/proc/self";
+        std::string cgroup = "/sys/fs/cgroup";
+    };
+
+    explicit HealthCheck(std::chrono::milliseconds interval = kDefaultInterval);
+    HealthCheck(std::chrono::milliseconds interval, Paths paths);
+    ~HealthCheck();
+
+    HealthCheck(const HealthCheck&) = delete;
+    HealthCheck& operator=(const HealthCheck&) = delete;
+
+    // Takes a first sample, then keeps sampling every interval until stop()
+    void start();
+    void stop();
+    // What the sampler thread does each interval
+    void sampleNow();
+
+    void setState(ServingState state) { state_.store(state, std::memory_order_release); }
+    // setState(next) only if the state is still expected
+    bool advanceState(ServingState expected, ServingState next) {
+        return state_.compare_exchange_strong(expected, next, std::memory_order_acq_rel);
+    }
+    ServingState state() const { return state_.load(std::memory_order_acquire); }
+    // Requests other than the probes are served while SERVING or DRAINING
+    bool acceptsRequests() const {
+        const ServingState current = state();
+        return current == ServingState::SERVING || current == ServingState::DRAINING;
+    }
+    // Asked on each readiness probe, so it must be cheap; set before start()
+    void setOverloadCheck(std::function<bool()> overloaded) { overloaded_ = std::move(overloaded); }
+
+    bool isLive() const { return state() != ServingState::FAILED; }
+    bool isReady() const;
+    // Null until the first sample
+    std::shared_ptr<const ProcessSample> latest() const { return sample_.load(std::memory_order_acquire); }
+
     // Health check endpoints
     Json::Value getHealthStatus() const;
     Json::Value getReadinessStatus() const;
     Json::Value getLivenessStatus() const;
-    
+
     // System metrics
     Json::Value getSystemMetrics() const;
-    
+    // The standard process_* series for /metrics, from the same snapshot
+    void appendPrometheus(std::string& out) const;
+
 private:
+    const std::chrono::milliseconds interval_;
+    const Paths paths_;
     std::chrono::system_clock::time_point startup_time_;
-    
+    std::atomic<ServingState> state_{ServingState::SERVING};
+    std::function<bool()> overloaded_;
+    std::atomic<std::shared_ptr<const ProcessSample>> sample_;
+
+    // Sampler state; the CPU counters give the next sample its rate
+    std::mutex sample_mutex_;
+    double last_cpu_seconds_ = 0;
+    std::chrono::steady_clock::time_point last_sampled_;
+
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    std::thread sampler_;
+
     // Helper functions
-    std::string getCurrentTimestamp() const;
+    int64_t getCurrentTimestamp() const;
     double getUptimeSeconds() const;
     Json::Value getMemoryInfo() const;
     Json::Value getCpuInfo() const;
+    const char* notReadyReason() const;
 };
 
-} // namespace http_server
\ No newline at end of file
+} // namespace http_server
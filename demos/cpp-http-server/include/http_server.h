@@ -1,66 +1,290 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <thread>
 #include <microhttpd.h>
 #include <json/json.h>
+#include "admission.h"
+#include "change_feed.h"
+#include "compression.h"
+#include "health_check.h"
+#include "metrics.h"
 #include "task_manager.h"
+#include "ndjson_import.h"
+#include "persistence.h"
+#include "replication.h"
+#include "routing.h"
+#include "topology.h"
+#include "trace.h"
 
 namespace http_server {
 
+// How libmicrohttpd schedules connections onto threads
+enum class ThreadingMode {
+    THREAD_PER_CONNECTION,  // MHD_USE_THREAD_PER_CONNECTION
+    THREAD_POOL             // MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_EPOLL
+};
+
+// The daemons listening on the port, and where their threads run
+enum class ListenerLayout {
+    SINGLE,    // One daemon; its threads run on any CPU
+    PER_NODE,  // One per NUMA node, its threads pinned to the node's CPUs
+    PER_CORE   // One per CPU, with a single thread pinned to it
+};
+
+struct ServerConfig {
+    int port = 8000;
+    ThreadingMode threading_mode = ThreadingMode::THREAD_POOL;
+    unsigned int thread_pool_size = 0;          // 0 = one thread per core
+    // Past SINGLE, every listener binds the port with SO_REUSEPORT and the
+    // kernel spreads connections over them; the task store gets one
+    // partition per node, which creates on that node's listeners fill
+    ListenerLayout listener_layout = ListenerLayout::SINGLE;
+    unsigned int connection_limit = 10000;
+    unsigned int connection_timeout_seconds = 30;
+    // SO_REUSEPORT, so a new process can bind the port while this one
+    // drains (zero-downtime restarts)
+    bool reuse_port = false;
+    // How long shutdown() waits for in-flight requests
+    unsigned int drain_timeout_ms = 10000;
+    size_t max_body_size = 1024 * 1024;         // Larger uploads get 413
+    size_t task_shards = TaskManager::kDefaultShardCount;
+
+    // Durability; an empty data_dir keeps the store in memory only
+    std::string data_dir{};
+    unsigned int wal_sync_interval_ms = 10;
+    bool wal_wait_for_sync = true;
+    uint64_t snapshot_every = 1000000;          // Logged writes per snapshot
+
+    // Read replica: with a primary host set, the store is loaded from the
+    // primary and kept in step with its change feed instead of data_dir;
+    // writes are redirected to the primary and reads answer 503 until the
+    // replica has caught up
+    replication::Settings replication{};
+
+    // How often the health sampler reads /proc and the cgroup limits
+    unsigned int health_sample_interval_ms = 1000;
+
+    // Change feed served at /api/v1/tasks/events: how many events are kept
+    // for clients catching up, and how often idle streams get a heartbeat
+    size_t change_feed_capacity = ChangeFeed::kDefaultCapacity;
+    unsigned int event_heartbeat_seconds = 15;
+
+    // gzip/br for JSON bodies of at least min_size and for exports, when
+    // the client's Accept-Encoding allows it
+    compression::Settings compression{};
+
+    // Token buckets and the concurrency limit, checked on each request's
+    // headers; all off by default
+    admission::Settings admission{};
+
+    // Span breakdowns for a sample of requests; off by default
+    trace::Settings tracing{};
+};
+
+// Per-request state. The body is allocated from a monotonic arena that
+// starts in an inline buffer and is released all at once when the request
+// completes; instances are then recycled by the thread that served them.
 struct ConnectionInfo {
-    std::string post_data;
-    size_t data_size;
+    static constexpr size_t kInlineArenaSize = 8 * 1024;
+
+    ConnectionInfo();
+    ConnectionInfo(const ConnectionInfo&) = delete;
+    ConnectionInfo& operator=(const ConnectionInfo&) = delete;
+
+    // Drops the request's data and rewinds the arena for the next one
+    void reset();
+
+private:
+    // Declared ahead of arena, which is constructed on top of it
+    alignas(std::max_align_t) std::byte inline_arena_[kInlineArenaSize];
+
+public:
+    std::pmr::monotonic_buffer_resource arena;
+    std::pmr::string post_data;
+    size_t data_size = 0;
+    // Labels and start time for the request metrics
+    metrics::Route route = metrics::Route::OTHER;
+    metrics::Method method = metrics::Method::OTHER;
+    std::chrono::steady_clock::time_point started;
+    // Resolved with the headers; respond() dispatches on it
+    routing::Target target{};
+    // Set for streaming imports, which consume the body as it arrives
+    // instead of buffering it in post_data
+    std::unique_ptr<NdjsonImporter> importer;
+    // Holds one of the admission concurrency slots until the request ends
+    bool holds_slot = false;
+    // A request waiting, suspended, for a slot. The waker sets the outcome
+    // before MHD_resume_connection, which orders it before the next call.
+    enum class SlotWait : uint8_t { NONE, WAITING, ACQUIRED, REFUSED };
+    SlotWait slot_wait = SlotWait::NONE;
+    struct MHD_Connection* connection = nullptr;
+    // Allocated the first time a request on this instance is sampled, then
+    // kept for the next ones; active() while one is being traced
+    std::unique_ptr<trace::RequestTrace> trace;
+};
+
+// Representation headers a response carries besides Content-Type
+struct BodyHeaders {
+    compression::Encoding encoding = compression::Encoding::IDENTITY;
+    const char* etag = nullptr;
 };
 
+class EventStreams;
+
 class HttpServer {
 public:
     explicit HttpServer(int port = 8000);
+    explicit HttpServer(const ServerConfig& config);
     ~HttpServer();
-    
+
     bool start();
+    // Stops at once; requests still in flight are cut off
     void stop();
+    // Graceful stop: closes the listening socket, reports not ready, ends
+    // event streams and answers with Connection: close until the requests
+    // in flight are done or drain_timeout passes; then stop(), which
+    // flushes the write-ahead log. True if everything drained in time.
+    bool shutdown(std::chrono::milliseconds drain_timeout);
     bool isRunning() const;
-    
+    bool isDraining() const { return health_->state() == ServingState::DRAINING; }
+    // Requests that have been accepted and not yet completed
+    unsigned int activeRequests() const { return active_requests_.load(std::memory_order_acquire); }
+
     int getPort() const { return port_; }
-    
+    size_t getListenerCount() const { return listeners_.size(); }
+    // Empty for ListenerLayout::SINGLE, which does not look
+    const std::vector<topology::Node>& getNodes() const { return nodes_; }
+    const ServerConfig& getConfig() const { return config_; }
+    TaskManager& getTaskManager() { return *task_manager_; }
+    const ChangeFeed& getChangeFeed() const { return *change_feed_; }
+    const metrics::RequestMetrics& getRequestMetrics() const { return *request_metrics_; }
+    const trace::Tracer& getTracer() const { return *tracer_; }
+    const HealthCheck& getHealthCheck() const { return *health_; }
+    // The data directory is replayed on a background thread once the
+    // server is listening; until then only /health* and /metrics answer
+    bool isRecovering() const { return health_->state() == ServingState::RECOVERING; }
+    bool isReplica() const { return follower_ != nullptr; }
+    // Null unless this server is a replica
+    const replication::Follower* getFollower() const { return follower_.get(); }
+
     // Request handlers
     static MHD_Result requestHandler(void* cls, struct MHD_Connection* connection,
                                    const char* url, const char* method,
                                    const char* version, const char* upload_data,
                                    size_t* upload_data_size, void** con_cls);
-    
+    static void requestCompleted(void* cls, struct MHD_Connection* connection,
+                                 void** con_cls, enum MHD_RequestTerminationCode toe);
+
 private:
+    // One daemon on the port; what MHD passes the callbacks
+    struct Listener {
+        HttpServer* server;
+        size_t partition;       // Store partition of the listener's node
+        std::vector<int> cpus;  // Its threads' CPUs; empty = unpinned
+        unsigned int threads;   // Pool size
+        struct MHD_Daemon* daemon = nullptr;
+    };
+
+    ServerConfig config_;
     int port_;
-    struct MHD_Daemon* daemon_;
+    std::vector<topology::Node> nodes_;
+    std::vector<Listener> listeners_;  // Fixed at construction; MHD keeps pointers into it
     std::unique_ptr<TaskManager> task_manager_;
-    
-    // HTTP method handlers
-    MHD_Result handleGET(struct MHD_Connection* connection, const std::string& url);
-    MHD_Result handlePOST(struct MHD_Connection* connection, const std::string& url, 
-                         const std::string& data);
-    MHD_Result handlePUT(struct MHD_Connection* connection, const std::string& url,
-                        const std::string& data);
-    MHD_Result handleDELETE(struct MHD_Connection* connection, const std::string& url);
-    
+    std::unique_ptr<Persistence> persistence_;
+    std::unique_ptr<metrics::RequestMetrics> request_metrics_;
+    std::unique_ptr<ChangeFeed> change_feed_;
+    std::unique_ptr<EventStreams> event_streams_;
+    std::unique_ptr<admission::Controller> admission_;
+    std::unique_ptr<trace::Tracer> tracer_;
+    // Compressed single-task bodies, so a version fetched again is not
+    // compressed again
+    std::unique_ptr<compression::BodyCache> body_cache_;
+    std::unique_ptr<HealthCheck> health_;
+    std::unique_ptr<replication::Follower> follower_;
+    std::thread recovery_;
+    std::atomic<unsigned int> active_requests_{0};
+
+    // Loads the data directory and attaches the log, then starts serving
+    void recoverStore();
+    void planListeners();
+    // Starts listener's daemon from a thread pinned to its CPUs, so the
+    // threads MHD creates for it inherit the mask
+    bool startListener(Listener& listener);
+
+    // Everything after the body has arrived: dispatch and error handling
+    MHD_Result respond(struct MHD_Connection* connection, const char* url, ConnectionInfo& info);
+
     // Route handlers
-    MHD_Result handleHealthCheck(struct MHD_Connection* connection);
-    MHD_Result handleGetTasks(struct MHD_Connection* connection, const std::string& query);
+    // /health, /health/live, /health/ready (503 while recovering or
+    // overloaded) and /health/metrics, all from the sampler's snapshot
+    MHD_Result handleHealthCheck(struct MHD_Connection* connection, std::string_view url);
+    // GET /metrics in the Prometheus text format
+    MHD_Result handleMetrics(struct MHD_Connection* connection);
+    // Filters, sort and paging from the query, read in place from MHD's
+    // decoded arguments
+    MHD_Result handleGetTasks(struct MHD_Connection* connection);
     MHD_Result handleGetTask(struct MHD_Connection* connection, uint64_t id);
-    MHD_Result handleCreateTask(struct MHD_Connection* connection, const std::string& data);
-    MHD_Result handleUpdateTask(struct MHD_Connection* connection, uint64_t id, 
-                               const std::string& data);
+    MHD_Result handleCreateTask(struct MHD_Connection* connection, std::string_view data);
+    MHD_Result handleUpdateTask(struct MHD_Connection* connection, uint64_t id,
+                               std::string_view data);
+    // POST /api/v1/tasks:batch {"create":[...],"update":[{"id":..},...],"delete":[ids]};
+    // every item gets its own status in the response
+    MHD_Result handleBatch(struct MHD_Connection* connection, std::string_view data);
+    // GET /api/v1/tasks:export streams the store as NDJSON in id order;
+    // POST /api/v1/tasks:import loads the same format
+    MHD_Result handleExport(struct MHD_Connection* connection);
+    MHD_Result handleImport(struct MHD_Connection* connection, NdjsonImporter& importer);
+    // GET /api/v1/tasks/events?since=<seq>: Server-Sent Events from the
+    // change feed, resuming from since or Last-Event-ID
+    MHD_Result handleEvents(struct MHD_Connection* connection);
     MHD_Result handleDeleteTask(struct MHD_Connection* connection, uint64_t id);
     MHD_Result handleGetStatistics(struct MHD_Connection* connection);
-    
+
     // Utility functions
-    MHD_Result sendJsonResponse(struct MHD_Connection* connection, int status_code, 
+    MHD_Result sendJsonResponse(struct MHD_Connection* connection, int status_code,
                                const Json::Value& json);
-    MHD_Result sendErrorResponse(struct MHD_Connection* connection, int status_code, 
+    // Compressed when large enough and the client accepts it
+    MHD_Result sendJsonBody(struct MHD_Connection* connection, int status_code,
+                            const std::string& body, const char* etag = nullptr);
+    // A task's cached rendering, tagged with its version's ETag; compressed
+    // copies are kept on the version, so repeated hits do not compress the
+    // same bytes again
+    MHD_Result sendTaskJson(struct MHD_Connection* connection, int status_code, const TaskPtr& task);
+    // Zero-copy: MHD reads straight from the shared bytes, which stay
+    // referenced until the response is destroyed
+    MHD_Result sendSharedJsonBody(struct MHD_Connection* connection, int status_code,
+                                  std::shared_ptr<const std::string> body,
+                                  const BodyHeaders& headers = {});
+    MHD_Result queueJsonResponse(struct MHD_Connection* connection, int status_code,
+                                 struct MHD_Response* response, const BodyHeaders& headers = {});
+    MHD_Result queueResponse(struct MHD_Connection* connection, int status_code,
+                             struct MHD_Response* response, const char* content_type,
+                             const BodyHeaders& headers = {});
+    // 304 when the request's If-None-Match already names etag
+    bool notModified(struct MHD_Connection* connection, const std::string& etag) const;
+    MHD_Result sendNotModified(struct MHD_Connection* connection, const std::string& etag);
+    // Coding for a body of the given size, IDENTITY when it should go out
+    // as-is; SIZE_MAX means a stream of unknown length
+    compression::Encoding responseEncoding(struct MHD_Connection* connection, size_t size) const;
+    MHD_Result sendErrorResponse(struct MHD_Connection* connection, int status_code,
                                 const std::string& message);
-    
-    std::string parseQueryString(const std::string& query, const std::string& key);
-    uint64_t parseTaskId(const std::string& url);
+    // 429 or 503 with Retry-After, for a request admission turned away
+    MHD_Result sendRejection(struct MHD_Connection* connection, const admission::Decision& decision);
+    // 503 for everything but the probes while the store is not serving
+    MHD_Result sendUnavailable(struct MHD_Connection* connection);
+    // 307 to the same path on the primary, for a write sent to a replica
+    MHD_Result sendToPrimary(struct MHD_Connection* connection, const char* url);
+    MHD_Result sendRetryLater(struct MHD_Connection* connection, int status_code, const char* error,
+                              uint32_t retry_after_seconds);
+    // 400 naming the offending field, from Task/TaskPatch::fromJson
+    MHD_Result sendValidationError(struct MHD_Connection* connection, const std::string& summary,
+                                   const ValidationError& error);
 };
 
-} // namespace http_server
\ No newline at end of file
+} // namespace http_server
@@ -1,14 +1,19 @@
 #pragma once
 
 #include <json/json.h>
+#include <cstddef>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace http_server {
 namespace json_utils {
 
-// JSON parsing and validation
-Json::Value parseJson(const std::string& json_str);
-bool isValidJson(const std::string& json_str);
+// JSON parsing and validation. Readers and writers are cached per thread, so
+// these are safe to call concurrently and cost no builder setup per call.
+Json::Value parseJson(std::string_view json_str);
+Json::Value parseJson(const char* data, size_t size);
+bool isValidJson(std::string_view json_str);
 std::string jsonToString(const Json::Value& json, bool pretty = false);
 
 // JSON validation helpers
@@ -20,7 +25,7 @@ bool isValidInteger(const Json::Value& value, const std::string& field, bool req
 Json::Value createErrorResponse(const std::string& message, int code = 400);
 Json::Value createSuccessResponse(const std::string& message, const Json::Value& data = Json::Value::null);
 
-// Task validation
+// Task validation; same rules as Task::fromJson / TaskPatch::fromJson
 bool isValidTaskData(const Json::Value& json);
 bool isValidTaskUpdate(const Json::Value& json);
 
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "task_manager.h"
+
+namespace http_server {
+namespace json_writer {
+
+// Direct serializers that append to a caller-owned buffer without building a
+// Json::Value. Output is byte-identical to json_utils::jsonToString() of the
+// equivalent DOM (compact, keys sorted, non-ASCII escaped as \uXXXX).
+
+void appendString(std::string& out, std::string_view value);
+void appendUInt(std::string& out, uint64_t value);
+
+// "YYYY-MM-DDTHH:MM:SSZ", as Task::toJson() renders timestamps
+void appendTimestamp(std::string& out, std::chrono::system_clock::time_point tp);
+
+// The due date as it was written, without quotes; nothing for NONE
+void appendDueDateText(std::string& out, DueDate due);
+
+// Same bytes as jsonToString(task.toJson())
+void appendTask(std::string& out, const Task& task);
+
+} // namespace json_writer
+} // namespace http_server
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace http_server {
+namespace metrics {
+
+// Independent copies behind every sharded metric. A thread always records
+// into the same copy, so concurrent recorders rarely share a cache line;
+// readers sum the copies.
+constexpr size_t kShardCount = 8;
+size_t threadShard();
+
+// Latency buckets in nanoseconds, HDR style: everything under 1.024 us
+// shares bucket 0, then each power of two up to 2^33 ns (~8.6 s) is split
+// into four linear sub-buckets, for at most 25% relative error. Slower
+// samples land in the overflow slot and only count towards +Inf.
+struct Buckets {
+    static constexpr size_t kCount = 93;
+    static constexpr size_t kOverflow = kCount;
+
+    static size_t indexFor(uint64_t nanos);
+    // Exclusive upper bound of a bucket, in nanoseconds
+    static uint64_t upperBound(size_t index);
+};
+
+struct HistogramSnapshot {
+    std::array<uint64_t, Buckets::kCount + 1> counts{};  // Last slot is overflow
+    uint64_t count = 0;
+    uint64_t sum_nanos = 0;
+};
+
+// Lock-free latency histogram, sharded per thread
+class Histogram {
+public:
+    void record(uint64_t nanos);
+    void record(std::chrono::steady_clock::duration elapsed) {
+        record(static_cast<uint64_t>(std::max<int64_t>(0,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())));
+    }
+    HistogramSnapshot snapshot() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counts[Buckets::kCount + 1] = {};
+        std::atomic<uint64_t> sum{0};
+    };
+    std::array<Shard, kShardCount> shards_;
+};
+
+// Routes as they are labelled in metrics; ids and queries are folded away
+enum class Route : uint8_t {
+    HEALTH,
+    METRICS,
+    TASKS,       // /api/v1/tasks
+    TASK,        // /api/v1/tasks/{id}
+    STATISTICS,
+    BATCH,
+    EXPORT,
+    IMPORT,
+    EVENTS,      // /api/v1/tasks/events
+    OTHER
+};
+
+enum class Method : uint8_t {
+    GET,
+    POST,
+    PUT,
+    DELETE,
+    OTHER
+};
+
+constexpr size_t kRouteCount = 10;
+constexpr size_t kMethodCount = 5;
+
+const char* toString(Route route);
+const char* toString(Method method);
+
+// Request counts by route, method and status class, plus handler latency by
+// route and method. Recording is wait-free.
+class RequestMetrics {
+public:
+    void record(Route route, Method method, int status,
+                std::chrono::steady_clock::duration elapsed);
+
+    uint64_t requests(Route route, Method method) const;
+    HistogramSnapshot latency(Route route, Method method) const;
+
+    // Prometheus text exposition; series with no requests are left out
+    void appendPrometheus(std::string& out) const;
+
+private:
+    // 1xx .. 5xx
+    static constexpr size_t kStatusClassCount = 5;
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> responses[kRouteCount][kMethodCount][kStatusClassCount] = {};
+    };
+
+    std::array<Shard, kShardCount> shards_;
+    Histogram latency_[kRouteCount][kMethodCount];
+};
+
+// Contention on the task store's shard locks: how long writers and scans
+// waited to acquire them, and how long writers held them
+struct LockMetrics {
+    Histogram write_wait;
+    Histogram write_hold;
+    Histogram read_wait;
+
+    void appendPrometheus(std::string& out) const;
+};
+
+// Exposition helpers. labels is the inside of the braces, without them.
+void appendHelp(std::string& out, std::string_view name, std::string_view type,
+                std::string_view help);
+void appendSample(std::string& out, std::string_view name, std::string_view labels, double value);
+void appendSample(std::string& out, std::string_view name, std::string_view labels, uint64_t value);
+void appendHistogram(std::string& out, std::string_view name, std::string_view labels,
+                     const HistogramSnapshot& histogram);
+
+} // namespace metrics
+} // namespace http_server
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "task_manager.h"
+
+namespace http_server {
+
+// Incremental loader for newline-delimited task JSON (one toJson() object
+// per line, as /api/v1/tasks:export writes it). Bytes can arrive in chunks
+// of any size; only the current partial line and one batch of parsed tasks
+// are held in memory, and batches go to TaskManager::restoreTasks.
+// Exports end with {"count":N,"end":true,"seq":S}, which is not a task.
+class NdjsonImporter {
+public:
+    static constexpr size_t kBatchSize = 512;
+    static constexpr size_t kMaxReportedErrors = 16;
+
+    // An export's closing line: its task count and the change feed
+    // position every change it reflects is at or below
+    struct Trailer {
+        uint64_t count;
+        uint64_t seq;
+    };
+
+    struct LineError {
+        uint64_t line;
+        std::string field;
+        std::string message;
+    };
+
+    NdjsonImporter(TaskManager& manager, size_t max_line_size);
+
+    void feed(const char* data, size_t size);
+    // Flushes a final line without a trailing newline and the last batch
+    void finish();
+
+    uint64_t imported() const { return imported_; }
+    uint64_t failed() const { return failed_; }
+    // The first kMaxReportedErrors rejected lines
+    const std::vector<LineError>& errors() const { return errors_; }
+    // The store's log failed under a batch; what remains is not loaded.
+    // Imports run on MHD's upload callbacks, where nothing may throw.
+    bool logFailed() const { return log_failed_; }
+    // Set once the closing line has been read; an export without one was
+    // cut off
+    const std::optional<Trailer>& trailer() const { return trailer_; }
+
+private:
+    TaskManager& manager_;
+    size_t max_line_size_;
+
+    std::string partial_;
+    bool skipping_ = false;  // Inside a line that already overflowed
+    uint64_t line_ = 0;
+
+    std::vector<std::shared_ptr<Task>> batch_;
+    uint64_t imported_ = 0;
+    uint64_t failed_ = 0;
+    std::vector<LineError> errors_;
+    bool log_failed_ = false;
+    std::optional<Trailer> trailer_;
+
+    void processLine(const char* data, size_t size);
+    void reject(std::string field, std::string message);
+    void flush();
+};
+
+} // namespace http_server
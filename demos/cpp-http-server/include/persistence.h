@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "task_manager.h"
+
+namespace http_server {
+
+struct PersistenceConfig {
+    std::string data_dir;
+    // Group commit window: one fdatasync covers every record logged within it
+    std::chrono::milliseconds sync_interval{10};
+    // Writers block until their record is synced. When false they return
+    // at once and a crash can lose up to one interval of writes.
+    bool wait_for_sync = true;
+    // Logged operations between compacted snapshots; 0 disables them
+    uint64_t snapshot_every = 1000000;
+};
+
+// Binary task encoding shared by the log and snapshots. Fields are written
+// in host byte order, so data directories are not portable across
+// architectures.
+namespace task_codec {
+
+void encode(std::string& out, const Task& task);
+// Decodes one task at pos and advances past it; nullptr if truncated
+std::shared_ptr<Task> decode(const char*& pos, const char* end);
+uint32_t crc32(const char* data, size_t size);
+
+} // namespace task_codec
+
+// Append-only log in numbered segment files (wal-<segment>.log). Records are
+// framed as [length][crc32][op][payload] and buffered in memory; a flusher
+// thread writes and syncs the buffer every sync interval.
+class WriteAheadLog : public MutationLog {
+public:
+    WriteAheadLog(std::string dir, std::chrono::milliseconds sync_interval, bool wait_for_sync);
+    ~WriteAheadLog() override;
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Starts appending to a new segment and launches the flusher
+    bool open(uint64_t segment);
+    // Syncs everything and stops the flusher
+    void close();
+
+    uint64_t logPut(const Task& task) override;
+    uint64_t logDelete(uint64_t id) override;
+    bool waitDurable(uint64_t seq) override;
+
+    // A failed write or sync is sticky: nothing after it is written, no
+    // record is reported durable again and the segment is left as it was
+    bool failed() const;
+    // Called once, with the log's locks held, before any waiter sees the
+    // failure; it must not call back into the log. Set before open().
+    void setFailureListener(std::function<void()> listener) { on_failure_ = std::move(listener); }
+
+    // Seals the current segment and continues in the next one. Every record
+    // logged before the call is in a segment below the returned number.
+    uint64_t rotate();
+
+    uint64_t segment() const;
+    uint64_t operationsLogged() const { return operations_.load(std::memory_order_relaxed); }
+
+private:
+    std::string dir_;
+    std::chrono::milliseconds sync_interval_;
+    bool wait_for_sync_;
+
+    // io_mutex_ serializes file writes and is always taken before mutex_
+    std::mutex io_mutex_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable synced_;
+
+    int fd_ = -1;
+    uint64_t segment_ = 0;
+    std::string buffer_;   // Appended, not yet written
+    std::string writing_;  // Being written by flush(); keeps its capacity
+    uint64_t appended_ = 0;
+    uint64_t durable_ = 0;
+    bool failed_ = false;
+    bool stopping_ = false;
+    std::function<void()> on_failure_;
+    std::atomic<uint64_t> operations_{0};
+    std::thread flusher_;
+
+    uint64_t appendRecord(uint8_t op, const Task* task, uint64_t id);
+    void flusherLoop();
+    void flush();
+    bool writeOut(int fd, const std::string& data);
+    // Marks the log failed, with both locks held
+    void fail();
+};
+
+// Snapshots plus the write-ahead log for one TaskManager. snapshot-<N>.bin
+// holds the store as of the start of wal-<N>.log, so recovery maps the
+// newest snapshot and replays segments N and up.
+class Persistence {
+public:
+    struct RecoveryStats {
+        uint64_t snapshot_tasks = 0;
+        uint64_t replayed_records = 0;
+        double seconds = 0;
+    };
+
+    explicit Persistence(PersistenceConfig config);
+    ~Persistence();
+
+    // Loads the data directory into an empty manager; creates it if missing
+    RecoveryStats recover(TaskManager& manager);
+
+    // Attaches the log to the manager and starts background snapshots
+    bool start(TaskManager& manager);
+    void stop();
+
+    // Writes a compacted snapshot and deletes the files it supersedes
+    bool snapshot();
+
+    bool failed() const { return wal_.failed(); }
+    // See WriteAheadLog::setFailureListener
+    void setFailureListener(std::function<void()> listener) { wal_.setFailureListener(std::move(listener)); }
+
+private:
+    PersistenceConfig config_;
+    WriteAheadLog wal_;
+    TaskManager* manager_ = nullptr;
+    uint64_t next_segment_ = 1;
+
+    std::mutex snapshot_mutex_;
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    std::thread snapshotter_;
+
+    bool loadSnapshot(const std::string& path, TaskManager& manager, RecoveryStats& stats);
+    void replaySegment(const std::string& path, TaskManager& manager, RecoveryStats& stats);
+    void removeSupersededFiles(uint64_t segment);
+};
+
+} // namespace http_server
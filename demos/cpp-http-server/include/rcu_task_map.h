@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace http_server {
+
+struct Task;
+
+// Hash map from task id to the current immutable Task version.
+//
+// find() is lock-free and must run inside an EpochDomain::Guard. All
+// mutating calls must be serialized by the caller (TaskManager holds the
+// shard's exclusive lock). Writers never modify a reachable node: they link
+// in a replacement and retire the old node through the epoch domain.
+class RcuTaskMap {
+public:
+    using TaskPtr = std::shared_ptr<const Task>;
+
+    RcuTaskMap();
+    ~RcuTaskMap();
+
+    RcuTaskMap(const RcuTaskMap&) = delete;
+    RcuTaskMap& operator=(const RcuTaskMap&) = delete;
+
+    // Readers
+    TaskPtr find(uint64_t id) const;
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+    // Visit entries until fn returns false; the caller must exclude writers
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        const Table* table = table_.load(std::memory_order_acquire);
+        for (size_t i = 0; i <= table->mask; ++i) {
+            for (const Node* node = table->buckets[i].load(std::memory_order_acquire); node;
+                 node = node->next.load(std::memory_order_acquire)) {
+                if (!fn(node->task)) {
+                    return;
+                }
+            }
+        }
+    }
+
+    // Writers; return the version that was replaced or removed, if any
+    TaskPtr insertOrAssign(uint64_t id, TaskPtr task);
+    TaskPtr erase(uint64_t id);
+    // Size the table for count entries up front, so a bulk insert does not
+    // copy the chains once per doubling
+    void reserve(size_t count);
+
+private:
+    struct Node {
+        uint64_t id;
+        TaskPtr task;
+        std::atomic<Node*> next;
+    };
+
+    struct Table {
+        size_t mask;
+        unsigned shift;
+        std::unique_ptr<std::atomic<Node*>[]> buckets;
+
+        explicit Table(unsigned bits);
+        size_t bucketFor(uint64_t id) const;
+    };
+
+    static constexpr unsigned kInitialBits = 4;
+
+    static void deleteTable(void* table);
+
+    void rehash(unsigned bits);
+
+    std::atomic<Table*> table_;
+    std::atomic<size_t> size_;
+};
+
+} // namespace http_server
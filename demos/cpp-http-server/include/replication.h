@@ -0,0 +1,136 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "task_manager.h"
+
+namespace http_server {
+namespace replication {
+
+// On /api/v1/tasks/events responses: the sequence number the stream
+// starts after
+inline constexpr const char* kFeedSeqHeader = "X-Feed-Seq";
+
+struct Settings {
+    std::string host{};                     // The primary; empty = not a replica
+    uint16_t port = 0;
+    unsigned int reconnect_delay_ms = 1000;
+};
+
+// "host:port" into settings; false if text is not one
+bool parseAddress(std::string_view text, Settings& settings);
+
+// One text/event-stream frame
+struct Event {
+    std::string id;
+    std::string type;  // "message" when the frame names none
+    std::string data;  // data lines joined by '\n'
+};
+
+// Incremental text/event-stream framing; bytes may be split anywhere.
+// Comments (the primary's heartbeats) and retry fields produce no frame.
+class EventParser {
+public:
+    void feed(std::string_view bytes, const std::function<void(const Event&)>& on_event);
+
+private:
+    void processLine(std::string_view line, const std::function<void(const Event&)>& on_event);
+
+    std::string line_;
+    Event current_;
+    bool has_data_ = false;
+};
+
+// Keeps a local TaskManager in step with a primary over plain HTTP: loads
+// /api/v1/tasks:export, then applies /api/v1/tasks/events in order. A
+// dropped stream is resumed from the last applied position; a primary that
+// no longer has it (a restart, or a follower too far behind) sends resync,
+// and the store is reloaded. The store must take no other writes.
+class Follower {
+public:
+    static constexpr size_t kMaxLineSize = 16 * 1024 * 1024;
+
+    Follower(TaskManager& manager, Settings settings);
+    ~Follower();
+
+    Follower(const Follower&) = delete;
+    Follower& operator=(const Follower&) = delete;
+
+    void start();
+    void stop();
+
+    // Called on the follower thread with true once the store has caught up
+    // with the primary, and with false when it has to reload; set before
+    // start()
+    void setSyncListener(std::function<void(bool)> listener) { sync_listener_ = std::move(listener); }
+
+    bool connected() const { return connected_.load(std::memory_order_acquire); }
+    bool synced() const { return synced_.load(std::memory_order_acquire); }
+    // Last change feed position applied; 0 before the first connection
+    uint64_t position() const { return position_.load(std::memory_order_acquire); }
+    uint64_t applied() const { return applied_.load(std::memory_order_relaxed); }
+    uint64_t reloads() const { return reloads_.load(std::memory_order_relaxed); }
+    // How far the store trails the primary: 0 while connected with nothing
+    // left to apply, else the age of the newest change applied, which keeps
+    // growing while disconnected. Across hosts this includes clock skew.
+    double lagSeconds() const;
+
+    const Settings& settings() const { return settings_; }
+    // For /health: primary, connected, synced, position, lag_seconds
+    Json::Value getStatus() const;
+    void appendPrometheus(std::string& out) const;
+
+private:
+    // One open response: the status, its headers and the body bytes read
+    // with them
+    struct Response;
+
+    void run();
+    // One stream connection, until it drops or stop()
+    void follow();
+    // Loads the export, drops local tasks it no longer has and learns the
+    // feed position to catch up to before reporting synced
+    bool reload();
+    void apply(const Event& event, std::vector<std::shared_ptr<Task>>& puts, bool& resync);
+    void flush(std::vector<std::shared_ptr<Task>>& puts);
+    void setSynced(bool synced);
+
+    bool open(const std::string& path, Response& response) const;
+    // Appends what arrives next; false at the end of the stream, on an
+    // error and on stop()
+    bool receive(int fd, std::string& out) const;
+    bool stopping() const;
+
+    TaskManager& manager_;
+    const Settings settings_;
+    std::function<void(bool)> sync_listener_;
+
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> synced_{false};
+    std::atomic<bool> idle_{false};
+    std::atomic<uint64_t> position_{0};
+    std::atomic<uint64_t> applied_{0};
+    std::atomic<uint64_t> reloads_{0};
+    // The primary's wall clock, in microseconds, that the store reflects
+    std::atomic<int64_t> current_as_of_us_{0};
+    // Synced once position_ reaches it; follower thread only
+    uint64_t target_ = 0;
+
+    mutable std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+} // namespace replication
+} // namespace http_server
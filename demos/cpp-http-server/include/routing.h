@@ -0,0 +1,193 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include "metrics.h"
+
+namespace http_server {
+namespace routing {
+
+inline constexpr std::string_view kApiPrefix = "/api/v1/tasks";
+
+enum class Handler : uint8_t {
+    HEALTH,
+    METRICS,
+    LIST_TASKS,
+    CREATE_TASK,
+    STATISTICS,
+    BATCH,
+    EXPORT,
+    IMPORT,
+    EVENTS,
+    GET_TASK,
+    UPDATE_TASK,
+    DELETE_TASK,
+    INVALID_TASK_ID,     // A task route whose id is not a positive integer
+    NOT_FOUND,
+    METHOD_NOT_ALLOWED
+};
+
+enum class PathMatch : uint8_t {
+    EXACT,
+    PREFIX,
+    COLLECTION,  // The path, or the path and a trailing '/'
+    TASK_ID      // Anything under the path; "/<id>" is valid
+};
+
+struct RouteEntry {
+    metrics::Method method;
+    std::string_view path;
+    PathMatch match;
+    Handler handler;
+    metrics::Route route;
+};
+
+// First match wins; the metrics route of a path is that of the first entry
+// matching it for any method
+inline constexpr RouteEntry kRoutes[] = {
+    {metrics::Method::GET, "/health", PathMatch::PREFIX, Handler::HEALTH, metrics::Route::HEALTH},
+    {metrics::Method::GET, "/metrics", PathMatch::EXACT, Handler::METRICS, metrics::Route::METRICS},
+    {metrics::Method::GET, "/api/v1/tasks/stats/summary", PathMatch::EXACT, Handler::STATISTICS,
+     metrics::Route::STATISTICS},
+    {metrics::Method::POST, "/api/v1/tasks:batch", PathMatch::EXACT, Handler::BATCH, metrics::Route::BATCH},
+    {metrics::Method::GET, "/api/v1/tasks:export", PathMatch::EXACT, Handler::EXPORT, metrics::Route::EXPORT},
+    {metrics::Method::POST, "/api/v1/tasks:import", PathMatch::EXACT, Handler::IMPORT, metrics::Route::IMPORT},
+    {metrics::Method::GET, "/api/v1/tasks/events", PathMatch::EXACT, Handler::EVENTS, metrics::Route::EVENTS},
+    {metrics::Method::GET, kApiPrefix, PathMatch::COLLECTION, Handler::LIST_TASKS, metrics::Route::TASKS},
+    {metrics::Method::POST, kApiPrefix, PathMatch::COLLECTION, Handler::CREATE_TASK, metrics::Route::TASKS},
+    {metrics::Method::GET, kApiPrefix, PathMatch::TASK_ID, Handler::GET_TASK, metrics::Route::TASK},
+    {metrics::Method::PUT, kApiPrefix, PathMatch::TASK_ID, Handler::UPDATE_TASK, metrics::Route::TASK},
+    {metrics::Method::DELETE, kApiPrefix, PathMatch::TASK_ID, Handler::DELETE_TASK, metrics::Route::TASK},
+};
+
+constexpr bool matches(const RouteEntry& entry, std::string_view path) {
+    switch (entry.match) {
+        case PathMatch::EXACT:
+            return path == entry.path;
+        case PathMatch::PREFIX:
+        case PathMatch::TASK_ID:
+            return path.starts_with(entry.path);
+        case PathMatch::COLLECTION:
+            return path.starts_with(entry.path) &&
+                   (path.size() == entry.path.size() ||
+                    (path.size() == entry.path.size() + 1 && path.back() == '/'));
+    }
+    return false;
+}
+
+struct RouteMatch {
+    const RouteEntry* entry = nullptr;  // For method and path, or nullptr
+    metrics::Route route = metrics::Route::OTHER;
+};
+
+// Both in one pass: the first entry matching the path, for any method,
+// comes at or before the first matching the method too
+constexpr RouteMatch lookup(metrics::Method method, std::string_view path) {
+    RouteMatch found;
+    bool routed = false;
+    for (const RouteEntry& entry : kRoutes) {
+        if (!matches(entry, path)) {
+            continue;
+        }
+        if (!routed) {
+            found.route = entry.route;
+            routed = true;
+        }
+        if (entry.method == method) {
+            found.entry = &entry;
+            break;
+        }
+    }
+    return found;
+}
+
+constexpr metrics::Method methodOf(std::string_view method) {
+    if (method == "GET") return metrics::Method::GET;
+    if (method == "POST") return metrics::Method::POST;
+    if (method == "PUT") return metrics::Method::PUT;
+    if (method == "DELETE") return metrics::Method::DELETE;
+    return metrics::Method::OTHER;
+}
+
+static_assert(lookup(metrics::Method::GET, "/api/v1/tasks/").entry->handler == Handler::LIST_TASKS);
+static_assert(lookup(metrics::Method::GET, "/api/v1/tasks/7").entry->handler == Handler::GET_TASK);
+static_assert(lookup(metrics::Method::POST, "/api/v1/tasks/7").entry == nullptr);
+static_assert(lookup(metrics::Method::POST, "/api/v1/tasks/7").route == metrics::Route::TASK);
+static_assert(lookup(metrics::Method::OTHER, "/api/v1/tasks:import").route == metrics::Route::IMPORT);
+
+// Where a request goes, worked out from its method and path in one pass
+// over kRoutes, before the body is read
+struct Target {
+    Handler handler = Handler::NOT_FOUND;
+    metrics::Route route = metrics::Route::OTHER;
+    uint64_t task_id = 0;  // For GET_TASK, UPDATE_TASK and DELETE_TASK
+};
+
+Target resolve(metrics::Method method, std::string_view path);
+
+// Whole-string unsigned decimal; no sign, spaces or trailing text
+bool parseUInt(std::string_view text, uint64_t& value);
+// The positive id in "<kApiPrefix>/<id>"; 0 for anything else
+uint64_t parseTaskId(std::string_view path);
+
+// Query parameters the task list understands
+enum class Param : uint8_t {
+    STATUS,
+    PRIORITY,
+    Q,
+    SORT,
+    LIMIT,
+    OFFSET,
+    AFTER,
+    DUE_AFTER,
+    DUE_BEFORE,
+    CREATED_AFTER,
+    CREATED_BEFORE,
+    UPDATED_AFTER,
+    UPDATED_BEFORE
+};
+
+inline constexpr std::string_view kParamNames[] = {
+    "status", "priority", "q", "sort", "limit", "offset", "after",
+    "due_after", "due_before", "created_after", "created_before", "updated_after", "updated_before",
+};
+inline constexpr size_t kParamCount = std::size(kParamNames);
+
+constexpr std::optional<Param> paramOf(std::string_view key) {
+    for (size_t i = 0; i < kParamCount; ++i) {
+        if (kParamNames[i] == key) {
+            return static_cast<Param>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+static_assert(paramOf("updated_before") == Param::UPDATED_BEFORE);
+static_assert(!paramOf("limits"));
+
+// Views of the known parameters' values; nothing is copied, so the values
+// (MHD's decoded arguments, for a request) must outlive it. The first value
+// of a repeated key wins, and empty values count as absent.
+class QueryParams {
+public:
+    void set(std::string_view key, std::string_view value) {
+        if (auto param = paramOf(key)) {
+            std::string_view& slot = values_[static_cast<size_t>(*param)];
+            if (slot.empty()) {
+                slot = value;
+            }
+        }
+    }
+
+    std::string_view get(Param param) const { return values_[static_cast<size_t>(param)]; }
+    bool has(Param param) const { return !get(param).empty(); }
+
+private:
+    std::array<std::string_view, kParamCount> values_{};
+};
+
+} // namespace routing
+} // namespace http_server
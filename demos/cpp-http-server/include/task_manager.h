@@ -1,78 +1,368 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
+#include <set>
+#include <span>
+#include <optional>
 #include <memory>
 #include <atomic>
 #include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
 #include <chrono>
 #include <json/json.h>
+#include "metrics.h"
+#include "rcu_task_map.h"
+#include "text_index.h"
 
 namespace http_server {
 
-enum class TaskStatus {
+enum class TaskStatus : uint8_t {
     PENDING,
     IN_PROGRESS, 
     COMPLETED
 };
 
-enum class TaskPriority {
+enum class TaskPriority : uint8_t {
     LOW,
     MEDIUM,
     HIGH
 };
 
+constexpr size_t kTaskStatusCount = 3;
+constexpr size_t kTaskPriorityCount = 3;
+
+// Wire names of the enums ("pending", "high", ...)
+const char* toString(TaskStatus status);
+const char* toString(TaskPriority priority);
+std::optional<TaskStatus> parseTaskStatus(std::string_view str);
+std::optional<TaskPriority> parseTaskPriority(std::string_view str);
+
+// Why a request body was rejected; field is empty when the whole document is
+struct ValidationError {
+    std::string field;
+    std::string message;
+};
+
+// How a due date was written, so it renders back the way it came in
+enum class DueDateKind : uint8_t {
+    NONE,
+    DATE,       // "YYYY-MM-DD"
+    DATE_TIME   // "YYYY-MM-DDTHH:MM:SSZ"
+};
+
+// A due date parsed once on input instead of kept as free text
+struct DueDate {
+    int64_t seconds = 0;  // UTC, since the epoch; midnight for DATE
+    DueDateKind kind = DueDateKind::NONE;
+
+    // Accepts "YYYY-MM-DD" or "YYYY-MM-DDTHH:MM:SSZ"; "" means no due date
+    static std::optional<DueDate> parse(std::string_view text);
+};
+
 struct Task {
+    // Fixed-size fields first, largest to smallest, so the scalars share a
+    // cache line and fill 39 of the 40 bytes ahead of title
     uint64_t id;
-    std::string title;
-    std::string description;
-    TaskStatus status;
-    TaskPriority priority;
     std::chrono::system_clock::time_point created_at;
     std::chrono::system_clock::time_point updated_at;
-    std::string due_date;
-    
+    int64_t due_at = 0;
+    // Bumped on every update. 32 bits fill what would be padding; a task
+    // would need four billion updates to wrap it.
+    uint32_t version = 1;
+    DueDateKind due_kind = DueDateKind::NONE;
+    TaskStatus status;
+    TaskPriority priority;
+    std::string title;
+    std::string description;
+    // This version's toJson() bytes, rendered once when it is published.
+    // Kept inline so a version is a single allocation; share it with
+    // cachedJson() rather than copying.
+    std::string cached_json;
+
+    DueDate dueDate() const { return {due_at, due_kind}; }
+    void setDueDate(DueDate due) { due_at = due.seconds; due_kind = due.kind; }
+
     Json::Value toJson() const;
-    static std::shared_ptr<Task> fromJson(const Json::Value& json);
+    // Validates and builds in a single pass; on failure returns nullptr and
+    // fills *error when given
+    static std::shared_ptr<Task> fromJson(const Json::Value& json, ValidationError* error = nullptr);
+    // Inverse of toJson() for dumps: like fromJson, but also keeps id,
+    // created_at and updated_at when present
+    static std::shared_ptr<Task> restoreFromJson(const Json::Value& json, ValidationError* error = nullptr);
     static bool isValidTask(const Json::Value& json);
 };
 
+// 40 bytes of scalars and three strings; grows only on purpose
+static_assert(sizeof(Task) <= 40 + 3 * sizeof(std::string), "Task grew past its packed layout");
+
+// Field changes decoded from an update body; unset fields are left alone
+struct TaskPatch {
+    std::optional<std::string> title;
+    std::optional<std::string> description;
+    std::optional<DueDate> due_date;
+    std::optional<TaskStatus> status;
+    std::optional<TaskPriority> priority;
+
+    // One pass over the members, validating as it decodes
+    static std::optional<TaskPatch> fromJson(const Json::Value& json, ValidationError* error = nullptr);
+    void applyTo(Task& task) const;
+};
+
+// Published tasks are immutable; writers replace them with a new version
+using TaskPtr = std::shared_ptr<const Task>;
+
+// The task's cached rendering, sharing ownership with the task itself
+inline std::shared_ptr<const std::string> cachedJson(const TaskPtr& task) {
+    return std::shared_ptr<const std::string>(task, &task->cached_json);
+}
+
+// One item of an updateTasks batch
+struct TaskUpdate {
+    uint64_t id;
+    TaskPatch patch;
+};
+
+// Timestamps a list can be ranged over and sorted by
+enum class TaskTimeField : uint8_t {
+    DUE_DATE,
+    CREATED_AT,
+    UPDATED_AT
+};
+
+constexpr size_t kTaskTimeFieldCount = 3;
+
+// Half-open [from, until) in UTC seconds since the epoch; unset ends are open
+struct TimeRange {
+    std::optional<int64_t> from;
+    std::optional<int64_t> until;
+
+    bool bounded() const { return from || until; }
+    bool contains(int64_t seconds) const { return (!from || seconds >= *from) && (!until || seconds < *until); }
+};
+
+// A task's timestamp for field, truncated to seconds; nullopt for a task
+// without a due date
+std::optional<int64_t> timeKey(const Task& task, TaskTimeField field);
+
+// List filters and order, parsed once from the request; unset fields match
+// everything
+struct TaskFilter {
+    std::optional<TaskStatus> status;
+    std::optional<TaskPriority> priority;
+    // Full-text search: tasks whose title or description contain every
+    // term. Set with an empty list (a query with no terms) matches nothing.
+    std::optional<std::vector<std::string>> terms = std::nullopt;
+    // Indexed by TaskTimeField; a bounded due range never matches tasks
+    // without a due date
+    TimeRange ranges[kTaskTimeFieldCount] = {};
+    // Ascending by this timestamp, ties by id; unset is id order. Only
+    // offset paging applies to a sorted list.
+    std::optional<TaskTimeField> sort = std::nullopt;
+
+    // Splits q the way titles and descriptions are indexed
+    void setQuery(std::string_view q);
+    TimeRange& range(TaskTimeField field) { return ranges[static_cast<size_t>(field)]; }
+    const TimeRange& range(TaskTimeField field) const { return ranges[static_cast<size_t>(field)]; }
+};
+
+// Point-in-time task counts
+struct TaskStatistics {
+    uint64_t total = 0;
+    uint64_t by_status[kTaskStatusCount] = {};
+    uint64_t by_priority[kTaskPriorityCount] = {};
+};
+
+// One page of a keyset scan; pass next_cursor back to continue
+struct TaskPage {
+    std::vector<TaskPtr> tasks;
+    uint64_t next_cursor = 0;  // 0 = no further results
+    // Tasks the scan looked at, matching or not; what an index saved
+    size_t examined = 0;
+};
+
+// Durability hook. TaskManager calls logPut / logDelete with the shard's
+// write lock held, so the records for any one task are in the order the
+// store applied them, then waitDurable(seq) once the lock is released.
+class MutationLog {
+public:
+    virtual ~MutationLog() = default;
+    virtual uint64_t logPut(const Task& task) = 0;
+    virtual uint64_t logDelete(uint64_t id) = 0;
+    // Blocks until every record up to seq is on stable storage; false if
+    // the log failed first, in which case it never will be
+    virtual bool waitDurable(uint64_t seq) = 0;
+};
+
+// Thrown by a write whose log record could not be made durable. The store
+// already has the change, but it may not survive a restart.
+class DurabilityError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class ChangeFeed;
+
 class TaskManager {
 public:
-    TaskManager();
+    static constexpr size_t kDefaultShardCount = 16;
+
+    // shard_count = 1 keeps everything in a single map behind one lock.
+    // With more than one partition the shards are split between them (the
+    // count rounded up to a multiple): partition p owns the ids with
+    // id % partitions == p, and so the shards s with s % partitions == p.
+    // Creates take ids from the calling thread's home partition, so tasks
+    // made on a NUMA node stay in shards only that node's threads insert
+    // into, and partitions never share an id counter.
+    explicit TaskManager(size_t shard_count = kDefaultShardCount, size_t partitions = 1);
     ~TaskManager() = default;
+
+    // For every TaskManager, the partition creates on this thread use
+    // (modulo the partition count); the server sets it per listener
+    static void setHomePartition(size_t partition) { t_home_partition = partition; }
+    size_t getPartitionCount() const { return next_ids_.size(); }
+    // The partition that owns id
+    size_t partitionOf(uint64_t id) const { return id % next_ids_.size(); }
     
     // Task CRUD operations
-    std::shared_ptr<Task> createTask(const Json::Value& taskData);
-    std::shared_ptr<Task> getTask(uint64_t id) const;
-    std::vector<std::shared_ptr<Task>> getAllTasks(
-        const std::string& status_filter = "",
-        const std::string& priority_filter = "",
+    TaskPtr createTask(const Json::Value& taskData);
+    // Publishes a task built by Task::fromJson, assigning its id
+    TaskPtr createTask(std::shared_ptr<Task> task);
+    TaskPtr getTask(uint64_t id) const;  // Lock-free
+    // Ordered by id; cost is O(offset + limit), independent of store size.
+    // A search reads only the posting lists of its terms, and stops once it
+    // has enough matches.
+    std::vector<TaskPtr> getAllTasks(
+        const TaskFilter& filter = {},
         size_t limit = 10,
         size_t offset = 0
     ) const;
+
+    // Keyset pagination: tasks with id > cursor, in id order. Each page costs
+    // O(log n + limit) however deep the walk is. filter.sort is ignored.
+    TaskPage getTasksAfter(uint64_t cursor, size_t limit, const TaskFilter& filter = {}) const;
     
-    std::shared_ptr<Task> updateTask(uint64_t id, const Json::Value& updates);
+    // Both return nullptr if the task does not exist; the Json overload also
+    // does so when the updates fail validation
+    TaskPtr updateTask(uint64_t id, const Json::Value& updates);
+    TaskPtr updateTask(uint64_t id, const TaskPatch& patch);
     bool deleteTask(uint64_t id);
+
+    // Batches reserve all their ids at once and lock each shard once.
+    // Results line up with the inputs; nullptr / false mark items that were
+    // invalid (null in the create span) or not found.
+    std::vector<TaskPtr> createTasks(std::span<const Json::Value> items);
+    std::vector<TaskPtr> createTasks(std::span<const std::shared_ptr<Task>> tasks);
+    std::vector<TaskPtr> updateTasks(std::span<const TaskUpdate> updates);
+    std::vector<bool> deleteTasks(std::span<const uint64_t> ids);
+    // Bulk load of restored tasks: keeps their ids (tasks with id 0 get a
+    // fresh one), replaces any task already stored under the same id and
+    // moves the id counter past everything loaded
+    std::vector<TaskPtr> restoreTasks(std::span<const std::shared_ptr<Task>> tasks);
+
+    // Persistence support. Attach the log before serving requests; it is not
+    // swapped atomically. Once it fails, writes throw DurabilityError. loadTasks installs recovered tasks exactly as they
+    // were logged (ids and versions kept) without logging them again.
+    void setMutationLog(MutationLog* log) { log_ = log; }
+    // Every published write is also appended to the feed; like the log it
+    // is attached once, before serving, and recovery does not feed it
+    void setChangeFeed(ChangeFeed* feed) { feed_ = feed; }
+    void loadTasks(std::span<const std::shared_ptr<Task>> tasks);
+    // Pre-sizes the shard maps for about count tasks in total
+    void reserve(size_t count);
+    // Greater than every id handed out so far
+    uint64_t nextId() const;
+    // Keeps every partition's ids at or past next
+    void advanceNextId(uint64_t next);
     
-    // Statistics
+    // Statistics; constant time and lock-free, read from per-shard counters
+    TaskStatistics getStatisticsSnapshot() const;
     Json::Value getStatistics() const;
     size_t getTaskCount() const;
-    
-    // Thread safety
-    std::mutex& getMutex() const { return mutex_; }
+    size_t getShardCount() const { return shards_.size(); }
+
+    // Changes whenever any write is published, so equal values mean an
+    // unchanged store. Starts from the wall clock in microseconds, so values
+    // handed out by an earlier process are not reused after a restart.
+    uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+    // Wait and hold times of the shard locks
+    const metrics::LockMetrics& lockMetrics() const { return lock_metrics_; }
 
 private:
-    mutable std::mutex mutex_;
-    std::unordered_map<uint64_t, std::shared_ptr<Task>> tasks_;
-    std::atomic<uint64_t> next_id_;
+    using IdIndex = std::set<uint64_t>;
+    // (seconds, id), so equal timestamps still order by id
+    using TimeIndex = std::set<std::pair<int64_t, uint64_t>>;
+
+    // Tasks are partitioned by id. The lock serializes writers and scans;
+    // point reads go through the RCU map without touching it. The index
+    // holds the shard's ids per (status, priority) pair, in id order, and
+    // counts mirrors its sizes for lock-free statistics. text indexes the
+    // title and description terms, and by_time each TaskTimeField.
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        RcuTaskMap tasks;
+        IdIndex index[kTaskStatusCount][kTaskPriorityCount];
+        std::atomic<uint64_t> counts[kTaskStatusCount][kTaskPriorityCount] = {};
+        text_index::TextIndex text;
+        TimeIndex by_time[kTaskTimeFieldCount];
+
+        void addToIndex(const Task& task);
+        void removeFromIndex(const Task& task);
+        // For a new version of a stored task; only what changed is touched
+        void replaceInIndex(const Task& current, const Task& next);
+    };
+
+    // A partition's next id; a multiple of the partition count plus its
+    // index, and on a line of its own
+    struct alignas(64) IdCounter {
+        std::atomic<uint64_t> next{0};
+    };
+
+    inline static thread_local size_t t_home_partition = 0;
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<IdCounter> next_ids_;
+    // Bumped by every writer while it still holds its shard lock; on its
+    // own line, as every write touches it
+    alignas(64) std::atomic<uint64_t> generation_;
+    MutationLog* log_ = nullptr;
+    ChangeFeed* feed_ = nullptr;
+    mutable metrics::LockMetrics lock_metrics_;
     
-    // Helper functions
-    TaskStatus stringToStatus(const std::string& str) const;
-    TaskPriority stringToPriority(const std::string& str) const;
-    std::string statusToString(TaskStatus status) const;
-    std::string priorityToString(TaskPriority priority) const;
+    size_t shardIndex(uint64_t id) const { return id % shards_.size(); }
+    // count ids of the home partition; they are first, first + stride, ...
+    // with stride the partition count
+    uint64_t reserveIds(size_t count);
+    Shard& shardFor(uint64_t id) const { return *shards_[shardIndex(id)]; }
+
+    // Inserts tasks that already have ids, one critical section per shard
+    // recovering keeps versions as given and skips the log
+    void publishBatch(std::span<const std::shared_ptr<Task>> tasks, std::vector<TaskPtr>& results,
+                      bool recovering = false);
+
+    void bumpGeneration() { generation_.fetch_add(1, std::memory_order_release); }
+    // Change feed hooks, called with the shard lock held
+    void feedPut(const TaskPtr& task);
+    void feedDelete(uint64_t id);
+
+    uint64_t logPut(const Task& task) { return log_ ? log_->logPut(task) : 0; }
+    uint64_t logDelete(uint64_t id) { return log_ ? log_->logDelete(id) : 0; }
+    void awaitLog(uint64_t seq) const {
+        if (seq != 0 && !log_->waitDurable(seq)) {
+            throw DurabilityError("write-ahead log failed");
+        }
+    }
+
+    // Shared implementation of both pagination styles
+    TaskPage scanPage(const TaskFilter& filter, uint64_t after, size_t offset, size_t limit) const;
+    // scanPage for filters with terms, for sorted lists and for time
+    // ranges in id order; all run with its locks held
+    TaskPage searchPage(const TaskFilter& filter, uint64_t after, size_t offset, size_t limit) const;
+    TaskPage sortedPage(const TaskFilter& filter, size_t offset, size_t limit) const;
+    TaskPage rangePage(const TaskFilter& filter, uint64_t after, size_t offset, size_t limit) const;
 };
 
-} // namespace http_server
\ No newline at end of file
+} // namespace http_server
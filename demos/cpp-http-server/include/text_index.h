@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace http_server {
+namespace text_index {
+
+// Search terms are runs of ASCII letters and digits, lowercased, plus any
+// non-ASCII bytes (so UTF-8 words stay whole, compared byte for byte).
+// Longer runs are cut to kMaxTokenLength, in documents and queries alike.
+constexpr size_t kMaxTokenLength = 64;
+
+// Appends the distinct terms of text to tokens, which is kept sorted
+void tokenize(std::string_view text, std::vector<std::string>& tokens);
+
+// Writes the ids present in both sorted arrays to out (room for min(n, m))
+// and returns how many; SSE2 on x86-64, a plain merge elsewhere
+size_t intersect(const uint64_t* a, size_t n, const uint64_t* b, size_t m, uint64_t* out);
+
+// Sorted set of task ids, stored as blocks of up to kBlockSize ids: the first
+// id in full, the gaps after it as varints. Appending past the largest id is
+// O(1); other inserts and erases re-encode a single block.
+class PostingList {
+public:
+    static constexpr size_t kBlockSize = 128;
+
+    void insert(uint64_t id);
+    void erase(uint64_t id);
+    bool contains(uint64_t id) const;
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t blockCount() const { return blocks_.size(); }
+
+    // First block that may hold ids > after
+    size_t firstBlockAfter(uint64_t after) const;
+    // Decodes block i into out (kBlockSize entries) and returns its length
+    size_t decode(size_t block, uint64_t* out) const;
+    // Keeps the ids[0..n) that are in this list, in place; n <= kBlockSize
+    size_t retainCommon(uint64_t* ids, size_t n) const;
+
+private:
+    struct Block {
+        uint64_t first = 0;
+        uint64_t last = 0;
+        uint32_t count = 0;
+        std::vector<uint8_t> gaps;
+    };
+
+    void encode(Block& block, const uint64_t* ids, size_t n);
+    size_t blockFor(uint64_t id) const;  // First block with last >= id
+
+    std::vector<Block> blocks_;
+    size_t size_ = 0;
+};
+
+// Term -> posting list over the title and description of one shard's tasks.
+// Not synchronized; TaskManager updates it under the shard's write lock and
+// searches it under the shared one.
+class TextIndex {
+public:
+    void add(uint64_t id, std::string_view title, std::string_view description);
+    void remove(uint64_t id, std::string_view title, std::string_view description);
+    // Moves id from the old text's terms to the new one's, touching only the
+    // terms that differ
+    void replace(uint64_t id, std::string_view old_title, std::string_view old_description,
+                 std::string_view title, std::string_view description);
+
+    size_t termCount() const { return postings_.size(); }
+    const PostingList* find(const std::string& term) const;
+    // Whether id has every one of the terms; for checking a candidate found
+    // some other way, where search() would have to walk the lists
+    bool containsAll(std::span<const std::string> terms, uint64_t id) const;
+
+    // Calls visit(id) for every id > after that has all the terms, in id
+    // order, until visit returns false. No terms matches nothing.
+    template <typename Visit>
+    void search(std::span<const std::string> terms, uint64_t after, Visit&& visit) const;
+
+private:
+    static void terms(std::string_view title, std::string_view description, std::vector<std::string>& out);
+    // Drops the term once its list is empty
+    void eraseFrom(const std::string& term, uint64_t id);
+
+    std::unordered_map<std::string, PostingList> postings_;
+};
+
+template <typename Visit>
+void TextIndex::search(std::span<const std::string> terms, uint64_t after, Visit&& visit) const {
+    if (terms.empty()) {
+        return;
+    }
+    // The shortest list drives; every other one only answers membership for
+    // the blocks it overlaps
+    std::vector<const PostingList*> lists;
+    lists.reserve(terms.size());
+    for (const auto& term : terms) {
+        const PostingList* list = find(term);
+        if (!list) {
+            return;
+        }
+        lists.push_back(list);
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const PostingList* a, const PostingList* b) { return a->size() < b->size(); });
+
+    uint64_t ids[PostingList::kBlockSize];
+    const PostingList& driver = *lists.front();
+    for (size_t block = driver.firstBlockAfter(after); block < driver.blockCount(); ++block) {
+        size_t n = driver.decode(block, ids);
+        size_t start = 0;
+        while (start < n && ids[start] <= after) {
+            ++start;
+        }
+        if (start > 0) {
+            std::copy(ids + start, ids + n, ids);
+            n -= start;
+        }
+        for (size_t l = 1; l < lists.size() && n > 0; ++l) {
+            n = lists[l]->retainCommon(ids, n);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (!visit(ids[i])) {
+                return;
+            }
+        }
+    }
+}
+
+} // namespace text_index
+} // namespace http_server
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <sched.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace http_server {
+namespace topology {
+
+// A NUMA node and the CPUs of it this process may run on
+struct Node {
+    int id = 0;
+    std::vector<int> cpus;
+};
+
+// The kernel's list format, "0-3,8,10-11", into cpus in ascending order;
+// false if text is not one
+bool parseCpuList(std::string_view text, std::vector<int>& cpus);
+
+// CPUs in the calling thread's affinity mask (cgroup cpusets included)
+std::vector<int> allowedCpus();
+
+// Nodes with at least one allowed CPU, by node id, read from
+// <node_dir>/node<N>/cpulist. Without that directory (no NUMA support, or a
+// sandbox hiding sysfs) every allowed CPU is reported as node 0.
+std::vector<Node> discoverNodes(const std::string& node_dir, const std::vector<int>& allowed);
+std::vector<Node> discoverNodes();
+
+// Pins the calling thread to cpus for the enclosing scope. Threads started
+// meanwhile inherit the mask and keep it, which is how the server pins the
+// worker threads libmicrohttpd creates.
+class ScopedAffinity {
+public:
+    explicit ScopedAffinity(const std::vector<int>& cpus);
+    ~ScopedAffinity();
+
+    ScopedAffinity(const ScopedAffinity&) = delete;
+    ScopedAffinity& operator=(const ScopedAffinity&) = delete;
+
+    // False if the mask could not be applied (the thread runs unpinned)
+    bool pinned() const { return pinned_; }
+
+private:
+    cpu_set_t previous_;
+    bool saved_ = false;
+    bool pinned_ = false;
+};
+
+} // namespace topology
+} // namespace http_server
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include "metrics.h"
+
+namespace http_server {
+namespace trace {
+
+// Built with HTTP_SERVER_WITH_TRACING (the ENABLE_TRACING CMake option);
+// without it every timer below is empty and the compiler drops it
+#if defined(HTTP_SERVER_WITH_TRACING)
+constexpr bool kEnabled = true;
+#else
+constexpr bool kEnabled = false;
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// Where a request's time goes
+enum class Phase : uint8_t {
+    PARSE,       // json_utils::parseJson
+    VALIDATE,    // Task::fromJson, TaskPatch::fromJson
+    LOCK_WAIT,   // Acquiring task store shard locks
+    LOCK_HOLD,   // Holding them
+    SERIALIZE,   // Rendering task and response JSON
+    COMPRESS,    // gzip/br of response bodies
+    SEND         // From queueing the response until MHD has sent it
+};
+
+constexpr size_t kPhaseCount = 7;
+
+const char* toString(Phase phase);
+
+// Spans of one sampled request. Spans may nest (serializing inside a lock
+// hold, say), so per-phase totals can add up to more than the request took.
+class RequestTrace {
+public:
+    static constexpr size_t kMaxSpans = 64;
+
+    struct Interval {
+        Phase phase;
+        Clock::time_point begin;
+        Clock::time_point end;
+    };
+
+    // Starts over for a request that arrived at started
+    void begin(Clock::time_point started);
+    // Marks the handler done; the rest of the request is SEND
+    void responded(int status, Clock::time_point when);
+    void end() { active_ = false; }
+
+    bool active() const { return active_; }
+    // Past kMaxSpans only the totals are kept
+    void add(Phase phase, Clock::time_point begin, Clock::time_point end);
+
+    Clock::time_point started() const { return started_; }
+    Clock::time_point respondedAt() const { return responded_; }
+    int status() const { return status_; }
+    unsigned int thread() const { return thread_; }
+    std::span<const Interval> spans() const { return {spans_.data(), count_}; }
+    size_t dropped() const { return dropped_; }
+    Clock::duration total(Phase phase) const { return totals_[static_cast<size_t>(phase)]; }
+
+private:
+    bool active_ = false;
+    int status_ = 0;
+    unsigned int thread_ = 0;
+    Clock::time_point started_;
+    Clock::time_point responded_;
+    std::array<Interval, kMaxSpans> spans_;
+    size_t count_ = 0;
+    size_t dropped_ = 0;
+    std::array<Clock::duration, kPhaseCount> totals_{};
+};
+
+// The trace of the request this thread is serving, if it was sampled
+inline thread_local RequestTrace* t_current = nullptr;
+
+// Makes trace current on this thread for the enclosing scope
+class Activation {
+public:
+    explicit Activation(RequestTrace* trace) : previous_(t_current) {
+        if constexpr (kEnabled) {
+            t_current = trace && trace->active() ? trace : nullptr;
+        }
+    }
+    ~Activation() {
+        if constexpr (kEnabled) {
+            t_current = previous_;
+        }
+    }
+
+    Activation(const Activation&) = delete;
+    Activation& operator=(const Activation&) = delete;
+
+private:
+    RequestTrace* previous_;
+};
+
+// Scoped timer: adds the enclosing scope to the current trace as one span.
+// Outside a sampled request it costs a thread-local load and a branch.
+class Span {
+public:
+    explicit Span(Phase phase) {
+        if constexpr (kEnabled) {
+            trace_ = t_current;
+            if (trace_) {
+                phase_ = phase;
+                begin_ = Clock::now();
+            }
+        }
+    }
+    ~Span() {
+        if constexpr (kEnabled) {
+            if (trace_) {
+                trace_->add(phase_, begin_, Clock::now());
+            }
+        }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    RequestTrace* trace_ = nullptr;
+    Phase phase_ = Phase::PARSE;
+    Clock::time_point begin_;
+};
+
+// For intervals already being timed, like the store's lock statistics
+inline void record(Phase phase, Clock::time_point begin, Clock::time_point end) {
+    if constexpr (kEnabled) {
+        if (t_current) {
+            t_current->add(phase, begin, end);
+        }
+    }
+}
+
+struct Settings {
+    uint32_t sample_every = 0;        // Trace one request in this many per thread; 0 = off
+    uint32_t slow_threshold_ms = 0;   // Traced requests at least this slow are logged; 0 = none
+    // Appends every traced request in the Chrome trace event format
+    // (chrome://tracing, Perfetto); empty = no file
+    std::string chrome_trace_file{};
+};
+
+// Samples requests, and reports the ones it traced: per-phase histograms
+// for /metrics, a log line for slow ones, and the trace file
+class Tracer {
+public:
+    // Slow requests are logged to log, std::cerr when null
+    explicit Tracer(const Settings& settings, std::ostream* log = nullptr);
+    ~Tracer();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    bool enabled() const { return kEnabled && settings_.sample_every > 0; }
+    // Whether to trace the request this thread is about to serve
+    bool sample();
+    // Ends trace, which has responded(), at ended: adds its SEND span and
+    // reports it
+    void finish(RequestTrace& trace, metrics::Route route, metrics::Method method, Clock::time_point ended);
+
+    uint64_t traced() const { return traced_.load(std::memory_order_relaxed); }
+    uint64_t slow() const { return slow_.load(std::memory_order_relaxed); }
+    void appendPrometheus(std::string& out) const;
+
+private:
+    Settings settings_;
+    std::ostream* log_;
+    std::atomic<uint64_t> traced_{0};
+    std::atomic<uint64_t> slow_{0};
+    metrics::Histogram phases_[kPhaseCount];
+
+    std::mutex file_mutex_;
+    std::unique_ptr<std::ofstream> file_;
+    bool file_empty_ = true;
+};
+
+// The one-line summary the slow-request log prints
+void appendSummary(std::string& out, const RequestTrace& trace, metrics::Route route,
+                   metrics::Method method, Clock::time_point ended);
+// trace as Chrome trace events, one for the request and one per span,
+// separated by ",\n"
+void appendChromeEvents(std::string& out, const RequestTrace& trace, metrics::Route route,
+                        metrics::Method method, Clock::time_point ended);
+
+} // namespace trace
+} // namespace http_server
@@ -0,0 +1,379 @@
+#include "admission.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <netinet/in.h>
+#include <utility>
+#include <vector>
+
+namespace http_server {
+namespace admission {
+
+namespace {
+
+// splitmix64 finalizer: spreads similar addresses over the whole table
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+size_t verdictIndex(Verdict verdict) {
+    return static_cast<size_t>(verdict);
+}
+
+uint32_t retryAfterSeconds(uint64_t wait_ns) {
+    // Rounded up, so a client that waits as told finds a token
+    return static_cast<uint32_t>(std::max<uint64_t>(1, (wait_ns + 999999999) / 1000000000));
+}
+
+} // namespace
+
+bool Settings::enabled() const {
+    return per_client.enabled() || max_concurrent > 0 ||
+           std::any_of(std::begin(per_route), std::end(per_route),
+                       [](const RateLimit& limit) { return limit.enabled(); });
+}
+
+// Gcra implementation
+Gcra::Gcra(const RateLimit& limit) {
+    if (!limit.enabled()) {
+        return;
+    }
+    const double burst = std::max(1.0, limit.burst > 0 ? limit.burst : limit.rate);
+    interval_ns_ = std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(1e9 / limit.rate)));
+    tolerance_ns_ = static_cast<uint64_t>(std::llround((burst - 1) * static_cast<double>(interval_ns_)));
+}
+
+uint64_t Gcra::take(std::atomic<uint64_t>& tat, uint64_t now_ns) const {
+    uint64_t current = tat.load(std::memory_order_relaxed);
+    for (;;) {
+        // A full bucket is a tat at or before now; each token taken pushes
+        // it one interval further, and the bucket is empty once it is more
+        // than the tolerance ahead
+        const uint64_t allowed_at = current > tolerance_ns_ ? current - tolerance_ns_ : 0;
+        if (now_ns < allowed_at) {
+            return allowed_at - now_ns;
+        }
+        const uint64_t next = std::max(current, now_ns) + interval_ns_;
+        if (tat.compare_exchange_weak(current, next, std::memory_order_relaxed)) {
+            return 0;
+        }
+    }
+}
+
+// ClientBuckets implementation
+ClientBuckets::ClientBuckets(size_t slots) {
+    size_t sets = 1;
+    while (sets * kWays < slots) {
+        sets <<= 1;
+    }
+    sets_ = std::make_unique<Set[]>(sets);
+    mask_ = sets - 1;
+}
+
+uint64_t ClientBuckets::take(const Gcra& gcra, uint64_t client, uint64_t now_ns) {
+    const uint64_t hash = mix(client);
+    const uint64_t key = hash | 1;  // 0 marks a free slot
+    Set& set = sets_[(hash >> 32) & mask_];
+
+    for (size_t way = 0; way < kWays; ++way) {
+        if (set.keys[way].load(std::memory_order_acquire) == key) {
+            return gcra.take(set.tats[way], now_ns);
+        }
+    }
+    // Two first requests of one client can race here and each claim a slot;
+    // the client then briefly has two buckets, until one of them goes idle
+    for (size_t way = 0; way < kWays; ++way) {
+        uint64_t current = set.keys[way].load(std::memory_order_relaxed);
+        const bool reusable = current == 0 || set.tats[way].load(std::memory_order_relaxed) <= now_ns;
+        if (reusable && set.keys[way].compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+            return gcra.take(set.tats[way], now_ns);
+        }
+    }
+    untracked_.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+// ConcurrencyLimiter implementation
+ConcurrencyLimiter::ConcurrencyLimiter(unsigned int limit, unsigned int queue_size,
+                                       std::chrono::milliseconds timeout)
+    : limit_(limit), queue_size_(queue_size), timeout_(timeout) {}
+
+ConcurrencyLimiter::~ConcurrencyLimiter() {
+    stopQueue();
+}
+
+bool ConcurrencyLimiter::tryAcquire() {
+    unsigned int current = in_flight_.load();
+    while (current < limit_) {
+        if (in_flight_.compare_exchange_weak(current, current + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ConcurrencyLimiter::acquire() {
+    if (tryAcquire()) {
+        return true;
+    }
+    if (queue_size_ == 0) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (waiting_.load() >= queue_size_) {
+        return false;
+    }
+    // Announced before the predicate runs; release() reads it after freeing
+    // its slot, so either it notifies or this thread sees the slot
+    waiting_.fetch_add(1);
+    bool acquired = freed_.wait_for(lock, timeout_, [this] { return tryAcquire(); });
+    waiting_.fetch_sub(1);
+    return acquired;
+}
+
+ConcurrencyLimiter::Queued ConcurrencyLimiter::enqueue(void* waiter, const std::function<void()>& park) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!queueing_.load() || waiting_.load() >= queue_size_) {
+        return Queued::REFUSED;
+    }
+    // Announced before the slot is tried, as in acquire()
+    waiting_.fetch_add(1);
+    if (tryAcquire()) {
+        waiting_.fetch_sub(1);
+        return Queued::ACQUIRED;
+    }
+    park();
+    queue_.push_back({waiter, std::chrono::steady_clock::now() + timeout_});
+    if (queue_.size() == 1) {
+        queued_.notify_one();
+    }
+    return Queued::QUEUED;
+}
+
+void ConcurrencyLimiter::release() {
+    in_flight_.fetch_sub(1);
+    if (waiting_.load() == 0) {
+        return;
+    }
+    void* woken = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // A newcomer may have taken the slot first; the waiter then waits
+        // for that one's release
+        if (!queue_.empty() && tryAcquire()) {
+            woken = queue_.front().waiter;
+            queue_.pop_front();
+            waiting_.fetch_sub(1);
+        } else {
+            freed_.notify_one();
+        }
+    }
+    if (woken) {
+        waker_(woken, true);
+    }
+}
+
+void ConcurrencyLimiter::startQueue(Waker waker) {
+    if (queueing_.load()) {
+        return;
+    }
+    waker_ = std::move(waker);
+    queueing_ = true;
+    expiry_ = std::thread([this] { expiryLoop(); });
+}
+
+void ConcurrencyLimiter::stopQueue() {
+    std::deque<Waiter> refused;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!queueing_.load()) {
+            return;
+        }
+        queueing_ = false;
+        refused.swap(queue_);
+        waiting_.fetch_sub(static_cast<unsigned int>(refused.size()));
+    }
+    queued_.notify_one();
+    expiry_.join();
+    for (const Waiter& waiter : refused) {
+        waker_(waiter.waiter, false);
+    }
+}
+
+void ConcurrencyLimiter::expiryLoop() {
+    std::vector<void*> expired;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (queueing_.load()) {
+        if (queue_.empty()) {
+            // Bounded, like the other waits here; enqueue() notifies anyway
+            queued_.wait_for(lock, std::chrono::seconds(1));
+            continue;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        while (!queue_.empty() && queue_.front().deadline <= now) {
+            expired.push_back(queue_.front().waiter);
+            queue_.pop_front();
+        }
+        if (expired.empty()) {
+            queued_.wait_until(lock, queue_.front().deadline);
+            continue;
+        }
+        waiting_.fetch_sub(static_cast<unsigned int>(expired.size()));
+        lock.unlock();
+        for (void* waiter : expired) {
+            waker_(waiter, false);
+        }
+        expired.clear();
+        lock.lock();
+    }
+}
+
+// Controller implementation
+Controller::Controller(const Settings& settings)
+    : enabled_(settings.enabled()),
+      epoch_(std::chrono::steady_clock::now()),
+      client_gcra_(settings.per_client),
+      client_buckets_(settings.per_client.enabled() ? settings.client_table_size : 1) {
+    for (size_t r = 0; r < metrics::kRouteCount; ++r) {
+        route_gcra_[r] = Gcra(settings.per_route[r]);
+    }
+    if (settings.max_concurrent > 0) {
+        limiter_ = std::make_unique<ConcurrencyLimiter>(settings.max_concurrent, settings.queue_size,
+                                                        std::chrono::milliseconds(settings.queue_timeout_ms));
+    }
+}
+
+uint64_t Controller::nowNanos() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch_).count());
+}
+
+Decision Controller::admit(metrics::Route route, uint64_t client, bool& counted) {
+    counted = false;
+    if (!enabled_ || route == metrics::Route::HEALTH || route == metrics::Route::METRICS) {
+        return {};
+    }
+
+    auto reject = [this](Verdict verdict, uint64_t wait_ns) {
+        rejected_[verdictIndex(verdict)].fetch_add(1, std::memory_order_relaxed);
+        return Decision{verdict, retryAfterSeconds(wait_ns)};
+    };
+
+    const uint64_t now = nowNanos();
+    if (client_gcra_.enabled()) {
+        if (uint64_t wait = client_buckets_.take(client_gcra_, client, now)) {
+            return reject(Verdict::CLIENT_RATE, wait);
+        }
+    }
+    const size_t r = static_cast<size_t>(route);
+    if (route_gcra_[r].enabled()) {
+        if (uint64_t wait = route_gcra_[r].take(route_tats_[r], now)) {
+            return reject(Verdict::ROUTE_RATE, wait);
+        }
+    }
+    if (limiter_ && route != metrics::Route::EVENTS) {
+        if (limiter_->queueing()) {
+            if (!limiter_->tryAcquire()) {
+                if (limiter_->queueFull()) {
+                    return reject(Verdict::OVERLOADED, 0);
+                }
+                return Decision{Verdict::QUEUED, 0};
+            }
+        } else if (!limiter_->acquire()) {
+            return reject(Verdict::OVERLOADED, 0);
+        }
+        counted = true;
+    }
+    return {};
+}
+
+ConcurrencyLimiter::Queued Controller::enqueue(void* waiter, const std::function<void()>& park) {
+    ConcurrencyLimiter::Queued queued = limiter_->enqueue(waiter, park);
+    if (queued == ConcurrencyLimiter::Queued::REFUSED) {
+        rejected_[verdictIndex(Verdict::OVERLOADED)].fetch_add(1, std::memory_order_relaxed);
+    }
+    return queued;
+}
+
+void Controller::release() {
+    limiter_->release();
+}
+
+void Controller::startQueue(ConcurrencyLimiter::Waker waker) {
+    if (!limiter_) {
+        return;
+    }
+    limiter_->startQueue([this, waker = std::move(waker)](void* waiter, bool acquired) {
+        if (!acquired) {
+            rejected_[verdictIndex(Verdict::OVERLOADED)].fetch_add(1, std::memory_order_relaxed);
+        }
+        waker(waiter, acquired);
+    });
+}
+
+void Controller::stopQueue() {
+    if (limiter_) {
+        limiter_->stopQueue();
+    }
+}
+
+uint64_t Controller::rejected(Verdict verdict) const {
+    return rejected_[verdictIndex(verdict)].load(std::memory_order_relaxed);
+}
+
+void Controller::appendPrometheus(std::string& out) const {
+    if (!enabled_) {
+        return;
+    }
+    static constexpr std::pair<Verdict, const char*> kReasons[] = {
+        {Verdict::CLIENT_RATE, "reason=\"client_rate\""},
+        {Verdict::ROUTE_RATE, "reason=\"route_rate\""},
+        {Verdict::OVERLOADED, "reason=\"overloaded\""},
+    };
+    metrics::appendHelp(out, "http_admission_rejected_total", "counter",
+                        "Requests turned away before their body was read");
+    for (const auto& [verdict, labels] : kReasons) {
+        metrics::appendSample(out, "http_admission_rejected_total", labels, rejected(verdict));
+    }
+    metrics::appendHelp(out, "http_admission_untracked_total", "counter",
+                        "Requests admitted without a client bucket because their table set was full");
+    metrics::appendSample(out, "http_admission_untracked_total", "", client_buckets_.untracked());
+    if (limiter_) {
+        metrics::appendHelp(out, "http_admission_in_flight", "gauge", "Requests holding a concurrency slot");
+        metrics::appendSample(out, "http_admission_in_flight", "", static_cast<uint64_t>(limiter_->inFlight()));
+    }
+}
+
+uint64_t clientKey(const struct sockaddr* address) {
+    if (!address) {
+        return 0;
+    }
+    if (address->sa_family == AF_INET) {
+        const auto* v4 = reinterpret_cast<const sockaddr_in*>(address);
+        return static_cast<uint64_t>(v4->sin_addr.s_addr);
+    }
+    if (address->sa_family == AF_INET6) {
+        const auto* v6 = reinterpret_cast<const sockaddr_in6*>(address);
+        const uint8_t* bytes = v6->sin6_addr.s6_addr;
+        // An IPv4 client on a dual-stack socket shares its IPv4 bucket
+        if (IN6_IS_ADDR_V4MAPPED(&v6->sin6_addr)) {
+            uint32_t v4;
+            std::memcpy(&v4, bytes + 12, sizeof(v4));
+            return v4;
+        }
+        uint64_t high;
+        uint64_t low;
+        std::memcpy(&high, bytes, sizeof(high));
+        std::memcpy(&low, bytes + 8, sizeof(low));
+        return mix(high) ^ low ^ (uint64_t{1} << 63);
+    }
+    return 0;
+}
+
+} // namespace admission
+} // namespace http_server
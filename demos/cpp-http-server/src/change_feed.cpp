@@ -0,0 +1,113 @@
+#include "change_feed.h"
+#include <algorithm>
+#include <thread>
+
+namespace http_server {
+
+namespace {
+
+uint64_t clockMicros() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+} // namespace
+
+ChangeFeed::ChangeFeed(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)),
+      ring_(std::make_unique<Slot[]>(capacity_)),
+      first_seq_(clockMicros()),
+      reserved_(first_seq_),
+      latest_(first_seq_) {}
+
+void ChangeFeed::publishPut(TaskPtr task) {
+    uint64_t id = task->id;
+    append(ChangeKind::PUT, id, std::move(task));
+}
+
+void ChangeFeed::publishDelete(uint64_t id) {
+    append(ChangeKind::DELETE, id, nullptr);
+}
+
+void ChangeFeed::append(ChangeKind kind, uint64_t id, TaskPtr task) {
+    const int64_t published_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const uint64_t seq = reserved_.fetch_add(1) + 1;
+    Slot& slot = ring_[seq % capacity_];
+    // The slot's previous event has to be behind latest_ first, or latest_
+    // could never get past it. Only capacity appends in flight at once wait.
+    while (latest_.load() + capacity_ < seq) {
+        std::this_thread::yield();
+    }
+    TaskPtr evicted;
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        // Drop the overwritten version outside the lock
+        evicted = std::move(slot.event.task);
+        slot.event = {seq, kind, id, std::move(task), published_us};
+    }
+    slot.published.store(seq);
+    if (!advance()) {
+        // An earlier writer is still filling its slot; whoever moves
+        // latest_ past this one notifies
+        return;
+    }
+    // Waiters announce themselves before checking latest_, so either this
+    // sees them or they see the new latest_
+    if (waiters_.load() > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        published_.notify_all();
+    }
+    if (listener_) {
+        listener_();
+    }
+}
+
+bool ChangeFeed::advance() {
+    bool moved = false;
+    uint64_t latest = latest_.load();
+    while (ring_[(latest + 1) % capacity_].published.load() == latest + 1) {
+        // On failure latest is reloaded and the next slot checked
+        if (latest_.compare_exchange_weak(latest, latest + 1)) {
+            ++latest;
+            moved = true;
+        }
+    }
+    return moved;
+}
+
+ChangeBatch ChangeFeed::read(uint64_t since, size_t max) const {
+    ChangeBatch batch;
+    batch.latest = latest_.load();
+
+    const uint64_t oldest = std::max(first_seq_ + 1, batch.latest >= capacity_ ? batch.latest - capacity_ + 1 : 0);
+    if (since > batch.latest || since + 1 < oldest) {
+        batch.resync = true;
+        return batch;
+    }
+
+    uint64_t end = std::min(batch.latest, since + max);
+    batch.events.reserve(end - since);
+    for (uint64_t seq = since + 1; seq <= end; ++seq) {
+        Slot& slot = ring_[seq % capacity_];
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        if (slot.event.seq != seq) {
+            // Overwritten since latest was read: the reader fell behind
+            batch.events.clear();
+            batch.resync = true;
+            return batch;
+        }
+        batch.events.push_back(slot.event);
+    }
+    return batch;
+}
+
+bool ChangeFeed::waitForNewer(uint64_t since, std::chrono::milliseconds timeout) const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiters_.fetch_add(1);
+    const bool newer = published_.wait_for(lock, timeout, [&] { return latest_.load() > since; });
+    waiters_.fetch_sub(1);
+    return newer;
+}
+
+} // namespace http_server
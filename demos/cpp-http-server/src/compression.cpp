@@ -0,0 +1,308 @@
+#include "compression.h"
+#include "trace.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#ifdef HTTP_SERVER_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HTTP_SERVER_WITH_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace http_server {
+namespace compression {
+
+namespace {
+
+constexpr size_t kOutputChunk = 16 * 1024;
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+// q-value of one Accept-Encoding element ("gzip;q=0.5"); 1 when absent
+double parseQuality(std::string_view params) {
+    while (!params.empty()) {
+        size_t semi = params.find(';');
+        std::string_view param = trim(params.substr(0, semi));
+        params = semi == std::string_view::npos ? std::string_view() : params.substr(semi + 1);
+        if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+            std::string value(param.substr(2));
+            return std::strtod(value.c_str(), nullptr);
+        }
+    }
+    return 1.0;
+}
+
+} // namespace
+
+const char* toString(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::GZIP: return "gzip";
+        case Encoding::BROTLI: return "br";
+        case Encoding::IDENTITY: break;
+    }
+    return "identity";
+}
+
+bool isAvailable(Encoding encoding) {
+    switch (encoding) {
+#ifdef HTTP_SERVER_WITH_ZLIB
+        case Encoding::GZIP: return true;
+#endif
+#ifdef HTTP_SERVER_WITH_BROTLI
+        case Encoding::BROTLI: return true;
+#endif
+        case Encoding::IDENTITY: return true;
+        default: return false;
+    }
+}
+
+Encoding negotiate(const char* accept_encoding) {
+    if (!accept_encoding || !*accept_encoding) {
+        return Encoding::IDENTITY;
+    }
+
+    // -1 means the coding was not mentioned
+    double gzip = -1;
+    double brotli = -1;
+    double any = -1;
+    std::string_view rest(accept_encoding);
+    while (!rest.empty()) {
+        size_t comma = rest.find(',');
+        std::string_view element = rest.substr(0, comma);
+        rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+
+        size_t semi = element.find(';');
+        std::string_view name = trim(element.substr(0, semi));
+        double q = semi == std::string_view::npos ? 1.0 : parseQuality(element.substr(semi + 1));
+        if (equalsIgnoreCase(name, "gzip") || equalsIgnoreCase(name, "x-gzip")) {
+            gzip = std::max(gzip, q);
+        } else if (equalsIgnoreCase(name, "br")) {
+            brotli = std::max(brotli, q);
+        } else if (name == "*") {
+            any = q;
+        }
+    }
+    if (gzip < 0) gzip = any;
+    if (brotli < 0) brotli = any;
+    if (!isAvailable(Encoding::GZIP)) gzip = 0;
+    if (!isAvailable(Encoding::BROTLI)) brotli = 0;
+
+    if (brotli > 0 && brotli >= gzip) {
+        return Encoding::BROTLI;
+    }
+    return gzip > 0 ? Encoding::GZIP : Encoding::IDENTITY;
+}
+
+struct Compressor::State {
+#ifdef HTTP_SERVER_WITH_ZLIB
+    z_stream zlib{};
+    bool zlib_ready = false;
+#endif
+#ifdef HTTP_SERVER_WITH_BROTLI
+    BrotliEncoderState* brotli = nullptr;
+#endif
+};
+
+Compressor::Compressor(Encoding encoding, int level)
+    : encoding_(encoding), level_(level), state_(std::make_unique<State>()) {
+    reset();
+}
+
+Compressor::~Compressor() {
+#ifdef HTTP_SERVER_WITH_ZLIB
+    if (state_->zlib_ready) {
+        deflateEnd(&state_->zlib);
+    }
+#endif
+#ifdef HTTP_SERVER_WITH_BROTLI
+    if (state_->brotli) {
+        BrotliEncoderDestroyInstance(state_->brotli);
+    }
+#endif
+}
+
+void Compressor::reset() {
+    switch (encoding_) {
+#ifdef HTTP_SERVER_WITH_ZLIB
+        case Encoding::GZIP:
+            if (state_->zlib_ready) {
+                // Keeps the window and hash tables allocated
+                deflateReset(&state_->zlib);
+            } else {
+                // 15 + 16: maximum window, gzip framing
+                state_->zlib_ready = deflateInit2(&state_->zlib, std::clamp(level_, 1, 9), Z_DEFLATED,
+                                                  15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+            }
+            break;
+#endif
+#ifdef HTTP_SERVER_WITH_BROTLI
+        case Encoding::BROTLI:
+            // Brotli has no reset; a finished encoder has to be replaced
+            if (state_->brotli) {
+                BrotliEncoderDestroyInstance(state_->brotli);
+            }
+            state_->brotli = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+            if (state_->brotli) {
+                BrotliEncoderSetParameter(state_->brotli, BROTLI_PARAM_QUALITY,
+                                          static_cast<uint32_t>(std::clamp(level_, 0, 11)));
+                BrotliEncoderSetParameter(state_->brotli, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+}
+
+bool Compressor::write(std::string_view input, std::string& out, bool finish) {
+    switch (encoding_) {
+#ifdef HTTP_SERVER_WITH_ZLIB
+        case Encoding::GZIP: {
+            if (!state_->zlib_ready) {
+                return false;
+            }
+            z_stream& z = state_->zlib;
+            z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+            z.avail_in = static_cast<uInt>(input.size());
+            const int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+            int rc;
+            do {
+                size_t used = out.size();
+                size_t room = std::max(kOutputChunk, static_cast<size_t>(deflateBound(&z, z.avail_in)));
+                out.resize(used + room);
+                z.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+                z.avail_out = static_cast<uInt>(room);
+                rc = deflate(&z, flush);
+                out.resize(used + room - z.avail_out);
+                if (rc == Z_STREAM_ERROR) {
+                    return false;
+                }
+            } while (z.avail_out == 0 || (finish && rc != Z_STREAM_END));
+            return true;
+        }
+#endif
+#ifdef HTTP_SERVER_WITH_BROTLI
+        case Encoding::BROTLI: {
+            if (!state_->brotli) {
+                return false;
+            }
+            const uint8_t* next_in = reinterpret_cast<const uint8_t*>(input.data());
+            size_t avail_in = input.size();
+            const BrotliEncoderOperation op = finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS;
+            do {
+                size_t used = out.size();
+                size_t room = std::max(kOutputChunk, avail_in + avail_in / 8 + 64);
+                out.resize(used + room);
+                uint8_t* next_out = reinterpret_cast<uint8_t*>(out.data() + used);
+                size_t avail_out = room;
+                if (!BrotliEncoderCompressStream(state_->brotli, op, &avail_in, &next_in,
+                                                 &avail_out, &next_out, nullptr)) {
+                    out.resize(used);
+                    return false;
+                }
+                out.resize(used + room - avail_out);
+            } while (avail_in > 0 || BrotliEncoderHasMoreOutput(state_->brotli) ||
+                     (finish && !BrotliEncoderIsFinished(state_->brotli)));
+            return true;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+bool compress(Encoding encoding, const Settings& settings, std::string_view input, std::string& out) {
+    // Each thread keeps one gzip compressor, rebuilt only if another server
+    // instance asks for a different level
+    thread_local std::unique_ptr<Compressor> compressors[kEncodingCount];
+    if (encoding == Encoding::IDENTITY || !isAvailable(encoding)) {
+        return false;
+    }
+
+    trace::Span span(trace::Phase::COMPRESS);
+#ifdef HTTP_SERVER_WITH_BROTLI
+    if (encoding == Encoding::BROTLI) {
+        // A stream encoder cannot be reset, so whole bodies skip it
+        size_t size = BrotliEncoderMaxCompressedSize(input.size());
+        if (size == 0) {
+            return false;
+        }
+        out.resize(size);
+        if (!BrotliEncoderCompress(std::clamp(settings.brotli_quality, 0, 11), BROTLI_DEFAULT_WINDOW,
+                                   BROTLI_MODE_TEXT, input.size(),
+                                   reinterpret_cast<const uint8_t*>(input.data()), &size,
+                                   reinterpret_cast<uint8_t*>(out.data()))) {
+            return false;
+        }
+        out.resize(size);
+        return true;
+    }
+#endif
+    auto& compressor = compressors[static_cast<size_t>(encoding)];
+    const int level = encoding == Encoding::GZIP ? settings.gzip_level : settings.brotli_quality;
+    if (!compressor || compressor->level() != level) {
+        compressor = std::make_unique<Compressor>(encoding, level);
+    } else {
+        compressor->reset();
+    }
+    out.clear();
+    return compressor->write(input, out, true);
+}
+
+// BodyCache implementation
+BodyCache::BodyCache(size_t slots) {
+    size_t size = 1;
+    while (size < slots) {
+        size <<= 1;
+    }
+    slots_ = std::make_unique<Slot[]>(size);
+    mask_ = size - 1;
+}
+
+BodyCache::Slot& BodyCache::slotFor(const void* owner, Encoding encoding) const {
+    // Fibonacci hashing; allocations are aligned, so the low bits say little
+    uint64_t key = reinterpret_cast<uintptr_t>(owner) ^ static_cast<uint64_t>(encoding);
+    key *= 0x9e3779b97f4a7c15ULL;
+    return slots_[(key >> 32) & mask_];
+}
+
+std::shared_ptr<const std::string> BodyCache::find(const std::shared_ptr<const void>& owner,
+                                                   Encoding encoding) const {
+    Slot& slot = slotFor(owner.get(), encoding);
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    if (slot.encoding != encoding || slot.owner.lock() != owner) {
+        return nullptr;
+    }
+    return slot.body;
+}
+
+void BodyCache::store(const std::shared_ptr<const void>& owner, Encoding encoding,
+                      std::shared_ptr<const std::string> body) {
+    Slot& slot = slotFor(owner.get(), encoding);
+    std::shared_ptr<const std::string> evicted;
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.owner = owner;
+        slot.encoding = encoding;
+        // Freed outside the lock
+        evicted = std::exchange(slot.body, std::move(body));
+    }
+}
+
+} // namespace compression
+} // namespace http_server
@@ -0,0 +1,152 @@
+#include "epoch.h"
+
+namespace http_server {
+
+// Releases the calling thread's record when the thread exits
+struct ThreadRecordHolder {
+    EpochDomain::ThreadRecord* record = nullptr;
+
+    ~ThreadRecordHolder() {
+        if (record) {
+            EpochDomain::instance().releaseRecord(record);
+        }
+    }
+};
+
+namespace {
+thread_local ThreadRecordHolder tls_record;
+} // namespace
+
+EpochDomain& EpochDomain::instance() {
+    static EpochDomain domain;
+    return domain;
+}
+
+EpochDomain::~EpochDomain() {
+    // Process teardown: no readers remain, free everything still pending
+    ThreadRecord* record = records_.load(std::memory_order_acquire);
+    while (record) {
+        for (const auto& item : record->retired) {
+            item.deleter(item.ptr);
+        }
+        ThreadRecord* next = record->next;
+        delete record;
+        record = next;
+    }
+}
+
+EpochDomain::ThreadRecord& EpochDomain::localRecord() {
+    if (!tls_record.record) {
+        tls_record.record = acquireRecord();
+    }
+    return *tls_record.record;
+}
+
+EpochDomain::ThreadRecord* EpochDomain::acquireRecord() {
+    // Reuse a record left behind by an exited thread, along with whatever it
+    // still had pending
+    for (ThreadRecord* record = records_.load(std::memory_order_acquire); record;
+         record = record->next) {
+        bool expected = false;
+        if (record->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            return record;
+        }
+    }
+
+    auto* record = new ThreadRecord();
+    record->in_use.store(true, std::memory_order_relaxed);
+    ThreadRecord* head = records_.load(std::memory_order_relaxed);
+    do {
+        record->next = head;
+    } while (!records_.compare_exchange_weak(head, record, std::memory_order_acq_rel));
+    return record;
+}
+
+void EpochDomain::releaseRecord(ThreadRecord* record) {
+    freeExpired(*record);
+    record->nesting = 0;
+    record->state.store(0, std::memory_order_release);
+    record->in_use.store(false, std::memory_order_release);
+}
+
+void EpochDomain::pin(ThreadRecord& record) {
+    if (record.nesting++ > 0) {
+        return;
+    }
+    uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+    record.state.store((epoch << 1) | 1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EpochDomain::unpin(ThreadRecord& record) {
+    if (--record.nesting > 0) {
+        return;
+    }
+    record.state.store(0, std::memory_order_release);
+}
+
+bool EpochDomain::tryAdvance() {
+    uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+
+    for (ThreadRecord* record = records_.load(std::memory_order_acquire); record;
+         record = record->next) {
+        uint64_t state = record->state.load(std::memory_order_seq_cst);
+        if ((state & 1) && (state >> 1) != epoch) {
+            return false;
+        }
+    }
+
+    return global_epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+}
+
+size_t EpochDomain::freeExpired(ThreadRecord& record) {
+    uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+    size_t freed = 0;
+
+    auto keep = record.retired.begin();
+    for (auto it = record.retired.begin(); it != record.retired.end(); ++it) {
+        if (it->epoch + 2 <= epoch) {
+            it->deleter(it->ptr);
+            ++freed;
+        } else {
+            *keep++ = *it;
+        }
+    }
+    record.retired.erase(keep, record.retired.end());
+
+    return freed;
+}
+
+void EpochDomain::retire(void* ptr, void (*deleter)(void*)) {
+    ThreadRecord& record = localRecord();
+    record.retired.push_back({ptr, deleter, global_epoch_.load(std::memory_order_seq_cst)});
+
+    if (record.retired.size() % kCollectInterval == 0) {
+        collect();
+    }
+}
+
+size_t EpochDomain::collect() {
+    ThreadRecord& record = localRecord();
+    // A pinned caller would stall the epoch on itself; just free what we can
+    if (record.nesting == 0) {
+        tryAdvance();
+    }
+    return freeExpired(record);
+}
+
+size_t EpochDomain::pendingRetired() const {
+    return tls_record.record ? tls_record.record->retired.size() : 0;
+}
+
+EpochDomain::Guard::Guard() {
+    EpochDomain& domain = instance();
+    domain.pin(domain.localRecord());
+}
+
+EpochDomain::Guard::~Guard() {
+    EpochDomain& domain = instance();
+    domain.unpin(domain.localRecord());
+}
+
+} // namespace http_server
@@ -0,0 +1,318 @@
+#include "health_check.h"
+#include "metrics.h"
+#include <algorithm>
+#include <charconv>
+#include <fcntl.h>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace http_server {
+
+namespace {
+
+// Everything read here is a line or two; /proc files report no size, so
+// read until EOF into a fixed buffer
+bool readFile(const std::string& path, std::string& out) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char buf[4096];
+    size_t used = 0;
+    ssize_t n;
+    while (used < sizeof(buf) && (n = ::read(fd, buf + used, sizeof(buf) - used)) > 0) {
+        used += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    out.assign(buf, used);
+    return used > 0;
+}
+
+std::vector<std::string_view> fields(std::string_view text) {
+    std::vector<std::string_view> out;
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && (text[i] == ' ' || text[i] == '\n')) {
+            ++i;
+        }
+        size_t start = i;
+        while (i < text.size() && text[i] != ' ' && text[i] != '\n') {
+            ++i;
+        }
+        if (i > start) {
+            out.push_back(text.substr(start, i - start));
+        }
+    }
+    return out;
+}
+
+template <typename T>
+bool parseNumber(std::string_view text, T& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+// A cgroup v1 "unlimited" is the largest page-aligned int64
+constexpr uint64_t kUnlimitedBytes = uint64_t{1} << 62;
+
+uint64_t readBytes(const std::string& path) {
+    std::string text;
+    uint64_t value = 0;
+    if (!readFile(path, text)) {
+        return 0;
+    }
+    auto parts = fields(text);
+    if (parts.empty() || !parseNumber(parts[0], value) || value >= kUnlimitedBytes) {
+        return 0;  // Includes v2's "max"
+    }
+    return value;
+}
+
+// CPU quota in cores: v2 cpu.max is "<quota> <period>" or "max <period>",
+// v1 has them in two files with -1 for no quota
+double readCpuLimit(const std::string& cgroup) {
+    std::string text;
+    int64_t quota = 0;
+    int64_t period = 0;
+    if (readFile(cgroup + "/cpu.max", text)) {
+        auto parts = fields(text);
+        if (parts.size() == 2 && parseNumber(parts[0], quota) && parseNumber(parts[1], period) &&
+            quota > 0 && period > 0) {
+            return static_cast<double>(quota) / static_cast<double>(period);
+        }
+        return 0;
+    }
+    std::string period_text;
+    if (readFile(cgroup + "/cpu/cpu.cfs_quota_us", text) &&
+        readFile(cgroup + "/cpu/cpu.cfs_period_us", period_text)) {
+        auto q = fields(text);
+        auto p = fields(period_text);
+        if (!q.empty() && !p.empty() && parseNumber(q[0], quota) && parseNumber(p[0], period) &&
+            quota > 0 && period > 0) {
+            return static_cast<double>(quota) / static_cast<double>(period);
+        }
+    }
+    return 0;
+}
+
+int64_t unixSeconds(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+}
+
+} // namespace
+
+HealthCheck::HealthCheck(std::chrono::milliseconds interval) : HealthCheck(interval, Paths{}) {}
+
+HealthCheck::HealthCheck(std::chrono::milliseconds interval, Paths paths)
+    : interval_(interval),
+      paths_(std::move(paths)),
+      startup_time_(std::chrono::system_clock::now()) {}
+
+HealthCheck::~HealthCheck() {
+    stop();
+}
+
+void HealthCheck::start() {
+    if (sampler_.joinable()) {
+        return;
+    }
+    sampleNow();
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stopping_ = false;
+    }
+    sampler_ = std::thread([this] {
+        std::unique_lock<std::mutex> lock(stop_mutex_);
+        while (!stop_cv_.wait_for(lock, interval_, [this] { return stopping_; })) {
+            lock.unlock();
+            sampleNow();
+            lock.lock();
+        }
+    });
+}
+
+void HealthCheck::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+    if (sampler_.joinable()) {
+        sampler_.join();
+    }
+}
+
+void HealthCheck::sampleNow() {
+    static const long kPageSize = ::sysconf(_SC_PAGESIZE);
+    static const long kTicksPerSecond = ::sysconf(_SC_CLK_TCK);
+
+    auto sample = std::make_shared<ProcessSample>();
+    sample->taken = std::chrono::system_clock::now();
+    const auto now = std::chrono::steady_clock::now();
+
+    std::string text;
+    // statm: size resident shared text lib data dt, in pages
+    if (readFile(paths_.proc_self + "/statm", text)) {
+        auto parts = fields(text);
+        uint64_t pages = 0;
+        if (parts.size() >= 2 && parseNumber(parts[0], pages)) {
+            sample->virtual_bytes = pages * static_cast<uint64_t>(kPageSize);
+        }
+        if (parts.size() >= 2 && parseNumber(parts[1], pages)) {
+            sample->rss_bytes = pages * static_cast<uint64_t>(kPageSize);
+        }
+    }
+    // stat: the command name may hold spaces and parentheses, so fields
+    // are counted from the last ')'; state is field 3, utime 14, stime 15
+    // and num_threads 20
+    if (readFile(paths_.proc_self + "/stat", text)) {
+        size_t close = text.rfind(')');
+        if (close != std::string::npos) {
+            auto parts = fields(std::string_view(text).substr(close + 1));
+            uint64_t utime = 0;
+            uint64_t stime = 0;
+            if (parts.size() >= 18 && parseNumber(parts[11], utime) && parseNumber(parts[12], stime)) {
+                sample->cpu_seconds = static_cast<double>(utime + stime) / static_cast<double>(kTicksPerSecond);
+            }
+            if (parts.size() >= 18) {
+                parseNumber(parts[17], sample->threads);
+            }
+        }
+    }
+
+    // cgroup v2 first; v1 keeps each controller in a directory of its own
+    sample->memory_limit_bytes = readBytes(paths_.cgroup + "/memory.max");
+    sample->memory_usage_bytes = readBytes(paths_.cgroup + "/memory.current");
+    if (sample->memory_usage_bytes == 0) {
+        sample->memory_limit_bytes = readBytes(paths_.cgroup + "/memory/memory.limit_in_bytes");
+        sample->memory_usage_bytes = readBytes(paths_.cgroup + "/memory/memory.usage_in_bytes");
+    }
+    sample->cpu_limit_cores = readCpuLimit(paths_.cgroup);
+
+    {
+        std::lock_guard<std::mutex> lock(sample_mutex_);
+        const double elapsed = std::chrono::duration<double>(now - last_sampled_).count();
+        if (last_sampled_ != std::chrono::steady_clock::time_point() && elapsed > 0) {
+            sample->cpu_percent = std::max(0.0, (sample->cpu_seconds - last_cpu_seconds_) / elapsed * 100);
+        }
+        last_cpu_seconds_ = sample->cpu_seconds;
+        last_sampled_ = now;
+    }
+    sample_.store(std::move(sample), std::memory_order_release);
+}
+
+const char* HealthCheck::notReadyReason() const {
+    switch (state()) {
+        case ServingState::RECOVERING: return "recovering";
+        case ServingState::DRAINING: return "draining";
+        case ServingState::FAILED: return "failed";
+        case ServingState::SERVING: break;
+    }
+    if (overloaded_ && overloaded_()) {
+        return "overloaded";
+    }
+    return nullptr;
+}
+
+bool HealthCheck::isReady() const {
+    return notReadyReason() == nullptr;
+}
+
+int64_t HealthCheck::getCurrentTimestamp() const {
+    return unixSeconds(std::chrono::system_clock::now());
+}
+
+double HealthCheck::getUptimeSeconds() const {
+    return std::chrono::duration<double>(std::chrono::system_clock::now() - startup_time_).count();
+}
+
+Json::Value HealthCheck::getHealthStatus() const {
+    Json::Value response;
+    response["status"] = isLive() ? "healthy" : "unhealthy";
+    response["timestamp"] = static_cast<Json::Int64>(getCurrentTimestamp());
+    response["uptime_seconds"] = getUptimeSeconds();
+    return response;
+}
+
+Json::Value HealthCheck::getReadinessStatus() const {
+    Json::Value response;
+    const char* reason = notReadyReason();
+    response["status"] = reason ? "not_ready" : "ready";
+    if (reason) {
+        response["reason"] = reason;
+    }
+    response["timestamp"] = static_cast<Json::Int64>(getCurrentTimestamp());
+    return response;
+}
+
+Json::Value HealthCheck::getLivenessStatus() const {
+    Json::Value response;
+    response["status"] = isLive() ? "alive" : "failed";
+    response["timestamp"] = static_cast<Json::Int64>(getCurrentTimestamp());
+    response["uptime_seconds"] = getUptimeSeconds();
+    return response;
+}
+
+Json::Value HealthCheck::getMemoryInfo() const {
+    Json::Value memory;
+    auto sample = latest();
+    if (!sample) {
+        return memory;
+    }
+    memory["rss_bytes"] = static_cast<Json::UInt64>(sample->rss_bytes);
+    memory["virtual_bytes"] = static_cast<Json::UInt64>(sample->virtual_bytes);
+    if (sample->memory_limit_bytes > 0) {
+        memory["limit_bytes"] = static_cast<Json::UInt64>(sample->memory_limit_bytes);
+    }
+    if (sample->memory_usage_bytes > 0) {
+        memory["cgroup_usage_bytes"] = static_cast<Json::UInt64>(sample->memory_usage_bytes);
+    }
+    return memory;
+}
+
+Json::Value HealthCheck::getCpuInfo() const {
+    Json::Value cpu;
+    auto sample = latest();
+    if (!sample) {
+        return cpu;
+    }
+    cpu["seconds"] = sample->cpu_seconds;
+    cpu["percent"] = sample->cpu_percent;
+    cpu["threads"] = sample->threads;
+    if (sample->cpu_limit_cores > 0) {
+        cpu["limit_cores"] = sample->cpu_limit_cores;
+    }
+    return cpu;
+}
+
+Json::Value HealthCheck::getSystemMetrics() const {
+    Json::Value response;
+    response["timestamp"] = static_cast<Json::Int64>(getCurrentTimestamp());
+    response["uptime_seconds"] = getUptimeSeconds();
+    if (auto sample = latest()) {
+        response["sampled_at"] = static_cast<Json::Int64>(unixSeconds(sample->taken));
+    }
+    response["memory"] = getMemoryInfo();
+    response["cpu"] = getCpuInfo();
+    return response;
+}
+
+void HealthCheck::appendPrometheus(std::string& out) const {
+    auto sample = latest();
+    if (!sample) {
+        return;
+    }
+    metrics::appendHelp(out, "process_resident_memory_bytes", "gauge", "Resident memory size in bytes");
+    metrics::appendSample(out, "process_resident_memory_bytes", "", sample->rss_bytes);
+    metrics::appendHelp(out, "process_virtual_memory_bytes", "gauge", "Virtual memory size in bytes");
+    metrics::appendSample(out, "process_virtual_memory_bytes", "", sample->virtual_bytes);
+    metrics::appendHelp(out, "process_cpu_seconds_total", "counter", "User and system CPU time spent");
+    metrics::appendSample(out, "process_cpu_seconds_total", "", sample->cpu_seconds);
+    metrics::appendHelp(out, "process_threads", "gauge", "Threads in the process");
+    metrics::appendSample(out, "process_threads", "", static_cast<uint64_t>(sample->threads));
+    metrics::appendHelp(out, "process_start_time_seconds", "gauge", "Start time since the epoch in seconds");
+    metrics::appendSample(out, "process_start_time_seconds", "", static_cast<uint64_t>(unixSeconds(startup_time_)));
+}
+
+} // namespace http_server
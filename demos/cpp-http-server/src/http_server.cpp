@@ -0,0 +1,1570 @@
+#include "http_server.h"
+#include "json_utils.h"
+#include "json_writer.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace http_server {
+
+namespace {
+
+constexpr const char* kLivePath = "/health/live";
+constexpr const char* kReadyPath = "/health/ready";
+constexpr const char* kSystemMetricsPath = "/health/metrics";
+
+constexpr size_t kExportPageSize = 256;
+constexpr size_t kStreamBlockSize = 64 * 1024;
+constexpr size_t kEventBatchSize = 256;
+
+unsigned int resolveThreadPoolSize(unsigned int requested) {
+    if (requested > 0) {
+        return requested;
+    }
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+// MHD hands us the query already split and decoded, in strings it keeps
+// for the whole request; the parameters are viewed in place
+MHD_Result collectQueryArgument(void* cls, enum MHD_ValueKind /*kind*/,
+                                const char* key, const char* value) {
+    if (key && value) {
+        static_cast<routing::QueryParams*>(cls)->set(key, value);
+    }
+    return MHD_YES;
+}
+
+// Idle ConnectionInfo objects, kept per thread so a steady stream of
+// requests reuses their arenas instead of going back to malloc
+class ConnectionPool {
+public:
+    static constexpr size_t kMaxIdle = 64;
+
+    ConnectionPool() { idle_.reserve(kMaxIdle); }
+
+    ConnectionInfo* acquire() {
+        if (idle_.empty()) {
+            return new ConnectionInfo();
+        }
+        ConnectionInfo* info = idle_.back().release();
+        idle_.pop_back();
+        return info;
+    }
+
+    void recycle(ConnectionInfo* info) {
+        if (idle_.size() >= kMaxIdle) {
+            delete info;
+            return;
+        }
+        info->reset();
+        idle_.emplace_back(info);
+    }
+
+private:
+    std::vector<std::unique_ptr<ConnectionInfo>> idle_;
+};
+
+ConnectionPool& connectionPool() {
+    thread_local ConnectionPool pool;
+    return pool;
+}
+
+// Declared body size, when it fits under the limit; lets the body buffer
+// be sized once instead of growing chunk by chunk
+size_t expectedBodySize(struct MHD_Connection* connection, size_t limit) {
+    const char* value = MHD_lookup_connection_value(connection, MHD_HEADER_KIND,
+                                                    MHD_HTTP_HEADER_CONTENT_LENGTH);
+    if (!value) {
+        return 0;
+    }
+    size_t size = 0;
+    const char* end = value + std::strlen(value);
+    auto result = std::from_chars(value, end, size);
+    return result.ec == std::errc() && result.ptr == end && size <= limit ? size : 0;
+}
+
+// Per-thread scratch buffer for serialized responses; MHD copies out of it,
+// so it is safe to reuse (and keep its capacity) for the next request
+std::string& responseBuffer() {
+    thread_local std::string buffer;
+    buffer.clear();
+    return buffer;
+}
+
+void releaseSharedBody(void* cls) {
+    delete static_cast<std::shared_ptr<const std::string>*>(cls);
+}
+
+#if MHD_VERSION < 0x00097302
+ssize_t readSharedBody(void* cls, uint64_t pos, char* buf, size_t max) {
+    const std::string& body = **static_cast<std::shared_ptr<const std::string>*>(cls);
+    if (pos >= body.size()) {
+        return MHD_CONTENT_READER_END_OF_STREAM;
+    }
+    size_t n = std::min<size_t>(max, body.size() - pos);
+    std::memcpy(buf, body.data() + pos, n);
+    return static_cast<ssize_t>(n);
+}
+#endif
+
+// Export cursor; each refill takes one keyset page, so memory stays at one
+// page of rendered lines however large the store is. Tasks written while the
+// export runs may or may not be included.
+// Compressed exports run their own compressor: the stream outlives any one
+// callback, and one pool thread may be serving several exports at once.
+struct ExportStream {
+    const TaskManager* manager = nullptr;
+    const ChangeFeed* feed = nullptr;
+    uint64_t cursor = 0;
+    uint64_t count = 0;
+    bool done = false;
+    std::string pending;
+    size_t offset = 0;
+    std::unique_ptr<compression::Compressor> compressor;
+    std::string lines;  // Uncompressed page, when compressing
+};
+
+ssize_t readExport(void* cls, uint64_t /*pos*/, char* buf, size_t max) {
+    auto* stream = static_cast<ExportStream*>(cls);
+    while (stream->offset == stream->pending.size()) {
+        if (stream->done) {
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        }
+        TaskPage page = stream->manager->getTasksAfter(stream->cursor, kExportPageSize);
+        stream->pending.clear();
+        stream->offset = 0;
+        std::string& lines = stream->compressor ? stream->lines : stream->pending;
+        lines.clear();
+        for (const auto& task : page.tasks) {
+            lines.append(task->cached_json);
+            lines.push_back('\n');
+        }
+        stream->count += page.tasks.size();
+        stream->cursor = page.next_cursor;
+        stream->done = page.next_cursor == 0;
+        if (stream->done) {
+            // Lets a reader tell a complete export from one cut off at a
+            // line boundary. Read after the last page, so every change the
+            // export reflects is at or below seq.
+            lines.append("{\"count\":");
+            json_writer::appendUInt(lines, stream->count);
+            lines.append(",\"end\":true,\"seq\":");
+            json_writer::appendUInt(lines, stream->feed->reserved());
+            lines.append("}\n");
+        }
+        // A page may compress to nothing yet; the loop then takes the next
+        if (stream->compressor && !stream->compressor->write(lines, stream->pending, stream->done)) {
+            return MHD_CONTENT_READER_END_WITH_ERROR;
+        }
+    }
+
+    size_t n = std::min(max, stream->pending.size() - stream->offset);
+    std::memcpy(buf, stream->pending.data() + stream->offset, n);
+    stream->offset += n;
+    return static_cast<ssize_t>(n);
+}
+
+void releaseExport(void* cls) {
+    delete static_cast<ExportStream*>(cls);
+}
+
+// Weak validators: compressed and identity bodies share them. A task's
+// changes with every version; updated_at keeps tags from an in-memory
+// store that restarted from id 1 distinct from the old ones.
+std::string taskEtag(const Task& task) {
+    std::string etag = "W/\"";
+    json_writer::appendUInt(etag, task.version);
+    etag.push_back('-');
+    json_writer::appendUInt(etag, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        task.updated_at.time_since_epoch()).count()));
+    etag.push_back('"');
+    return etag;
+}
+
+// Lists are tagged with the store generation; the URL (filters, page)
+// is part of the cache key already
+std::string listEtag(uint64_t generation) {
+    std::string etag = "W/\"g";
+    json_writer::appendUInt(etag, generation);
+    etag.push_back('"');
+    return etag;
+}
+
+// If-None-Match uses the weak comparison: W/ prefixes are ignored
+bool etagListMatches(const char* header, std::string_view etag) {
+    if (!header) {
+        return false;
+    }
+    auto opaque = [](std::string_view tag) {
+        return tag.starts_with("W/") ? tag.substr(2) : tag;
+    };
+    std::string_view wanted = opaque(etag);
+    std::string_view rest(header);
+    while (!rest.empty()) {
+        size_t comma = rest.find(',');
+        std::string_view tag = rest.substr(0, comma);
+        rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+        while (!tag.empty() && tag.front() == ' ') tag.remove_prefix(1);
+        while (!tag.empty() && tag.back() == ' ') tag.remove_suffix(1);
+        if (tag == "*" || opaque(tag) == wanted) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Status of the response most recently queued on this thread, so the
+// request handler can label its metrics without threading it through
+// every route handler
+thread_local int t_queued_status = 0;
+
+// Per-item entries of a batch response, keys in sorted order like the rest
+void appendItemError(std::string& out, int status, const std::string& message,
+                     const std::string& field = "", uint64_t id = 0) {
+    out.append("{\"error\":");
+    json_writer::appendString(out, message);
+    if (!field.empty()) {
+        out.append(",\"field\":");
+        json_writer::appendString(out, field);
+    }
+    if (id != 0) {
+        out.append(",\"id\":");
+        json_writer::appendUInt(out, id);
+    }
+    out.append(",\"status\":");
+    json_writer::appendUInt(out, static_cast<uint64_t>(status));
+    out.push_back('}');
+}
+
+void appendItemTask(std::string& out, int status, const TaskPtr& task) {
+    out.append("{\"status\":");
+    json_writer::appendUInt(out, static_cast<uint64_t>(status));
+    out.append(",\"task\":");
+    out.append(task->cached_json);
+    out.push_back('}');
+}
+
+} // namespace
+
+// Event streams that have caught up with the change feed. In the pool
+// threading mode they are suspended, so waiting clients hold no worker
+// thread: every publish resumes them, and a ticker resumes them once per
+// heartbeat interval so idle streams stay open. Thread-per-connection mode
+// cannot suspend; there each stream waits on the feed in its own thread.
+class EventStreams {
+public:
+    EventStreams(const ChangeFeed& feed, bool can_suspend, std::chrono::seconds heartbeat)
+        : feed_(feed), can_suspend_(can_suspend), heartbeat_(std::max(heartbeat, std::chrono::seconds(1))) {}
+
+    ~EventStreams() { stop(); }
+
+    const ChangeFeed& feed() const { return feed_; }
+    bool canSuspend() const { return can_suspend_; }
+    std::chrono::seconds heartbeat() const { return heartbeat_; }
+    bool stopping() const { return stopping_.load(); }
+
+    void start() {
+        stopping_ = false;
+        if (can_suspend_) {
+            ticker_ = std::thread([this] { tick(); });
+        }
+    }
+
+    // Resumes every parked stream so they see stopping() and end
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ticked_.notify_all();
+        if (ticker_.joinable()) {
+            ticker_.join();
+        }
+        wakeAll();
+    }
+
+    // Suspends the connection until the next publish or tick. False, and
+    // nothing suspended, if the feed already moved past cursor or the
+    // server is stopping; the caller then reads again.
+    bool park(struct MHD_Connection* connection, uint64_t cursor) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return false;
+        }
+        // Announce first, then re-check: a publisher stores latest before
+        // reading parked_count_, so one of the two sees the other
+        parked_count_.fetch_add(1);
+        if (feed_.latest() > cursor) {
+            parked_count_.fetch_sub(1);
+            return false;
+        }
+        MHD_suspend_connection(connection);
+        parked_.push_back(connection);
+        return true;
+    }
+
+    // The feed's listener: runs on every write, so it is one atomic load
+    // unless someone is parked
+    void wakeAll() {
+        if (parked_count_.load() == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto* connection : parked_) {
+            MHD_resume_connection(connection);
+        }
+        parked_count_.fetch_sub(parked_.size());
+        parked_.clear();
+    }
+
+private:
+    void tick() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            ticked_.wait_for(lock, heartbeat_);
+            lock.unlock();
+            wakeAll();
+            lock.lock();
+        }
+    }
+
+    const ChangeFeed& feed_;
+    const bool can_suspend_;
+    const std::chrono::seconds heartbeat_;
+    std::mutex mutex_;
+    std::condition_variable ticked_;
+    std::vector<struct MHD_Connection*> parked_;
+    std::atomic<size_t> parked_count_{0};
+    std::atomic<bool> stopping_{false};
+    std::thread ticker_;
+};
+
+namespace {
+
+// One SSE response. Events are framed as
+//   id: <seq>\nevent: put|delete\ndata: <json>\n\n
+// and a reader whose position fell off the ring gets an "event: resync"
+// carrying the newest seq as its id: reload the tasks, then keep reading,
+// since later events (possibly already in the reload) follow on this stream.
+struct EventStream {
+    EventStreams* streams = nullptr;
+    struct MHD_Connection* connection = nullptr;
+    uint64_t cursor = 0;
+    std::string pending;
+    size_t offset = 0;
+    std::chrono::steady_clock::time_point last_write;
+};
+
+void appendEvent(std::string& out, const ChangeEvent& event) {
+    out.append("id: ");
+    json_writer::appendUInt(out, event.seq);
+    if (event.kind == ChangeKind::PUT) {
+        out.append("\nevent: put\ndata: {\"op\":\"put\",\"published_us\":");
+        json_writer::appendUInt(out, static_cast<uint64_t>(event.published_us));
+        out.append(",\"seq\":");
+        json_writer::appendUInt(out, event.seq);
+        out.append(",\"task\":");
+        out.append(event.task->cached_json);
+    } else {
+        out.append("\nevent: delete\ndata: {\"id\":");
+        json_writer::appendUInt(out, event.id);
+        out.append(",\"op\":\"delete\",\"published_us\":");
+        json_writer::appendUInt(out, static_cast<uint64_t>(event.published_us));
+        out.append(",\"seq\":");
+        json_writer::appendUInt(out, event.seq);
+    }
+    out.append("}\n\n");
+}
+
+void appendResync(std::string& out, uint64_t latest) {
+    out.append("id: ");
+    json_writer::appendUInt(out, latest);
+    out.append("\nevent: resync\ndata: {\"latest_seq\":");
+    json_writer::appendUInt(out, latest);
+    out.append(",\"op\":\"resync\"}\n\n");
+}
+
+ssize_t readEvents(void* cls, uint64_t /*pos*/, char* buf, size_t max) {
+    auto* stream = static_cast<EventStream*>(cls);
+    EventStreams& streams = *stream->streams;
+    while (stream->offset == stream->pending.size()) {
+        if (streams.stopping()) {
+            return MHD_CONTENT_READER_END_OF_STREAM;
+        }
+        stream->pending.clear();
+        stream->offset = 0;
+
+        ChangeBatch batch = streams.feed().read(stream->cursor, kEventBatchSize);
+        if (batch.resync) {
+            appendResync(stream->pending, batch.latest);
+            stream->cursor = batch.latest;
+            break;
+        }
+        if (!batch.events.empty()) {
+            for (const auto& event : batch.events) {
+                appendEvent(stream->pending, event);
+            }
+            stream->cursor = batch.events.back().seq;
+            break;
+        }
+        // Caught up. Ticks come once per interval, so half of it idle is
+        // enough to owe the client a heartbeat.
+        auto now = std::chrono::steady_clock::now();
+        if (now - stream->last_write >= streams.heartbeat() / 2) {
+            stream->pending.append(":\n\n");
+            break;
+        }
+        if (streams.canSuspend()) {
+            if (streams.park(stream->connection, stream->cursor)) {
+                // Called again once resumed
+                return 0;
+            }
+        } else {
+            streams.feed().waitForNewer(stream->cursor, std::chrono::milliseconds(500));
+        }
+    }
+
+    size_t n = std::min(max, stream->pending.size() - stream->offset);
+    std::memcpy(buf, stream->pending.data() + stream->offset, n);
+    stream->offset += n;
+    stream->last_write = std::chrono::steady_clock::now();
+    return static_cast<ssize_t>(n);
+}
+
+void releaseEvents(void* cls) {
+    delete static_cast<EventStream*>(cls);
+}
+
+} // namespace
+
+HttpServer::HttpServer(int port) : HttpServer(ServerConfig{port}) {}
+
+HttpServer::HttpServer(const ServerConfig& config)
+    : config_(config),
+      port_(config.port),
+      nodes_(config.listener_layout == ListenerLayout::SINGLE ? std::vector<topology::Node>{}
+                                                             : topology::discoverNodes()),
+      task_manager_(std::make_unique<TaskManager>(config.task_shards, std::max<size_t>(nodes_.size(), 1))),
+      request_metrics_(std::make_unique<metrics::RequestMetrics>()),
+      change_feed_(std::make_unique<ChangeFeed>(config.change_feed_capacity)),
+      event_streams_(std::make_unique<EventStreams>(
+          *change_feed_, config.threading_mode != ThreadingMode::THREAD_PER_CONNECTION,
+          std::chrono::seconds(config.event_heartbeat_seconds))),
+      admission_(std::make_unique<admission::Controller>(config.admission)),
+      tracer_(std::make_unique<trace::Tracer>(config.tracing)),
+      body_cache_(std::make_unique<compression::BodyCache>()),
+      health_(std::make_unique<HealthCheck>(std::chrono::milliseconds(config.health_sample_interval_ms))) {
+    planListeners();
+    change_feed_->setListener([streams = event_streams_.get()] { streams->wakeAll(); });
+    health_->setOverloadCheck([admission = admission_.get()] { return admission->saturated(); });
+    if (!config_.replication.host.empty()) {
+        // The replica's own feed republishes what it applies, so event
+        // streams and chained replicas work against it as well
+        task_manager_->setChangeFeed(change_feed_.get());
+        follower_ = std::make_unique<replication::Follower>(*task_manager_, config_.replication);
+        health_->setState(ServingState::RECOVERING);
+        follower_->setSyncListener([health = health_.get()](bool synced) {
+            if (synced) {
+                health->advanceState(ServingState::RECOVERING, ServingState::SERVING);
+            } else {
+                health->advanceState(ServingState::SERVING, ServingState::RECOVERING);
+            }
+        });
+    } else if (!config_.data_dir.empty()) {
+        PersistenceConfig persistence;
+        persistence.data_dir = config_.data_dir;
+        persistence.sync_interval = std::chrono::milliseconds(config_.wal_sync_interval_ms);
+        persistence.wait_for_sync = config_.wal_wait_for_sync;
+        persistence.snapshot_every = config_.snapshot_every;
+        persistence_ = std::make_unique<Persistence>(persistence);
+        persistence_->setFailureListener([health = health_.get()] { health->setState(ServingState::FAILED); });
+        // Replayed by start(), so probes are answered while it runs
+        health_->setState(ServingState::RECOVERING);
+    } else {
+        task_manager_->setChangeFeed(change_feed_.get());
+    }
+}
+
+HttpServer::~HttpServer() {
+    stop();
+}
+
+void HttpServer::recoverStore() {
+    try {
+        Persistence::RecoveryStats stats = persistence_->recover(*task_manager_);
+        std::cout << "Recovered " << task_manager_->getTaskCount() << " tasks from " << config_.data_dir
+                  << " (" << stats.snapshot_tasks << " from snapshot, " << stats.replayed_records
+                  << " log records) in " << stats.seconds << "s" << std::endl;
+        if (!persistence_->start(*task_manager_)) {
+            std::cerr << "Cannot open the write-ahead log in " << config_.data_dir << std::endl;
+            health_->setState(ServingState::FAILED);
+            return;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Recovery of " << config_.data_dir << " failed: " << e.what() << std::endl;
+        health_->setState(ServingState::FAILED);
+        return;
+    }
+    // Attached after recovery, which the feed has no use for. Requests
+    // that change the store are only admitted once the state says SERVING,
+    // which publishes this; a shutdown that began meanwhile keeps DRAINING.
+    task_manager_->setChangeFeed(change_feed_.get());
+    health_->advanceState(ServingState::RECOVERING, ServingState::SERVING);
+}
+
+void HttpServer::planListeners() {
+    switch (config_.listener_layout) {
+        case ListenerLayout::SINGLE:
+            listeners_.push_back({this, 0, {}, resolveThreadPoolSize(config_.thread_pool_size)});
+            break;
+        case ListenerLayout::PER_NODE:
+            for (size_t n = 0; n < nodes_.size(); ++n) {
+                // An explicit pool size is split between the nodes
+                const unsigned int threads =
+                    config_.thread_pool_size > 0
+                        ? std::max(1u, config_.thread_pool_size / static_cast<unsigned int>(nodes_.size()))
+                        : static_cast<unsigned int>(nodes_[n].cpus.size());
+                listeners_.push_back({this, n, nodes_[n].cpus, threads});
+            }
+            break;
+        case ListenerLayout::PER_CORE:
+            for (size_t n = 0; n < nodes_.size(); ++n) {
+                for (int cpu : nodes_[n].cpus) {
+                    listeners_.push_back({this, n, {cpu}, 1});
+                }
+            }
+            break;
+    }
+    // No CPUs found to pin to
+    if (listeners_.empty()) {
+        listeners_.push_back({this, 0, {}, resolveThreadPoolSize(config_.thread_pool_size)});
+    }
+}
+
+bool HttpServer::startListener(Listener& listener) {
+    // ITC lets shutdown() quiesce the daemon while its threads run on
+    unsigned int flags = MHD_USE_ERROR_LOG | MHD_USE_ITC;
+    std::vector<MHD_OptionItem> options;
+
+    options.push_back({MHD_OPTION_CONNECTION_LIMIT, config_.connection_limit, nullptr});
+    options.push_back({MHD_OPTION_CONNECTION_TIMEOUT, config_.connection_timeout_seconds, nullptr});
+    // Several listeners in this process share the port the same way
+    if (config_.reuse_port || listeners_.size() > 1) {
+        options.push_back({MHD_OPTION_LISTENING_ADDRESS_REUSE, 1, nullptr});
+    }
+    options.push_back({MHD_OPTION_NOTIFY_COMPLETED,
+                       reinterpret_cast<intptr_t>(&HttpServer::requestCompleted), &listener});
+
+    if (config_.threading_mode == ThreadingMode::THREAD_PER_CONNECTION) {
+        flags |= MHD_USE_THREAD_PER_CONNECTION | MHD_USE_INTERNAL_POLLING_THREAD;
+    } else {
+        // Suspend/resume parks idle event streams off the worker threads
+        flags |= MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_EPOLL | MHD_ALLOW_SUSPEND_RESUME;
+        options.push_back({MHD_OPTION_THREAD_POOL_SIZE, listener.threads, nullptr});
+    }
+    options.push_back({MHD_OPTION_END, 0, nullptr});
+
+    std::optional<topology::ScopedAffinity> pinned;
+    if (!listener.cpus.empty()) {
+        pinned.emplace(listener.cpus);
+        if (!pinned->pinned()) {
+            std::cerr << "Cannot pin listener threads; they run unpinned" << std::endl;
+        }
+    }
+    listener.daemon = MHD_start_daemon(flags, static_cast<uint16_t>(port_),
+                                       nullptr, nullptr,
+                                       &HttpServer::requestHandler, &listener,
+                                       MHD_OPTION_ARRAY, options.data(),
+                                       MHD_OPTION_END);
+    return listener.daemon != nullptr;
+}
+
+bool HttpServer::start() {
+    if (isRunning()) {
+        return true;
+    }
+
+    // A restart after stop() reopens the log of the store already loaded
+    const bool recover = persistence_ && health_->state() == ServingState::RECOVERING;
+    if (persistence_ && !recover && !persistence_->start(*task_manager_)) {
+        return false;
+    }
+
+    health_->start();
+    event_streams_->start();
+    // Thread-per-connection requests can wait in their own thread instead
+    if (event_streams_->canSuspend()) {
+        admission_->startQueue([](void* waiter, bool acquired) {
+            auto* info = static_cast<ConnectionInfo*>(waiter);
+            info->holds_slot = acquired;
+            info->slot_wait = acquired ? ConnectionInfo::SlotWait::ACQUIRED : ConnectionInfo::SlotWait::REFUSED;
+            MHD_resume_connection(info->connection);
+        });
+    }
+    for (Listener& listener : listeners_) {
+        if (startListener(listener)) {
+            continue;
+        }
+        std::cerr << "Failed to start HTTP server on port " << port_ << std::endl;
+        event_streams_->stop();
+        admission_->stopQueue();
+        for (Listener& started : listeners_) {
+            if (started.daemon) {
+                MHD_stop_daemon(started.daemon);
+                started.daemon = nullptr;
+            }
+        }
+        health_->stop();
+        if (persistence_ && !recover) {
+            persistence_->stop();
+        }
+        return false;
+    }
+
+    if (recover) {
+        recovery_ = std::thread([this] { recoverStore(); });
+    }
+    if (follower_) {
+        follower_->start();
+    }
+    // Restarted after shutdown()
+    health_->advanceState(ServingState::DRAINING, ServingState::SERVING);
+    return true;
+}
+
+void HttpServer::stop() {
+    if (isRunning()) {
+        // Open event streams and queued requests end first; MHD cannot stop
+        // with suspended ones
+        event_streams_->stop();
+        admission_->stopQueue();
+        for (Listener& listener : listeners_) {
+            MHD_stop_daemon(listener.daemon);
+            listener.daemon = nullptr;
+        }
+    }
+    if (follower_) {
+        follower_->stop();
+    }
+    // A replay cannot be cut short; shutting down waits for it
+    if (recovery_.joinable()) {
+        recovery_.join();
+    }
+    // No request can write any more; sync the log tail
+    if (persistence_) {
+        persistence_->stop();
+    }
+    health_->stop();
+}
+
+bool HttpServer::shutdown(std::chrono::milliseconds drain_timeout) {
+    if (!isRunning()) {
+        stop();
+        return true;
+    }
+    health_->setState(ServingState::DRAINING);
+    // Stop accepting. Closing the sockets now, rather than with the
+    // daemons, sends every new connection to a process sharing the port
+    // (reuse_port) instead of queueing it here; closing them also resets
+    // those already in their accept queues.
+    for (Listener& listener : listeners_) {
+        MHD_socket socket = MHD_quiesce_daemon(listener.daemon);
+        if (socket != MHD_INVALID_SOCKET) {
+            ::close(socket);
+        }
+    }
+    // Event streams never finish by themselves
+    event_streams_->stop();
+
+    const auto deadline = std::chrono::steady_clock::now() + drain_timeout;
+    while (activeRequests() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    const bool drained = activeRequests() == 0;
+    stop();
+    return drained;
+}
+
+bool HttpServer::isRunning() const {
+    return listeners_.front().daemon != nullptr;
+}
+
+ConnectionInfo::ConnectionInfo()
+    : arena(inline_arena_, sizeof(inline_arena_)), post_data(&arena) {}
+
+void ConnectionInfo::reset() {
+    importer.reset();
+    // Swap with a fresh string so nothing still points into the arena
+    std::pmr::string(&arena).swap(post_data);
+    data_size = 0;
+    arena.release();
+}
+
+MHD_Result HttpServer::requestHandler(void* cls, struct MHD_Connection* connection,
+                                      const char* url, const char* method,
+                                      const char* /*version*/, const char* upload_data,
+                                      size_t* upload_data_size, void** con_cls) {
+    auto* listener = static_cast<Listener*>(cls);
+    HttpServer* server = listener->server;
+    // Creates, imports included, fill the partition of this node
+    TaskManager::setHomePartition(listener->partition);
+
+    // First call for a request: only the headers are available
+    if (*con_cls == nullptr) {
+        const auto started = std::chrono::steady_clock::now();
+        const metrics::Method method_kind = routing::methodOf(method);
+        const routing::Target target = routing::resolve(method_kind, url);
+        const metrics::Route route = target.route;
+        // A replica's store only changes through the follower
+        if (server->follower_ && route != metrics::Route::HEALTH && route != metrics::Route::METRICS &&
+            method_kind != metrics::Method::GET && std::strcmp(method, MHD_HTTP_METHOD_HEAD) != 0) {
+            t_queued_status = 0;
+            MHD_Result result = server->sendToPrimary(connection, url);
+            server->request_metrics_->record(route, method_kind, t_queued_status,
+                                             std::chrono::steady_clock::now() - started);
+            return result;
+        }
+        // Until the store is recovered only the probes and metrics answer
+        if (route != metrics::Route::HEALTH && route != metrics::Route::METRICS &&
+            !server->health_->acceptsRequests()) {
+            t_queued_status = 0;
+            MHD_Result result = server->sendUnavailable(connection);
+            server->request_metrics_->record(route, method_kind, t_queued_status,
+                                             std::chrono::steady_clock::now() - started);
+            return result;
+        }
+        bool holds_slot = false;
+        bool queued = false;
+        if (server->admission_->enabled()) {
+            const union MHD_ConnectionInfo* address =
+                MHD_get_connection_info(connection, MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+            admission::Decision decision = server->admission_->admit(
+                route, admission::clientKey(address ? address->client_addr : nullptr), holds_slot);
+            queued = decision.verdict == admission::Verdict::QUEUED;
+            if (decision.verdict != admission::Verdict::ADMIT && !queued) {
+                // Answered now, so an upload is never read; there is no
+                // per-request state for requestCompleted to recycle
+                t_queued_status = 0;
+                MHD_Result result = server->sendRejection(connection, decision);
+                server->request_metrics_->record(route, method_kind, t_queued_status,
+                                                 std::chrono::steady_clock::now() - started);
+                return result;
+            }
+        }
+
+        ConnectionInfo* info = connectionPool().acquire();
+        server->active_requests_.fetch_add(1, std::memory_order_acq_rel);
+        info->started = started;
+        info->route = route;
+        info->method = method_kind;
+        info->target = target;
+        info->holds_slot = holds_slot;
+        info->slot_wait = ConnectionInfo::SlotWait::NONE;
+        info->connection = connection;
+        if (server->tracer_->sample()) {
+            if (!info->trace) {
+                info->trace = std::make_unique<trace::RequestTrace>();
+            }
+            info->trace->begin(started);
+        }
+        if (target.handler == routing::Handler::IMPORT) {
+            // max_body_size bounds each line rather than the whole upload
+            info->importer = std::make_unique<NdjsonImporter>(*server->task_manager_,
+                                                              server->config_.max_body_size);
+        } else {
+            info->post_data.reserve(expectedBodySize(connection, server->config_.max_body_size));
+        }
+        *con_cls = info;
+        if (queued) {
+            // Suspended rather than blocking this worker; the headers call
+            // comes again once the limiter's waker resumes it
+            info->slot_wait = ConnectionInfo::SlotWait::WAITING;
+            switch (server->admission_->enqueue(info, [connection] { MHD_suspend_connection(connection); })) {
+                case admission::ConcurrencyLimiter::Queued::QUEUED:
+                    return MHD_YES;
+                case admission::ConcurrencyLimiter::Queued::ACQUIRED:
+                    info->holds_slot = true;
+                    info->slot_wait = ConnectionInfo::SlotWait::NONE;
+                    break;
+                case admission::ConcurrencyLimiter::Queued::REFUSED:
+                    info->slot_wait = ConnectionInfo::SlotWait::REFUSED;
+                    break;
+            }
+        }
+        if (info->slot_wait == ConnectionInfo::SlotWait::NONE) {
+            return MHD_YES;
+        }
+    }
+
+    auto* info = static_cast<ConnectionInfo*>(*con_cls);
+    if (info->slot_wait != ConnectionInfo::SlotWait::NONE) {
+        // Still the headers call, so a refusal means the upload is never read
+        const bool acquired = info->slot_wait == ConnectionInfo::SlotWait::ACQUIRED;
+        info->slot_wait = ConnectionInfo::SlotWait::NONE;
+        if (acquired) {
+            return MHD_YES;
+        }
+        // Turned away like a rejection at admission, which is never traced
+        if (info->trace) {
+            info->trace->end();
+        }
+        t_queued_status = 0;
+        MHD_Result result = server->sendRejection(connection, {admission::Verdict::OVERLOADED, 0});
+        server->request_metrics_->record(info->route, info->method, t_queued_status,
+                                         std::chrono::steady_clock::now() - info->started);
+        return result;
+    }
+    trace::Activation traced(info->trace.get());
+
+    if (*upload_data_size != 0) {
+        if (info->importer) {
+            info->importer->feed(upload_data, *upload_data_size);
+        } else {
+            // Accumulate the request body
+            info->data_size += *upload_data_size;
+            if (info->data_size <= server->config_.max_body_size) {
+                info->post_data.append(upload_data, *upload_data_size);
+            }
+        }
+        *upload_data_size = 0;
+        return MHD_YES;
+    }
+
+    t_queued_status = 0;
+    MHD_Result result = server->respond(connection, url, *info);
+    const auto responded = std::chrono::steady_clock::now();
+    if (info->trace) {
+        info->trace->responded(t_queued_status, responded);
+    }
+    server->request_metrics_->record(info->route, info->method, t_queued_status,
+                                     responded - info->started);
+    return result;
+}
+
+MHD_Result HttpServer::respond(struct MHD_Connection* connection, const char* url, ConnectionInfo& info) {
+    if (info.importer) {
+        try {
+            return handleImport(connection, *info.importer);
+        } catch (const std::exception& e) {
+            std::cerr << "Import error: " << e.what() << std::endl;
+            return sendErrorResponse(connection, MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                     "Internal server error");
+        }
+    }
+
+    if (info.data_size > config_.max_body_size) {
+        return sendErrorResponse(connection, MHD_HTTP_PAYLOAD_TOO_LARGE, "Request body too large");
+    }
+
+    try {
+        const routing::Target& target = info.target;
+        switch (target.handler) {
+            case routing::Handler::HEALTH:
+                return handleHealthCheck(connection, url);
+            case routing::Handler::METRICS:
+                return handleMetrics(connection);
+            case routing::Handler::LIST_TASKS:
+                return handleGetTasks(connection);
+            case routing::Handler::CREATE_TASK:
+                return handleCreateTask(connection, info.post_data);
+            case routing::Handler::STATISTICS:
+                return handleGetStatistics(connection);
+            case routing::Handler::BATCH:
+                return handleBatch(connection, info.post_data);
+            case routing::Handler::EXPORT:
+                return handleExport(connection);
+            case routing::Handler::EVENTS:
+                return handleEvents(connection);
+            case routing::Handler::GET_TASK:
+                return handleGetTask(connection, target.task_id);
+            case routing::Handler::UPDATE_TASK:
+                return handleUpdateTask(connection, target.task_id, info.post_data);
+            case routing::Handler::DELETE_TASK:
+                return handleDeleteTask(connection, target.task_id);
+            case routing::Handler::INVALID_TASK_ID:
+                return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST, "Invalid task ID");
+            case routing::Handler::METHOD_NOT_ALLOWED:
+                return sendErrorResponse(connection, MHD_HTTP_METHOD_NOT_ALLOWED, "Method not allowed");
+            case routing::Handler::IMPORT:  // Always has an importer
+            case routing::Handler::NOT_FOUND:
+                break;
+        }
+        return sendErrorResponse(connection, MHD_HTTP_NOT_FOUND, "Not found");
+    } catch (const DurabilityError&) {
+        // Applied in memory only; the log's failure listener has already
+        // taken the server out of service
+        return sendErrorResponse(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "Write could not be made durable");
+    } catch (const std::exception& e) {
+        std::cerr << "Request handling error: " << e.what() << std::endl;
+        return sendErrorResponse(connection, MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                 "Internal server error");
+    }
+}
+
+void HttpServer::requestCompleted(void* cls, struct MHD_Connection* /*connection*/,
+                                  void** con_cls, enum MHD_RequestTerminationCode toe) {
+    if (auto* info = static_cast<ConnectionInfo*>(*con_cls)) {
+        HttpServer* server = static_cast<Listener*>(cls)->server;
+        if (info->holds_slot) {
+            server->admission_->release();
+            info->holds_slot = false;
+        }
+        if (info->trace && info->trace->active()) {
+            // Only requests that were answered in full have a breakdown worth
+            // reporting; aborted ones are dropped
+            if (toe == MHD_REQUEST_TERMINATED_COMPLETED_OK) {
+                server->tracer_->finish(*info->trace, info->route, info->method,
+                                        std::chrono::steady_clock::now());
+            } else {
+                info->trace->end();
+            }
+        }
+        connectionPool().recycle(info);
+        server->active_requests_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    *con_cls = nullptr;
+}
+
+// Route handlers
+MHD_Result HttpServer::handleHealthCheck(struct MHD_Connection* connection, std::string_view url) {
+    if (url == kReadyPath) {
+        Json::Value status = health_->getReadinessStatus();
+        const bool ready = status["status"].asString() == "ready";
+        if (follower_) {
+            status["replication"] = follower_->getStatus();
+        }
+        return sendJsonResponse(connection, ready ? MHD_HTTP_OK : MHD_HTTP_SERVICE_UNAVAILABLE, status);
+    }
+    if (url == kSystemMetricsPath) {
+        return sendJsonResponse(connection, MHD_HTTP_OK, health_->getSystemMetrics());
+    }
+    const int status_code = health_->isLive() ? MHD_HTTP_OK : MHD_HTTP_SERVICE_UNAVAILABLE;
+    if (url == kLivePath) {
+        return sendJsonResponse(connection, status_code, health_->getLivenessStatus());
+    }
+    Json::Value status = health_->getHealthStatus();
+    if (follower_) {
+        status["replication"] = follower_->getStatus();
+    }
+    return sendJsonResponse(connection, status_code, status);
+}
+
+MHD_Result HttpServer::handleMetrics(struct MHD_Connection* connection) {
+    std::string& body = responseBuffer();
+    request_metrics_->appendPrometheus(body);
+    task_manager_->lockMetrics().appendPrometheus(body);
+    admission_->appendPrometheus(body);
+    tracer_->appendPrometheus(body);
+    health_->appendPrometheus(body);
+    if (follower_) {
+        follower_->appendPrometheus(body);
+    }
+    metrics::appendHelp(body, "task_store_tasks", "gauge", "Tasks currently stored");
+    metrics::appendSample(body, "task_store_tasks", "",
+                          static_cast<uint64_t>(task_manager_->getTaskCount()));
+
+    struct MHD_Response* response = MHD_create_response_from_buffer(
+        body.size(), body.data(), MHD_RESPMEM_MUST_COPY);
+    return queueResponse(connection, MHD_HTTP_OK, response, "text/plain; version=0.0.4");
+}
+
+MHD_Result HttpServer::handleGetTasks(struct MHD_Connection* connection) {
+    routing::QueryParams query;
+    MHD_get_connection_values(connection, MHD_GET_ARGUMENT_KIND, &collectQueryArgument, &query);
+    const std::string_view status = query.get(routing::Param::STATUS);
+    const std::string_view priority = query.get(routing::Param::PRIORITY);
+
+    // Filters are matched against the enums once, here
+    TaskFilter filter;
+    if (!status.empty()) {
+        filter.status = parseTaskStatus(status);
+        if (!filter.status) {
+            return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST, "Invalid status filter");
+        }
+    }
+    if (!priority.empty()) {
+        filter.priority = parseTaskPriority(priority);
+        if (!filter.priority) {
+            return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST, "Invalid priority filter");
+        }
+    }
+    const std::string_view q = query.get(routing::Param::Q);
+    if (!q.empty()) {
+        filter.setQuery(q);
+    }
+    // [<field>_after, <field>_before), each a date or a date-time
+    static constexpr struct {
+        routing::Param after;
+        routing::Param before;
+        TaskTimeField field;
+    } kRangeParams[] = {
+        {routing::Param::DUE_AFTER, routing::Param::DUE_BEFORE, TaskTimeField::DUE_DATE},
+        {routing::Param::CREATED_AFTER, routing::Param::CREATED_BEFORE, TaskTimeField::CREATED_AT},
+        {routing::Param::UPDATED_AFTER, routing::Param::UPDATED_BEFORE, TaskTimeField::UPDATED_AT},
+    };
+    for (const auto& param : kRangeParams) {
+        for (routing::Param key : {param.after, param.before}) {
+            const std::string_view value = query.get(key);
+            if (value.empty()) {
+                continue;
+            }
+            auto time = DueDate::parse(value);
+            if (!time) {
+                return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST,
+                                         "Invalid " + std::string(routing::kParamNames[static_cast<size_t>(key)]));
+            }
+            TimeRange& range = filter.range(param.field);
+            (key == param.after ? range.from : range.until) = time->seconds;
+        }
+    }
+    const std::string_view sort = query.get(routing::Param::SORT);
+    if (sort == "due_date") {
+        filter.sort = TaskTimeField::DUE_DATE;
+    } else if (sort == "created_at") {
+        filter.sort = TaskTimeField::CREATED_AT;
+    } else if (sort == "updated_at") {
+        filter.sort = TaskTimeField::UPDATED_AT;
+    } else if (!sort.empty() && sort != "id") {
+        return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST,
+                                 "Invalid sort (expected id, due_date, created_at or updated_at)");
+    }
+
+    const bool paged_after = query.has(routing::Param::AFTER);
+    if (paged_after && filter.sort) {
+        return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST,
+                                 "after pages in id order only; use offset with sort");
+    }
+
+    uint64_t limit = 10;
+    uint64_t offset = 0;
+    uint64_t after = 0;
+    if ((query.has(routing::Param::LIMIT) && !routing::parseUInt(query.get(routing::Param::LIMIT), limit)) ||
+        (query.has(routing::Param::OFFSET) && !routing::parseUInt(query.get(routing::Param::OFFSET), offset)) ||
+        (paged_after && !routing::parseUInt(query.get(routing::Param::AFTER), after))) {
+        return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST, "Invalid pagination parameters");
+    }
+    limit = std::min<uint64_t>(limit, 1000);
+
+    // Read before the scan, so the tag is never newer than the page: a
+    // write that lands in between bumps it, and the client just refetches
+    const std::string etag = listEtag(task_manager_->generation());
+    if (notModified(connection, etag)) {
+        return sendNotModified(connection, etag);
+    }
+
+    TaskPage page;
+    if (paged_after) {
+        page = task_manager_->getTasksAfter(after, limit, filter);
+    } else {
+        // Ask for one extra task to learn whether a next page exists
+        page.tasks = task_manager_->getAllTasks(filter, limit + 1, offset);
+        if (page.tasks.size() > limit) {
+            page.tasks.pop_back();
+            // A cursor continues in id order, so a sorted list has none
+            page.next_cursor = page.tasks.empty() || filter.sort ? 0 : page.tasks.back()->id;
+        }
+    }
+
+    // Same bytes as the Json::Value envelope (keys sorted), written directly
+    std::string& body = responseBuffer();
+    {
+        trace::Span span(trace::Phase::SERIALIZE);
+        body.append("{\"count\":");
+        json_writer::appendUInt(body, page.tasks.size());
+        body.append(",\"limit\":");
+        json_writer::appendUInt(body, limit);
+        body.append(",\"next_cursor\":");
+        if (page.next_cursor) {
+            json_writer::appendUInt(body, page.next_cursor);
+        } else {
+            body.append("null");
+        }
+        if (!paged_after) {
+            body.append(",\"offset\":");
+            json_writer::appendUInt(body, offset);
+        }
+        body.append(",\"tasks\":[");
+        for (size_t i = 0; i < page.tasks.size(); ++i) {
+            if (i > 0) {
+                body.push_back(',');
+            }
+            // Concatenate the per-version fragments rendered at write time
+            body.append(page.tasks[i]->cached_json);
+        }
+        body.append("]}");
+    }
+
+    return sendJsonBody(connection, MHD_HTTP_OK, body, etag.c_str());
+}
+
+MHD_Result HttpServer::handleGetTask(struct MHD_Connection* connection, uint64_t id) {
+    auto task = task_manager_->getTask(id);
+    if (!task) {
+        return sendErrorResponse(connection, MHD_HTTP_NOT_FOUND, "Task not found");
+    }
+
+    std::string etag = taskEtag(*task);
+    if (notModified(connection, etag)) {
+        return sendNotModified(connection, etag);
+    }
+
+    return sendTaskJson(connection, MHD_HTTP_OK, task);
+}
+
+MHD_Result HttpServer::handleCreateTask(struct MHD_Connection* connection, std::string_view data) {
+    Json::Value json = json_utils::parseJson(data);
+    if (json.isNull() || !json.isObject()) {
+        return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST, "Invalid JSON");
+    }
+
+    ValidationError error;
+    auto built = Task::fromJson(json, &error);
+    if (!built) {
+        return sendValidationError(connection, "Invalid task data", error);
+    }
+
+    auto task = task_manager_->createTask(std::move(built));
+    if (!task) {
+        return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST, "Failed to create task");
+    }
+
+    return sendTaskJson(connection, MHD_HTTP_CREATED, task);
+}
+
+MHD_Result HttpServer::handleUpdateTask(struct MHD_Connection* connection, uint64_t id,
+                                        std::string_view data) {
+    Json::Value json = json_utils::parseJson(data);
+    if (json.isNull() || !json.isObject()) {
+        return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST, "Invalid JSON");
+    }
+
+    ValidationError error;
+    auto patch = TaskPatch::fromJson(json, &error);
+    if (!patch) {
+        return sendValidationError(connection, "Invalid task update", error);
+    }
+
+    auto task = task_manager_->updateTask(id, *patch);
+    if (!task) {
+        return sendErrorResponse(connection, MHD_HTTP_NOT_FOUND, "Task not found");
+    }
+
+    return sendTaskJson(connection, MHD_HTTP_OK, task);
+}
+
+MHD_Result HttpServer::handleBatch(struct MHD_Connection* connection, std::string_view data) {
+    Json::Value parsed = json_utils::parseJson(data);
+    if (parsed.isNull() || !parsed.isObject()) {
+        return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST, "Invalid JSON");
+    }
+
+    const Json::Value& json = parsed;
+    for (const char* section : {"create", "update", "delete"}) {
+        if (json.isMember(section) && !json[section].isArray()) {
+            return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST,
+                                     std::string(section) + " must be an array");
+        }
+    }
+    const Json::Value& creates = json["create"];
+    const Json::Value& updates = json["update"];
+    const Json::Value& deletes = json["delete"];
+
+    // Decode everything first so each section reaches the store as one batch
+    std::vector<std::shared_ptr<Task>> built(creates.size());
+    std::vector<ValidationError> create_errors(creates.size());
+    for (Json::ArrayIndex i = 0; i < creates.size(); ++i) {
+        built[i] = Task::fromJson(creates[i], &create_errors[i]);
+    }
+
+    std::vector<TaskUpdate> patches;
+    std::vector<ValidationError> update_errors(updates.size());
+    patches.reserve(updates.size());
+    for (Json::ArrayIndex i = 0; i < updates.size(); ++i) {
+        const Json::Value& item = updates[i];
+        uint64_t id = item.isObject() && item["id"].isUInt64() ? item["id"].asUInt64() : 0;
+        if (id == 0) {
+            update_errors[i] = {"id", "id must be a positive integer"};
+            continue;
+        }
+        if (auto patch = TaskPatch::fromJson(item, &update_errors[i])) {
+            patches.push_back({id, std::move(*patch)});
+        }
+    }
+
+    std::vector<uint64_t> ids;
+    ids.reserve(deletes.size());
+    for (const auto& item : deletes) {
+        if (item.isUInt64() && item.asUInt64() != 0) {
+            ids.push_back(item.asUInt64());
+        }
+    }
+
+    std::vector<TaskPtr> created = task_manager_->createTasks(built);
+    std::vector<TaskPtr> patched = task_manager_->updateTasks(patches);
+    std::vector<bool> removed = task_manager_->deleteTasks(ids);
+
+    std::string& body = responseBuffer();
+    body.reserve(64 + creates.size() * 320 + updates.size() * 320 + deletes.size() * 32);
+
+    body.append("{\"create\":[");
+    for (size_t i = 0; i < created.size(); ++i) {
+        if (i > 0) body.push_back(',');
+        if (created[i]) {
+            appendItemTask(body, MHD_HTTP_CREATED, created[i]);
+        } else {
+            appendItemError(body, MHD_HTTP_BAD_REQUEST, "Invalid task data: " + create_errors[i].message,
+                            create_errors[i].field);
+        }
+    }
+
+    body.append("],\"delete\":[");
+    for (Json::ArrayIndex i = 0, next = 0; i < deletes.size(); ++i) {
+        if (i > 0) body.push_back(',');
+        if (!deletes[i].isUInt64() || deletes[i].asUInt64() == 0) {
+            appendItemError(body, MHD_HTTP_BAD_REQUEST, "id must be a positive integer");
+            continue;
+        }
+        if (removed[next]) {
+            body.append("{\"id\":");
+            json_writer::appendUInt(body, ids[next]);
+            body.append(",\"status\":200}");
+        } else {
+            appendItemError(body, MHD_HTTP_NOT_FOUND, "Task not found", "", ids[next]);
+        }
+        ++next;
+    }
+
+    body.append("],\"update\":[");
+    for (Json::ArrayIndex i = 0, next = 0; i < updates.size(); ++i) {
+        if (i > 0) body.push_back(',');
+        if (!update_errors[i].message.empty()) {
+            appendItemError(body, MHD_HTTP_BAD_REQUEST, "Invalid task update: " + update_errors[i].message,
+                            update_errors[i].field);
+            continue;
+        }
+        if (patched[next]) {
+            appendItemTask(body, MHD_HTTP_OK, patched[next]);
+        } else {
+            appendItemError(body, MHD_HTTP_NOT_FOUND, "Task not found", "", patches[next].id);
+        }
+        ++next;
+    }
+    body.append("]}");
+
+    return sendJsonBody(connection, MHD_HTTP_OK, body);
+}
+
+MHD_Result HttpServer::handleExport(struct MHD_Connection* connection) {
+    auto* stream = new ExportStream();
+    stream->manager = task_manager_.get();
+    stream->feed = change_feed_.get();
+    compression::Encoding encoding = responseEncoding(connection, SIZE_MAX);
+    if (encoding != compression::Encoding::IDENTITY) {
+        const auto& settings = config_.compression;
+        stream->compressor = std::make_unique<compression::Compressor>(
+            encoding, encoding == compression::Encoding::GZIP ? settings.gzip_level : settings.brotli_quality);
+    }
+    struct MHD_Response* response = MHD_create_response_from_callback(
+        MHD_SIZE_UNKNOWN, kStreamBlockSize, &readExport, stream, &releaseExport);
+    if (!response) {
+        releaseExport(stream);
+        return MHD_NO;
+    }
+
+    return queueResponse(connection, MHD_HTTP_OK, response, "application/x-ndjson", {encoding});
+}
+
+MHD_Result HttpServer::handleEvents(struct MHD_Connection* connection) {
+    // Explicit since wins; EventSource reconnects send Last-Event-ID; with
+    // neither the stream starts at the present
+    const char* since = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "since");
+    if (!since) {
+        since = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Last-Event-ID");
+    }
+    uint64_t cursor = change_feed_->latest();
+    if (since) {
+        const char* end = since + std::strlen(since);
+        auto result = std::from_chars(since, end, cursor);
+        if (result.ec != std::errc() || result.ptr != end) {
+            return sendErrorResponse(connection, MHD_HTTP_BAD_REQUEST, "Invalid since parameter");
+        }
+    }
+
+    auto* stream = new EventStream();
+    stream->streams = event_streams_.get();
+    stream->connection = connection;
+    stream->cursor = cursor;
+    stream->last_write = std::chrono::steady_clock::now();
+    // Sent at once, so the client sees the stream open before any event
+    stream->pending = "retry: 3000\n\n";
+    struct MHD_Response* response = MHD_create_response_from_callback(
+        MHD_SIZE_UNKNOWN, kStreamBlockSize, &readEvents, stream, &releaseEvents);
+    if (!response) {
+        releaseEvents(stream);
+        return MHD_NO;
+    }
+
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CACHE_CONTROL, "no-cache");
+    // Where the stream starts, so a follower knows its position before
+    // the first event
+    const std::string start = std::to_string(cursor);
+    MHD_add_response_header(response, replication::kFeedSeqHeader, start.c_str());
+    return queueResponse(connection, MHD_HTTP_OK, response, "text/event-stream");
+}
+
+MHD_Result HttpServer::handleImport(struct MHD_Connection* connection, NdjsonImporter& importer) {
+    importer.finish();
+    if (importer.logFailed()) {
+        return sendErrorResponse(connection, MHD_HTTP_INTERNAL_SERVER_ERROR, "Write could not be made durable");
+    }
+
+    Json::Value response;
+    response["imported"] = static_cast<Json::UInt64>(importer.imported());
+    response["failed"] = static_cast<Json::UInt64>(importer.failed());
+    response["errors"] = Json::Value(Json::arrayValue);
+    for (const auto& error : importer.errors()) {
+        Json::Value entry;
+        entry["line"] = static_cast<Json::UInt64>(error.line);
+        entry["error"] = error.message;
+        if (!error.field.empty()) {
+            entry["field"] = error.field;
+        }
+        response["errors"].append(entry);
+    }
+
+    return sendJsonResponse(connection, MHD_HTTP_OK, response);
+}
+
+MHD_Result HttpServer::handleDeleteTask(struct MHD_Connection* connection, uint64_t id) {
+    if (!task_manager_->deleteTask(id)) {
+        return sendErrorResponse(connection, MHD_HTTP_NOT_FOUND, "Task not found");
+    }
+
+    return sendJsonResponse(connection, MHD_HTTP_OK,
+                            json_utils::createSuccessResponse("Task deleted"));
+}
+
+MHD_Result HttpServer::handleGetStatistics(struct MHD_Connection* connection) {
+    return sendJsonResponse(connection, MHD_HTTP_OK, task_manager_->getStatistics());
+}
+
+// Utility functions
+MHD_Result HttpServer::sendJsonResponse(struct MHD_Connection* connection, int status_code,
+                                        const Json::Value& json) {
+    return sendJsonBody(connection, status_code, json_utils::jsonToString(json));
+}
+
+MHD_Result HttpServer::sendJsonBody(struct MHD_Connection* connection, int status_code,
+                                    const std::string& body, const char* etag) {
+    compression::Encoding encoding = responseEncoding(connection, body.size());
+    if (encoding != compression::Encoding::IDENTITY) {
+        // Compressed per response, into a buffer each thread keeps
+        thread_local std::string compressed;
+        if (compression::compress(encoding, config_.compression, body, compressed) &&
+            compressed.size() < body.size()) {
+            struct MHD_Response* response = MHD_create_response_from_buffer(
+                compressed.size(), compressed.data(), MHD_RESPMEM_MUST_COPY);
+            return queueJsonResponse(connection, status_code, response, {encoding, etag});
+        }
+    }
+
+    struct MHD_Response* response = MHD_create_response_from_buffer(
+        body.size(), const_cast<char*>(body.data()), MHD_RESPMEM_MUST_COPY);
+    return queueJsonResponse(connection, status_code, response, {compression::Encoding::IDENTITY, etag});
+}
+
+MHD_Result HttpServer::sendTaskJson(struct MHD_Connection* connection, int status_code,
+                                    const TaskPtr& task) {
+    const std::string etag = taskEtag(*task);
+    compression::Encoding encoding = responseEncoding(connection, task->cached_json.size());
+    if (encoding != compression::Encoding::IDENTITY) {
+        std::shared_ptr<const std::string> body = body_cache_->find(task, encoding);
+        if (!body) {
+            std::string compressed;
+            if (compression::compress(encoding, config_.compression, task->cached_json, compressed)) {
+                body = std::make_shared<const std::string>(std::move(compressed));
+                body_cache_->store(task, encoding, body);
+            }
+        }
+        if (body) {
+            return sendSharedJsonBody(connection, status_code, std::move(body), {encoding, etag.c_str()});
+        }
+    }
+    return sendSharedJsonBody(connection, status_code, cachedJson(task),
+                              {compression::Encoding::IDENTITY, etag.c_str()});
+}
+
+MHD_Result HttpServer::sendSharedJsonBody(struct MHD_Connection* connection, int status_code,
+                                          std::shared_ptr<const std::string> body,
+                                          const BodyHeaders& headers) {
+    auto* hold = new std::shared_ptr<const std::string>(std::move(body));
+    const std::string& bytes = **hold;
+
+#if MHD_VERSION >= 0x00097302
+    struct MHD_Response* response = MHD_create_response_from_buffer_with_free_callback_cls(
+        bytes.size(), bytes.data(), &releaseSharedBody, hold);
+#else
+    struct MHD_Response* response = MHD_create_response_from_callback(
+        bytes.size(), 64 * 1024, &readSharedBody, hold, &releaseSharedBody);
+#endif
+    if (!response) {
+        releaseSharedBody(hold);
+    }
+    return queueJsonResponse(connection, status_code, response, headers);
+}
+
+MHD_Result HttpServer::queueJsonResponse(struct MHD_Connection* connection, int status_code,
+                                         struct MHD_Response* response, const BodyHeaders& headers) {
+    return queueResponse(connection, status_code, response, "application/json", headers);
+}
+
+MHD_Result HttpServer::queueResponse(struct MHD_Connection* connection, int status_code,
+                                     struct MHD_Response* response, const char* content_type,
+                                     const BodyHeaders& headers) {
+    if (!response) {
+        return MHD_NO;
+    }
+
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, content_type);
+    if (headers.encoding != compression::Encoding::IDENTITY) {
+        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_ENCODING,
+                                compression::toString(headers.encoding));
+    }
+    if (headers.etag) {
+        MHD_add_response_header(response, MHD_HTTP_HEADER_ETAG, headers.etag);
+    }
+    // Caches must key on Accept-Encoding wherever a coding could apply
+    if (config_.compression.enabled) {
+        MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+    }
+    // Keep-alive clients reconnect, and reach whichever process listens now
+    if (isDraining()) {
+        MHD_add_response_header(response, MHD_HTTP_HEADER_CONNECTION, "close");
+    }
+    MHD_Result result = MHD_queue_response(connection, static_cast<unsigned int>(status_code), response);
+    MHD_destroy_response(response);
+    t_queued_status = status_code;
+
+    return result;
+}
+
+bool HttpServer::notModified(struct MHD_Connection* connection, const std::string& etag) const {
+    return etagListMatches(MHD_lookup_connection_value(connection, MHD_HEADER_KIND,
+                                                       MHD_HTTP_HEADER_IF_NONE_MATCH), etag);
+}
+
+MHD_Result HttpServer::sendNotModified(struct MHD_Connection* connection, const std::string& etag) {
+    struct MHD_Response* response = MHD_create_response_from_buffer(0, nullptr, MHD_RESPMEM_PERSISTENT);
+    if (!response) {
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, MHD_HTTP_HEADER_ETAG, etag.c_str());
+    if (config_.compression.enabled) {
+        MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+    }
+    if (isDraining()) {
+        MHD_add_response_header(response, MHD_HTTP_HEADER_CONNECTION, "close");
+    }
+    MHD_Result result = MHD_queue_response(connection, MHD_HTTP_NOT_MODIFIED, response);
+    MHD_destroy_response(response);
+    t_queued_status = MHD_HTTP_NOT_MODIFIED;
+    return result;
+}
+
+compression::Encoding HttpServer::responseEncoding(struct MHD_Connection* connection,
+                                                   size_t size) const {
+    const auto& settings = config_.compression;
+    if (!settings.enabled || size < settings.min_size) {
+        return compression::Encoding::IDENTITY;
+    }
+    return compression::negotiate(MHD_lookup_connection_value(connection, MHD_HEADER_KIND,
+                                                              MHD_HTTP_HEADER_ACCEPT_ENCODING));
+}
+
+MHD_Result HttpServer::sendErrorResponse(struct MHD_Connection* connection, int status_code,
+                                         const std::string& message) {
+    return sendJsonResponse(connection, status_code,
+                            json_utils::createErrorResponse(message, status_code));
+}
+
+MHD_Result HttpServer::sendRejection(struct MHD_Connection* connection, const admission::Decision& decision) {
+    const bool overloaded = decision.verdict == admission::Verdict::OVERLOADED;
+    return sendRetryLater(connection, overloaded ? MHD_HTTP_SERVICE_UNAVAILABLE : MHD_HTTP_TOO_MANY_REQUESTS,
+                          overloaded ? "Server overloaded" : "Too many requests", decision.retry_after_seconds);
+}
+
+MHD_Result HttpServer::sendUnavailable(struct MHD_Connection* connection) {
+    const bool recovering = health_->state() == ServingState::RECOVERING;
+    return sendRetryLater(connection, MHD_HTTP_SERVICE_UNAVAILABLE,
+                          recovering ? "Server is recovering" : "Server unavailable", recovering ? 1 : 5);
+}
+
+MHD_Result HttpServer::sendToPrimary(struct MHD_Connection* connection, const char* url) {
+    const replication::Settings& primary = follower_->settings();
+    std::string authority = primary.host.find(':') == std::string::npos ? primary.host
+                                                                         : "[" + primary.host + "]";
+    authority.append(":").append(std::to_string(primary.port));
+    const std::string location = "http://" + authority + url;
+
+    std::string& body = responseBuffer();
+    body.append("{\"code\":");
+    json_writer::appendUInt(body, MHD_HTTP_TEMPORARY_REDIRECT);
+    body.append(",\"error\":\"Writes go to the primary\",\"primary\":");
+    json_writer::appendString(body, authority);
+    body.append(",\"timestamp\":");
+    json_writer::appendUInt(body, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count()));
+    body.push_back('}');
+    struct MHD_Response* response = MHD_create_response_from_buffer(
+        body.size(), body.data(), MHD_RESPMEM_MUST_COPY);
+    if (!response) {
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, MHD_HTTP_HEADER_LOCATION, location.c_str());
+    return queueJsonResponse(connection, MHD_HTTP_TEMPORARY_REDIRECT, response);
+}
+
+MHD_Result HttpServer::sendRetryLater(struct MHD_Connection* connection, int status_code, const char* error,
+                                      uint32_t retry_after_seconds) {
+    // Same shape as createErrorResponse, written directly and never
+    // compressed: this path has to stay cheap under overload
+    std::string& body = responseBuffer();
+    body.append("{\"code\":");
+    json_writer::appendUInt(body, static_cast<uint64_t>(status_code));
+    body.append(",\"error\":\"").append(error).append("\"");
+    body.append(",\"timestamp\":");
+    json_writer::appendUInt(body, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count()));
+    body.push_back('}');
+    struct MHD_Response* response = MHD_create_response_from_buffer(
+        body.size(), body.data(), MHD_RESPMEM_MUST_COPY);
+    if (!response) {
+        return MHD_NO;
+    }
+    const std::string retry_after = std::to_string(retry_after_seconds);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_RETRY_AFTER, retry_after.c_str());
+    return queueJsonResponse(connection, status_code, response);
+}
+
+MHD_Result HttpServer::sendValidationError(struct MHD_Connection* connection,
+                                           const std::string& summary,
+                                           const ValidationError& error) {
+    Json::Value body = json_utils::createErrorResponse(summary + ": " + error.message,
+                                                       MHD_HTTP_BAD_REQUEST);
+    if (!error.field.empty()) {
+        body["field"] = error.field;
+    }
+    return sendJsonResponse(connection, MHD_HTTP_BAD_REQUEST, body);
+}
+
+} // namespace http_server
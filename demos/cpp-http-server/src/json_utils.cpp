@@ -1,22 +1,70 @@
 #include "json_utils.h"
+#include "task_manager.h"
+#include "trace.h"
 #include <iostream>
-#include <sstream>
+#include <ostream>
+#include <streambuf>
 #include <chrono>
+#include <memory>
 
 namespace http_server {
 namespace json_utils {
 
-Json::Value parseJson(const std::string& json_str) {
-    Json::Value root;
-    Json::CharReaderBuilder builder;
-    Json::CharReader* reader = builder.newCharReader();
+namespace {
 
-    std::string errors;
-    bool success = reader->parse(json_str.c_str(), json_str.c_str() + json_str.length(), &root, &errors);
+Json::CharReader& threadReader() {
+    thread_local std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+    return *reader;
+}
+
+Json::StreamWriter& threadWriter(bool pretty) {
+    thread_local std::unique_ptr<Json::StreamWriter> writers[2];
+    auto& writer = writers[pretty ? 1 : 0];
+    if (!writer) {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = pretty ? "  " : "";
+        writer.reset(builder.newStreamWriter());
+    }
+    return *writer;
+}
+
+// Output stream over a std::string that keeps its capacity between uses,
+// unlike ostringstream, whose str(std::string()) frees it
+class StringBuf : public std::streambuf {
+public:
+    std::string& buffer() { return buffer_; }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            buffer_.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        buffer_.append(s, static_cast<size_t>(n));
+        return n;
+    }
+
+private:
+    std::string buffer_;
+};
+
+bool parseInto(const char* data, size_t size, Json::Value& root, std::string* errors) {
+    return threadReader().parse(data, data + size, &root, errors);
+}
 
-    delete reader;
+} // namespace
 
-    if (!success) {
+Json::Value parseJson(std::string_view json_str) {
+    return parseJson(json_str.data(), json_str.size());
+}
+
+Json::Value parseJson(const char* data, size_t size) {
+    trace::Span span(trace::Phase::PARSE);
+    Json::Value root;
+    std::string errors;
+    if (!parseInto(data, size, root, &errors)) {
         std::cerr << "JSON parse error: " << errors << std::endl;
         return Json::Value::null;
     }
@@ -24,21 +72,22 @@ Json::Value parseJson(const std::string& json_str) {
     return root;
 }
 
-bool isValidJson(const std::string& json_str) {
-    Json::Value root = parseJson(json_str);
-    return !root.isNull();
+bool isValidJson(std::string_view json_str) {
+    // Only the verdict matters, so skip collecting error text
+    Json::Value root;
+    return parseInto(json_str.data(), json_str.size(), root, nullptr) && !root.isNull();
 }
 
 std::string jsonToString(const Json::Value& json, bool pretty) {
-    if (pretty) {
-        Json::StreamWriterBuilder builder;
-        builder["indentation"] = "  ";
-        return Json::writeString(builder, json);
-    } else {
-        Json::StreamWriterBuilder builder;
-        builder["indentation"] = "";
-        return Json::writeString(builder, json);
-    }
+    trace::Span span(trace::Phase::SERIALIZE);
+    // Rendered into a buffer this thread keeps, so only the returned copy,
+    // sized exactly, is allocated once the buffer has grown
+    thread_local StringBuf buf;
+    thread_local std::ostream out(&buf);
+    buf.buffer().clear();
+    out.clear();
+    threadWriter(pretty).write(json, &out);
+    return buf.buffer();
 }
 
 bool hasRequiredFields(const Json::Value& json, const std::vector<std::string>& fields) {
@@ -92,73 +141,11 @@ Json::Value createSuccessResponse(const std::string& message, const Json::Value&
 }
 
 bool isValidTaskData(const Json::Value& json) {
-    // Required field: title
-    if (!isValidString(json, "title", true)) {
-        return false;
-    }
-
-    // Optional fields validation
-    if (json.isMember("description") && !json["description"].isString()) {
-        return false;
-    }
-
-    if (json.isMember("priority")) {
-        std::string priority = json["priority"].asString();
-        if (priority != "low" && priority != "medium" && priority != "high") {
-            return false;
-        }
-    }
-
-    if (json.isMember("status")) {
-        std::string status = json["status"].asString();
-        if (status != "pending" && status != "in_progress" && status != "completed") {
-            return false;
-        }
-    }
-
-    if (json.isMember("due_date") && !json["due_date"].isString()) {
-        return false;
-    }
-
-    return true;
+    return Task::isValidTask(json);
 }
 
 bool isValidTaskUpdate(const Json::Value& json) {
-    // For updates, no field is required, but all present fields must be valid
-
-    if (json.isMember("title") && !isValidString(json, "title", false)) {
-        return false;
-    }
-
-    if (json.isMember("description") && !json["description"].isString()) {
-        return false;
-    }
-
-    if (json.isMember("priority")) {
-        if (!json["priority"].isString()) {
-            return false;
-        }
-        std::string priority = json["priority"].asString();
-        if (priority != "low" && priority != "medium" && priority != "high") {
-            return false;
-        }
-    }
-
-    if (json.isMember("status")) {
-        if (!json["status"].isString()) {
-            return false;
-        }
-        std::string status = json["status"].asString();
-        if (status != "pending" && status != "in_progress" && status != "completed") {
-            return false;
-        }
-    }
-
-    if (json.isMember("due_date") && !json["due_date"].isString()) {
-        return false;
-    }
-
-    return true;
+    return TaskPatch::fromJson(json).has_value();
 }
 
 } // namespace json_utils
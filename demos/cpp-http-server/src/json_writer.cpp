@@ -0,0 +1,225 @@
+#include "json_writer.h"
+#include <charconv>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+namespace http_server {
+namespace json_writer {
+
+namespace {
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+void appendHex4(std::string& out, unsigned int codepoint) {
+    char buf[6] = {'\\', 'u',
+                   kHexDigits[(codepoint >> 12) & 0xF], kHexDigits[(codepoint >> 8) & 0xF],
+                   kHexDigits[(codepoint >> 4) & 0xF], kHexDigits[codepoint & 0xF]};
+    out.append(buf, sizeof(buf));
+}
+
+// Mirrors jsoncpp's decoder, including how it consumes malformed sequences,
+// so invalid UTF-8 maps to the same replacement characters
+unsigned int utf8ToCodepoint(const char*& s, const char* e) {
+    constexpr unsigned int kReplacement = 0xFFFD;
+
+    unsigned int first = static_cast<unsigned char>(*s);
+    if (first < 0x80) {
+        return first;
+    }
+    if (first < 0xE0) {
+        if (e - s < 2) {
+            return kReplacement;
+        }
+        unsigned int cp = ((first & 0x1F) << 6) | (static_cast<unsigned int>(s[1]) & 0x3F);
+        s += 1;
+        return cp < 0x80 ? kReplacement : cp;
+    }
+    if (first < 0xF0) {
+        if (e - s < 3) {
+            return kReplacement;
+        }
+        unsigned int cp = ((first & 0x0F) << 12) | ((static_cast<unsigned int>(s[1]) & 0x3F) << 6) |
+                          (static_cast<unsigned int>(s[2]) & 0x3F);
+        s += 2;
+        if (cp >= 0xD800 && cp <= 0xDFFF) {
+            return kReplacement;
+        }
+        return cp < 0x800 ? kReplacement : cp;
+    }
+    if (first < 0xF8) {
+        if (e - s < 4) {
+            return kReplacement;
+        }
+        unsigned int cp = ((first & 0x07) << 18) | ((static_cast<unsigned int>(s[1]) & 0x3F) << 12) |
+                          ((static_cast<unsigned int>(s[2]) & 0x3F) << 6) |
+                          (static_cast<unsigned int>(s[3]) & 0x3F);
+        s += 3;
+        return cp < 0x10000 ? kReplacement : cp;
+    }
+    return kReplacement;
+}
+
+bool needsEscaping(unsigned char c) {
+    return c == '"' || c == '\\' || c < 0x20 || c >= 0x80;
+}
+
+// Days since 1970-01-01 to a proleptic Gregorian date
+void civilFromDays(int64_t days, int64_t& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = static_cast<int64_t>(yoe) + era * 400 + (month <= 2 ? 1 : 0);
+}
+
+void appendDigits(char* out, unsigned value, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+
+} // namespace
+
+void appendString(std::string& out, std::string_view value) {
+    out.push_back('"');
+
+    const char* begin = value.data();
+    const char* end = begin + value.size();
+    const char* run = begin;
+
+    for (const char* c = begin; c < end; ++c) {
+        unsigned char ch = static_cast<unsigned char>(*c);
+        if (!needsEscaping(ch)) {
+            continue;
+        }
+
+        // Copy the clean run in one go
+        out.append(run, static_cast<size_t>(c - run));
+
+        switch (ch) {
+            case '"': out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\b': out.append("\\b"); break;
+            case '\f': out.append("\\f"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            case '\t': out.append("\\t"); break;
+            default: {
+                unsigned int cp = utf8ToCodepoint(c, end);
+                if (cp < 0x20 || (cp >= 0x80 && cp < 0x10000)) {
+                    appendHex4(out, cp);
+                } else if (cp < 0x80) {
+                    out.push_back(static_cast<char>(cp));
+                } else {
+                    cp -= 0x10000;
+                    appendHex4(out, 0xD800 + ((cp >> 10) & 0x3FF));
+                    appendHex4(out, 0xDC00 + (cp & 0x3FF));
+                }
+                break;
+            }
+        }
+        run = c + 1;
+    }
+
+    out.append(run, static_cast<size_t>(end - run));
+    out.push_back('"');
+}
+
+void appendUInt(std::string& out, uint64_t value) {
+    char buf[20];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, static_cast<size_t>(result.ptr - buf));
+}
+
+void appendTimestamp(std::string& out, std::chrono::system_clock::time_point tp) {
+    // Same truncation as system_clock::to_time_t
+    int64_t secs = std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch()).count();
+    int64_t days = secs >= 0 ? secs / 86400 : (secs - 86399) / 86400;
+    unsigned sod = static_cast<unsigned>(secs - days * 86400);
+
+    int64_t year;
+    unsigned month, day;
+    civilFromDays(days, year, month, day);
+
+    if (year < 1000 || year > 9999) {
+        // put_time does not zero-pad; defer to it outside the common range
+        auto time_t = static_cast<std::time_t>(secs);
+        std::tm tm{};
+        gmtime_r(&time_t, &tm);
+        std::ostringstream ss;
+        ss << '"' << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ") << '"';
+        out.append(ss.str());
+        return;
+    }
+
+    char buf[] = "\"0000-00-00T00:00:00Z\"";
+    appendDigits(buf + 1, static_cast<unsigned>(year), 4);
+    appendDigits(buf + 6, month, 2);
+    appendDigits(buf + 9, day, 2);
+    appendDigits(buf + 12, sod / 3600, 2);
+    appendDigits(buf + 15, (sod / 60) % 60, 2);
+    appendDigits(buf + 18, sod % 60, 2);
+    out.append(buf, sizeof(buf) - 1);
+}
+
+void appendDueDateText(std::string& out, DueDate due) {
+    if (due.kind == DueDateKind::NONE) {
+        return;
+    }
+    int64_t days = due.seconds >= 0 ? due.seconds / 86400 : (due.seconds - 86399) / 86400;
+    unsigned sod = static_cast<unsigned>(due.seconds - days * 86400);
+
+    int64_t year;
+    unsigned month, day;
+    civilFromDays(days, year, month, day);
+
+    // Parsing only accepts four-digit years, so zero padding round-trips
+    char buf[] = "0000-00-00T00:00:00Z";
+    appendDigits(buf, static_cast<unsigned>(year), 4);
+    appendDigits(buf + 5, month, 2);
+    appendDigits(buf + 8, day, 2);
+    if (due.kind == DueDateKind::DATE) {
+        out.append(buf, 10);
+        return;
+    }
+    appendDigits(buf + 11, sod / 3600, 2);
+    appendDigits(buf + 14, (sod / 60) % 60, 2);
+    appendDigits(buf + 17, sod % 60, 2);
+    out.append(buf, sizeof(buf) - 1);
+}
+
+void appendTask(std::string& out, const Task& task) {
+    // Keys in the sorted order Json::Value emits them
+    out.append("{\"created_at\":");
+    appendTimestamp(out, task.created_at);
+    out.append(",\"description\":");
+    appendString(out, task.description);
+    out.append(",\"due_date\":");
+    if (task.due_kind == DueDateKind::NONE) {
+        out.append("null");
+    } else {
+        out.push_back('"');
+        appendDueDateText(out, task.dueDate());
+        out.push_back('"');
+    }
+    out.append(",\"id\":");
+    appendUInt(out, task.id);
+    out.append(",\"priority\":\"");
+    out.append(toString(task.priority));
+    out.append("\",\"status\":\"");
+    out.append(toString(task.status));
+    out.append("\",\"title\":");
+    appendString(out, task.title);
+    out.append(",\"updated_at\":");
+    appendTimestamp(out, task.updated_at);
+    out.push_back('}');
+}
+
+} // namespace json_writer
+} // namespace http_server
@@ -1,17 +1,10 @@
-#include "task_manager.h"
+#include "http_server.h"
 #include <iostream>
+#include <pthread.h>
 #include <signal.h>
-#include <unistd.h>
 #include <cstdlib>
-
-static volatile bool running = true;
-
-void signal_handler(int signal) {
-    if (signal == SIGINT || signal == SIGTERM) {
-        std::cout << "\nReceived signal " << signal << ", shutting down gracefully..." << std::endl;
-        running = false;
-    }
-}
+#include <cstring>
+#include <string>
 
 void print_banner() {
     std::cout << R"(
@@ -23,69 +16,299 @@ void print_banner() {
     )" << std::endl;
 }
 
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [port] [options]\n"
+              << "  --threading=pool|thread-per-connection  Connection threading model (default: pool)\n"
+              << "  --threads=N                             Worker pool size (default: one per core)\n"
+              << "  --listeners=single|node|core            One listener, or one per NUMA node or CPU with\n"
+              << "                                          pinned threads and a store partition per node\n"
+              << "  --shards=N                              Task store shards (default: 16, 1 = single map)\n"
+              << "  --data-dir=PATH                         Persist tasks (WAL + snapshots) under PATH\n"
+              << "  --sync-interval-ms=N                    WAL group commit window (default: 10)\n"
+              << "  --no-sync-wait                          Acknowledge writes before their fsync\n"
+              << "  --snapshot-every=N                      Logged writes between snapshots (default: 1000000, 0 = off)\n"
+              << "  --replicate-from=HOST:PORT              Serve reads as a replica of the primary at HOST:PORT;\n"
+              << "                                          writes are redirected there\n"
+              << "  --health-sample-ms=N                    How often /health* data is refreshed (default: 1000)\n"
+              << "  --reuse-port                            Bind with SO_REUSEPORT, so a new server can start\n"
+              << "                                          on the port while this one drains\n"
+              << "  --drain-timeout-ms=N                    How long shutdown waits for requests (default: 10000)\n"
+              << "  --no-compression                        Never gzip/br-encode responses\n"
+              << "  --compression-min-size=N                Smallest body worth compressing (default: 1024)\n"
+              << "  --gzip-level=N                          gzip level 1-9 (default: 6)\n"
+              << "  --brotli-quality=N                      Brotli quality 0-11 (default: 5)\n"
+              << "  --client-rate=R[:BURST]                 Requests/s per client address, beyond which 429\n"
+              << "  --route-rate=PATH=R[:BURST]             Requests/s for a route across clients, e.g.\n"
+              << "                                          --route-rate=/api/v1/tasks:import=1\n"
+              << "  --max-concurrent=N                      Requests in handlers at once, beyond which 503\n"
+              << "  --admission-queue=N                     Requests that may wait for a slot (default: 0)\n"
+              << "  --admission-queue-timeout-ms=N          How long they wait (default: 50)\n"
+              << "  --trace-sample=N                        Trace one request in N per thread (default: 0 = off)\n"
+              << "  --slow-request-ms=N                     Log traced requests slower than N ms\n"
+              << "  --trace-file=PATH                       Write traced requests as a Chrome trace to PATH\n"
+              << std::endl;
+}
+
+static bool parse_port(const std::string& value, int& port) {
+    try {
+        port = std::stoi(value);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: Invalid port number: " << value << std::endl;
+        return false;
+    }
+    if (port < 1 || port > 65535) {
+        std::cerr << "Error: Port must be between 1 and 65535" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// "R" or "R:BURST"
+static bool parse_rate(const std::string& value, http_server::admission::RateLimit& limit) {
+    try {
+        size_t used = 0;
+        limit.rate = std::stod(value, &used);
+        if (used < value.size()) {
+            if (value[used] != ':') {
+                return false;
+            }
+            limit.burst = std::stod(value.substr(used + 1));
+        }
+    } catch (const std::exception& e) {
+        return false;
+    }
+    return limit.rate > 0 && limit.burst >= 0;
+}
+
 int main(int argc, char* argv[]) {
     print_banner();
 
+    http_server::ServerConfig config;
+
+    // Environment first, command line overrides
+    if (const char* env_port = std::getenv("PORT")) {
+        if (!parse_port(env_port, config.port)) {
+            return 1;
+        }
+    }
+
+    if (const char* env_dir = std::getenv("DATA_DIR")) {
+        config.data_dir = env_dir;
+    }
+
     // Parse command line arguments
-    int port = 8000;
-    if (argc > 1) {
-        try {
-            port = std::stoi(argv[1]);
-            if (port < 1 || port > 65535) {
-                std::cerr << "Error: Port must be between 1 and 65535" << std::endl;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg.rfind("--threading=", 0) == 0) {
+            std::string mode = arg.substr(std::strlen("--threading="));
+            if (mode == "pool") {
+                config.threading_mode = http_server::ThreadingMode::THREAD_POOL;
+            } else if (mode == "thread-per-connection") {
+                config.threading_mode = http_server::ThreadingMode::THREAD_PER_CONNECTION;
+            } else {
+                std::cerr << "Error: Unknown threading mode: " << mode << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--listeners=", 0) == 0) {
+            std::string layout = arg.substr(std::strlen("--listeners="));
+            if (layout == "single") {
+                config.listener_layout = http_server::ListenerLayout::SINGLE;
+            } else if (layout == "node") {
+                config.listener_layout = http_server::ListenerLayout::PER_NODE;
+            } else if (layout == "core") {
+                config.listener_layout = http_server::ListenerLayout::PER_CORE;
+            } else {
+                std::cerr << "Error: Unknown listener layout: " << layout << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            try {
+                config.thread_pool_size = static_cast<unsigned int>(
+                    std::stoul(arg.substr(std::strlen("--threads="))));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid thread count: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--shards=", 0) == 0) {
+            try {
+                config.task_shards = std::stoul(arg.substr(std::strlen("--shards=")));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid shard count: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--data-dir=", 0) == 0) {
+            config.data_dir = arg.substr(std::strlen("--data-dir="));
+        } else if (arg.rfind("--sync-interval-ms=", 0) == 0) {
+            try {
+                config.wal_sync_interval_ms = static_cast<unsigned int>(
+                    std::stoul(arg.substr(std::strlen("--sync-interval-ms="))));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid sync interval: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg == "--no-sync-wait") {
+            config.wal_wait_for_sync = false;
+        } else if (arg.rfind("--snapshot-every=", 0) == 0) {
+            try {
+                config.snapshot_every = std::stoull(arg.substr(std::strlen("--snapshot-every=")));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid snapshot interval: " << arg << std::endl;
                 return 1;
             }
-        } catch (const std::exception& e) {
-            std::cerr << "Error: Invalid port number: " << argv[1] << std::endl;
+        } else if (arg.rfind("--replicate-from=", 0) == 0) {
+            if (!http_server::replication::parseAddress(arg.substr(std::strlen("--replicate-from=")),
+                                                        config.replication)) {
+                std::cerr << "Error: Invalid primary address: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--health-sample-ms=", 0) == 0) {
+            try {
+                config.health_sample_interval_ms = static_cast<unsigned int>(
+                    std::stoul(arg.substr(std::strlen("--health-sample-ms="))));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid health sample interval: " << arg << std::endl;
+                return 1;
+            }
+            if (config.health_sample_interval_ms == 0) {
+                std::cerr << "Error: Health sample interval must be positive" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--reuse-port") {
+            config.reuse_port = true;
+        } else if (arg.rfind("--drain-timeout-ms=", 0) == 0) {
+            try {
+                config.drain_timeout_ms = static_cast<unsigned int>(
+                    std::stoul(arg.substr(std::strlen("--drain-timeout-ms="))));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid drain timeout: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg == "--no-compression") {
+            config.compression.enabled = false;
+        } else if (arg.rfind("--compression-min-size=", 0) == 0) {
+            try {
+                config.compression.min_size = std::stoul(arg.substr(std::strlen("--compression-min-size=")));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid compression threshold: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--gzip-level=", 0) == 0 || arg.rfind("--brotli-quality=", 0) == 0) {
+            bool gzip = arg[2] == 'g';
+            int level = -1;
+            try {
+                level = std::stoi(arg.substr(arg.find('=') + 1));
+            } catch (const std::exception& e) {
+            }
+            if (level < (gzip ? 1 : 0) || level > (gzip ? 9 : 11)) {
+                std::cerr << "Error: Invalid compression level: " << arg << std::endl;
+                return 1;
+            }
+            (gzip ? config.compression.gzip_level : config.compression.brotli_quality) = level;
+        } else if (arg.rfind("--client-rate=", 0) == 0) {
+            if (!parse_rate(arg.substr(std::strlen("--client-rate=")), config.admission.per_client)) {
+                std::cerr << "Error: Invalid rate: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--route-rate=", 0) == 0) {
+            std::string spec = arg.substr(std::strlen("--route-rate="));
+            size_t eq = spec.rfind('=');
+            bool parsed = false;
+            for (size_t r = 0; eq != std::string::npos && r < http_server::metrics::kRouteCount; ++r) {
+                auto route = static_cast<http_server::metrics::Route>(r);
+                if (spec.compare(0, eq, http_server::metrics::toString(route)) == 0) {
+                    parsed = parse_rate(spec.substr(eq + 1), config.admission.per_route[r]);
+                    break;
+                }
+            }
+            if (!parsed) {
+                std::cerr << "Error: Invalid route rate: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--max-concurrent=", 0) == 0 || arg.rfind("--admission-queue=", 0) == 0 ||
+                   arg.rfind("--admission-queue-timeout-ms=", 0) == 0) {
+            unsigned int& target = arg[2] == 'm' ? config.admission.max_concurrent
+                                   : arg.rfind("--admission-queue=", 0) == 0 ? config.admission.queue_size
+                                   : config.admission.queue_timeout_ms;
+            try {
+                target = static_cast<unsigned int>(std::stoul(arg.substr(arg.find('=') + 1)));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid admission setting: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--trace-sample=", 0) == 0 || arg.rfind("--slow-request-ms=", 0) == 0) {
+            uint32_t& target = arg[2] == 't' ? config.tracing.sample_every : config.tracing.slow_threshold_ms;
+            try {
+                target = static_cast<uint32_t>(std::stoul(arg.substr(arg.find('=') + 1)));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid tracing setting: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--trace-file=", 0) == 0) {
+            config.tracing.chrome_trace_file = arg.substr(std::strlen("--trace-file="));
+        } else if (!parse_port(arg, config.port)) {
+            print_usage(argv[0]);
             return 1;
         }
     }
 
-    // Set up signal handlers for graceful shutdown
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    if (!config.replication.host.empty() && !config.data_dir.empty()) {
+        std::cerr << "Error: A replica keeps no data directory; drop --data-dir or --replicate-from" << std::endl;
+        return 1;
+    }
+
+    if (!http_server::trace::kEnabled && config.tracing.sample_every > 0) {
+        std::cerr << "Warning: built without ENABLE_TRACING; --trace-sample is ignored" << std::endl;
+    }
+
+    // Blocked before any thread starts, so every thread inherits the mask
+    // and main() alone takes SIGINT/SIGTERM, in sigwait() below
+    sigset_t shutdown_signals;
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &shutdown_signals, nullptr);
 
     try {
-        // Create task manager and demonstrate functionality
-        http_server::TaskManager task_manager;
-
-        std::cout << "🚀 Starting Task Manager Demo on port " << port << "..." << std::endl;
-
-        // Create a sample task
-        Json::Value taskData;
-        taskData["title"] = "Demo Task";
-        taskData["description"] = "A sample task for demonstration";
-        taskData["priority"] = "high";
-        taskData["status"] = "pending";
-
-        auto task = task_manager.createTask(taskData);
-
-        if (task) {
-            std::cout << "✅ Created demo task with ID: " << task->id << std::endl;
-            std::cout << "📋 Task count: " << task_manager.getTaskCount() << std::endl;
-
-            // Show statistics
-            auto stats = task_manager.getStatistics();
-            std::cout << "📊 Statistics:" << std::endl;
-            std::cout << "   Total tasks: " << stats["total"] << std::endl;
-            std::cout << "   Pending: " << stats["by_status"]["pending"] << std::endl;
-            std::cout << "   High priority: " << stats["by_priority"]["high"] << std::endl;
-        } else {
-            std::cerr << "❌ Failed to create demo task" << std::endl;
+        http_server::HttpServer server(config);
+
+        std::cout << "🚀 Starting HTTP server on port " << config.port << " ("
+                  << (config.threading_mode == http_server::ThreadingMode::THREAD_POOL
+                          ? "epoll thread pool" : "thread per connection")
+                  << ")..." << std::endl;
+        if (config.listener_layout != http_server::ListenerLayout::SINGLE) {
+            std::cout << "🧭 " << server.getListenerCount() << " pinned listeners over "
+                      << server.getNodes().size() << " NUMA node(s), "
+                      << server.getTaskManager().getShardCount() << " store shards" << std::endl;
+        }
+
+        if (server.isReplica()) {
+            std::cout << "🪞 Replicating from " << config.replication.host << ":" << config.replication.port
+                      << "; reads answer once caught up" << std::endl;
+        }
+
+        if (!server.start()) {
+            std::cerr << "❌ Failed to start HTTP server" << std::endl;
             return 1;
         }
 
-        std::cout << "💚 Task Manager Demo running successfully!" << std::endl;
-        std::cout << "📋 In a full implementation, this would be http://localhost:" << port << "/api/v1/tasks" << std::endl;
+        std::cout << "💚 Server running at http://localhost:" << config.port << "/api/v1/tasks" << std::endl;
         std::cout << "\nPress Ctrl+C to stop..." << std::endl;
 
-        // Simple demo loop
-        while (running) {
-            sleep(1);
-        }
+        int signal = 0;
+        sigwait(&shutdown_signals, &signal);
+        std::cout << "\nReceived signal " << signal << ", shutting down gracefully..." << std::endl;
 
-        std::cout << "\n🛑 Stopping Task Manager Demo..." << std::endl;
-        std::cout << "✅ Demo stopped gracefully. Goodbye!" << std::endl;
+        std::cout << "🛑 Draining " << server.activeRequests() << " requests (up to "
+                  << config.drain_timeout_ms << " ms)..." << std::endl;
+        if (server.shutdown(std::chrono::milliseconds(config.drain_timeout_ms))) {
+            std::cout << "✅ Server stopped gracefully. Goodbye!" << std::endl;
+        } else {
+            std::cout << "⚠️  Drain timed out; remaining requests were cut off" << std::endl;
+        }
 
     } catch (const std::exception& e) {
         std::cerr << "💥 Fatal error: " << e.what() << std::endl;
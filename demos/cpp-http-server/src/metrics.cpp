@@ -0,0 +1,214 @@
+#include "metrics.h"
+#include <bit>
+#include <charconv>
+
+namespace http_server {
+namespace metrics {
+
+size_t threadShard() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+    return shard;
+}
+
+size_t Buckets::indexFor(uint64_t nanos) {
+    if (nanos < 1024) {
+        return 0;
+    }
+    const unsigned width = static_cast<unsigned>(std::bit_width(nanos));
+    if (width > 33) {
+        return kOverflow;
+    }
+    // The two bits below the leading one pick the sub-bucket
+    const unsigned shift = width - 3;
+    return 1 + (width - 11) * 4 + ((nanos >> shift) & 3);
+}
+
+uint64_t Buckets::upperBound(size_t index) {
+    if (index == 0) {
+        return 1024;
+    }
+    const size_t k = index - 1;
+    const unsigned width = static_cast<unsigned>(k / 4 + 11);
+    return static_cast<uint64_t>(5 + k % 4) << (width - 3);
+}
+
+void Histogram::record(uint64_t nanos) {
+    Shard& shard = shards_[threadShard()];
+    shard.counts[Buckets::indexFor(nanos)].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+HistogramSnapshot Histogram::snapshot() const {
+    HistogramSnapshot snapshot;
+    for (const Shard& shard : shards_) {
+        for (size_t i = 0; i < snapshot.counts.size(); ++i) {
+            uint64_t n = shard.counts[i].load(std::memory_order_relaxed);
+            snapshot.counts[i] += n;
+            snapshot.count += n;
+        }
+        snapshot.sum_nanos += shard.sum.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+const char* toString(Route route) {
+    switch (route) {
+        case Route::HEALTH: return "/health";
+        case Route::METRICS: return "/metrics";
+        case Route::TASKS: return "/api/v1/tasks";
+        case Route::TASK: return "/api/v1/tasks/{id}";
+        case Route::STATISTICS: return "/api/v1/tasks/stats/summary";
+        case Route::BATCH: return "/api/v1/tasks:batch";
+        case Route::EXPORT: return "/api/v1/tasks:export";
+        case Route::IMPORT: return "/api/v1/tasks:import";
+        case Route::EVENTS: return "/api/v1/tasks/events";
+        case Route::OTHER: return "other";
+    }
+    return "other";
+}
+
+const char* toString(Method method) {
+    switch (method) {
+        case Method::GET: return "GET";
+        case Method::POST: return "POST";
+        case Method::PUT: return "PUT";
+        case Method::DELETE: return "DELETE";
+        case Method::OTHER: return "OTHER";
+    }
+    return "OTHER";
+}
+
+void RequestMetrics::record(Route route, Method method, int status,
+                            std::chrono::steady_clock::duration elapsed) {
+    const size_t r = static_cast<size_t>(route);
+    const size_t m = static_cast<size_t>(method);
+    size_t status_class = status >= 100 && status < 600 ? static_cast<size_t>(status / 100 - 1) : 4;
+    shards_[threadShard()].responses[r][m][status_class].fetch_add(1, std::memory_order_relaxed);
+    latency_[r][m].record(elapsed);
+}
+
+uint64_t RequestMetrics::requests(Route route, Method method) const {
+    uint64_t total = 0;
+    for (const Shard& shard : shards_) {
+        for (const auto& count : shard.responses[static_cast<size_t>(route)][static_cast<size_t>(method)]) {
+            total += count.load(std::memory_order_relaxed);
+        }
+    }
+    return total;
+}
+
+HistogramSnapshot RequestMetrics::latency(Route route, Method method) const {
+    return latency_[static_cast<size_t>(route)][static_cast<size_t>(method)].snapshot();
+}
+
+namespace {
+
+std::string seriesLabels(size_t route, size_t method) {
+    std::string labels = "route=\"";
+    labels.append(toString(static_cast<Route>(route)));
+    labels.append("\",method=\"");
+    labels.append(toString(static_cast<Method>(method)));
+    labels.push_back('"');
+    return labels;
+}
+
+void appendDouble(std::string& out, double value) {
+    char buf[32];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, static_cast<size_t>(result.ptr - buf));
+}
+
+} // namespace
+
+void RequestMetrics::appendPrometheus(std::string& out) const {
+    appendHelp(out, "http_requests_total", "counter", "Requests answered, by route, method and status class");
+    for (size_t r = 0; r < kRouteCount; ++r) {
+        for (size_t m = 0; m < kMethodCount; ++m) {
+            for (size_t c = 0; c < kStatusClassCount; ++c) {
+                uint64_t total = 0;
+                for (const Shard& shard : shards_) {
+                    total += shard.responses[r][m][c].load(std::memory_order_relaxed);
+                }
+                if (total == 0) {
+                    continue;
+                }
+                std::string labels = seriesLabels(r, m);
+                labels.append(",code=\"");
+                labels.push_back(static_cast<char>('1' + c));
+                labels.append("xx\"");
+                appendSample(out, "http_requests_total", labels, total);
+            }
+        }
+    }
+
+    appendHelp(out, "http_request_duration_seconds", "histogram",
+               "Time from receiving the request headers to queueing the response");
+    for (size_t r = 0; r < kRouteCount; ++r) {
+        for (size_t m = 0; m < kMethodCount; ++m) {
+            HistogramSnapshot snapshot = latency_[r][m].snapshot();
+            if (snapshot.count > 0) {
+                appendHistogram(out, "http_request_duration_seconds", seriesLabels(r, m), snapshot);
+            }
+        }
+    }
+}
+
+void LockMetrics::appendPrometheus(std::string& out) const {
+    appendHelp(out, "task_store_lock_wait_seconds", "histogram",
+               "Time spent acquiring a task store shard lock");
+    appendHistogram(out, "task_store_lock_wait_seconds", "mode=\"write\"", write_wait.snapshot());
+    appendHistogram(out, "task_store_lock_wait_seconds", "mode=\"read\"", read_wait.snapshot());
+    appendHelp(out, "task_store_lock_hold_seconds", "histogram",
+               "Time a writer held a task store shard lock");
+    appendHistogram(out, "task_store_lock_hold_seconds", "mode=\"write\"", write_hold.snapshot());
+}
+
+void appendHelp(std::string& out, std::string_view name, std::string_view type,
+                std::string_view help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void appendSample(std::string& out, std::string_view name, std::string_view labels, double value) {
+    out.append(name);
+    if (!labels.empty()) {
+        out.append("{").append(labels).append("}");
+    }
+    out.push_back(' ');
+    appendDouble(out, value);
+    out.push_back('\n');
+}
+
+void appendSample(std::string& out, std::string_view name, std::string_view labels, uint64_t value) {
+    out.append(name);
+    if (!labels.empty()) {
+        out.append("{").append(labels).append("}");
+    }
+    out.push_back(' ');
+    char buf[20];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, static_cast<size_t>(result.ptr - buf));
+    out.push_back('\n');
+}
+
+void appendHistogram(std::string& out, std::string_view name, std::string_view labels,
+                     const HistogramSnapshot& histogram) {
+    const std::string bucket = std::string(name) + "_bucket";
+    const std::string prefix = labels.empty() ? std::string() : std::string(labels) + ",";
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < Buckets::kCount; ++i) {
+        cumulative += histogram.counts[i];
+        std::string le = prefix + "le=\"";
+        appendDouble(le, static_cast<double>(Buckets::upperBound(i)) / 1e9);
+        le.push_back('"');
+        appendSample(out, bucket, le, cumulative);
+    }
+    appendSample(out, bucket, prefix + "le=\"+Inf\"", histogram.count);
+    appendSample(out, std::string(name) + "_sum", labels, static_cast<double>(histogram.sum_nanos) / 1e9);
+    appendSample(out, std::string(name) + "_count", labels, histogram.count);
+}
+
+} // namespace metrics
+} // namespace http_server
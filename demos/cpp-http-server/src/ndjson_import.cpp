@@ -0,0 +1,116 @@
+#include "ndjson_import.h"
+#include "json_utils.h"
+#include <cstring>
+
+namespace http_server {
+
+NdjsonImporter::NdjsonImporter(TaskManager& manager, size_t max_line_size)
+    : manager_(manager), max_line_size_(max_line_size) {
+    batch_.reserve(kBatchSize);
+}
+
+void NdjsonImporter::feed(const char* data, size_t size) {
+    const char* end = data + size;
+    while (data < end) {
+        const char* newline = static_cast<const char*>(std::memchr(data, '\n', static_cast<size_t>(end - data)));
+        const char* line_end = newline ? newline : end;
+        size_t length = static_cast<size_t>(line_end - data);
+
+        if (!skipping_ && partial_.size() + length > max_line_size_) {
+            ++line_;
+            reject("", "Line too long");
+            partial_.clear();
+            skipping_ = true;
+        }
+
+        if (!newline) {
+            if (!skipping_) {
+                partial_.append(data, length);
+            }
+            return;
+        }
+
+        if (skipping_) {
+            skipping_ = false;
+        } else if (partial_.empty()) {
+            // Whole line inside this chunk: parse it in place
+            processLine(data, length);
+        } else {
+            partial_.append(data, length);
+            processLine(partial_.data(), partial_.size());
+            partial_.clear();
+        }
+        data = newline + 1;
+    }
+}
+
+void NdjsonImporter::finish() {
+    if (!skipping_ && !partial_.empty()) {
+        processLine(partial_.data(), partial_.size());
+    }
+    partial_.clear();
+    skipping_ = false;
+    flush();
+}
+
+void NdjsonImporter::processLine(const char* data, size_t size) {
+    ++line_;
+    if (size > 0 && data[size - 1] == '\r') {
+        --size;
+    }
+    if (size == 0) {
+        return;
+    }
+
+    Json::Value json = json_utils::parseJson(data, size);
+    if (json.isNull()) {
+        reject("", "Invalid JSON");
+        return;
+    }
+    if (const Json::Value* end = json.isObject() ? json.find("end", "end" + 3) : nullptr;
+        end && end->isBool() && end->asBool()) {
+        const Json::Value& count = json["count"];
+        const Json::Value& seq = json["seq"];
+        if (!count.isUInt64() || !seq.isUInt64()) {
+            reject("", "Invalid end of export");
+            return;
+        }
+        trailer_ = Trailer{count.asUInt64(), seq.asUInt64()};
+        return;
+    }
+
+    ValidationError error;
+    auto task = Task::restoreFromJson(json, &error);
+    if (!task) {
+        reject(std::move(error.field), std::move(error.message));
+        return;
+    }
+
+    batch_.push_back(std::move(task));
+    if (batch_.size() == kBatchSize) {
+        flush();
+    }
+}
+
+void NdjsonImporter::reject(std::string field, std::string message) {
+    ++failed_;
+    if (errors_.size() < kMaxReportedErrors) {
+        errors_.push_back({line_, std::move(field), std::move(message)});
+    }
+}
+
+void NdjsonImporter::flush() {
+    if (batch_.empty() || log_failed_) {
+        batch_.clear();
+        return;
+    }
+    try {
+        manager_.restoreTasks(batch_);
+        imported_ += batch_.size();
+    } catch (const DurabilityError&) {
+        log_failed_ = true;
+    }
+    batch_.clear();
+}
+
+} // namespace http_server
@@ -0,0 +1,691 @@
+#include "persistence.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace http_server {
+
+namespace {
+
+constexpr uint8_t kOpPut = 1;
+constexpr uint8_t kOpDelete = 2;
+constexpr size_t kFrameHeaderSize = 8;  // length + crc32
+
+constexpr char kSnapshotMagic[8] = {'T', 'A', 'S', 'K', 'S', 'N', 'P', '1'};
+constexpr size_t kSnapshotHeaderSize = sizeof(kSnapshotMagic) + 2 * sizeof(uint64_t);
+constexpr size_t kSnapshotPageSize = 4096;
+constexpr size_t kLoadBatchSize = 64 * 1024;
+constexpr size_t kWriteChunkSize = 1024 * 1024;
+
+template <typename T>
+void put(std::string& out, T value) {
+    char buf[sizeof(T)];
+    std::memcpy(buf, &value, sizeof(T));
+    out.append(buf, sizeof(T));
+}
+
+template <typename T>
+bool get(const char*& pos, const char* end, T& value) {
+    if (static_cast<size_t>(end - pos) < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+void putString(std::string& out, const std::string& value) {
+    put<uint32_t>(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+bool getString(const char*& pos, const char* end, std::string& value) {
+    uint32_t size;
+    if (!get(pos, end, size) || static_cast<size_t>(end - pos) < size) {
+        return false;
+    }
+    value.assign(pos, size);
+    pos += size;
+    return true;
+}
+
+int64_t toTicks(std::chrono::system_clock::time_point tp) {
+    return static_cast<int64_t>(tp.time_since_epoch().count());
+}
+
+std::chrono::system_clock::time_point fromTicks(int64_t ticks) {
+    return std::chrono::system_clock::time_point(std::chrono::system_clock::duration(ticks));
+}
+
+std::string numberedPath(const std::string& dir, const char* prefix, uint64_t n, const char* suffix) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s%020llu%s", prefix, static_cast<unsigned long long>(n), suffix);
+    return dir + "/" + name;
+}
+
+std::string segmentPath(const std::string& dir, uint64_t n) {
+    return numberedPath(dir, "wal-", n, ".log");
+}
+
+std::string snapshotPath(const std::string& dir, uint64_t n) {
+    return numberedPath(dir, "snapshot-", n, ".bin");
+}
+
+bool parseNumbered(const std::string& name, const std::string& prefix, const std::string& suffix,
+                   uint64_t& n) {
+    if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return false;
+    }
+    std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    n = std::stoull(digits);
+    return true;
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Makes a created or renamed entry in dir durable
+void syncDirectory(const std::string& dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+// Read-only mapping of a whole file; empty files map to an empty range
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st {};
+        if (::fstat(fd, &st) == 0) {
+            size_ = static_cast<size_t>(st.st_size);
+            ok_ = true;
+            if (size_ > 0) {
+                void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED) {
+                    ok_ = false;
+                    size_ = 0;
+                } else {
+                    data_ = static_cast<const char*>(data);
+                    ::madvise(data, size_, MADV_SEQUENTIAL);
+                }
+            }
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return ok_; }
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool ok_ = false;
+};
+
+} // namespace
+
+namespace task_codec {
+
+void encode(std::string& out, const Task& task) {
+    put<uint64_t>(out, task.id);
+    put<uint64_t>(out, task.version);
+    put<int64_t>(out, toTicks(task.created_at));
+    put<int64_t>(out, toTicks(task.updated_at));
+    put<uint8_t>(out, static_cast<uint8_t>(task.status));
+    put<uint8_t>(out, static_cast<uint8_t>(task.priority));
+    put<int64_t>(out, task.due_at);
+    put<uint8_t>(out, static_cast<uint8_t>(task.due_kind));
+    putString(out, task.title);
+    putString(out, task.description);
+}
+
+std::shared_ptr<Task> decode(const char*& pos, const char* end) {
+    auto task = std::make_shared<Task>();
+    uint64_t version;
+    int64_t created, updated;
+    uint8_t status, priority, due_kind;
+    if (!get(pos, end, task->id) || !get(pos, end, version) || version > UINT32_MAX || !get(pos, end, created) ||
+        !get(pos, end, updated) || !get(pos, end, status) || !get(pos, end, priority) ||
+        status >= kTaskStatusCount || priority >= kTaskPriorityCount ||
+        !get(pos, end, task->due_at) || !get(pos, end, due_kind) ||
+        due_kind > static_cast<uint8_t>(DueDateKind::DATE_TIME) ||
+        !getString(pos, end, task->title) || !getString(pos, end, task->description)) {
+        return nullptr;
+    }
+    task->version = static_cast<uint32_t>(version);
+    task->due_kind = static_cast<DueDateKind>(due_kind);
+    task->created_at = fromTicks(created);
+    task->updated_at = fromTicks(updated);
+    task->status = static_cast<TaskStatus>(status);
+    task->priority = static_cast<TaskPriority>(priority);
+    return task;
+}
+
+uint32_t crc32(const char* data, size_t size) {
+    static constexpr auto kTable = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = kTable[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+} // namespace task_codec
+
+// WriteAheadLog
+
+WriteAheadLog::WriteAheadLog(std::string dir, std::chrono::milliseconds sync_interval,
+                             bool wait_for_sync)
+    : dir_(std::move(dir)), sync_interval_(sync_interval), wait_for_sync_(wait_for_sync) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+bool WriteAheadLog::open(uint64_t segment) {
+    std::lock_guard<std::mutex> io(io_mutex_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ >= 0) {
+        return true;
+    }
+    // The store may hold writes the failed log never got to disk
+    if (failed_) {
+        return false;
+    }
+
+    std::string path = segmentPath(dir_, segment);
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        std::cerr << "WAL: cannot open " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    syncDirectory(dir_);
+
+    segment_ = segment;
+    stopping_ = false;
+    flusher_ = std::thread(&WriteAheadLog::flusherLoop, this);
+    return true;
+}
+
+void WriteAheadLog::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!flusher_.joinable()) {
+            return;
+        }
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    flusher_.join();
+    flush();
+
+    std::lock_guard<std::mutex> io(io_mutex_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ::close(fd_);
+    fd_ = -1;
+    synced_.notify_all();
+}
+
+uint64_t WriteAheadLog::logPut(const Task& task) {
+    return appendRecord(kOpPut, &task, task.id);
+}
+
+uint64_t WriteAheadLog::logDelete(uint64_t id) {
+    return appendRecord(kOpDelete, nullptr, id);
+}
+
+uint64_t WriteAheadLog::appendRecord(uint8_t op, const Task* task, uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed_) {
+        // Never written; waitDurable reports the failure
+        return appended_ + 1;
+    }
+
+    // Encode straight into the buffer, then fill in the frame header
+    size_t start = buffer_.size();
+    buffer_.append(kFrameHeaderSize, '\0');
+    buffer_.push_back(static_cast<char>(op));
+    if (task) {
+        task_codec::encode(buffer_, *task);
+    } else {
+        put<uint64_t>(buffer_, id);
+    }
+
+    const char* body = buffer_.data() + start + kFrameHeaderSize;
+    uint32_t length = static_cast<uint32_t>(buffer_.size() - start - kFrameHeaderSize);
+    uint32_t crc = task_codec::crc32(body, length);
+    std::memcpy(&buffer_[start], &length, sizeof(length));
+    std::memcpy(&buffer_[start + sizeof(length)], &crc, sizeof(crc));
+
+    appended_ += buffer_.size() - start;
+    operations_.fetch_add(1, std::memory_order_relaxed);
+    return appended_;
+}
+
+bool WriteAheadLog::waitDurable(uint64_t seq) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!wait_for_sync_) {
+        return !failed_;
+    }
+    // Bounded waits, re-armed each sync interval, like the flusher's
+    while (!synced_.wait_for(lock, sync_interval_,
+                             [&] { return durable_ >= seq || failed_ || fd_ < 0; })) {
+    }
+    return durable_ >= seq;
+}
+
+bool WriteAheadLog::failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+void WriteAheadLog::fail() {
+    if (!failed_ && on_failure_) {
+        on_failure_();
+    }
+    failed_ = true;
+    buffer_.clear();
+}
+
+uint64_t WriteAheadLog::rotate() {
+    uint64_t segment;
+    {
+        std::lock_guard<std::mutex> io(io_mutex_);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (failed_) {
+            return segment_;
+        }
+
+        // Appenders wait out this one write; it only happens per snapshot
+        if (!writeOut(fd_, buffer_)) {
+            fail();
+        } else {
+            durable_ = appended_;
+            buffer_.clear();
+            ::close(fd_);
+
+            ++segment_;
+            std::string path = segmentPath(dir_, segment_);
+            fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd_ < 0) {
+                std::cerr << "WAL: cannot open " << path << ": " << std::strerror(errno) << std::endl;
+                fail();
+            }
+            syncDirectory(dir_);
+        }
+        segment = segment_;
+    }
+    synced_.notify_all();
+    return segment;
+}
+
+uint64_t WriteAheadLog::segment() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return segment_;
+}
+
+void WriteAheadLog::flusherLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        wake_.wait_for(lock, sync_interval_, [this] { return stopping_; });
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+void WriteAheadLog::flush() {
+    std::lock_guard<std::mutex> io(io_mutex_);
+
+    uint64_t target;
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (buffer_.empty() || failed_) {
+            return;
+        }
+        writing_.swap(buffer_);
+        target = appended_;
+        fd = fd_;
+    }
+
+    // Appenders keep filling the other buffer while this one syncs
+    const bool written = writeOut(fd, writing_);
+    writing_.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (written) {
+            durable_ = std::max(durable_, target);
+        } else {
+            fail();
+        }
+    }
+    synced_.notify_all();
+}
+
+bool WriteAheadLog::writeOut(int fd, const std::string& data) {
+    if (data.empty()) {
+        return true;
+    }
+    // Not retried: after a failed fdatasync the kernel may already have
+    // dropped the dirty pages, so a later success would prove nothing
+    if (fd < 0 || !writeAll(fd, data.data(), data.size()) || ::fdatasync(fd) != 0) {
+        std::cerr << "WAL: write to segment " << segment_ << " failed: " << std::strerror(errno)
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Persistence
+
+Persistence::Persistence(PersistenceConfig config)
+    : config_(std::move(config)),
+      wal_(config_.data_dir, config_.sync_interval, config_.wait_for_sync) {}
+
+Persistence::~Persistence() {
+    stop();
+}
+
+Persistence::RecoveryStats Persistence::recover(TaskManager& manager) {
+    auto started = std::chrono::steady_clock::now();
+    RecoveryStats stats;
+
+    std::filesystem::create_directories(config_.data_dir);
+
+    std::vector<uint64_t> snapshots;
+    std::vector<uint64_t> segments;
+    for (const auto& entry : std::filesystem::directory_iterator(config_.data_dir)) {
+        std::string name = entry.path().filename().string();
+        uint64_t n;
+        if (parseNumbered(name, "snapshot-", ".bin", n)) {
+            snapshots.push_back(n);
+        } else if (parseNumbered(name, "wal-", ".log", n)) {
+            segments.push_back(n);
+        }
+    }
+    std::sort(snapshots.begin(), snapshots.end());
+    std::sort(segments.begin(), segments.end());
+
+    uint64_t base = 0;
+    for (auto it = snapshots.rbegin(); it != snapshots.rend(); ++it) {
+        if (loadSnapshot(snapshotPath(config_.data_dir, *it), manager, stats)) {
+            base = *it;
+            break;
+        }
+    }
+
+    // Segments below the snapshot are leftovers of an interrupted cleanup
+    for (uint64_t n : segments) {
+        if (n >= base) {
+            replaySegment(segmentPath(config_.data_dir, n), manager, stats);
+        }
+    }
+
+    // Never append to a segment that may end in a torn record
+    next_segment_ = std::max<uint64_t>({base, segments.empty() ? 0 : segments.back() + 1, 1});
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return stats;
+}
+
+bool Persistence::loadSnapshot(const std::string& path, TaskManager& manager, RecoveryStats& stats) {
+    MappedFile file(path);
+    if (!file.ok() || file.size() < kSnapshotHeaderSize ||
+        std::memcmp(file.begin(), kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) {
+        std::cerr << "Persistence: skipping unreadable snapshot " << path << std::endl;
+        return false;
+    }
+
+    const char* pos = file.begin() + sizeof(kSnapshotMagic);
+    uint64_t next_id, count;
+    get(pos, file.end(), next_id);
+    get(pos, file.end(), count);
+
+    // Size each map once instead of rehashing at every doubling. An encoded
+    // task takes at least 40 bytes, which caps what a bad header can ask for.
+    manager.reserve(static_cast<size_t>(std::min<uint64_t>(count, file.size() / 40)));
+
+    std::vector<std::shared_ptr<Task>> batch;
+    batch.reserve(std::min<uint64_t>(count, kLoadBatchSize));
+    for (uint64_t i = 0; i < count; ++i) {
+        auto task = task_codec::decode(pos, file.end());
+        if (!task) {
+            throw std::runtime_error("corrupt snapshot " + path);
+        }
+        batch.push_back(std::move(task));
+        if (batch.size() == kLoadBatchSize) {
+            manager.loadTasks(batch);
+            batch.clear();
+        }
+    }
+    manager.loadTasks(batch);
+    manager.advanceNextId(next_id);
+
+    stats.snapshot_tasks = count;
+    return true;
+}
+
+void Persistence::replaySegment(const std::string& path, TaskManager& manager, RecoveryStats& stats) {
+    MappedFile file(path);
+    if (!file.ok()) {
+        std::cerr << "Persistence: cannot read " << path << std::endl;
+        return;
+    }
+
+    std::vector<std::shared_ptr<Task>> batch;
+    const char* pos = file.begin();
+    while (pos != file.end()) {
+        uint32_t length, crc;
+        const char* frame = pos;
+        if (!get(pos, file.end(), length) || !get(pos, file.end(), crc) ||
+            static_cast<size_t>(file.end() - pos) < length || task_codec::crc32(pos, length) != crc ||
+            length == 0) {
+            std::cerr << "Persistence: ignoring torn tail of " << path << " at byte "
+                      << (frame - file.begin()) << std::endl;
+            break;
+        }
+
+        const char* body = pos + 1;
+        const char* body_end = pos + length;
+        uint8_t op = static_cast<uint8_t>(*pos);
+        pos = body_end;
+
+        if (op == kOpPut) {
+            auto task = task_codec::decode(body, body_end);
+            if (task) {
+                batch.push_back(std::move(task));
+            }
+        } else if (op == kOpDelete) {
+            uint64_t id;
+            if (get(body, body_end, id)) {
+                // Puts before the delete must land first
+                manager.loadTasks(batch);
+                batch.clear();
+                manager.deleteTask(id);
+            }
+        }
+        ++stats.replayed_records;
+
+        if (batch.size() == kLoadBatchSize) {
+            manager.loadTasks(batch);
+            batch.clear();
+        }
+    }
+    manager.loadTasks(batch);
+}
+
+bool Persistence::start(TaskManager& manager) {
+    if (!wal_.open(next_segment_)) {
+        return false;
+    }
+    manager_ = &manager;
+    manager.setMutationLog(&wal_);
+
+    stopping_ = false;
+    if (config_.snapshot_every > 0) {
+        snapshotter_ = std::thread([this] {
+            uint64_t last = wal_.operationsLogged();
+            std::unique_lock<std::mutex> lock(stop_mutex_);
+            while (!stop_cv_.wait_for(lock, std::chrono::seconds(1), [this] { return stopping_; })) {
+                if (wal_.operationsLogged() - last >= config_.snapshot_every) {
+                    last = wal_.operationsLogged();
+                    lock.unlock();
+                    snapshot();
+                    lock.lock();
+                }
+            }
+        });
+    }
+    return true;
+}
+
+void Persistence::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+    if (snapshotter_.joinable()) {
+        snapshotter_.join();
+    }
+
+    if (manager_) {
+        manager_->setMutationLog(nullptr);
+        manager_ = nullptr;
+        wal_.close();
+        next_segment_ = wal_.segment() + 1;
+    }
+}
+
+bool Persistence::snapshot() {
+    std::lock_guard<std::mutex> guard(snapshot_mutex_);
+    if (!manager_) {
+        return false;
+    }
+
+    // Everything logged before the rotation is in the store by now; later
+    // writes land in the new segment and are replayed over the snapshot
+    uint64_t segment = wal_.rotate();
+    // A snapshot would take in writes the log refused, and then delete the
+    // segments that are all a restart has to go on
+    if (wal_.failed()) {
+        return false;
+    }
+    uint64_t next_id = manager_->nextId();
+
+    std::string path = snapshotPath(config_.data_dir, segment);
+    std::string temp = path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Persistence: cannot create " << temp << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::string buffer;
+    buffer.reserve(kWriteChunkSize + 4096);
+    buffer.append(kSnapshotMagic, sizeof(kSnapshotMagic));
+    put<uint64_t>(buffer, next_id);
+    put<uint64_t>(buffer, 0);  // Count, patched below
+
+    bool ok = true;
+    uint64_t count = 0;
+    uint64_t cursor = 0;
+    do {
+        TaskPage page = manager_->getTasksAfter(cursor, kSnapshotPageSize);
+        for (const auto& task : page.tasks) {
+            task_codec::encode(buffer, *task);
+        }
+        count += page.tasks.size();
+        if (buffer.size() >= kWriteChunkSize) {
+            ok = ok && writeAll(fd, buffer.data(), buffer.size());
+            buffer.clear();
+        }
+        cursor = page.next_cursor;
+    } while (cursor != 0);
+
+    ok = ok && writeAll(fd, buffer.data(), buffer.size());
+    ok = ok && ::pwrite(fd, &count, sizeof(count), sizeof(kSnapshotMagic) + sizeof(uint64_t)) ==
+                   static_cast<ssize_t>(sizeof(count));
+    ok = ok && ::fsync(fd) == 0;
+    ::close(fd);
+
+    if (!ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Persistence: snapshot " << path << " failed: " << std::strerror(errno) << std::endl;
+        ::unlink(temp.c_str());
+        return false;
+    }
+    syncDirectory(config_.data_dir);
+
+    removeSupersededFiles(segment);
+    return true;
+}
+
+void Persistence::removeSupersededFiles(uint64_t segment) {
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(config_.data_dir, ec)) {
+        std::string name = entry.path().filename().string();
+        uint64_t n;
+        if ((parseNumbered(name, "snapshot-", ".bin", n) || parseNumbered(name, "wal-", ".log", n)) &&
+            n < segment) {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+}
+
+} // namespace http_server
@@ -0,0 +1,128 @@
+#include "rcu_task_map.h"
+#include "epoch.h"
+#include "task_manager.h"
+
+namespace http_server {
+
+RcuTaskMap::Table::Table(unsigned bits)
+    : mask((size_t{1} << bits) - 1),
+      shift(64 - bits),
+      buckets(new std::atomic<Node*>[size_t{1} << bits]) {
+    for (size_t i = 0; i <= mask; ++i) {
+        buckets[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+size_t RcuTaskMap::Table::bucketFor(uint64_t id) const {
+    // Fibonacci hashing; ids inside a shard are strided, so mix them first
+    return static_cast<size_t>((id * 0x9E3779B97F4A7C15ULL) >> shift) & mask;
+}
+
+RcuTaskMap::RcuTaskMap() : table_(new Table(kInitialBits)), size_(0) {}
+
+RcuTaskMap::~RcuTaskMap() {
+    // The owner guarantees there are no readers left
+    deleteTable(table_.load(std::memory_order_relaxed));
+}
+
+void RcuTaskMap::deleteTable(void* ptr) {
+    auto* table = static_cast<Table*>(ptr);
+    for (size_t i = 0; i <= table->mask; ++i) {
+        Node* node = table->buckets[i].load(std::memory_order_relaxed);
+        while (node) {
+            Node* next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+    delete table;
+}
+
+RcuTaskMap::TaskPtr RcuTaskMap::find(uint64_t id) const {
+    const Table* table = table_.load(std::memory_order_acquire);
+    for (const Node* node = table->buckets[table->bucketFor(id)].load(std::memory_order_acquire);
+         node; node = node->next.load(std::memory_order_acquire)) {
+        if (node->id == id) {
+            return node->task;
+        }
+    }
+    return nullptr;
+}
+
+RcuTaskMap::TaskPtr RcuTaskMap::insertOrAssign(uint64_t id, TaskPtr task) {
+    Table* table = table_.load(std::memory_order_relaxed);
+    std::atomic<Node*>* link = &table->buckets[table->bucketFor(id)];
+
+    for (Node* node = link->load(std::memory_order_relaxed); node;
+         node = node->next.load(std::memory_order_relaxed)) {
+        if (node->id == id) {
+            // Publish a replacement node; readers already on the old one keep
+            // a consistent view until the epoch moves on
+            auto* replacement = new Node{id, std::move(task), {node->next.load(std::memory_order_relaxed)}};
+            link->store(replacement, std::memory_order_release);
+            TaskPtr previous = node->task;
+            EpochDomain::instance().retire(node);
+            return previous;
+        }
+        link = &node->next;
+    }
+
+    auto* head = &table->buckets[table->bucketFor(id)];
+    auto* node = new Node{id, std::move(task), {head->load(std::memory_order_relaxed)}};
+    head->store(node, std::memory_order_release);
+
+    if (size_.fetch_add(1, std::memory_order_relaxed) + 1 > 2 * (table->mask + 1)) {
+        rehash(64 - table->shift + 1);
+    }
+    return nullptr;
+}
+
+RcuTaskMap::TaskPtr RcuTaskMap::erase(uint64_t id) {
+    Table* table = table_.load(std::memory_order_relaxed);
+    std::atomic<Node*>* link = &table->buckets[table->bucketFor(id)];
+
+    for (Node* node = link->load(std::memory_order_relaxed); node;
+         node = node->next.load(std::memory_order_relaxed)) {
+        if (node->id == id) {
+            link->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+            size_.fetch_sub(1, std::memory_order_relaxed);
+            TaskPtr previous = node->task;
+            EpochDomain::instance().retire(node);
+            return previous;
+        }
+        link = &node->next;
+    }
+    return nullptr;
+}
+
+void RcuTaskMap::reserve(size_t count) {
+    // Same load factor insertOrAssign grows at
+    const Table* table = table_.load(std::memory_order_relaxed);
+    unsigned bits = 64 - table->shift;
+    while ((size_t{2} << bits) < count) {
+        ++bits;
+    }
+    if (bits != 64 - table->shift) {
+        rehash(bits);
+    }
+}
+
+void RcuTaskMap::rehash(unsigned bits) {
+    Table* old_table = table_.load(std::memory_order_relaxed);
+    auto* table = new Table(bits);
+
+    // Readers may still be walking the old chains, so copy rather than relink
+    for (size_t i = 0; i <= old_table->mask; ++i) {
+        for (Node* node = old_table->buckets[i].load(std::memory_order_relaxed); node;
+             node = node->next.load(std::memory_order_relaxed)) {
+            auto& head = table->buckets[table->bucketFor(node->id)];
+            head.store(new Node{node->id, node->task, {head.load(std::memory_order_relaxed)}},
+                       std::memory_order_relaxed);
+        }
+    }
+
+    table_.store(table, std::memory_order_release);
+    EpochDomain::instance().retire(old_table, &RcuTaskMap::deleteTable);
+}
+
+} // namespace http_server
@@ -0,0 +1,490 @@
+#include "replication.h"
+#include "json_utils.h"
+#include "metrics.h"
+#include "ndjson_import.h"
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <strings.h>
+
+namespace http_server {
+namespace replication {
+
+namespace {
+
+constexpr const char* kEventsPath = "/api/v1/tasks/events";
+constexpr const char* kExportPath = "/api/v1/tasks:export";
+constexpr size_t kReadSize = 64 * 1024;
+constexpr size_t kMaxHeaderSize = 64 * 1024;
+// How often blocked reads look at stop()
+constexpr int kPollMillis = 200;
+constexpr std::chrono::milliseconds kConnectTimeout{2000};
+
+int64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+template <typename T>
+bool parseNumber(std::string_view text, T& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+// Non-blocking connect bounded by timeout; the socket is left blocking
+int connectTo(const Settings& settings, std::chrono::milliseconds timeout) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    const std::string port = std::to_string(settings.port);
+    if (getaddrinfo(settings.host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* address = addresses; address && fd < 0; address = address->ai_next) {
+        fd = ::socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        const int flags = ::fcntl(fd, F_GETFL);
+        ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        bool connected = ::connect(fd, address->ai_addr, address->ai_addrlen) == 0;
+        if (!connected && errno == EINPROGRESS) {
+            pollfd pending{fd, POLLOUT, 0};
+            int error = 0;
+            socklen_t length = sizeof(error);
+            connected = ::poll(&pending, 1, static_cast<int>(timeout.count())) == 1 &&
+                        ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+        }
+        if (connected) {
+            ::fcntl(fd, F_SETFL, flags);
+        } else {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+bool sendAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+// Value of a header in a raw header block; names compare case-insensitively
+std::string_view headerValue(std::string_view headers, std::string_view name) {
+    size_t pos = headers.find("\r\n");
+    while (pos != std::string_view::npos) {
+        pos += 2;
+        size_t end = headers.find("\r\n", pos);
+        std::string_view line = headers.substr(pos, end == std::string_view::npos ? end : end - pos);
+        size_t colon = line.find(':');
+        if (colon == name.size() && ::strncasecmp(line.data(), name.data(), name.size()) == 0) {
+            std::string_view value = line.substr(colon + 1);
+            while (!value.empty() && value.front() == ' ') {
+                value.remove_prefix(1);
+            }
+            return value;
+        }
+        pos = end;
+    }
+    return {};
+}
+
+} // namespace
+
+bool parseAddress(std::string_view text, Settings& settings) {
+    size_t colon = text.rfind(':');
+    if (colon == std::string_view::npos || colon == 0) {
+        return false;
+    }
+    uint16_t port = 0;
+    if (!parseNumber(text.substr(colon + 1), port) || port == 0) {
+        return false;
+    }
+    std::string_view host = text.substr(0, colon);
+    // [::1]:8000
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+    settings.host = std::string(host);
+    settings.port = port;
+    return true;
+}
+
+// EventParser implementation
+void EventParser::feed(std::string_view bytes, const std::function<void(const Event&)>& on_event) {
+    while (!bytes.empty()) {
+        size_t newline = bytes.find('\n');
+        if (newline == std::string_view::npos) {
+            line_.append(bytes);
+            return;
+        }
+        if (line_.empty()) {
+            processLine(bytes.substr(0, newline), on_event);
+        } else {
+            line_.append(bytes.substr(0, newline));
+            processLine(line_, on_event);
+            line_.clear();
+        }
+        bytes.remove_prefix(newline + 1);
+    }
+}
+
+void EventParser::processLine(std::string_view line, const std::function<void(const Event&)>& on_event) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    if (line.empty()) {
+        if (has_data_) {
+            if (current_.type.empty()) {
+                current_.type = "message";
+            }
+            on_event(current_);
+        }
+        current_.type.clear();
+        current_.data.clear();
+        has_data_ = false;
+        return;
+    }
+    if (line.front() == ':') {
+        return;
+    }
+    size_t colon = line.find(':');
+    std::string_view field = line.substr(0, colon);
+    std::string_view value = colon == std::string_view::npos ? std::string_view() : line.substr(colon + 1);
+    if (!value.empty() && value.front() == ' ') {
+        value.remove_prefix(1);
+    }
+    if (field == "data") {
+        if (has_data_) {
+            current_.data.push_back('\n');
+        }
+        current_.data.append(value);
+        has_data_ = true;
+    } else if (field == "event") {
+        current_.type = std::string(value);
+    } else if (field == "id") {
+        // Like EventSource's last event id, it carries over to later frames
+        current_.id = std::string(value);
+    }
+}
+
+// Follower implementation
+struct Follower::Response {
+    int fd = -1;
+    int status = 0;
+    std::string headers;
+    std::string body;
+
+    ~Response() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+Follower::Follower(TaskManager& manager, Settings settings)
+    : manager_(manager), settings_(std::move(settings)) {}
+
+Follower::~Follower() {
+    stop();
+}
+
+void Follower::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stopping_ = false;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void Follower::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool Follower::stopping() const {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    return stopping_;
+}
+
+void Follower::run() {
+    for (;;) {
+        follow();
+        connected_.store(false, std::memory_order_release);
+        idle_.store(false, std::memory_order_release);
+        std::unique_lock<std::mutex> lock(stop_mutex_);
+        if (stop_cv_.wait_for(lock, std::chrono::milliseconds(settings_.reconnect_delay_ms),
+                              [this] { return stopping_; })) {
+            return;
+        }
+    }
+}
+
+bool Follower::open(const std::string& path, Response& response) const {
+    response.fd = connectTo(settings_, kConnectTimeout);
+    if (response.fd < 0) {
+        return false;
+    }
+    // HTTP/1.0, so streamed bodies come unchunked and end with the
+    // connection; no Accept-Encoding, so they come uncompressed
+    std::string request = "GET " + path + " HTTP/1.0\r\nHost: " + settings_.host + ":" +
+                          std::to_string(settings_.port) + "\r\n\r\n";
+    if (!sendAll(response.fd, request)) {
+        return false;
+    }
+    std::string raw;
+    size_t end;
+    while ((end = raw.find("\r\n\r\n")) == std::string::npos) {
+        if (raw.size() > kMaxHeaderSize || !receive(response.fd, raw)) {
+            return false;
+        }
+    }
+    if (raw.size() < 12 || raw.compare(0, 5, "HTTP/") != 0 ||
+        !parseNumber(std::string_view(raw).substr(9, 3), response.status)) {
+        return false;
+    }
+    response.body = raw.substr(end + 4);
+    raw.resize(end);
+    response.headers = std::move(raw);
+    return true;
+}
+
+bool Follower::receive(int fd, std::string& out) const {
+    for (;;) {
+        pollfd readable{fd, POLLIN, 0};
+        int ready = ::poll(&readable, 1, kPollMillis);
+        if (stopping()) {
+            return false;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        const size_t used = out.size();
+        out.resize(used + kReadSize);
+        ssize_t n = ::recv(fd, out.data() + used, kReadSize, 0);
+        out.resize(used + static_cast<size_t>(std::max<ssize_t>(n, 0)));
+        return n > 0;
+    }
+}
+
+void Follower::follow() {
+    std::string path = kEventsPath;
+    const bool fresh = position() == 0;
+    if (!fresh) {
+        path += "?since=" + std::to_string(position());
+    }
+    Response stream;
+    if (!open(path, stream) || stream.status != 200) {
+        return;
+    }
+    connected_.store(true, std::memory_order_release);
+    if (fresh) {
+        // The stream starts at the present: everything after that has
+        // already been queued on it, and the export covers the rest
+        uint64_t start = 0;
+        if (!parseNumber(headerValue(stream.headers, kFeedSeqHeader), start) || start == 0) {
+            std::cerr << "Replication: " << settings_.host << ":" << settings_.port
+                      << " sent no " << kFeedSeqHeader << std::endl;
+            return;
+        }
+        position_.store(start, std::memory_order_release);
+        if (!reload()) {
+            position_.store(0, std::memory_order_release);
+            return;
+        }
+    }
+
+    EventParser parser;
+    std::vector<std::shared_ptr<Task>> puts;
+    std::string chunk = std::move(stream.body);
+    for (;;) {
+        bool resync = false;
+        parser.feed(chunk, [&](const Event& event) { apply(event, puts, resync); });
+        flush(puts);
+        if (resync && !reload()) {
+            // Half reloaded, or not at all: start over from a fresh stream
+            position_.store(0, std::memory_order_release);
+            return;
+        }
+        if (!synced() && position() >= target_) {
+            setSynced(true);
+        }
+        // Nothing more has arrived: the store is as current as the primary
+        pollfd readable{stream.fd, POLLIN, 0};
+        if (::poll(&readable, 1, 0) == 0) {
+            current_as_of_us_.store(nowMicros(), std::memory_order_release);
+            idle_.store(true, std::memory_order_release);
+        }
+        chunk.clear();
+        if (!receive(stream.fd, chunk)) {
+            return;
+        }
+        idle_.store(false, std::memory_order_release);
+    }
+}
+
+void Follower::apply(const Event& event, std::vector<std::shared_ptr<Task>>& puts, bool& resync) {
+    Json::Value data;
+    try {
+        data = json_utils::parseJson(event.data);
+    } catch (const std::exception& e) {
+        std::cerr << "Replication: unreadable " << event.type << " event: " << e.what() << std::endl;
+        return;
+    }
+    if (event.type == "resync") {
+        // Continue after the primary's newest position once reloaded
+        flush(puts);
+        position_.store(data["latest_seq"].asUInt64(), std::memory_order_release);
+        resync = true;
+        return;
+    }
+    if (event.type == "put") {
+        if (auto task = Task::restoreFromJson(data["task"])) {
+            puts.push_back(std::move(task));
+        }
+    } else if (event.type == "delete") {
+        // Keeps the order with the puts before it
+        flush(puts);
+        manager_.deleteTask(data["id"].asUInt64());
+    } else {
+        return;
+    }
+    applied_.fetch_add(1, std::memory_order_relaxed);
+    position_.store(data["seq"].asUInt64(), std::memory_order_release);
+    current_as_of_us_.store(data["published_us"].asInt64(), std::memory_order_release);
+}
+
+void Follower::flush(std::vector<std::shared_ptr<Task>>& puts) {
+    if (!puts.empty()) {
+        manager_.restoreTasks(puts);
+        puts.clear();
+    }
+}
+
+bool Follower::reload() {
+    setSynced(false);
+    reloads_.fetch_add(1, std::memory_order_relaxed);
+    const int64_t started_us = nowMicros();
+
+    // What the store holds now; whatever the export does not replace is gone
+    std::vector<TaskPtr> previous;
+    for (TaskPage page = manager_.getTasksAfter(0, 1000);; page = manager_.getTasksAfter(page.next_cursor, 1000)) {
+        previous.insert(previous.end(), page.tasks.begin(), page.tasks.end());
+        if (page.next_cursor == 0) {
+            break;
+        }
+    }
+
+    Response dump;
+    if (!open(kExportPath, dump) || dump.status != 200) {
+        return false;
+    }
+    NdjsonImporter importer(manager_, kMaxLineSize);
+    importer.feed(dump.body.data(), dump.body.size());
+    // An HTTP/1.0 body ends with the connection, so only the closing line
+    // tells a complete export from one cut off between two lines
+    std::string chunk;
+    while (receive(dump.fd, chunk)) {
+        importer.feed(chunk.data(), chunk.size());
+        chunk.clear();
+    }
+    if (stopping()) {
+        return false;
+    }
+    importer.finish();
+    if (importer.failed() > 0) {
+        std::cerr << "Replication: " << importer.failed() << " unreadable tasks in the export" << std::endl;
+        return false;
+    }
+    if (!importer.trailer() || importer.trailer()->count != importer.imported()) {
+        std::cerr << "Replication: the export from " << settings_.host << ":" << settings_.port
+                  << " was cut off after " << importer.imported() << " tasks" << std::endl;
+        return false;
+    }
+
+    std::vector<uint64_t> removed;
+    for (const TaskPtr& task : previous) {
+        if (manager_.getTask(task->id) == task) {
+            removed.push_back(task->id);
+        }
+    }
+    manager_.deleteTasks(removed);
+
+    // Once the stream has come this far, no task is older than it was in
+    // the export
+    target_ = importer.trailer()->seq;
+    current_as_of_us_.store(started_us, std::memory_order_release);
+    std::cout << "Replication: loaded " << importer.imported() << " tasks from " << settings_.host << ":"
+              << settings_.port << " (" << removed.size() << " removed)" << std::endl;
+    return true;
+}
+
+void Follower::setSynced(bool synced) {
+    if (synced_.exchange(synced, std::memory_order_acq_rel) != synced && sync_listener_) {
+        sync_listener_(synced);
+    }
+}
+
+double Follower::lagSeconds() const {
+    if (connected() && idle_.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    const int64_t as_of = current_as_of_us_.load(std::memory_order_acquire);
+    if (as_of == 0) {
+        return 0;
+    }
+    return std::max<int64_t>(0, nowMicros() - as_of) / 1e6;
+}
+
+Json::Value Follower::getStatus() const {
+    Json::Value status;
+    status["primary"] = settings_.host + ":" + std::to_string(settings_.port);
+    status["connected"] = connected();
+    status["synced"] = synced();
+    status["position"] = static_cast<Json::UInt64>(position());
+    status["lag_seconds"] = lagSeconds();
+    return status;
+}
+
+void Follower::appendPrometheus(std::string& out) const {
+    metrics::appendHelp(out, "replication_connected", "gauge", "Whether the primary's change stream is open");
+    metrics::appendSample(out, "replication_connected", "", static_cast<uint64_t>(connected() ? 1 : 0));
+    metrics::appendHelp(out, "replication_lag_seconds", "gauge", "How far the store trails the primary");
+    metrics::appendSample(out, "replication_lag_seconds", "", lagSeconds());
+    metrics::appendHelp(out, "replication_applied_events_total", "counter", "Change events applied");
+    metrics::appendSample(out, "replication_applied_events_total", "", applied());
+    metrics::appendHelp(out, "replication_reloads_total", "counter", "Full reloads from the primary's export");
+    metrics::appendSample(out, "replication_reloads_total", "", reloads());
+}
+
+} // namespace replication
+} // namespace http_server
@@ -0,0 +1,48 @@
+#include "routing.h"
+#include <charconv>
+
+namespace http_server {
+namespace routing {
+
+Target resolve(metrics::Method method, std::string_view path) {
+    Target target;
+    const RouteMatch found = lookup(method, path);
+    target.route = found.route;
+    if (method == metrics::Method::OTHER) {
+        target.handler = Handler::METHOD_NOT_ALLOWED;
+        return target;
+    }
+    const RouteEntry* entry = found.entry;
+    if (!entry) {
+        return target;
+    }
+    target.handler = entry->handler;
+    if (entry->match == PathMatch::TASK_ID) {
+        target.task_id = parseTaskId(path);
+        if (target.task_id == 0) {
+            target.handler = Handler::INVALID_TASK_ID;
+        }
+    }
+    return target;
+}
+
+bool parseUInt(std::string_view text, uint64_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    const char* end = text.data() + text.size();
+    auto result = std::from_chars(text.data(), end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+uint64_t parseTaskId(std::string_view path) {
+    if (path.size() <= kApiPrefix.size() + 1 || !path.starts_with(kApiPrefix) ||
+        path[kApiPrefix.size()] != '/') {
+        return 0;
+    }
+    uint64_t id = 0;
+    return parseUInt(path.substr(kApiPrefix.size() + 1), id) ? id : 0;
+}
+
+} // namespace routing
+} // namespace http_server
@@ -1,6 +1,12 @@
 #include "task_manager.h"
+#include "change_feed.h"
 #include "json_utils.h"
+#include "epoch.h"
+#include "json_writer.h"
+#include "trace.h"
 #include <algorithm>
+#include <charconv>
+#include <ctime>
 #include <iomanip>
 #include <sstream>
 
@@ -29,41 +35,194 @@ Json::Value Task::toJson() const {
     // Convert timestamps to ISO 8601 format
     auto to_iso_string = [](const std::chrono::system_clock::time_point& tp) {
         auto time_t = std::chrono::system_clock::to_time_t(tp);
+        std::tm tm{};
+        gmtime_r(&time_t, &tm);  // std::gmtime shares a static buffer across threads
         std::stringstream ss;
-        ss << std::put_time(std::gmtime(&time_t), "%Y-%m-%dT%H:%M:%SZ");
+        ss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
         return ss.str();
     };
     
     json["created_at"] = to_iso_string(created_at);
     json["updated_at"] = to_iso_string(updated_at);
-    json["due_date"] = due_date.empty() ? Json::Value::null : Json::Value(due_date);
+    if (due_kind == DueDateKind::NONE) {
+        json["due_date"] = Json::Value::null;
+    } else {
+        std::string text;
+        json_writer::appendDueDateText(text, dueDate());
+        json["due_date"] = text;
+    }
     
     return json;
 }
 
-std::shared_ptr<Task> Task::fromJson(const Json::Value& json) {
-    if (!isValidTask(json)) {
+namespace {
+
+bool fail(ValidationError* error, const char* field, const char* message) {
+    if (error) {
+        error->field = field;
+        error->message = message;
+    }
+    return false;
+}
+
+// Borrow a string member's bytes without copying them
+bool stringView(const Json::Value& value, std::string_view& out) {
+    const char* begin;
+    const char* end;
+    if (!value.getString(&begin, &end)) {
+        return false;
+    }
+    out = std::string_view(begin, static_cast<size_t>(end - begin));
+    return true;
+}
+
+// Decode the known members of a task body in one walk; unknown keys are
+// ignored. toJson() writes an unset due date as null, so dumps may too.
+bool decodeFields(const Json::Value& json, TaskPatch& patch, ValidationError* error,
+                  bool null_due_date = false) {
+    if (!json.isObject()) {
+        return fail(error, "", "Request body must be a JSON object");
+    }
+
+    for (auto it = json.begin(); it != json.end(); ++it) {
+        const char* name_end;
+        const char* name_begin = it.memberName(&name_end);
+        std::string_view name(name_begin, static_cast<size_t>(name_end - name_begin));
+        const Json::Value& value = *it;
+        std::string_view text;
+
+        if (name == "title") {
+            if (!stringView(value, text) || text.empty()) {
+                return fail(error, "title", "title must be a non-empty string");
+            }
+            patch.title.emplace(text);
+        } else if (name == "description") {
+            if (!stringView(value, text)) {
+                return fail(error, "description", "description must be a string");
+            }
+            patch.description.emplace(text);
+        } else if (name == "due_date") {
+            if (null_due_date && value.isNull()) {
+                continue;
+            }
+            if (!stringView(value, text) || !(patch.due_date = DueDate::parse(text))) {
+                return fail(error, "due_date", "due_date must look like YYYY-MM-DD or YYYY-MM-DDTHH:MM:SSZ");
+            }
+        } else if (name == "status") {
+            if (!stringView(value, text) || !(patch.status = parseTaskStatus(text))) {
+                return fail(error, "status", "status must be one of pending, in_progress, completed");
+            }
+        } else if (name == "priority") {
+            if (!stringView(value, text) || !(patch.priority = parseTaskPriority(text))) {
+                return fail(error, "priority", "priority must be one of low, medium, high");
+            }
+        }
+    }
+    return true;
+}
+
+const Json::Value* findMember(const Json::Value& json, std::string_view name) {
+    return json.find(name.data(), name.data() + name.size());
+}
+
+// Seconds since the epoch for "YYYY-MM-DD" (with_time false) or
+// "YYYY-MM-DDTHH:MM:SSZ"; rejects dates that do not exist, so every accepted
+// value renders back to the same text
+bool parseCivil(std::string_view text, bool with_time, int64_t& out) {
+    if (text.size() != (with_time ? 20u : 10u) || text[4] != '-' || text[7] != '-' ||
+        (with_time && (text[10] != 'T' || text[13] != ':' || text[16] != ':' || text[19] != 'Z'))) {
+        return false;
+    }
+    auto digits = [&](size_t pos, size_t len, unsigned& value) {
+        const char* end = text.data() + pos + len;
+        auto result = std::from_chars(text.data() + pos, end, value);
+        return result.ec == std::errc() && result.ptr == end;
+    };
+
+    unsigned year, month, day, hour = 0, minute = 0, second = 0;
+    if (!digits(0, 4, year) || !digits(5, 2, month) || !digits(8, 2, day) ||
+        (with_time && (!digits(11, 2, hour) || !digits(14, 2, minute) || !digits(17, 2, second))) ||
+        month < 1 || month > 12 || day < 1 || hour > 23 || minute > 59 || second > 59) {
+        return false;
+    }
+    const bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    constexpr unsigned kDaysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (day > kDaysInMonth[month - 1] + (month == 2 && leap ? 1 : 0)) {
+        return false;
+    }
+
+    // Days from 1970-01-01, proleptic Gregorian
+    const int64_t y = static_cast<int64_t>(year) - (month <= 2 ? 1 : 0);
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    const int64_t days = era * 146097 + static_cast<int64_t>(doe) - 719468;
+
+    out = days * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+// Inverse of the "YYYY-MM-DDTHH:MM:SSZ" rendering in toJson()
+bool parseTimestamp(std::string_view text, std::chrono::system_clock::time_point& out) {
+    int64_t seconds;
+    if (!parseCivil(text, true, seconds)) {
+        return false;
+    }
+    out = std::chrono::system_clock::time_point(std::chrono::seconds(seconds));
+    return true;
+}
+
+} // namespace
+
+std::optional<DueDate> DueDate::parse(std::string_view text) {
+    DueDate due;
+    if (text.empty()) {
+        return due;
+    }
+    due.kind = text.size() == 10 ? DueDateKind::DATE : DueDateKind::DATE_TIME;
+    if (!parseCivil(text, due.kind == DueDateKind::DATE_TIME, due.seconds)) {
+        return std::nullopt;
+    }
+    return due;
+}
+
+std::optional<TaskPatch> TaskPatch::fromJson(const Json::Value& json, ValidationError* error) {
+    trace::Span span(trace::Phase::VALIDATE);
+    TaskPatch patch;
+    if (!decodeFields(json, patch, error)) {
+        return std::nullopt;
+    }
+    return patch;
+}
+
+void TaskPatch::applyTo(Task& task) const {
+    if (title) task.title = *title;
+    if (description) task.description = *description;
+    if (due_date) task.setDueDate(*due_date);
+    if (status) task.status = *status;
+    if (priority) task.priority = *priority;
+}
+
+namespace {
+
+std::shared_ptr<Task> buildTask(const Json::Value& json, ValidationError* error, bool from_dump) {
+    trace::Span span(trace::Phase::VALIDATE);
+    TaskPatch fields;
+    if (!decodeFields(json, fields, error, from_dump)) {
         return nullptr;
     }
-    
+    if (!fields.title) {
+        fail(error, "title", "title is required");
+        return nullptr;
+    }
+
     auto task = std::make_shared<Task>();
-    task->title = json["title"].asString();
-    task->description = json.get("description", "").asString();
-    task->due_date = json.get("due_date", "").asString();
-    
-    // Parse status
-    std::string status_str = json.get("status", "pending").asString();
-    if (status_str == "pending") task->status = TaskStatus::PENDING;
-    else if (status_str == "in_progress") task->status = TaskStatus::IN_PROGRESS;
-    else if (status_str == "completed") task->status = TaskStatus::COMPLETED;
-    else task->status = TaskStatus::PENDING;
-    
-    // Parse priority
-    std::string priority_str = json.get("priority", "medium").asString();
-    if (priority_str == "low") task->priority = TaskPriority::LOW;
-    else if (priority_str == "medium") task->priority = TaskPriority::MEDIUM;
-    else if (priority_str == "high") task->priority = TaskPriority::HIGH;
-    else task->priority = TaskPriority::MEDIUM;
+    task->title = std::move(*fields.title);
+    task->description = std::move(fields.description).value_or("");
+    task->setDueDate(fields.due_date.value_or(DueDate{}));
+    task->status = fields.status.value_or(TaskStatus::PENDING);
+    task->priority = fields.priority.value_or(TaskPriority::MEDIUM);
     
     // Set timestamps
     auto now = std::chrono::system_clock::now();
@@ -73,145 +232,886 @@ std::shared_ptr<Task> Task::fromJson(const Json::Value& json) {
     return task;
 }
 
+} // namespace
+
+std::shared_ptr<Task> Task::fromJson(const Json::Value& json, ValidationError* error) {
+    return buildTask(json, error, false);
+}
+
 bool Task::isValidTask(const Json::Value& json) {
-    return json.isMember("title") && 
-           json["title"].isString() && 
-           !json["title"].asString().empty();
+    trace::Span span(trace::Phase::VALIDATE);
+    TaskPatch fields;
+    return decodeFields(json, fields, nullptr) && fields.title.has_value();
+}
+
+std::shared_ptr<Task> Task::restoreFromJson(const Json::Value& json, ValidationError* error) {
+    auto task = buildTask(json, error, true);
+    if (!task) {
+        return nullptr;
+    }
+
+    if (const Json::Value* id = findMember(json, "id")) {
+        if (!id->isUInt64() || id->asUInt64() == 0) {
+            fail(error, "id", "id must be a positive integer");
+            return nullptr;
+        }
+        task->id = id->asUInt64();
+    }
+
+    for (auto [name, field] : {std::pair{"created_at", &task->created_at},
+                               std::pair{"updated_at", &task->updated_at}}) {
+        const Json::Value* value = findMember(json, name);
+        std::string_view text;
+        if (value && (!stringView(*value, text) || !parseTimestamp(text, *field))) {
+            fail(error, name, "timestamps must look like YYYY-MM-DDTHH:MM:SSZ");
+            return nullptr;
+        }
+    }
+    return task;
+}
+
+// Enum wire names
+const char* toString(TaskStatus status) {
+    switch (status) {
+        case TaskStatus::PENDING: return "pending";
+        case TaskStatus::IN_PROGRESS: return "in_progress";
+        case TaskStatus::COMPLETED: return "completed";
+    }
+    return "pending";
+}
+
+const char* toString(TaskPriority priority) {
+    switch (priority) {
+        case TaskPriority::LOW: return "low";
+        case TaskPriority::MEDIUM: return "medium";
+        case TaskPriority::HIGH: return "high";
+    }
+    return "medium";
+}
+
+std::optional<TaskStatus> parseTaskStatus(std::string_view str) {
+    if (str == "pending") return TaskStatus::PENDING;
+    if (str == "in_progress") return TaskStatus::IN_PROGRESS;
+    if (str == "completed") return TaskStatus::COMPLETED;
+    return std::nullopt;
+}
+
+std::optional<TaskPriority> parseTaskPriority(std::string_view str) {
+    if (str == "low") return TaskPriority::LOW;
+    if (str == "medium") return TaskPriority::MEDIUM;
+    if (str == "high") return TaskPriority::HIGH;
+    return std::nullopt;
+}
+
+std::optional<int64_t> timeKey(const Task& task, TaskTimeField field) {
+    switch (field) {
+        case TaskTimeField::DUE_DATE:
+            if (task.due_kind == DueDateKind::NONE) {
+                return std::nullopt;
+            }
+            return task.due_at;
+        case TaskTimeField::CREATED_AT:
+            return std::chrono::duration_cast<std::chrono::seconds>(task.created_at.time_since_epoch()).count();
+        case TaskTimeField::UPDATED_AT:
+            return std::chrono::duration_cast<std::chrono::seconds>(task.updated_at.time_since_epoch()).count();
+    }
+    return std::nullopt;
+}
+
+void TaskFilter::setQuery(std::string_view q) {
+    terms.emplace();
+    text_index::tokenize(q, *terms);
+}
+
+namespace {
+
+// Exclusive shard lock that records how long it took to get and how long
+// it was held, in the lock metrics and the request's trace
+class WriteLock {
+public:
+    WriteLock(std::shared_mutex& mutex, metrics::LockMetrics& stats) : mutex_(mutex), stats_(stats) {
+        auto start = std::chrono::steady_clock::now();
+        mutex_.lock();
+        acquired_ = std::chrono::steady_clock::now();
+        stats_.write_wait.record(acquired_ - start);
+        trace::record(trace::Phase::LOCK_WAIT, start, acquired_);
+    }
+
+    ~WriteLock() {
+        if (locked_) {
+            unlock();
+        }
+    }
+
+    WriteLock(const WriteLock&) = delete;
+    WriteLock& operator=(const WriteLock&) = delete;
+
+    void unlock() {
+        mutex_.unlock();
+        locked_ = false;
+        auto released = std::chrono::steady_clock::now();
+        stats_.write_hold.record(released - acquired_);
+        trace::record(trace::Phase::LOCK_HOLD, acquired_, released);
+    }
+
+private:
+    std::shared_mutex& mutex_;
+    metrics::LockMetrics& stats_;
+    std::chrono::steady_clock::time_point acquired_;
+    bool locked_ = true;
+};
+
+// Render a version's JSON before it becomes visible to readers
+void renderCache(Task& task) {
+    trace::Span span(trace::Phase::SERIALIZE);
+    // A successor copied from its base arrives holding the old bytes;
+    // clear() keeps that buffer for the new rendering
+    task.cached_json.clear();
+    task.cached_json.reserve(256 + task.title.size() + task.description.size());
+    json_writer::appendTask(task.cached_json, task);
+}
+
+// Copy-on-write successor of base with patch applied, ready to publish
+std::shared_ptr<Task> nextVersion(const Task& base, const TaskPatch& patch) {
+    auto task = std::make_shared<Task>(base);
+    patch.applyTo(*task);
+    task->updated_at = std::chrono::system_clock::now();
+    task->version = base.version + 1;
+    renderCache(*task);
+    return task;
+}
+
+// K-way merge over ordered index sets (ids, or (time, id) keys) of
+// several shards
+template <typename Key, typename Owner>
+class IndexMerge {
+public:
+    using Iterator = typename std::set<Key>::const_iterator;
+
+    // Merges [it, end) of one set
+    void add(Iterator it, Iterator end, const Owner* owner) {
+        if (it != end) {
+            heap_.push_back({it, end, owner});
+            std::push_heap(heap_.begin(), heap_.end(), Later());
+        }
+    }
+
+    bool empty() const { return heap_.empty(); }
+
+    bool next(Key& key, const Owner*& owner) {
+        if (heap_.empty()) {
+            return false;
+        }
+        std::pop_heap(heap_.begin(), heap_.end(), Later());
+        Cursor& cursor = heap_.back();
+        key = *cursor.it;
+        owner = cursor.owner;
+        if (++cursor.it == cursor.end) {
+            heap_.pop_back();
+        } else {
+            std::push_heap(heap_.begin(), heap_.end(), Later());
+        }
+        return true;
+    }
+
+private:
+    struct Cursor {
+        Iterator it;
+        Iterator end;
+        const Owner* owner;
+    };
+
+    struct Later {
+        bool operator()(const Cursor& a, const Cursor& b) const { return *b.it < *a.it; }
+    };
+
+    std::vector<Cursor> heap_;
+};
+
+bool hasRanges(const TaskFilter& filter) {
+    return std::any_of(std::begin(filter.ranges), std::end(filter.ranges),
+                       [](const TimeRange& range) { return range.bounded(); });
+}
+
+// Everything but the terms, which need the shard's text index
+bool matchesFields(const TaskFilter& filter, const Task& task) {
+    if ((filter.status && task.status != *filter.status) ||
+        (filter.priority && task.priority != *filter.priority)) {
+        return false;
+    }
+    for (size_t f = 0; f < kTaskTimeFieldCount; ++f) {
+        if (filter.ranges[f].bounded()) {
+            auto key = timeKey(task, static_cast<TaskTimeField>(f));
+            if (!key || !filter.ranges[f].contains(*key)) {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
+} // namespace
+
 // TaskManager implementation
-TaskManager::TaskManager() : next_id_(1) {}
+void TaskManager::Shard::addToIndex(const Task& task) {
+    size_t s = static_cast<size_t>(task.status);
+    size_t p = static_cast<size_t>(task.priority);
+    // New ids are the largest so far, so the end hint makes inserts O(1)
+    index[s][p].emplace_hint(index[s][p].end(), task.id);
+    // Writers are serialized by the shard lock; readers only need atomicity
+    counts[s][p].store(index[s][p].size(), std::memory_order_relaxed);
+    text.add(task.id, task.title, task.description);
+    for (size_t f = 0; f < kTaskTimeFieldCount; ++f) {
+        if (auto key = timeKey(task, static_cast<TaskTimeField>(f))) {
+            by_time[f].emplace(*key, task.id);
+        }
+    }
+}
 
-std::shared_ptr<Task> TaskManager::createTask(const Json::Value& taskData) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    auto task = Task::fromJson(taskData);
+void TaskManager::Shard::removeFromIndex(const Task& task) {
+    size_t s = static_cast<size_t>(task.status);
+    size_t p = static_cast<size_t>(task.priority);
+    index[s][p].erase(task.id);
+    counts[s][p].store(index[s][p].size(), std::memory_order_relaxed);
+    text.remove(task.id, task.title, task.description);
+    for (size_t f = 0; f < kTaskTimeFieldCount; ++f) {
+        if (auto key = timeKey(task, static_cast<TaskTimeField>(f))) {
+            by_time[f].erase({*key, task.id});
+        }
+    }
+}
+
+void TaskManager::Shard::replaceInIndex(const Task& current, const Task& next) {
+    if (next.status != current.status || next.priority != current.priority) {
+        size_t s = static_cast<size_t>(current.status);
+        size_t p = static_cast<size_t>(current.priority);
+        index[s][p].erase(current.id);
+        counts[s][p].store(index[s][p].size(), std::memory_order_relaxed);
+        s = static_cast<size_t>(next.status);
+        p = static_cast<size_t>(next.priority);
+        index[s][p].insert(next.id);
+        counts[s][p].store(index[s][p].size(), std::memory_order_relaxed);
+    }
+    text.replace(next.id, current.title, current.description, next.title, next.description);
+    for (size_t f = 0; f < kTaskTimeFieldCount; ++f) {
+        auto before = timeKey(current, static_cast<TaskTimeField>(f));
+        auto after = timeKey(next, static_cast<TaskTimeField>(f));
+        if (before != after) {
+            if (before) {
+                by_time[f].erase({*before, current.id});
+            }
+            if (after) {
+                by_time[f].emplace(*after, next.id);
+            }
+        }
+    }
+}
+
+TaskManager::TaskManager(size_t shard_count, size_t partitions)
+    : next_ids_(std::max<size_t>(partitions, 1)),
+      generation_(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count())) {
+    const size_t stride = next_ids_.size();
+    // A multiple of the partitions, so id % shards keeps each partition's
+    // ids in its own shards
+    shard_count = (std::max<size_t>(shard_count, 1) + stride - 1) / stride * stride;
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+    // Ids start at 1; partition 0's first one is the stride itself
+    for (size_t p = 0; p < stride; ++p) {
+        next_ids_[p].next = p == 0 ? stride : p;
+    }
+}
+
+uint64_t TaskManager::reserveIds(size_t count) {
+    const size_t stride = next_ids_.size();
+    return next_ids_[t_home_partition % stride].next.fetch_add(count * stride);
+}
+
+uint64_t TaskManager::nextId() const {
+    uint64_t next = 1;
+    for (const auto& counter : next_ids_) {
+        next = std::max(next, counter.next.load());
+    }
+    return next;
+}
+
+void TaskManager::feedPut(const TaskPtr& task) {
+    if (feed_) {
+        feed_->publishPut(task);
+    }
+}
+
+void TaskManager::feedDelete(uint64_t id) {
+    if (feed_) {
+        feed_->publishDelete(id);
+    }
+}
+
+TaskPtr TaskManager::createTask(const Json::Value& taskData) {
+    // Building the task touches no shared state, so do it before locking
+    return createTask(Task::fromJson(taskData));
+}
+
+TaskPtr TaskManager::createTask(std::shared_ptr<Task> task) {
     if (!task) {
         return nullptr;
     }
     
-    task->id = next_id_.fetch_add(1);
-    tasks_[task->id] = task;
+    task->id = reserveIds(1);
+    renderCache(*task);
+
+    Shard& shard = shardFor(task->id);
+    uint64_t seq;
+    {
+        WriteLock lock(shard.mutex, lock_metrics_);
+        shard.tasks.insertOrAssign(task->id, task);
+        shard.addToIndex(*task);
+        bumpGeneration();
+        feedPut(task);
+        seq = logPut(*task);
+    }
+    awaitLog(seq);
     
     return task;
 }
 
-std::shared_ptr<Task> TaskManager::getTask(uint64_t id) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    auto it = tasks_.find(id);
-    return (it != tasks_.end()) ? it->second : nullptr;
+TaskPtr TaskManager::getTask(uint64_t id) const {
+    EpochDomain::Guard guard;
+    return shardFor(id).tasks.find(id);
 }
 
-std::vector<std::shared_ptr<Task>> TaskManager::getAllTasks(
-    const std::string& status_filter,
-    const std::string& priority_filter,
+std::vector<TaskPtr> TaskManager::getAllTasks(
+    const TaskFilter& filter,
     size_t limit,
     size_t offset
 ) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    std::vector<std::shared_ptr<Task>> filtered_tasks;
+    return scanPage(filter, 0, offset, limit).tasks;
+}
+
+TaskPage TaskManager::getTasksAfter(uint64_t cursor, size_t limit, const TaskFilter& filter) const {
+    if (filter.sort) {
+        TaskFilter by_id = filter;
+        by_id.sort.reset();
+        return scanPage(by_id, cursor, 0, limit);
+    }
+    return scanPage(filter, cursor, 0, limit);
+}
+
+TaskPage TaskManager::scanPage(const TaskFilter& filter, uint64_t after, size_t offset,
+                               size_t limit) const {
+    TaskPage page;
+    if (limit == 0) {
+        return page;
+    }
+
+    // Hold every shard's shared lock so the page is one consistent snapshot
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(shards_.size());
+    auto wait_start = std::chrono::steady_clock::now();
+    for (const auto& shard : shards_) {
+        locks.emplace_back(shard->mutex);
+    }
+    auto acquired = std::chrono::steady_clock::now();
+    lock_metrics_.read_wait.record(acquired - wait_start);
+    trace::record(trace::Phase::LOCK_WAIT, wait_start, acquired);
+    // Declared after locks, so it ends just before they are released
+    trace::Span hold(trace::Phase::LOCK_HOLD);
+
+    if (filter.sort) {
+        return sortedPage(filter, offset, limit);
+    }
+    if (filter.terms) {
+        return searchPage(filter, after, offset, limit);
+    }
+    if (hasRanges(filter)) {
+        return rangePage(filter, after, offset, limit);
+    }
+
+    // Each index set is positioned with one O(log n) seek past the cursor
+    IndexMerge<uint64_t, Shard> merge;
+    for (const auto& shard : shards_) {
+        for (size_t s = 0; s < kTaskStatusCount; ++s) {
+            if (filter.status && static_cast<size_t>(*filter.status) != s) {
+                continue;
+            }
+            for (size_t p = 0; p < kTaskPriorityCount; ++p) {
+                if (filter.priority && static_cast<size_t>(*filter.priority) != p) {
+                    continue;
+                }
+                const IdIndex& ids = shard->index[s][p];
+                merge.add(ids.upper_bound(after), ids.end(), shard.get());
+            }
+        }
+    }
+
+    uint64_t id;
+    const Shard* shard;
+    for (size_t skipped = 0; skipped < offset && merge.next(id, shard); ++skipped) {
+        ++page.examined;
+    }
+
+    page.tasks.reserve(limit);
+    while (page.tasks.size() < limit && merge.next(id, shard)) {
+        // The shard lock keeps writers (and thus reclamation) away from it
+        page.tasks.push_back(shard->tasks.find(id));
+        ++page.examined;
+    }
+
+    if (page.tasks.size() == limit && !merge.empty()) {
+        page.next_cursor = page.tasks.back()->id;
+    }
     
-    for (const auto& pair : tasks_) {
-        auto task = pair.second;
-        
-        // Apply status filter
-        if (!status_filter.empty()) {
-            if (statusToString(task->status) != status_filter) {
+    return page;
+}
+
+TaskPage TaskManager::sortedPage(const TaskFilter& filter, size_t offset, size_t limit) const {
+    TaskPage page;
+    const size_t field = static_cast<size_t>(*filter.sort);
+    const TimeRange& range = filter.ranges[field];
+    if (range.from && range.until && *range.from >= *range.until) {
+        return page;
+    }
+
+    // The range on the sort field bounds each shard's walk; every other
+    // condition is checked per candidate. Ids start at 1, so (t, 0) sorts
+    // before every key at time t.
+    IndexMerge<std::pair<int64_t, uint64_t>, Shard> merge;
+    for (const auto& shard : shards_) {
+        const TimeIndex& index = shard->by_time[field];
+        merge.add(range.from ? index.lower_bound({*range.from, 0}) : index.begin(),
+                  range.until ? index.lower_bound({*range.until, 0}) : index.end(), shard.get());
+    }
+
+    std::pair<int64_t, uint64_t> key;
+    const Shard* shard;
+    size_t skipped = 0;
+    page.tasks.reserve(limit);
+    while (page.tasks.size() < limit && merge.next(key, shard)) {
+        ++page.examined;
+        TaskPtr task = shard->tasks.find(key.second);
+        if (!matchesFields(filter, *task) || (filter.terms && !shard->text.containsAll(*filter.terms, key.second))) {
+            continue;
+        }
+        if (skipped < offset) {
+            ++skipped;
+            continue;
+        }
+        page.tasks.push_back(std::move(task));
+    }
+    // next_cursor stays 0: a sorted list is paged by offset
+    return page;
+}
+
+TaskPage TaskManager::rangePage(const TaskFilter& filter, uint64_t after, size_t offset,
+                                size_t limit) const {
+    TaskPage page;
+    using Walk = std::pair<TimeIndex::const_iterator, TimeIndex::const_iterator>;
+    auto walkOf = [&](const Shard& shard, size_t field) {
+        const TimeRange& range = filter.ranges[field];
+        const TimeIndex& index = shard.by_time[field];
+        auto begin = range.from ? index.lower_bound({*range.from, 0}) : index.begin();
+        auto end = range.until ? index.lower_bound({*range.until, 0}) : index.end();
+        // An empty or inverted range
+        return range.from && range.until && *range.from >= *range.until ? Walk{end, end} : Walk{begin, end};
+    };
+
+    // Each shard walks the by_time range of whichever bounded field has the
+    // fewest entries in it there (counting stops at the best so far); the
+    // other conditions are checked per candidate. Time order is not id
+    // order, so the hits are sorted by id for the keyset cursor.
+    std::vector<TaskPtr> matches;
+    for (const auto& shard : shards_) {
+        Walk best{};
+        size_t best_size = SIZE_MAX;
+        for (size_t f = 0; f < kTaskTimeFieldCount; ++f) {
+            if (!filter.ranges[f].bounded()) {
                 continue;
             }
+            Walk walk = walkOf(*shard, f);
+            size_t size = 0;
+            for (auto it = walk.first; it != walk.second && size < best_size; ++it) {
+                ++size;
+            }
+            if (size < best_size) {
+                best = walk;
+                best_size = size;
+            }
         }
-        
-        // Apply priority filter
-        if (!priority_filter.empty()) {
-            if (priorityToString(task->priority) != priority_filter) {
+        for (auto it = best.first; it != best.second; ++it) {
+            if (it->second <= after) {
                 continue;
             }
+            ++page.examined;
+            TaskPtr task = shard->tasks.find(it->second);
+            if (matchesFields(filter, *task)) {
+                matches.push_back(std::move(task));
+            }
         }
-        
-        filtered_tasks.push_back(task);
     }
-    
-    // Apply pagination
-    if (offset >= filtered_tasks.size()) {
-        return {};
+
+    // Only the ids up to the page and one lookahead need to be in order
+    const size_t wanted = std::min(matches.size(), offset + limit + 1);
+    auto byId = [](const TaskPtr& a, const TaskPtr& b) { return a->id < b->id; };
+    std::partial_sort(matches.begin(), matches.begin() + static_cast<std::ptrdiff_t>(wanted), matches.end(), byId);
+    if (offset >= wanted) {
+        return page;
     }
-    
-    auto start_it = filtered_tasks.begin() + offset;
-    auto end_it = (offset + limit >= filtered_tasks.size()) ? 
-                  filtered_tasks.end() : 
-                  filtered_tasks.begin() + offset + limit;
-    
-    return std::vector<std::shared_ptr<Task>>(start_it, end_it);
+    const size_t end = std::min(wanted, offset + limit);
+    page.tasks.assign(std::make_move_iterator(matches.begin() + static_cast<std::ptrdiff_t>(offset)),
+                      std::make_move_iterator(matches.begin() + static_cast<std::ptrdiff_t>(end)));
+    if (page.tasks.size() == limit && end < wanted) {
+        page.next_cursor = page.tasks.back()->id;
+    }
+    return page;
 }
 
-std::shared_ptr<Task> TaskManager::updateTask(uint64_t id, const Json::Value& updates) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    auto it = tasks_.find(id);
-    if (it == tasks_.end()) {
+TaskPage TaskManager::searchPage(const TaskFilter& filter, uint64_t after, size_t offset,
+                                 size_t limit) const {
+    TaskPage page;
+    // No shard contributes more than the whole page plus one lookahead, so
+    // each search stops early however common its terms are
+    const size_t wanted = offset + limit + 1;
+    std::vector<TaskPtr> matches;
+    for (const auto& shard : shards_) {
+        size_t found = 0;
+        shard->text.search(*filter.terms, after, [&](uint64_t id) {
+            ++page.examined;
+            TaskPtr task = shard->tasks.find(id);
+            if (!matchesFields(filter, *task)) {
+                return true;
+            }
+            matches.push_back(std::move(task));
+            return ++found < wanted;
+        });
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const TaskPtr& a, const TaskPtr& b) { return a->id < b->id; });
+    if (offset >= matches.size()) {
+        return page;
+    }
+    const size_t end = std::min(matches.size(), offset + limit);
+    page.tasks.assign(std::make_move_iterator(matches.begin() + static_cast<std::ptrdiff_t>(offset)),
+                      std::make_move_iterator(matches.begin() + static_cast<std::ptrdiff_t>(end)));
+    if (page.tasks.size() == limit && end < matches.size()) {
+        page.next_cursor = page.tasks.back()->id;
+    }
+    return page;
+}
+
+TaskPtr TaskManager::updateTask(uint64_t id, const Json::Value& updates) {
+    auto patch = TaskPatch::fromJson(updates);
+    if (!patch) {
         return nullptr;
     }
+    return updateTask(id, *patch);
+}
+
+TaskPtr TaskManager::updateTask(uint64_t id, const TaskPatch& patch) {
+    Shard& shard = shardFor(id);
+
+    // Optimistic copy-on-write: build and render the new version without the
+    // lock, then publish it only if nobody replaced the base meanwhile
+    for (;;) {
+        TaskPtr current = getTask(id);
+        if (!current) {
+            return nullptr;
+        }
+        
+        auto task = nextVersion(*current, patch);
+
+        WriteLock lock(shard.mutex, lock_metrics_);
+        TaskPtr latest = shard.tasks.find(id);
+        if (!latest) {
+            return nullptr;
+        }
+        if (latest != current) {
+            continue;
+        }
+
+        shard.tasks.insertOrAssign(id, task);
+        shard.replaceInIndex(*current, *task);
+        bumpGeneration();
+        feedPut(task);
+        uint64_t seq = logPut(*task);
+        lock.unlock();
+        awaitLog(seq);
+        
+        return task;
+    }
+}
+
+bool TaskManager::deleteTask(uint64_t id) {
+    Shard& shard = shardFor(id);
+    WriteLock lock(shard.mutex, lock_metrics_);
     
-    auto task = it->second;
-    
-    // Update fields if present
-    if (updates.isMember("title") && updates["title"].isString()) {
-        task->title = updates["title"].asString();
+    TaskPtr removed = shard.tasks.erase(id);
+    if (!removed) {
+        return false;
     }
-    if (updates.isMember("description") && updates["description"].isString()) {
-        task->description = updates["description"].asString();
+    shard.removeFromIndex(*removed);
+    bumpGeneration();
+    feedDelete(id);
+    uint64_t seq = logDelete(id);
+    lock.unlock();
+    awaitLog(seq);
+    return true;
+}
+
+std::vector<TaskPtr> TaskManager::createTasks(std::span<const Json::Value> items) {
+    std::vector<std::shared_ptr<Task>> tasks;
+    tasks.reserve(items.size());
+    for (const auto& item : items) {
+        tasks.push_back(Task::fromJson(item));
     }
-    if (updates.isMember("status") && updates["status"].isString()) {
-        task->status = stringToStatus(updates["status"].asString());
+    return createTasks(tasks);
+}
+
+std::vector<TaskPtr> TaskManager::createTasks(std::span<const std::shared_ptr<Task>> tasks) {
+    std::vector<TaskPtr> results(tasks.size());
+    size_t valid = std::count_if(tasks.begin(), tasks.end(), [](const auto& task) { return task != nullptr; });
+    if (valid == 0) {
+        return results;
     }
-    if (updates.isMember("priority") && updates["priority"].isString()) {
-        task->priority = stringToPriority(updates["priority"].asString());
+
+    // One reservation for the whole batch; ids stay in input order
+    const uint64_t stride = next_ids_.size();
+    uint64_t id = reserveIds(valid);
+    for (const auto& task : tasks) {
+        if (task) {
+            task->id = id;
+            id += stride;
+        }
+    }
+
+    publishBatch(tasks, results);
+    return results;
+}
+
+std::vector<TaskPtr> TaskManager::restoreTasks(std::span<const std::shared_ptr<Task>> tasks) {
+    std::vector<TaskPtr> results(tasks.size());
+
+    uint64_t highest = 0;
+    size_t fresh = 0;
+    for (const auto& task : tasks) {
+        if (task) {
+            highest = std::max(highest, task->id);
+            fresh += task->id == 0 ? 1 : 0;
+        }
     }
-    if (updates.isMember("due_date") && updates["due_date"].isString()) {
-        task->due_date = updates["due_date"].asString();
+
+    // Keep later createTask ids clear of everything restored
+    advanceNextId(highest + 1);
+
+    if (fresh > 0) {
+        const uint64_t stride = next_ids_.size();
+        uint64_t id = reserveIds(fresh);
+        for (const auto& task : tasks) {
+            if (task && task->id == 0) {
+                task->id = id;
+                id += stride;
+            }
+        }
     }
-    
-    task->updated_at = std::chrono::system_clock::now();
-    
-    return task;
+
+    publishBatch(tasks, results);
+    return results;
 }
 
-bool TaskManager::deleteTask(uint64_t id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    return tasks_.erase(id) > 0;
+void TaskManager::loadTasks(std::span<const std::shared_ptr<Task>> tasks) {
+    uint64_t highest = 0;
+    for (const auto& task : tasks) {
+        if (task) {
+            highest = std::max(highest, task->id);
+        }
+    }
+    advanceNextId(highest + 1);
+
+    std::vector<TaskPtr> results(tasks.size());
+    publishBatch(tasks, results, true);
+}
+
+void TaskManager::reserve(size_t count) {
+    size_t per_shard = count / shards_.size() + 1;
+    for (const auto& shard : shards_) {
+        WriteLock lock(shard->mutex, lock_metrics_);
+        shard->tasks.reserve(per_shard);
+    }
+}
+
+void TaskManager::advanceNextId(uint64_t next) {
+    const uint64_t stride = next_ids_.size();
+    for (uint64_t p = 0; p < stride; ++p) {
+        // The first id at or past next that partition p owns
+        const uint64_t target = next + (p + stride - next % stride) % stride;
+        std::atomic<uint64_t>& counter = next_ids_[p].next;
+        uint64_t current = counter.load();
+        while (current < target && !counter.compare_exchange_weak(current, target)) {
+        }
+    }
+}
+
+void TaskManager::publishBatch(std::span<const std::shared_ptr<Task>> tasks,
+                               std::vector<TaskPtr>& results, bool recovering) {
+    uint64_t seq = 0;
+    std::vector<std::vector<size_t>> by_shard(shards_.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        if (tasks[i]) {
+            renderCache(*tasks[i]);
+            by_shard[shardIndex(tasks[i]->id)].push_back(i);
+        }
+    }
+
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        if (by_shard[s].empty()) {
+            continue;
+        }
+        Shard& shard = *shards_[s];
+        WriteLock lock(shard.mutex, lock_metrics_);
+        shard.tasks.reserve(shard.tasks.size() + by_shard[s].size());
+        for (size_t i : by_shard[s]) {
+            const auto& task = tasks[i];
+            if (TaskPtr previous = shard.tasks.find(task->id)) {
+                // Replacing a stored task still moves its version forward
+                if (!recovering) {
+                    task->version = previous->version + 1;
+                }
+                shard.removeFromIndex(*previous);
+            }
+            shard.tasks.insertOrAssign(task->id, task);
+            shard.addToIndex(*task);
+            results[i] = task;
+            if (!recovering) {
+                feedPut(task);
+                seq = std::max(seq, logPut(*task));
+            }
+        }
+        bumpGeneration();
+    }
+
+    awaitLog(seq);
+}
+
+std::vector<TaskPtr> TaskManager::updateTasks(std::span<const TaskUpdate> updates) {
+    std::vector<TaskPtr> results(updates.size());
+    std::vector<std::vector<size_t>> by_shard(shards_.size());
+    for (size_t i = 0; i < updates.size(); ++i) {
+        by_shard[shardIndex(updates[i].id)].push_back(i);
+    }
+
+    struct Staged {
+        TaskPtr base;
+        std::shared_ptr<Task> next;
+    };
+    std::vector<Staged> staged;
+    uint64_t seq = 0;
+
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        if (by_shard[s].empty()) {
+            continue;
+        }
+
+        // Build and render outside the lock, as updateTask does
+        staged.clear();
+        for (size_t i : by_shard[s]) {
+            TaskPtr base = getTask(updates[i].id);
+            staged.push_back({base, base ? nextVersion(*base, updates[i].patch) : nullptr});
+        }
+
+        Shard& shard = *shards_[s];
+        WriteLock lock(shard.mutex, lock_metrics_);
+        for (size_t k = 0; k < by_shard[s].size(); ++k) {
+            const TaskUpdate& update = updates[by_shard[s][k]];
+            TaskPtr latest = shard.tasks.find(update.id);
+            if (!latest) {
+                continue;
+            }
+
+            // Raced with another writer, or an earlier item of this batch
+            // touched the same task: rebuild on what is there now
+            std::shared_ptr<Task> task = staged[k].next;
+            if (latest != staged[k].base) {
+                task = nextVersion(*latest, update.patch);
+            }
+
+            shard.tasks.insertOrAssign(update.id, task);
+            shard.replaceInIndex(*latest, *task);
+            results[by_shard[s][k]] = task;
+            bumpGeneration();
+            feedPut(task);
+            seq = std::max(seq, logPut(*task));
+        }
+    }
+
+    awaitLog(seq);
+    return results;
+}
+
+std::vector<bool> TaskManager::deleteTasks(std::span<const uint64_t> ids) {
+    std::vector<bool> results(ids.size(), false);
+    uint64_t seq = 0;
+    std::vector<std::vector<size_t>> by_shard(shards_.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        by_shard[shardIndex(ids[i])].push_back(i);
+    }
+
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        if (by_shard[s].empty()) {
+            continue;
+        }
+        Shard& shard = *shards_[s];
+        WriteLock lock(shard.mutex, lock_metrics_);
+        for (size_t i : by_shard[s]) {
+            if (TaskPtr removed = shard.tasks.erase(ids[i])) {
+                shard.removeFromIndex(*removed);
+                results[i] = true;
+                bumpGeneration();
+                feedDelete(ids[i]);
+                seq = std::max(seq, logDelete(ids[i]));
+            }
+        }
+    }
+
+    awaitLog(seq);
+    return results;
+}
+
+TaskStatistics TaskManager::getStatisticsSnapshot() const {
+    TaskStatistics stats;
+
+    for (const auto& shard : shards_) {
+        for (size_t s = 0; s < kTaskStatusCount; ++s) {
+            for (size_t p = 0; p < kTaskPriorityCount; ++p) {
+                uint64_t count = shard->counts[s][p].load(std::memory_order_relaxed);
+                stats.total += count;
+                stats.by_status[s] += count;
+                stats.by_priority[p] += count;
+            }
+        }
+    }
+
+    return stats;
 }
 
 Json::Value TaskManager::getStatistics() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
+    TaskStatistics snapshot = getStatisticsSnapshot();
+
     Json::Value stats;
-    stats["total"] = static_cast<Json::UInt64>(tasks_.size());
+    stats["total"] = static_cast<Json::UInt64>(snapshot.total);
     
     // Count by status
     Json::Value by_status;
-    by_status["pending"] = 0;
-    by_status["in_progress"] = 0;
-    by_status["completed"] = 0;
+    for (size_t s = 0; s < kTaskStatusCount; ++s) {
+        by_status[toString(static_cast<TaskStatus>(s))] = static_cast<Json::UInt64>(snapshot.by_status[s]);
+    }
     
     // Count by priority
     Json::Value by_priority;
-    by_priority["low"] = 0;
-    by_priority["medium"] = 0;
-    by_priority["high"] = 0;
-    
-    for (const auto& pair : tasks_) {
-        auto task = pair.second;
-        
-        // Count status
-        std::string status_str = statusToString(task->status);
-        by_status[status_str] = by_status[status_str].asUInt() + 1;
-        
-        // Count priority
-        std::string priority_str = priorityToString(task->priority);
-        by_priority[priority_str] = by_priority[priority_str].asUInt() + 1;
+    for (size_t p = 0; p < kTaskPriorityCount; ++p) {
+        by_priority[toString(static_cast<TaskPriority>(p))] =
+            static_cast<Json::UInt64>(snapshot.by_priority[p]);
     }
     
     stats["by_status"] = by_status;
@@ -221,41 +1121,11 @@ Json::Value TaskManager::getStatistics() const {
 }
 
 size_t TaskManager::getTaskCount() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return tasks_.size();
-}
-
-// Helper functions
-TaskStatus TaskManager::stringToStatus(const std::string& str) const {
-    if (str == "pending") return TaskStatus::PENDING;
-    if (str == "in_progress") return TaskStatus::IN_PROGRESS;
-    if (str == "completed") return TaskStatus::COMPLETED;
-    return TaskStatus::PENDING;
-}
-
-TaskPriority TaskManager::stringToPriority(const std::string& str) const {
-    if (str == "low") return TaskPriority::LOW;
-    if (str == "medium") return TaskPriority::MEDIUM;
-    if (str == "high") return TaskPriority::HIGH;
-    return TaskPriority::MEDIUM;
-}
-
-std::string TaskManager::statusToString(TaskStatus status) const {
-    switch (status) {
-        case TaskStatus::PENDING: return "pending";
-        case TaskStatus::IN_PROGRESS: return "in_progress";
-        case TaskStatus::COMPLETED: return "completed";
-        default: return "pending";
-    }
-}
-
-std::string TaskManager::priorityToString(TaskPriority priority) const {
-    switch (priority) {
-        case TaskPriority::LOW: return "low";
-        case TaskPriority::MEDIUM: return "medium";
-        case TaskPriority::HIGH: return "high";
-        default: return "medium";
+    size_t count = 0;
+    for (const auto& shard : shards_) {
+        count += shard->tasks.size();
     }
+    return count;
 }
 
-} // namespace http_server
\ No newline at end of file
+} // namespace http_server
@@ -0,0 +1,317 @@
+#include "text_index.h"
+#include <algorithm>
+#include <cassert>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace http_server {
+namespace text_index {
+
+namespace {
+
+bool isTermByte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+void appendVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+const uint8_t* readVarint(const uint8_t* in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return in;
+        }
+    }
+}
+
+size_t intersectScalar(const uint64_t* a, size_t n, const uint64_t* b, size_t m, uint64_t* out) {
+    size_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < n && j < m) {
+        if (a[i] < b[j]) {
+            ++i;
+        } else if (b[j] < a[i]) {
+            ++j;
+        } else {
+            out[count++] = a[i];
+            ++i;
+            ++j;
+        }
+    }
+    return count;
+}
+
+#if defined(__SSE2__)
+// SSE2 only compares 32-bit lanes; a 64-bit lane is equal when both of its
+// halves are
+__m128i equal64(__m128i a, __m128i b) {
+    __m128i eq32 = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(eq32, _mm_shuffle_epi32(eq32, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+#endif
+
+} // namespace
+
+void tokenize(std::string_view text, std::vector<std::string>& tokens) {
+    size_t i = 0;
+    while (i < text.size()) {
+        if (!isTermByte(static_cast<unsigned char>(text[i]))) {
+            ++i;
+            continue;
+        }
+        std::string token;
+        for (; i < text.size() && isTermByte(static_cast<unsigned char>(text[i])); ++i) {
+            if (token.size() < kMaxTokenLength) {
+                char c = text[i];
+                token.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+            }
+        }
+        auto pos = std::lower_bound(tokens.begin(), tokens.end(), token);
+        if (pos == tokens.end() || *pos != token) {
+            tokens.insert(pos, std::move(token));
+        }
+    }
+}
+
+size_t intersect(const uint64_t* a, size_t n, const uint64_t* b, size_t m, uint64_t* out) {
+    size_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+#if defined(__SSE2__)
+    // Two ids of each side per step: compare a pair against b's pair and its
+    // swap, then advance whichever pair ends lower (both on a tie). Every
+    // (a, b) pair of pairs meets at most once, so no id is emitted twice.
+    while (i + 2 <= n && j + 2 <= m) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+        __m128i vb_swapped = _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2));
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_or_si128(equal64(va, vb), equal64(va, vb_swapped))));
+        if (mask & 1) {
+            out[count++] = a[i];
+        }
+        if (mask & 2) {
+            out[count++] = a[i + 1];
+        }
+        const uint64_t a_last = a[i + 1];
+        const uint64_t b_last = b[j + 1];
+        i += a_last <= b_last ? 2 : 0;
+        j += b_last <= a_last ? 2 : 0;
+    }
+#endif
+    return count + intersectScalar(a + i, n - i, b + j, m - j, out + count);
+}
+
+// PostingList implementation
+size_t PostingList::blockFor(uint64_t id) const {
+    auto it = std::lower_bound(blocks_.begin(), blocks_.end(), id,
+                               [](const Block& block, uint64_t value) { return block.last < value; });
+    return static_cast<size_t>(it - blocks_.begin());
+}
+
+bool PostingList::contains(uint64_t id) const {
+    size_t index = blockFor(id);
+    if (index == blocks_.size() || id < blocks_[index].first) {
+        return false;
+    }
+    uint64_t ids[kBlockSize];
+    size_t n = decode(index, ids);
+    return std::binary_search(ids, ids + n, id);
+}
+
+size_t PostingList::firstBlockAfter(uint64_t after) const {
+    return after == UINT64_MAX ? blocks_.size() : blockFor(after + 1);
+}
+
+size_t PostingList::decode(size_t index, uint64_t* out) const {
+    const Block& block = blocks_[index];
+    uint64_t id = block.first;
+    out[0] = id;
+    const uint8_t* in = block.gaps.data();
+    for (uint32_t k = 1; k < block.count; ++k) {
+        uint64_t gap;
+        in = readVarint(in, gap);
+        id += gap;
+        out[k] = id;
+    }
+    return block.count;
+}
+
+void PostingList::encode(Block& block, const uint64_t* ids, size_t n) {
+    block.first = ids[0];
+    block.last = ids[n - 1];
+    block.count = static_cast<uint32_t>(n);
+    block.gaps.clear();
+    for (size_t k = 1; k < n; ++k) {
+        appendVarint(block.gaps, ids[k] - ids[k - 1]);
+    }
+}
+
+void PostingList::insert(uint64_t id) {
+    // New tasks get the largest id so far: the common case appends a gap
+    if (blocks_.empty() || id > blocks_.back().last) {
+        if (blocks_.empty() || blocks_.back().count == kBlockSize) {
+            blocks_.push_back({id, id, 1, {}});
+        } else {
+            Block& block = blocks_.back();
+            appendVarint(block.gaps, id - block.last);
+            block.last = id;
+            ++block.count;
+        }
+        ++size_;
+        return;
+    }
+
+    size_t index = blockFor(id);
+    uint64_t ids[kBlockSize + 1];
+    size_t n = decode(index, ids);
+    uint64_t* pos = std::lower_bound(ids, ids + n, id);
+    if (pos != ids + n && *pos == id) {
+        return;
+    }
+    std::copy_backward(pos, ids + n, ids + n + 1);
+    *pos = id;
+    ++n;
+    ++size_;
+
+    if (n <= kBlockSize) {
+        encode(blocks_[index], ids, n);
+        return;
+    }
+    // Split a full block in half, so either side has room again
+    size_t half = n / 2;
+    Block upper;
+    encode(upper, ids + half, n - half);
+    encode(blocks_[index], ids, half);
+    blocks_.insert(blocks_.begin() + static_cast<std::ptrdiff_t>(index) + 1, std::move(upper));
+}
+
+void PostingList::erase(uint64_t id) {
+    size_t index = blockFor(id);
+    if (index == blocks_.size() || id < blocks_[index].first) {
+        return;
+    }
+    uint64_t ids[kBlockSize];
+    size_t n = decode(index, ids);
+    uint64_t* pos = std::lower_bound(ids, ids + n, id);
+    if (pos == ids + n || *pos != id) {
+        return;
+    }
+    std::copy(pos + 1, ids + n, pos);
+    --n;
+    --size_;
+    if (n == 0) {
+        blocks_.erase(blocks_.begin() + static_cast<std::ptrdiff_t>(index));
+    } else {
+        encode(blocks_[index], ids, n);
+    }
+}
+
+size_t PostingList::retainCommon(uint64_t* ids, size_t n) const {
+    assert(n <= kBlockSize);
+    uint64_t kept[kBlockSize];
+    uint64_t block_ids[kBlockSize];
+    size_t count = 0;
+    size_t start = 0;
+    // Blocks entirely outside [ids[0], ids[n - 1]] are never decoded
+    for (size_t block = blockFor(ids[0]); block < blocks_.size() && start < n; ++block) {
+        if (blocks_[block].first > ids[n - 1]) {
+            break;
+        }
+        size_t m = decode(block, block_ids);
+        size_t end = std::upper_bound(ids + start, ids + n, blocks_[block].last) - ids;
+        count += intersect(ids + start, end - start, block_ids, m, kept + count);
+        start = end;
+    }
+    std::copy(kept, kept + count, ids);
+    return count;
+}
+
+// TextIndex implementation
+void TextIndex::terms(std::string_view title, std::string_view description, std::vector<std::string>& out) {
+    tokenize(title, out);
+    tokenize(description, out);
+}
+
+const PostingList* TextIndex::find(const std::string& term) const {
+    auto it = postings_.find(term);
+    return it == postings_.end() ? nullptr : &it->second;
+}
+
+bool TextIndex::containsAll(std::span<const std::string> terms, uint64_t id) const {
+    if (terms.empty()) {
+        return false;
+    }
+    for (const auto& term : terms) {
+        const PostingList* list = find(term);
+        if (!list || !list->contains(id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TextIndex::eraseFrom(const std::string& term, uint64_t id) {
+    auto it = postings_.find(term);
+    if (it == postings_.end()) {
+        return;
+    }
+    it->second.erase(id);
+    if (it->second.empty()) {
+        postings_.erase(it);
+    }
+}
+
+void TextIndex::add(uint64_t id, std::string_view title, std::string_view description) {
+    std::vector<std::string> words;
+    terms(title, description, words);
+    for (auto& word : words) {
+        postings_[std::move(word)].insert(id);
+    }
+}
+
+void TextIndex::remove(uint64_t id, std::string_view title, std::string_view description) {
+    std::vector<std::string> words;
+    terms(title, description, words);
+    for (const auto& word : words) {
+        eraseFrom(word, id);
+    }
+}
+
+void TextIndex::replace(uint64_t id, std::string_view old_title, std::string_view old_description,
+                        std::string_view title, std::string_view description) {
+    if (old_title == title && old_description == description) {
+        return;
+    }
+    std::vector<std::string> before;
+    std::vector<std::string> after;
+    terms(old_title, old_description, before);
+    terms(title, description, after);
+
+    // Both lists are sorted, so one merge finds the terms on either side
+    size_t i = 0;
+    size_t j = 0;
+    while (i < before.size() || j < after.size()) {
+        if (j == after.size() || (i < before.size() && before[i] < after[j])) {
+            eraseFrom(before[i++], id);
+        } else if (i == before.size() || after[j] < before[i]) {
+            postings_[std::move(after[j++])].insert(id);
+        } else {
+            ++i;
+            ++j;
+        }
+    }
+}
+
+} // namespace text_index
+} // namespace http_server
@@ -0,0 +1,120 @@
+#include "topology.h"
+#include <pthread.h>
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace http_server {
+namespace topology {
+
+namespace {
+
+bool parseInt(std::string_view text, int& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size() && value >= 0;
+}
+
+} // namespace
+
+bool parseCpuList(std::string_view text, std::vector<int>& cpus) {
+    cpus.clear();
+    while (!text.empty() && (text.back() == '\n' || text.back() == ' ')) {
+        text.remove_suffix(1);
+    }
+    // A node without CPUs has an empty list
+    while (!text.empty()) {
+        size_t comma = text.find(',');
+        std::string_view item = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+
+        size_t dash = item.find('-');
+        int first = 0;
+        int last = 0;
+        if (!parseInt(item.substr(0, dash), first)) {
+            return false;
+        }
+        last = first;
+        if (dash != std::string_view::npos && (!parseInt(item.substr(dash + 1), last) || last < first)) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return true;
+}
+
+std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+std::vector<Node> discoverNodes(const std::string& node_dir, const std::vector<int>& allowed) {
+    std::vector<Node> nodes;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(node_dir, ec)) {
+        const std::string name = entry.path().filename().string();
+        Node node;
+        if (name.rfind("node", 0) != 0 || !parseInt(std::string_view(name).substr(4), node.id)) {
+            continue;
+        }
+        std::ifstream in(entry.path() / "cpulist");
+        std::stringstream text;
+        text << in.rdbuf();
+        std::vector<int> cpus;
+        if (!in || !parseCpuList(text.str(), cpus)) {
+            continue;
+        }
+        std::copy_if(cpus.begin(), cpus.end(), std::back_inserter(node.cpus), [&](int cpu) {
+            return std::binary_search(allowed.begin(), allowed.end(), cpu);
+        });
+        if (!node.cpus.empty()) {
+            nodes.push_back(std::move(node));
+        }
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+    if (nodes.empty() && !allowed.empty()) {
+        nodes.push_back(Node{0, allowed});
+    }
+    return nodes;
+}
+
+std::vector<Node> discoverNodes() {
+    return discoverNodes("/sys/devices/system/node", allowedCpus());
+}
+
+ScopedAffinity::ScopedAffinity(const std::vector<int>& cpus) {
+    saved_ = pthread_getaffinity_np(pthread_self(), sizeof(previous_), &previous_) == 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    pinned_ = saved_ && CPU_COUNT(&set) > 0 &&
+              pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+ScopedAffinity::~ScopedAffinity() {
+    if (pinned_) {
+        pthread_setaffinity_np(pthread_self(), sizeof(previous_), &previous_);
+    }
+}
+
+} // namespace topology
+} // namespace http_server
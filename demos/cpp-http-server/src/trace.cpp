@@ -0,0 +1,243 @@
+#include "trace.h"
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+namespace http_server {
+namespace trace {
+
+namespace {
+
+// Small, stable numbers for the tid of Chrome trace events
+unsigned int threadNumber() {
+    static std::atomic<unsigned int> next{1};
+    thread_local unsigned int number = next.fetch_add(1, std::memory_order_relaxed);
+    return number;
+}
+
+int64_t nanosBetween(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+void appendInteger(std::string& out, int64_t value) {
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, static_cast<size_t>(result.ptr - buf));
+}
+
+// Nanoseconds as "<whole>.<3 digits>" of a coarser unit (us or ms)
+void appendScaled(std::string& out, int64_t nanos, int64_t unit) {
+    if (nanos < 0) {
+        nanos = 0;
+    }
+    appendInteger(out, nanos / unit);
+    out.push_back('.');
+    const int64_t fraction = (nanos % unit) * 1000 / unit;
+    if (fraction < 100) {
+        out.push_back('0');
+    }
+    if (fraction < 10) {
+        out.push_back('0');
+    }
+    appendInteger(out, fraction);
+}
+
+// Timestamps are steady_clock microseconds, the timebase Chrome expects
+void appendTimestamp(std::string& out, Clock::time_point when) {
+    appendScaled(out, nanosBetween(Clock::time_point(), when), 1000);
+}
+
+void appendEvent(std::string& out, std::string_view name, std::string_view category,
+                 Clock::time_point begin, Clock::time_point end, unsigned int thread) {
+    out.append("{\"name\":\"").append(name);
+    out.append("\",\"cat\":\"").append(category);
+    out.append("\",\"ph\":\"X\",\"ts\":");
+    appendTimestamp(out, begin);
+    out.append(",\"dur\":");
+    appendScaled(out, nanosBetween(begin, end), 1000);
+    out.append(",\"pid\":");
+    appendInteger(out, static_cast<int64_t>(::getpid()));
+    out.append(",\"tid\":");
+    appendInteger(out, thread);
+}
+
+} // namespace
+
+const char* toString(Phase phase) {
+    switch (phase) {
+        case Phase::PARSE: return "parse";
+        case Phase::VALIDATE: return "validate";
+        case Phase::LOCK_WAIT: return "lock_wait";
+        case Phase::LOCK_HOLD: return "lock_hold";
+        case Phase::SERIALIZE: return "serialize";
+        case Phase::COMPRESS: return "compress";
+        case Phase::SEND: return "send";
+    }
+    return "other";
+}
+
+// RequestTrace implementation
+void RequestTrace::begin(Clock::time_point started) {
+    active_ = true;
+    status_ = 0;
+    thread_ = threadNumber();
+    started_ = started;
+    responded_ = started;
+    count_ = 0;
+    dropped_ = 0;
+    totals_.fill(Clock::duration::zero());
+}
+
+void RequestTrace::responded(int status, Clock::time_point when) {
+    status_ = status;
+    responded_ = when;
+}
+
+void RequestTrace::add(Phase phase, Clock::time_point begin, Clock::time_point end) {
+    totals_[static_cast<size_t>(phase)] += end - begin;
+    if (count_ == kMaxSpans) {
+        ++dropped_;
+        return;
+    }
+    spans_[count_++] = {phase, begin, end};
+}
+
+// Tracer implementation
+Tracer::Tracer(const Settings& settings, std::ostream* log)
+    : settings_(settings), log_(log ? log : &std::cerr) {
+    if (enabled() && !settings_.chrome_trace_file.empty()) {
+        file_ = std::make_unique<std::ofstream>(settings_.chrome_trace_file, std::ios::trunc);
+        if (*file_) {
+            // The JSON array form; Chrome and Perfetto load it even while
+            // the closing bracket is still missing
+            *file_ << "[\n";
+        } else {
+            std::cerr << "Cannot write trace file " << settings_.chrome_trace_file << std::endl;
+            file_.reset();
+        }
+    }
+}
+
+Tracer::~Tracer() {
+    if (file_) {
+        *file_ << "\n]\n";
+    }
+}
+
+bool Tracer::sample() {
+    if (!enabled()) {
+        return false;
+    }
+    // Every Nth request this thread serves; a counter is cheaper than a
+    // random draw, and thread pools spread requests evenly enough
+    thread_local uint32_t countdown = 0;
+    if (countdown > 1) {
+        --countdown;
+        return false;
+    }
+    countdown = settings_.sample_every;
+    return true;
+}
+
+void Tracer::finish(RequestTrace& trace, metrics::Route route, metrics::Method method,
+                    Clock::time_point ended) {
+    trace.add(Phase::SEND, trace.respondedAt(), ended);
+    trace.end();
+    traced_.fetch_add(1, std::memory_order_relaxed);
+    for (size_t p = 0; p < kPhaseCount; ++p) {
+        const Clock::duration total = trace.total(static_cast<Phase>(p));
+        if (total > Clock::duration::zero()) {
+            phases_[p].record(total);
+        }
+    }
+
+    if (settings_.slow_threshold_ms > 0 &&
+        ended - trace.started() >= std::chrono::milliseconds(settings_.slow_threshold_ms)) {
+        slow_.fetch_add(1, std::memory_order_relaxed);
+        std::string line = "Slow request: ";
+        appendSummary(line, trace, route, method, ended);
+        line.push_back('\n');
+        *log_ << line << std::flush;
+    }
+
+    if (file_) {
+        std::string events;
+        appendChromeEvents(events, trace, route, method, ended);
+        std::lock_guard<std::mutex> lock(file_mutex_);
+        if (!file_empty_) {
+            *file_ << ",\n";
+        }
+        // Flushed per request, so the file is usable while the server runs
+        *file_ << events << std::flush;
+        file_empty_ = false;
+    }
+}
+
+void Tracer::appendPrometheus(std::string& out) const {
+    if (!enabled()) {
+        return;
+    }
+    metrics::appendHelp(out, "http_traced_requests_total", "counter", "Requests sampled for tracing");
+    metrics::appendSample(out, "http_traced_requests_total", "", traced());
+    metrics::appendHelp(out, "http_slow_requests_total", "counter",
+                        "Traced requests over the slow-request threshold");
+    metrics::appendSample(out, "http_slow_requests_total", "", slow());
+    metrics::appendHelp(out, "http_request_phase_seconds", "histogram",
+                        "Time traced requests spent in each phase");
+    for (size_t p = 0; p < kPhaseCount; ++p) {
+        metrics::HistogramSnapshot snapshot = phases_[p].snapshot();
+        if (snapshot.count > 0) {
+            std::string labels = "phase=\"";
+            labels.append(toString(static_cast<Phase>(p))).push_back('"');
+            metrics::appendHistogram(out, "http_request_phase_seconds", labels, snapshot);
+        }
+    }
+}
+
+void appendSummary(std::string& out, const RequestTrace& trace, metrics::Route route,
+                   metrics::Method method, Clock::time_point ended) {
+    out.append(metrics::toString(method)).push_back(' ');
+    out.append(metrics::toString(route)).push_back(' ');
+    appendInteger(out, trace.status());
+    out.push_back(' ');
+    appendScaled(out, nanosBetween(trace.started(), ended), 1000000);
+    out.append(" ms (");
+    bool first = true;
+    for (size_t p = 0; p < kPhaseCount; ++p) {
+        const Phase phase = static_cast<Phase>(p);
+        if (trace.total(phase) <= Clock::duration::zero()) {
+            continue;
+        }
+        if (!first) {
+            out.append(", ");
+        }
+        first = false;
+        out.append(toString(phase)).push_back(' ');
+        appendScaled(out, std::chrono::duration_cast<std::chrono::nanoseconds>(trace.total(phase)).count(),
+                     1000000);
+        out.append(" ms");
+    }
+    out.push_back(')');
+}
+
+void appendChromeEvents(std::string& out, const RequestTrace& trace, metrics::Route route,
+                        metrics::Method method, Clock::time_point ended) {
+    std::string name = metrics::toString(method);
+    name.push_back(' ');
+    name.append(metrics::toString(route));
+    appendEvent(out, name, "request", trace.started(), ended, trace.thread());
+    out.append(",\"args\":{\"status\":");
+    appendInteger(out, trace.status());
+    out.append(",\"dropped_spans\":");
+    appendInteger(out, static_cast<int64_t>(trace.dropped()));
+    out.append("}}");
+    for (const auto& span : trace.spans()) {
+        out.append(",\n");
+        appendEvent(out, toString(span.phase), "phase", span.begin, span.end, trace.thread());
+        out.push_back('}');
+    }
+}
+
+} // namespace trace
+} // namespace http_server
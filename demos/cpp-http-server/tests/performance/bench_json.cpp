@@ -0,0 +1,105 @@
+#include <benchmark/benchmark.h>
+#include "json_utils.h"
+#include "json_writer.h"
+#include "task_manager.h"
+#include "trace.h"
+#include <string>
+
+using namespace http_server;
+
+namespace {
+
+const char* kTaskBody =
+    R"({"title":"Write the quarterly report","description":"Collect the numbers from every team )"
+    R"(and \"summarise\" them","status":"in_progress","priority":"high","due_date":"2030-06-15"})";
+
+TaskPtr sampleTask() {
+    static TaskManager manager;
+    static TaskPtr task = manager.createTask(json_utils::parseJson(kTaskBody));
+    return task;
+}
+
+} // namespace
+
+static void BM_TaskToJson(benchmark::State& state) {
+    TaskPtr task = sampleTask();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(task->toJson());
+    }
+}
+BENCHMARK(BM_TaskToJson);
+
+// The same document through toJson() and the generic writer, as the server
+// rendered tasks before responses were written directly
+static void BM_TaskToJsonString(benchmark::State& state) {
+    TaskPtr task = sampleTask();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(json_utils::jsonToString(task->toJson()));
+    }
+}
+BENCHMARK(BM_TaskToJsonString);
+
+static void BM_AppendTask(benchmark::State& state) {
+    TaskPtr task = sampleTask();
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        json_writer::appendTask(out, *task);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(out.size()));
+}
+BENCHMARK(BM_AppendTask);
+
+static void BM_ParseJson(benchmark::State& state) {
+    const std::string body = kTaskBody;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(json_utils::parseJson(body));
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(body.size()));
+}
+BENCHMARK(BM_ParseJson)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_IsValidTaskData(benchmark::State& state) {
+    const Json::Value data = json_utils::parseJson(kTaskBody);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(json_utils::isValidTaskData(data));
+    }
+}
+BENCHMARK(BM_IsValidTaskData);
+
+// Validation and construction in one pass, as POST /api/v1/tasks does it
+static void BM_TaskFromJson(benchmark::State& state) {
+    const Json::Value data = json_utils::parseJson(kTaskBody);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Task::fromJson(data));
+    }
+}
+BENCHMARK(BM_TaskFromJson);
+
+// POST /api/v1/tasks minus the HTTP layer, with one request in range(0)
+// traced (0 = tracing off); the tracing overhead is the difference to 0
+static void BM_TracedCreateRequest(benchmark::State& state) {
+    TaskManager manager;
+    trace::Settings settings;
+    settings.sample_every = static_cast<uint32_t>(state.range(0));
+    trace::Tracer tracer(settings);
+    trace::RequestTrace request;
+    const std::string body = kTaskBody;
+    for (auto _ : state) {
+        const auto started = trace::Clock::now();
+        if (tracer.sample()) {
+            request.begin(started);
+        }
+        {
+            trace::Activation active(&request);
+            benchmark::DoNotOptimize(manager.createTask(Task::fromJson(json_utils::parseJson(body))));
+        }
+        if (request.active()) {
+            request.responded(201, trace::Clock::now());
+            tracer.finish(request, metrics::Route::TASKS, metrics::Method::POST, trace::Clock::now());
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TracedCreateRequest)->Arg(0)->Arg(1000)->Arg(1);
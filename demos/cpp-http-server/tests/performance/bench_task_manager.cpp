@@ -0,0 +1,223 @@
+#include <benchmark/benchmark.h>
+#include "epoch.h"
+#include "task_manager.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace http_server;
+
+namespace {
+
+Json::Value sampleTask(uint64_t n) {
+    static const char* kStatuses[] = {"pending", "in_progress", "completed"};
+    static const char* kPriorities[] = {"low", "medium", "high"};
+    Json::Value data;
+    data["title"] = "Benchmark task " + std::to_string(n);
+    data["description"] = "A representative description that is a little longer than a title";
+    data["status"] = kStatuses[n % 3];
+    data["priority"] = kPriorities[(n / 3) % 3];
+    data["due_date"] = "2030-06-15";
+    return data;
+}
+
+// Stores filled with ids 1..size, built once per size and shared by every
+// benchmark that only reads them
+TaskManager& populatedStore(size_t size) {
+    static std::mutex mutex;
+    static std::map<size_t, std::unique_ptr<TaskManager>> stores;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& store = stores[size];
+    if (!store) {
+        store = std::make_unique<TaskManager>();
+        std::vector<Json::Value> batch;
+        for (uint64_t n = 0; n < size; n += batch.size()) {
+            batch.clear();
+            for (uint64_t i = n; i < std::min<uint64_t>(size, n + 4096); ++i) {
+                batch.push_back(sampleTask(i));
+            }
+            store->createTasks(batch);
+        }
+        // Growing the maps retired their old tables; free them now rather
+        // than inside whichever benchmark happens to collect next
+        for (int i = 0; i < 3 && EpochDomain::instance().pendingRetired() > 0; ++i) {
+            EpochDomain::instance().collect();
+        }
+    }
+    return *store;
+}
+
+void storeSizes(benchmark::internal::Benchmark* bench) {
+    for (int64_t size : {1000, 100000, 1000000}) {
+        bench->Arg(size);
+    }
+}
+
+// Cheap per-thread id stream, uniform over 1..size
+class IdSource {
+public:
+    IdSource(size_t size, int seed) : rng_(static_cast<uint64_t>(seed) * 7919 + 1), dist_(1, size) {}
+    uint64_t next() { return dist_(rng_); }
+
+private:
+    std::mt19937_64 rng_;
+    std::uniform_int_distribution<uint64_t> dist_;
+};
+
+} // namespace
+
+static void BM_CreateTask(benchmark::State& state) {
+    TaskManager manager;
+    Json::Value data = sampleTask(1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.createTask(data));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CreateTask);
+
+static void BM_CreateTasksBatch(benchmark::State& state) {
+    TaskManager manager;
+    std::vector<Json::Value> batch;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        batch.push_back(sampleTask(static_cast<uint64_t>(i)));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.createTasks(batch));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CreateTasksBatch)->Arg(64)->Arg(512);
+
+// Creates from every thread into one store; range(0) partitions, each
+// thread creating in partition thread_index % partitions, as the listeners
+// of a node would
+static void BM_ConcurrentCreate(benchmark::State& state) {
+    static std::unique_ptr<TaskManager> manager;
+    if (state.thread_index() == 0) {
+        manager = std::make_unique<TaskManager>(TaskManager::kDefaultShardCount,
+                                                static_cast<size_t>(state.range(0)));
+    }
+    TaskManager::setHomePartition(static_cast<size_t>(state.thread_index()));
+    Json::Value data = sampleTask(1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager->createTask(data));
+    }
+    state.SetItemsProcessed(state.iterations());
+    TaskManager::setHomePartition(0);
+}
+BENCHMARK(BM_ConcurrentCreate)->ArgName("partitions")->Arg(1)->Arg(4)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_GetTask(benchmark::State& state) {
+    const size_t size = static_cast<size_t>(state.range(0));
+    TaskManager& manager = populatedStore(size);
+    IdSource ids(size, state.thread_index());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.getTask(ids.next()));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetTask)->Apply(storeSizes);
+
+// First page of the list endpoint: no filter, one status, or status and priority
+static void BM_GetAllTasks(benchmark::State& state) {
+    TaskManager& manager = populatedStore(static_cast<size_t>(state.range(0)));
+    TaskFilter filter;
+    if (state.range(1) >= 1) {
+        filter.status = TaskStatus::IN_PROGRESS;
+    }
+    if (state.range(1) >= 2) {
+        filter.priority = TaskPriority::HIGH;
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.getAllTasks(filter, 10, 0));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetAllTasks)
+    ->ArgNames({"tasks", "filters"})
+    ->ArgsProduct({{1000, 100000, 1000000}, {0, 1, 2}});
+
+// Deep keyset page, which still only seeks once per index set
+static void BM_GetTasksAfter(benchmark::State& state) {
+    const size_t size = static_cast<size_t>(state.range(0));
+    TaskManager& manager = populatedStore(size);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.getTasksAfter(size / 2, 100));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetTasksAfter)->Apply(storeSizes);
+
+// ?q= search: a term every task has (the first page ends the walk early),
+// the same with a status filter, and a rare term intersected with it
+static void BM_SearchTasks(benchmark::State& state) {
+    const size_t size = static_cast<size_t>(state.range(0));
+    TaskManager& manager = populatedStore(size);
+    TaskFilter filter;
+    switch (state.range(1)) {
+        case 0: filter.setQuery("representative"); break;
+        case 1: filter.setQuery("representative"); filter.status = TaskStatus::COMPLETED; break;
+        default: filter.setQuery("benchmark " + std::to_string(size / 2)); break;
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.getAllTasks(filter, 10, 0));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SearchTasks)
+    ->ArgNames({"tasks", "query"})
+    ->ArgsProduct({{1000, 100000, 1000000}, {0, 1, 2}});
+
+static void BM_GetStatistics(benchmark::State& state) {
+    TaskManager& manager = populatedStore(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.getStatistics());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetStatistics)->Apply(storeSizes);
+
+static void BM_UpdateTask(benchmark::State& state) {
+    const size_t size = 100000;
+    TaskManager& manager = populatedStore(size);
+    IdSource ids(size, state.thread_index() + 100);
+    Json::Value update;
+    update["description"] = "updated by the benchmark";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.updateTask(ids.next(), update));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdateTask)->ThreadRange(1, 8)->UseRealTime();
+
+// Concurrent readers and writers on one store; range(0) is the share of
+// operations, in percent, that are updates
+static void BM_ReadWriteMix(benchmark::State& state) {
+    const size_t size = 100000;
+    TaskManager& manager = populatedStore(size);
+    IdSource ids(size, state.thread_index() + 1000);
+    const uint64_t write_percent = static_cast<uint64_t>(state.range(0));
+    TaskPatch patch;
+    patch.description = "written during the read/write mix";
+    uint64_t op = static_cast<uint64_t>(state.thread_index());
+    for (auto _ : state) {
+        uint64_t id = ids.next();
+        if (++op % 100 < write_percent) {
+            benchmark::DoNotOptimize(manager.updateTask(id, patch));
+        } else {
+            benchmark::DoNotOptimize(manager.getTask(id));
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReadWriteMix)
+    ->ArgName("write_pct")
+    ->Arg(5)
+    ->Arg(50)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Compare two Google Benchmark JSON result files.
+
+Usage: compare_benchmarks.py BASELINE CURRENT [--threshold 0.10]
+
+Benchmarks are matched by name. When the files contain repetitions, the
+median aggregate is compared, otherwise the single run. The exit status is 1
+if any benchmark got slower than the threshold allows, so the script can gate
+CI; benchmarks that only exist on one side are listed but never fail it.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path, encoding="utf-8") as f:
+        data = json.load(f)
+
+    runs = {}
+    medians = {}
+    for bench in data.get("benchmarks", []):
+        if bench.get("error_occurred"):
+            continue
+        if bench.get("run_type") == "aggregate":
+            if bench.get("aggregate_name") == "median":
+                medians[bench["run_name"]] = bench
+        else:
+            runs.setdefault(bench.get("run_name", bench["name"]), bench)
+
+    # Prefer medians; fall back to plain runs for files without repetitions
+    merged = dict(runs)
+    merged.update(medians)
+    return {name: bench["real_time"] * unit_scale(bench) for name, bench in merged.items()}
+
+
+def unit_scale(bench):
+    """Nanoseconds per time unit of a result entry."""
+    return {"ns": 1, "us": 1e3, "ms": 1e6, "s": 1e9}[bench.get("time_unit", "ns")]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="allowed slowdown as a fraction (default: 0.10)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    width = max((len(name) for name in baseline.keys() | current.keys()), default=10)
+    print(f"{'Benchmark':<{width}}  {'Baseline':>12}  {'Current':>12}  {'Change':>8}")
+    for name in sorted(baseline.keys() | current.keys()):
+        if name not in baseline or name not in current:
+            side = "baseline" if name in baseline else "current"
+            print(f"{name:<{width}}  only in {side}")
+            continue
+
+        before, after = baseline[name], current[name]
+        change = (after - before) / before if before > 0 else 0.0
+        marker = ""
+        if change > args.threshold:
+            marker = "  REGRESSION"
+            regressions += 1
+        print(f"{name:<{width}}  {before:>10.1f}ns  {after:>10.1f}ns  {change:>+7.1%}{marker}")
+
+    if regressions:
+        print(f"\n{regressions} benchmark(s) slower than baseline by more than {args.threshold:.0%}")
+        return 1
+    print(f"\nNo regressions beyond {args.threshold:.0%}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
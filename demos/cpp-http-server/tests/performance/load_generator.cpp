@@ -0,0 +1,627 @@
+// Open-loop HTTP load generator for the task API.
+//
+// Requests are scheduled at fixed arrival times for each phase, whatever the
+// server's response times, and latency is measured from the scheduled time,
+// not from when the request finally went out. A slow server therefore shows
+// up as queueing delay instead of silently lowering the offered load
+// (coordinated omission). Each worker owns one keep-alive connection and
+// takes every Nth arrival.
+
+#include <json/json.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json_utils.h"
+
+#ifdef LOADGEN_IN_PROCESS
+#include "http_server.h"
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum Operation { HEALTH, GET, LIST, STATS, CREATE, UPDATE, DELETE, kOperationCount };
+
+const char* kOperationNames[kOperationCount] = {"health", "get", "list", "stats",
+                                                "create", "update", "delete"};
+
+struct Phase {
+    std::string name;
+    double duration_s;
+    double rate;  // Arrivals per second
+};
+
+struct Scenario {
+    std::string name = "default";
+    std::vector<Phase> phases;
+    double weights[kOperationCount] = {0, 40, 10, 5, 20, 20, 5};
+    unsigned connections = 16;
+    uint64_t preload = 1000;
+    // Pass/fail thresholds; 0 disables a check
+    double ensure_p95_ms = 0;
+    double ensure_p99_ms = 0;
+    double ensure_max_error_pct = 0;
+};
+
+struct Target {
+    std::string host = "127.0.0.1";
+    std::string port = "8000";
+};
+
+struct Sample {
+    uint64_t latency_ns;
+    uint8_t op;
+    bool ok;
+};
+
+bool parseTarget(const std::string& url, Target& target) {
+    const std::string prefix = "http://";
+    if (url.rfind(prefix, 0) != 0) {
+        return false;
+    }
+    std::string rest = url.substr(prefix.size());
+    rest = rest.substr(0, rest.find('/'));
+    size_t colon = rest.rfind(':');
+    target.host = rest.substr(0, colon);
+    target.port = colon == std::string::npos ? "80" : rest.substr(colon + 1);
+    return !target.host.empty();
+}
+
+// "mix = get:40 create:20 ..." and friends; see scenarios/*.conf
+bool applySetting(Scenario& scenario, const std::string& key, const std::string& value) {
+    std::istringstream in(value);
+    if (key == "name") {
+        scenario.name = value;
+    } else if (key == "phase") {
+        // phase = <seconds> <arrivals per second> [name...]
+        Phase phase;
+        if (!(in >> phase.duration_s >> phase.rate) || phase.duration_s <= 0 || phase.rate <= 0) {
+            return false;
+        }
+        std::getline(in >> std::ws, phase.name);
+        scenario.phases.push_back(phase);
+    } else if (key == "mix") {
+        std::fill(std::begin(scenario.weights), std::end(scenario.weights), 0.0);
+        std::string item;
+        while (in >> item) {
+            size_t colon = item.find(':');
+            auto name = std::find(std::begin(kOperationNames), std::end(kOperationNames),
+                                  item.substr(0, colon));
+            if (colon == std::string::npos || name == std::end(kOperationNames)) {
+                return false;
+            }
+            scenario.weights[name - std::begin(kOperationNames)] = std::stod(item.substr(colon + 1));
+        }
+    } else if (key == "connections") {
+        scenario.connections = static_cast<unsigned>(std::stoul(value));
+    } else if (key == "preload") {
+        scenario.preload = std::stoull(value);
+    } else if (key == "ensure_p95_ms") {
+        scenario.ensure_p95_ms = std::stod(value);
+    } else if (key == "ensure_p99_ms") {
+        scenario.ensure_p99_ms = std::stod(value);
+    } else if (key == "ensure_max_error_pct") {
+        scenario.ensure_max_error_pct = std::stod(value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool loadScenario(const std::string& path, Scenario& scenario) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open scenario " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        size_t eq = line.find('=');
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        auto trim = [](std::string s) {
+            s.erase(0, s.find_first_not_of(" \t"));
+            s.erase(s.find_last_not_of(" \t\r") + 1);
+            return s;
+        };
+        bool ok = false;
+        try {
+            ok = eq != std::string::npos && applySetting(scenario, trim(line.substr(0, eq)),
+                                                         trim(line.substr(eq + 1)));
+        } catch (const std::exception&) {
+        }
+        if (!ok) {
+            std::cerr << path << ":" << number << ": invalid setting: " << line << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Blocking HTTP/1.1 client over one keep-alive connection
+class Connection {
+public:
+    explicit Connection(const Target& target) : target_(target) {}
+    ~Connection() { disconnect(); }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    // Returns the status code, or 0 on a transport error
+    int request(const char* method, const std::string& path, const std::string& body,
+                std::string& response_body) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (fd_ < 0 && !connect()) {
+                return 0;
+            }
+            int status = exchange(method, path, body, response_body);
+            if (status != 0) {
+                return status;
+            }
+            // The server may have closed an idle keep-alive connection;
+            // retry once on a fresh one
+            disconnect();
+        }
+        return 0;
+    }
+
+private:
+    Target target_;
+    int fd_ = -1;
+    std::string buffer_;
+
+    bool connect() {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(target_.host.c_str(), target_.port.c_str(), &hints, &result) != 0) {
+            return false;
+        }
+        for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+            fd_ = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd_ >= 0 && ::connect(fd_, ai->ai_addr, ai->ai_addrlen) == 0) {
+                int one = 1;
+                setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                break;
+            }
+            disconnect();
+        }
+        freeaddrinfo(result);
+        buffer_.clear();
+        return fd_ >= 0;
+    }
+
+    void disconnect() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    bool fill() {
+        char chunk[16384];
+        ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        buffer_.append(chunk, static_cast<size_t>(n));
+        return true;
+    }
+
+    int exchange(const char* method, const std::string& path, const std::string& body,
+                 std::string& response_body) {
+        std::string request;
+        request.reserve(128 + body.size());
+        request.append(method).append(" ").append(path).append(" HTTP/1.1\r\nHost: ");
+        request.append(target_.host).append("\r\n");
+        if (!body.empty()) {
+            request.append("Content-Type: application/json\r\n");
+        }
+        request.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n\r\n");
+        request.append(body);
+        for (size_t sent = 0; sent < request.size();) {
+            ssize_t n = ::send(fd_, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return 0;
+            }
+            sent += static_cast<size_t>(n);
+        }
+
+        size_t header_end;
+        while ((header_end = buffer_.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) {
+                return 0;
+            }
+        }
+        std::string headers = buffer_.substr(0, header_end);
+        buffer_.erase(0, header_end + 4);
+        for (char& c : headers) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        if (headers.size() < 12 || headers.rfind("http/1.", 0) != 0) {
+            return 0;
+        }
+        int status = std::atoi(headers.c_str() + 9);
+
+        response_body.clear();
+        if (headers.find("transfer-encoding: chunked") != std::string::npos) {
+            for (;;) {
+                size_t line_end;
+                while ((line_end = buffer_.find("\r\n")) == std::string::npos) {
+                    if (!fill()) return 0;
+                }
+                size_t size = std::stoul(buffer_.substr(0, line_end), nullptr, 16);
+                while (buffer_.size() < line_end + 2 + size + 2) {
+                    if (!fill()) return 0;
+                }
+                response_body.append(buffer_, line_end + 2, size);
+                buffer_.erase(0, line_end + 2 + size + 2);
+                if (size == 0) {
+                    break;
+                }
+            }
+        } else {
+            size_t length = 0;
+            size_t pos = headers.find("content-length:");
+            if (pos != std::string::npos) {
+                length = std::stoul(headers.substr(pos + 15));
+            }
+            while (buffer_.size() < length) {
+                if (!fill()) return 0;
+            }
+            response_body.assign(buffer_, 0, length);
+            buffer_.erase(0, length);
+        }
+
+        if (headers.find("connection: close") != std::string::npos) {
+            disconnect();
+        }
+        return status;
+    }
+};
+
+uint64_t parseId(const std::string& body) {
+    size_t pos = body.find("\"id\":");
+    return pos == std::string::npos ? 0 : std::strtoull(body.c_str() + pos + 5, nullptr, 10);
+}
+
+std::string taskBody(std::mt19937_64& rng) {
+    return R"({"title":"Load test task )" + std::to_string(rng() % 1000000) +
+           R"(","description":"Created by the C++ load generator","priority":"medium","status":"pending"})";
+}
+
+class Worker {
+public:
+    Worker(const Target& target, const Scenario& scenario, unsigned index,
+           const std::vector<uint64_t>& preloaded)
+        : connection_(target), scenario_(scenario), index_(index), preloaded_(preloaded),
+          rng_(index * 2654435761u + 17),
+          pick_(std::begin(scenario.weights), std::end(scenario.weights)) {}
+
+    void run(Clock::time_point start) {
+        Clock::time_point phase_start = start;
+        for (const Phase& phase : scenario_.phases) {
+            const uint64_t arrivals = static_cast<uint64_t>(phase.duration_s * phase.rate);
+            for (uint64_t j = index_; j < arrivals; j += scenario_.connections) {
+                auto intended = phase_start + std::chrono::nanoseconds(
+                    static_cast<int64_t>(static_cast<double>(j) * 1e9 / phase.rate));
+                std::this_thread::sleep_until(intended);
+                Operation op = static_cast<Operation>(pick_(rng_));
+                bool ok = perform(op);
+                samples_.push_back({static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - intended).count()),
+                    static_cast<uint8_t>(op), ok});
+            }
+            phase_start += std::chrono::nanoseconds(static_cast<int64_t>(phase.duration_s * 1e9));
+        }
+    }
+
+    const std::vector<Sample>& samples() const { return samples_; }
+
+private:
+    Connection connection_;
+    const Scenario& scenario_;
+    unsigned index_;
+    const std::vector<uint64_t>& preloaded_;
+    std::mt19937_64 rng_;
+    std::discrete_distribution<int> pick_;
+    std::vector<uint64_t> created_;  // This worker's tasks, which it may delete
+    std::vector<Sample> samples_;
+    std::string response_;
+
+    // Preloaded tasks are never deleted, so reads and updates always hit
+    std::string existingTask() {
+        uint64_t id = preloaded_.empty() ? 1 : preloaded_[rng_() % preloaded_.size()];
+        return "/api/v1/tasks/" + std::to_string(id);
+    }
+
+    bool perform(Operation op) {
+        int status = 0;
+        switch (op) {
+            case HEALTH:
+                status = connection_.request("GET", "/health", "", response_);
+                break;
+            case GET:
+                status = connection_.request("GET", existingTask(), "", response_);
+                break;
+            case LIST:
+                status = connection_.request("GET", "/api/v1/tasks?status=pending&limit=20", "", response_);
+                break;
+            case STATS:
+                status = connection_.request("GET", "/api/v1/tasks/stats/summary", "", response_);
+                break;
+            case UPDATE:
+                status = connection_.request("PUT", existingTask(),
+                                             R"({"status":"in_progress","description":"Updated under load"})",
+                                             response_);
+                break;
+            case DELETE:
+                if (!created_.empty()) {
+                    std::string path = "/api/v1/tasks/" + std::to_string(created_.back());
+                    created_.pop_back();
+                    status = connection_.request("DELETE", path, "", response_);
+                    break;
+                }
+                [[fallthrough]];  // Nothing of ours to delete yet
+            case CREATE:
+                status = connection_.request("POST", "/api/v1/tasks", taskBody(rng_), response_);
+                if (status == 201) {
+                    created_.push_back(parseId(response_));
+                }
+                break;
+            case kOperationCount:
+                break;
+        }
+        return status >= 200 && status < 300;
+    }
+};
+
+// Creates the tasks reads and updates go to and returns their ids
+std::vector<uint64_t> preload(const Target& target, uint64_t count) {
+    Connection connection(target);
+    std::mt19937_64 rng(1);
+    std::string response;
+    std::vector<uint64_t> ids;
+    while (ids.size() < count) {
+        std::string body = R"({"create":[)";
+        uint64_t batch = std::min<uint64_t>(500, count - ids.size());
+        for (uint64_t i = 0; i < batch; ++i) {
+            body.append(i ? "," : "").append(taskBody(rng));
+        }
+        body.append("]}");
+        Json::Value result;
+        if (connection.request("POST", "/api/v1/tasks:batch", body, response) == 200) {
+            result = http_server::json_utils::parseJson(response);
+        }
+        if (!result.isObject()) {
+            std::cerr << "Preload failed after " << ids.size() << " tasks" << std::endl;
+            break;
+        }
+        for (const auto& item : result["create"]) {
+            if (item["status"].asInt() == 201) {
+                ids.push_back(item["task"]["id"].asUInt64());
+            }
+        }
+    }
+    return ids;
+}
+
+double percentileMs(const std::vector<uint64_t>& sorted, double q) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(q * static_cast<double>(sorted.size())));
+    return static_cast<double>(sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1]) / 1e6;
+}
+
+Json::Value summarize(std::vector<uint64_t>& latencies, size_t errors, double elapsed_s) {
+    std::sort(latencies.begin(), latencies.end());
+    Json::Value out;
+    out["requests"] = static_cast<Json::UInt64>(latencies.size());
+    out["errors"] = static_cast<Json::UInt64>(errors);
+    out["throughput_rps"] = elapsed_s > 0 ? static_cast<double>(latencies.size()) / elapsed_s : 0.0;
+    out["p50_ms"] = percentileMs(latencies, 0.50);
+    out["p95_ms"] = percentileMs(latencies, 0.95);
+    out["p99_ms"] = percentileMs(latencies, 0.99);
+    out["p999_ms"] = percentileMs(latencies, 0.999);
+    out["max_ms"] = latencies.empty() ? 0.0 : static_cast<double>(latencies.back()) / 1e6;
+    return out;
+}
+
+void printRow(const std::string& name, const Json::Value& s) {
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed
+              << std::setw(10) << s["requests"].asUInt64() << std::setw(8) << s["errors"].asUInt64()
+              << std::setprecision(1) << std::setw(11) << s["throughput_rps"].asDouble()
+              << std::setprecision(3) << std::setw(10) << s["p50_ms"].asDouble()
+              << std::setw(10) << s["p99_ms"].asDouble() << std::setw(10) << s["p999_ms"].asDouble()
+              << std::setw(10) << s["max_ms"].asDouble() << "\n";
+}
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --scenario=FILE      Phases, mix and thresholds (tests/performance/scenarios/*.conf)\n"
+              << "  --target=URL         Server to load, e.g. http://127.0.0.1:8000"
+#ifdef LOADGEN_IN_PROCESS
+              << "\n                       (default: start an HttpServer in this process)"
+#endif
+              << "\n  --port=N             Port of the in-process server (default: 18080)\n"
+              << "  --rate=N --duration=S  Single phase instead of the scenario's phases\n"
+              << "  --connections=N      Keep-alive connections, one per worker thread\n"
+              << "  --preload=N          Tasks created before the run (default: 1000)\n"
+              << "  --mix=\"get:40 ...\"   Operation weights: health get list stats create update delete\n"
+              << "  --json=FILE          Also write the results as JSON\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Scenario scenario;
+    Target target;
+    bool have_target = false;
+    [[maybe_unused]] int port = 18080;
+    double rate = 0;
+    double duration = 0;
+    std::string json_path;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        try {
+            if (key == "--help" || key == "-h") {
+                printUsage(argv[0]);
+                return 0;
+            } else if (key == "--scenario") {
+                if (!loadScenario(value, scenario)) return 1;
+            } else if (key == "--target") {
+                if (!parseTarget(value, target)) {
+                    std::cerr << "Target must look like http://host:port" << std::endl;
+                    return 1;
+                }
+                have_target = true;
+            } else if (key == "--port") {
+                port = std::stoi(value);
+            } else if (key == "--rate") {
+                rate = std::stod(value);
+            } else if (key == "--duration") {
+                duration = std::stod(value);
+            } else if (key == "--json") {
+                json_path = value;
+            } else if (!applySetting(scenario, key.substr(2), value)) {
+                std::cerr << "Unknown option " << arg << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value in " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (rate > 0 || duration > 0) {
+        scenario.phases = {{"command line", duration > 0 ? duration : 10, rate > 0 ? rate : 100}};
+    }
+    if (scenario.phases.empty()) {
+        scenario.phases = {{"default", 10, 100}};
+    }
+    scenario.connections = std::max(1u, scenario.connections);
+
+#ifdef LOADGEN_IN_PROCESS
+    std::unique_ptr<http_server::HttpServer> server;
+    if (!have_target) {
+        http_server::ServerConfig config;
+        config.port = port;
+        server = std::make_unique<http_server::HttpServer>(config);
+        if (!server->start()) {
+            std::cerr << "Failed to start the in-process server on port " << port << std::endl;
+            return 1;
+        }
+        target.port = std::to_string(port);
+    }
+#else
+    if (!have_target) {
+        std::cerr << "Built without libmicrohttpd: pass --target=http://host:port" << std::endl;
+        return 1;
+    }
+#endif
+
+    std::vector<uint64_t> preloaded = preload(target, scenario.preload);
+    std::cout << "Scenario " << scenario.name << " against " << target.host << ":" << target.port
+              << ", " << scenario.connections << " connections, " << preloaded.size() << " tasks preloaded\n";
+    for (const Phase& phase : scenario.phases) {
+        std::cout << "  " << phase.duration_s << "s at " << phase.rate << " req/s"
+                  << (phase.name.empty() ? "" : " (" + phase.name + ")") << "\n";
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (unsigned i = 0; i < scenario.connections; ++i) {
+        workers.push_back(std::make_unique<Worker>(target, scenario, i, preloaded));
+    }
+    auto start = Clock::now() + std::chrono::milliseconds(50);
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&worker, start] { worker->run(start); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+#ifdef LOADGEN_IN_PROCESS
+    if (server) {
+        server->stop();
+    }
+#endif
+
+    std::vector<uint64_t> all;
+    std::vector<uint64_t> by_op[kOperationCount];
+    size_t errors = 0;
+    size_t op_errors[kOperationCount] = {};
+    for (const auto& worker : workers) {
+        for (const Sample& sample : worker->samples()) {
+            all.push_back(sample.latency_ns);
+            by_op[sample.op].push_back(sample.latency_ns);
+            errors += sample.ok ? 0 : 1;
+            op_errors[sample.op] += sample.ok ? 0 : 1;
+        }
+    }
+
+    Json::Value report;
+    report["scenario"] = scenario.name;
+    report["connections"] = scenario.connections;
+    report["elapsed_s"] = elapsed_s;
+    report["total"] = summarize(all, errors, elapsed_s);
+    std::cout << "\n" << std::left << std::setw(10) << "operation" << std::right << std::setw(10)
+              << "requests" << std::setw(8) << "errors" << std::setw(11) << "req/s" << std::setw(10)
+              << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "p99.9 ms" << std::setw(10)
+              << "max ms" << "\n";
+    for (int op = 0; op < kOperationCount; ++op) {
+        if (!by_op[op].empty()) {
+            report["operations"][kOperationNames[op]] = summarize(by_op[op], op_errors[op], elapsed_s);
+            printRow(kOperationNames[op], report["operations"][kOperationNames[op]]);
+        }
+    }
+    printRow("total", report["total"]);
+
+    if (!json_path.empty()) {
+        std::ofstream(json_path) << report.toStyledString();
+    }
+
+    // Thresholds, like artillery's "ensure"
+    const Json::Value& total = report["total"];
+    double error_pct = all.empty() ? 0 : 100.0 * static_cast<double>(errors) / static_cast<double>(all.size());
+    bool passed = true;
+    auto check = [&](const char* what, double limit, double actual) {
+        if (limit > 0 && actual > limit) {
+            std::cout << "FAILED: " << what << " " << actual << " exceeds " << limit << "\n";
+            passed = false;
+        }
+    };
+    check("p95 ms", scenario.ensure_p95_ms, total["p95_ms"].asDouble());
+    check("p99 ms", scenario.ensure_p99_ms, total["p99_ms"].asDouble());
+    check("error %", scenario.ensure_max_error_pct, error_pct);
+    return passed ? 0 : 2;
+}
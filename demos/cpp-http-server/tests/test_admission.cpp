@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include "../include/admission.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace http_server;
+using namespace http_server::admission;
+
+namespace {
+
+constexpr uint64_t kMillis = 1000000;
+
+} // namespace
+
+TEST(AdmissionTest, GcraAllowsBurstThenSustainedRate) {
+    Gcra gcra(RateLimit{10, 3});  // One token per 100 ms, three at once
+    std::atomic<uint64_t> tat{0};
+    const uint64_t start = 1000 * kMillis;
+
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(gcra.take(tat, start), 0u);
+    }
+    uint64_t wait = gcra.take(tat, start);
+    EXPECT_EQ(wait, 100 * kMillis);
+    EXPECT_GT(gcra.take(tat, start + 99 * kMillis), 0u);
+    EXPECT_EQ(gcra.take(tat, start + 100 * kMillis), 0u);
+
+    // Idle for a while refills up to the burst, not beyond it
+    const uint64_t later = start + 10000 * kMillis;
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(gcra.take(tat, later), 0u);
+    }
+    EXPECT_GT(gcra.take(tat, later), 0u);
+    EXPECT_FALSE(Gcra(RateLimit{}).enabled());
+}
+
+TEST(AdmissionTest, ClientBucketsAreIndependentAndReusable) {
+    Gcra gcra(RateLimit{1, 1});
+    ClientBuckets buckets(4);  // A single four-way set
+    const uint64_t now = 1000 * kMillis;
+
+    for (uint64_t client = 1; client <= 4; ++client) {
+        EXPECT_EQ(buckets.take(gcra, client, now), 0u);
+        EXPECT_GT(buckets.take(gcra, client, now), 0u);
+    }
+    // Every slot belongs to a client still paying off its request
+    EXPECT_EQ(buckets.take(gcra, 5, now), 0u);
+    EXPECT_EQ(buckets.untracked(), 1u);
+
+    // Once a bucket has refilled its slot can go to someone else
+    EXPECT_EQ(buckets.take(gcra, 5, now + 2000 * kMillis), 0u);
+    EXPECT_GT(buckets.take(gcra, 5, now + 2000 * kMillis), 0u);
+    EXPECT_EQ(buckets.untracked(), 1u);
+}
+
+TEST(AdmissionTest, ConcurrencyLimiterQueuesBriefly) {
+    ConcurrencyLimiter limiter(1, 1, std::chrono::milliseconds(2000));
+    ASSERT_TRUE(limiter.acquire());
+
+    auto waiter = std::async(std::launch::async, [&] { return limiter.acquire(); });
+    while (limiter.waiting() == 0) {
+        std::this_thread::yield();
+    }
+    // The queue holds one waiter, so a third caller is refused at once
+    EXPECT_FALSE(limiter.acquire());
+    limiter.release();
+    ASSERT_EQ(waiter.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_TRUE(waiter.get());
+    EXPECT_EQ(limiter.inFlight(), 1u);
+    limiter.release();
+
+    ConcurrencyLimiter no_queue(1, 0, std::chrono::milliseconds(0));
+    ASSERT_TRUE(no_queue.acquire());
+    EXPECT_FALSE(no_queue.acquire());
+}
+
+TEST(AdmissionTest, ConcurrencyLimiterQueuesWithoutBlocking) {
+    ConcurrencyLimiter limiter(1, 2, std::chrono::milliseconds(50));
+    std::mutex mutex;
+    std::vector<std::pair<void*, bool>> woken;
+    limiter.startQueue([&](void* waiter, bool acquired) {
+        std::lock_guard<std::mutex> lock(mutex);
+        woken.emplace_back(waiter, acquired);
+    });
+    auto wokenCount = [&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return woken.size();
+    };
+    ASSERT_TRUE(limiter.tryAcquire());
+
+    int first = 0, second = 0, third = 0;
+    int parked = 0;
+    auto park = [&] { ++parked; };
+    EXPECT_EQ(limiter.enqueue(&first, park), ConcurrencyLimiter::Queued::QUEUED);
+    EXPECT_EQ(limiter.enqueue(&second, park), ConcurrencyLimiter::Queued::QUEUED);
+    EXPECT_EQ(limiter.enqueue(&third, park), ConcurrencyLimiter::Queued::REFUSED);
+    EXPECT_EQ(parked, 2);
+    EXPECT_EQ(limiter.waiting(), 2u);
+
+    // The slot passes straight to the oldest waiter
+    limiter.release();
+    ASSERT_EQ(wokenCount(), 1u);
+    EXPECT_EQ(woken[0], std::make_pair(static_cast<void*>(&first), true));
+    EXPECT_EQ(limiter.inFlight(), 1u);
+
+    // The other one times out
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (wokenCount() < 2 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    ASSERT_EQ(wokenCount(), 2u);
+    EXPECT_EQ(woken[1], std::make_pair(static_cast<void*>(&second), false));
+    EXPECT_EQ(limiter.waiting(), 0u);
+
+    // Stopping refuses whoever is still queued, and everyone after
+    EXPECT_EQ(limiter.enqueue(&third, park), ConcurrencyLimiter::Queued::QUEUED);
+    limiter.stopQueue();
+    ASSERT_EQ(wokenCount(), 3u);
+    EXPECT_EQ(woken[2], std::make_pair(static_cast<void*>(&third), false));
+    EXPECT_EQ(limiter.enqueue(&third, park), ConcurrencyLimiter::Queued::REFUSED);
+    limiter.release();
+    EXPECT_EQ(limiter.inFlight(), 0u);
+    EXPECT_EQ(limiter.enqueue(&third, park), ConcurrencyLimiter::Queued::REFUSED);
+}
+
+TEST(AdmissionTest, ControllerQueuesOnceStarted) {
+    Settings settings;
+    settings.max_concurrent = 1;
+    settings.queue_size = 1;
+    settings.queue_timeout_ms = 10000;
+    Controller controller(settings);
+    std::vector<void*> acquired;
+    controller.startQueue([&](void* waiter, bool ok) {
+        if (ok) {
+            acquired.push_back(waiter);
+        }
+    });
+
+    bool counted = false;
+    EXPECT_EQ(controller.admit(metrics::Route::TASKS, 1, counted).verdict, Verdict::ADMIT);
+    EXPECT_TRUE(counted);
+    EXPECT_EQ(controller.admit(metrics::Route::TASKS, 1, counted).verdict, Verdict::QUEUED);
+    EXPECT_FALSE(counted);
+    int waiter = 0;
+    EXPECT_EQ(controller.enqueue(&waiter, [] {}), ConcurrencyLimiter::Queued::QUEUED);
+    // The queue is full now
+    EXPECT_EQ(controller.admit(metrics::Route::TASKS, 1, counted).verdict, Verdict::OVERLOADED);
+    controller.release();
+    EXPECT_EQ(acquired, std::vector<void*>{&waiter});
+    controller.release();
+    controller.stopQueue();
+    EXPECT_EQ(controller.rejected(Verdict::OVERLOADED), 1u);
+}
+
+TEST(AdmissionTest, ControllerExemptsHealthAndCountsRejections) {
+    Settings settings;
+    settings.per_route[static_cast<size_t>(metrics::Route::TASKS)] = {1, 1};
+    settings.max_concurrent = 1;
+    Controller controller(settings);
+    ASSERT_TRUE(controller.enabled());
+
+    bool counted = false;
+    EXPECT_EQ(controller.admit(metrics::Route::TASKS, 1, counted).verdict, Verdict::ADMIT);
+    EXPECT_TRUE(counted);
+    Decision limited = controller.admit(metrics::Route::TASKS, 2, counted);
+    EXPECT_EQ(limited.verdict, Verdict::ROUTE_RATE);
+    EXPECT_GE(limited.retry_after_seconds, 1u);
+    EXPECT_FALSE(counted);
+
+    // The one slot is taken; health checks still get through
+    EXPECT_EQ(controller.admit(metrics::Route::TASK, 1, counted).verdict, Verdict::OVERLOADED);
+    EXPECT_EQ(controller.admit(metrics::Route::HEALTH, 1, counted).verdict, Verdict::ADMIT);
+    EXPECT_FALSE(counted);
+    controller.release();
+    EXPECT_EQ(controller.admit(metrics::Route::TASK, 1, counted).verdict, Verdict::ADMIT);
+    controller.release();
+
+    EXPECT_EQ(controller.rejected(Verdict::ROUTE_RATE), 1u);
+    EXPECT_EQ(controller.rejected(Verdict::OVERLOADED), 1u);
+    std::string text;
+    controller.appendPrometheus(text);
+    EXPECT_NE(text.find("http_admission_rejected_total{reason=\"overloaded\"} 1"), std::string::npos);
+
+    EXPECT_FALSE(Controller(Settings{}).enabled());
+}
+
+TEST(AdmissionTest, ClientKeyIgnoresPortAndMapping) {
+    sockaddr_in v4{};
+    v4.sin_family = AF_INET;
+    v4.sin_port = htons(1234);
+    inet_pton(AF_INET, "192.0.2.7", &v4.sin_addr);
+    sockaddr_in other_port = v4;
+    other_port.sin_port = htons(4321);
+
+    sockaddr_in6 mapped{};
+    mapped.sin6_family = AF_INET6;
+    inet_pton(AF_INET6, "::ffff:192.0.2.7", &mapped.sin6_addr);
+    sockaddr_in6 v6{};
+    v6.sin6_family = AF_INET6;
+    inet_pton(AF_INET6, "2001:db8::7", &v6.sin6_addr);
+
+    auto key = [](const auto& address) { return clientKey(reinterpret_cast<const sockaddr*>(&address)); };
+    EXPECT_EQ(key(v4), key(other_port));
+    EXPECT_EQ(key(v4), key(mapped));
+    EXPECT_NE(key(v4), key(v6));
+}
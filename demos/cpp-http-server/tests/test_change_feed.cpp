@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include "../include/change_feed.h"
+#include "../include/task_manager.h"
+#include "test_helpers.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+
+using namespace http_server;
+
+TEST(ChangeFeedTest, RecordsStoreMutationsInOrder) {
+    ChangeFeed feed;
+    TaskManager manager(4);
+    manager.setChangeFeed(&feed);
+    const uint64_t start = feed.latest();
+
+    auto task = manager.createTask(makeTask("followed"));
+    manager.updateTask(task->id, makeTask("renamed"));
+    manager.createTasks(std::vector<Json::Value>{makeTask("a"), makeTask("b")});
+    manager.deleteTask(task->id);
+    EXPECT_FALSE(manager.deleteTask(task->id));
+
+    ChangeBatch batch = feed.read(start, 100);
+    EXPECT_FALSE(batch.resync);
+    ASSERT_EQ(batch.events.size(), 5u);
+    EXPECT_EQ(batch.latest, start + 5);
+    for (size_t i = 0; i < batch.events.size(); ++i) {
+        EXPECT_EQ(batch.events[i].seq, start + 1 + i);
+    }
+    EXPECT_EQ(batch.events[0].task->version, 1u);
+    EXPECT_EQ(batch.events[1].task->title, "renamed");
+    EXPECT_EQ(batch.events[4].kind, ChangeKind::DELETE);
+    EXPECT_EQ(batch.events[4].id, task->id);
+    EXPECT_EQ(batch.events[4].task, nullptr);
+
+    // Paged reads pick up where the last one stopped
+    ChangeBatch first = feed.read(start, 2);
+    ASSERT_EQ(first.events.size(), 2u);
+    EXPECT_EQ(feed.read(first.events.back().seq, 100).events.size(), 3u);
+    EXPECT_TRUE(feed.read(batch.latest, 100).events.empty());
+}
+
+TEST(ChangeFeedTest, ReadersBehindTheRingMustResync) {
+    ChangeFeed feed(4);
+    const uint64_t start = feed.latest();
+    for (uint64_t id = 1; id <= 10; ++id) {
+        feed.publishDelete(id);
+    }
+
+    EXPECT_TRUE(feed.read(start, 100).resync);
+    EXPECT_TRUE(feed.read(start + 5, 100).resync);
+    ChangeBatch kept = feed.read(start + 6, 100);
+    EXPECT_FALSE(kept.resync);
+    ASSERT_EQ(kept.events.size(), 4u);
+    EXPECT_EQ(kept.events.front().id, 7u);
+
+    // Positions from the future (an earlier process) are not trusted
+    EXPECT_TRUE(feed.read(feed.latest() + 1, 100).resync);
+    EXPECT_TRUE(feed.read(0, 100).resync);
+}
+
+TEST(ChangeFeedTest, WaitersAndListenerSeePublishes) {
+    ChangeFeed feed;
+    std::atomic<int> notified{0};
+    feed.setListener([&] { ++notified; });
+    const uint64_t start = feed.latest();
+
+    EXPECT_FALSE(feed.waitForNewer(start, std::chrono::milliseconds(1)));
+    std::thread writer([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        feed.publishDelete(1);
+    });
+    EXPECT_TRUE(feed.waitForNewer(start, std::chrono::seconds(5)));
+    writer.join();
+    EXPECT_EQ(notified.load(), 1);
+}
+
+// Writers on different shards reserve their slots independently; readers
+// still see every sequence number once, in order, and each task's events
+// in version order
+TEST(ChangeFeedTest, ConcurrentWritersLeaveNoGaps) {
+    ChangeFeed feed(1 << 16);
+    TaskManager manager(8);
+    manager.setChangeFeed(&feed);
+    std::atomic<int> notified{0};
+    feed.setListener([&] { ++notified; });
+    const uint64_t start = feed.latest();
+
+    constexpr int kWriters = 8;
+    constexpr int kUpdates = 200;
+    std::vector<std::thread> writers;
+    for (int w = 0; w < kWriters; ++w) {
+        writers.emplace_back([&, w] {
+            auto task = manager.createTask(makeTask("writer " + std::to_string(w)));
+            for (int i = 0; i < kUpdates; ++i) {
+                manager.updateTask(task->id, makeTask("update " + std::to_string(i)));
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    const uint64_t total = kWriters * (kUpdates + 1);
+    EXPECT_EQ(feed.latest(), start + total);
+    EXPECT_EQ(feed.reserved(), feed.latest());
+    ChangeBatch batch = feed.read(start, total);
+    ASSERT_FALSE(batch.resync);
+    ASSERT_EQ(batch.events.size(), total);
+    std::map<uint64_t, uint64_t> versions;
+    for (size_t i = 0; i < batch.events.size(); ++i) {
+        const ChangeEvent& event = batch.events[i];
+        EXPECT_EQ(event.seq, start + 1 + i);
+        EXPECT_EQ(event.task->version, versions[event.id] + 1);
+        versions[event.id] = event.task->version;
+    }
+    EXPECT_GT(notified.load(), 0);
+    EXPECT_LE(notified.load(), static_cast<int>(total));
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include "../include/compression.h"
+#include "../include/task_manager.h"
+#include <string>
+
+#ifdef HTTP_SERVER_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HTTP_SERVER_WITH_BROTLI_DECODER
+#include <brotli/decode.h>
+#endif
+
+using namespace http_server;
+using namespace http_server::compression;
+
+namespace {
+
+// Repetitive like a page of tasks, so it compresses well
+std::string sampleBody() {
+    std::string body = "{\"tasks\":[";
+    for (int i = 0; i < 200; ++i) {
+        body += R"({"description":"A task description","id":)" + std::to_string(i) +
+                R"(,"priority":"medium","status":"pending","title":"Task"},)";
+    }
+    body.back() = ']';
+    return body + "}";
+}
+
+#ifdef HTTP_SERVER_WITH_ZLIB
+std::string gunzip(const std::string& data) {
+    z_stream z{};
+    inflateInit2(&z, 15 + 16);
+    z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    z.avail_in = static_cast<uInt>(data.size());
+    std::string out;
+    char chunk[16384];
+    int rc;
+    do {
+        z.next_out = reinterpret_cast<Bytef*>(chunk);
+        z.avail_out = sizeof(chunk);
+        rc = inflate(&z, Z_NO_FLUSH);
+        out.append(chunk, sizeof(chunk) - z.avail_out);
+    } while (rc == Z_OK);
+    inflateEnd(&z);
+    return rc == Z_STREAM_END ? out : "<corrupt>";
+}
+#endif
+
+} // namespace
+
+TEST(CompressionTest, NegotiatesAcceptEncoding) {
+    const bool gzip = isAvailable(Encoding::GZIP);
+    const bool brotli = isAvailable(Encoding::BROTLI);
+    const Encoding best = brotli ? Encoding::BROTLI : gzip ? Encoding::GZIP : Encoding::IDENTITY;
+
+    EXPECT_EQ(negotiate(nullptr), Encoding::IDENTITY);
+    EXPECT_EQ(negotiate(""), Encoding::IDENTITY);
+    EXPECT_EQ(negotiate("identity"), Encoding::IDENTITY);
+    EXPECT_EQ(negotiate("gzip, deflate, br"), best);
+    EXPECT_EQ(negotiate("*"), best);
+    EXPECT_EQ(negotiate("GZIP"), gzip ? Encoding::GZIP : Encoding::IDENTITY);
+    EXPECT_EQ(negotiate("br;q=0.5, gzip;q=0.8"), gzip ? Encoding::GZIP : best);
+    EXPECT_EQ(negotiate("br;q=0, gzip;q=0"), Encoding::IDENTITY);
+    EXPECT_EQ(negotiate("*;q=0"), Encoding::IDENTITY);
+    EXPECT_EQ(negotiate("gzip;q=0, *"), brotli ? Encoding::BROTLI : Encoding::IDENTITY);
+}
+
+#ifdef HTTP_SERVER_WITH_ZLIB
+TEST(CompressionTest, GzipRoundTripsAndReusesThreadCompressor) {
+    const std::string body = sampleBody();
+    Settings settings;
+    std::string out;
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(compress(Encoding::GZIP, settings, body, out));
+        EXPECT_LT(out.size(), body.size() / 4);
+        EXPECT_EQ(gunzip(out), body);
+    }
+}
+
+// Export output: pages fed one at a time, finished on the last
+TEST(CompressionTest, GzipStreamsAcrossWrites) {
+    const std::string body = sampleBody();
+    Compressor compressor(Encoding::GZIP, 6);
+    std::string out;
+    for (size_t pos = 0; pos < body.size(); pos += 1000) {
+        const bool last = pos + 1000 >= body.size();
+        ASSERT_TRUE(compressor.write(std::string_view(body).substr(pos, 1000), out, last));
+    }
+    EXPECT_EQ(gunzip(out), body);
+
+    compressor.reset();
+    out.clear();
+    ASSERT_TRUE(compressor.write("{}", out, true));
+    EXPECT_EQ(gunzip(out), "{}");
+}
+#endif
+
+#ifdef HTTP_SERVER_WITH_BROTLI_DECODER
+TEST(CompressionTest, BrotliRoundTrips) {
+    const std::string body = sampleBody();
+    Settings settings;
+    std::string out;
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE(compress(Encoding::BROTLI, settings, body, out));
+        EXPECT_LT(out.size(), body.size() / 4);
+
+        std::string decoded(body.size(), '\0');
+        size_t decoded_size = decoded.size();
+        ASSERT_EQ(BrotliDecoderDecompress(out.size(), reinterpret_cast<const uint8_t*>(out.data()),
+                                          &decoded_size, reinterpret_cast<uint8_t*>(decoded.data())),
+                  BROTLI_DECODER_RESULT_SUCCESS);
+        decoded.resize(decoded_size);
+        EXPECT_EQ(decoded, body);
+    }
+}
+#endif
+
+TEST(CompressionTest, UnavailableCodingsRefuse) {
+    std::string out;
+    EXPECT_FALSE(compress(Encoding::IDENTITY, Settings{}, "body", out));
+}
+
+// Entries match only the version they were made for, in its coding
+TEST(CompressionTest, BodyCacheMatchesTheOwningVersion) {
+    BodyCache cache(4);
+    auto task = std::make_shared<const Task>();
+    EXPECT_EQ(cache.find(task, Encoding::GZIP), nullptr);
+
+    auto body = std::make_shared<const std::string>("compressed");
+    cache.store(task, Encoding::GZIP, body);
+    EXPECT_EQ(cache.find(task, Encoding::GZIP), body);
+    EXPECT_EQ(cache.find(task, Encoding::BROTLI), nullptr);
+
+    // A successor with the same id and version is still a different version
+    auto successor = std::make_shared<const Task>(*task);
+    EXPECT_EQ(cache.find(successor, Encoding::GZIP), nullptr);
+
+    // Once the version is gone nothing can match its entry
+    std::weak_ptr<const Task> gone = task;
+    task.reset();
+    EXPECT_TRUE(gone.expired());
+    EXPECT_EQ(cache.find(successor, Encoding::GZIP), nullptr);
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include "../include/health_check.h"
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace http_server;
+
+namespace {
+
+// A fake /proc/self and cgroup tree, so samples have known values
+class HealthCheckTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char pattern[] = "/tmp/health-check-XXXXXX";
+        ASSERT_NE(mkdtemp(pattern), nullptr);
+        root_ = pattern;
+        paths_.proc_self = root_ + "/proc";
+        paths_.cgroup = root_ + "/cgroup";
+        std::filesystem::create_directories(paths_.proc_self);
+        std::filesystem::create_directories(paths_.cgroup);
+
+        const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        write(paths_.proc_self + "/statm", std::to_string(20 * 1024 * 1024 / page) + " " +
+                                               std::to_string(8 * 1024 * 1024 / page) + " 100 10 0 300 0\n");
+        // A command name with spaces and parentheses; utime and stime are
+        // fields 14 and 15, num_threads 20
+        const long ticks = sysconf(_SC_CLK_TCK);
+        std::string stat = "4242 (http (server) x) S 1 4242 4242 0 -1 4194560 500 0 0 0 ";
+        stat += std::to_string(3 * ticks) + " " + std::to_string(ticks) + " 0 0 20 0 7 0 100 ";
+        stat += "20971520 2048 18446744073709551615 0 0 0 0 0 0 0 0 0 0 0 0 17 3 0 0 0 0 0\n";
+        write(paths_.proc_self + "/stat", stat);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(root_);
+    }
+
+    static void write(const std::string& path, const std::string& contents) {
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+        std::ofstream(path) << contents;
+    }
+
+    std::string root_;
+    HealthCheck::Paths paths_;
+};
+
+} // namespace
+
+TEST_F(HealthCheckTest, SamplesProcessAndCgroupV2Limits) {
+    write(paths_.cgroup + "/memory.max", "536870912\n");
+    write(paths_.cgroup + "/memory.current", "104857600\n");
+    write(paths_.cgroup + "/cpu.max", "150000 100000\n");
+
+    HealthCheck health(HealthCheck::kDefaultInterval, paths_);
+    EXPECT_EQ(health.latest(), nullptr);
+    health.sampleNow();
+    auto sample = health.latest();
+    ASSERT_NE(sample, nullptr);
+    EXPECT_EQ(sample->virtual_bytes, 20u * 1024 * 1024);
+    EXPECT_EQ(sample->rss_bytes, 8u * 1024 * 1024);
+    EXPECT_DOUBLE_EQ(sample->cpu_seconds, 4.0);
+    EXPECT_EQ(sample->threads, 7u);
+    EXPECT_EQ(sample->memory_limit_bytes, 536870912u);
+    EXPECT_EQ(sample->memory_usage_bytes, 104857600u);
+    EXPECT_DOUBLE_EQ(sample->cpu_limit_cores, 1.5);
+
+    Json::Value metrics = health.getSystemMetrics();
+    EXPECT_EQ(metrics["memory"]["rss_bytes"].asUInt64(), 8u * 1024 * 1024);
+    EXPECT_EQ(metrics["memory"]["limit_bytes"].asUInt64(), 536870912u);
+    EXPECT_DOUBLE_EQ(metrics["cpu"]["limit_cores"].asDouble(), 1.5);
+
+    std::string prometheus;
+    health.appendPrometheus(prometheus);
+    EXPECT_NE(prometheus.find("process_resident_memory_bytes 8388608\n"), std::string::npos);
+    EXPECT_NE(prometheus.find("process_cpu_seconds_total 4\n"), std::string::npos);
+    EXPECT_NE(prometheus.find("process_threads 7\n"), std::string::npos);
+}
+
+TEST_F(HealthCheckTest, TreatsCgroupV1UnlimitedAsNoLimit) {
+    write(paths_.cgroup + "/memory/memory.limit_in_bytes", "9223372036854771712\n");
+    write(paths_.cgroup + "/memory/memory.usage_in_bytes", "4096\n");
+    write(paths_.cgroup + "/cpu/cpu.cfs_quota_us", "-1\n");
+    write(paths_.cgroup + "/cpu/cpu.cfs_period_us", "100000\n");
+
+    HealthCheck health(HealthCheck::kDefaultInterval, paths_);
+    health.sampleNow();
+    auto sample = health.latest();
+    ASSERT_NE(sample, nullptr);
+    EXPECT_EQ(sample->memory_limit_bytes, 0u);
+    EXPECT_EQ(sample->memory_usage_bytes, 4096u);
+    EXPECT_EQ(sample->cpu_limit_cores, 0.0);
+    EXPECT_FALSE(health.getSystemMetrics()["memory"].isMember("limit_bytes"));
+}
+
+TEST_F(HealthCheckTest, ReadinessFollowsRecoveryAndOverload) {
+    HealthCheck health(HealthCheck::kDefaultInterval, paths_);
+    std::atomic<bool> overloaded{false};
+    health.setOverloadCheck([&] { return overloaded.load(); });
+
+    health.setState(ServingState::RECOVERING);
+    EXPECT_FALSE(health.isReady());
+    EXPECT_TRUE(health.isLive());
+    EXPECT_EQ(health.getReadinessStatus()["reason"].asString(), "recovering");
+    EXPECT_EQ(health.getHealthStatus()["status"].asString(), "healthy");
+
+    health.setState(ServingState::SERVING);
+    EXPECT_TRUE(health.isReady());
+    EXPECT_EQ(health.getReadinessStatus()["status"].asString(), "ready");
+    overloaded = true;
+    EXPECT_FALSE(health.isReady());
+    EXPECT_EQ(health.getReadinessStatus()["reason"].asString(), "overloaded");
+    EXPECT_TRUE(health.isLive());
+
+    // A drain answers what is in flight but takes no new traffic
+    health.setState(ServingState::DRAINING);
+    EXPECT_EQ(health.getReadinessStatus()["reason"].asString(), "draining");
+    EXPECT_TRUE(health.isLive());
+    EXPECT_TRUE(health.acceptsRequests());
+    // Recovery finishing late does not undo it
+    EXPECT_FALSE(health.advanceState(ServingState::RECOVERING, ServingState::SERVING));
+    EXPECT_EQ(health.state(), ServingState::DRAINING);
+
+    health.setState(ServingState::FAILED);
+    EXPECT_FALSE(health.isLive());
+    EXPECT_EQ(health.getLivenessStatus()["status"].asString(), "failed");
+    EXPECT_EQ(health.getHealthStatus()["status"].asString(), "unhealthy");
+}
+
+TEST(HealthCheckSamplerTest, RefreshesTheSnapshotInTheBackground) {
+    HealthCheck health(std::chrono::milliseconds(5));
+    health.start();
+    auto first = health.latest();
+    ASSERT_NE(first, nullptr);
+    EXPECT_GT(first->rss_bytes, 0u);
+    EXPECT_GT(first->threads, 0u);
+
+    for (int i = 0; i < 400 && health.latest() == first; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_NE(health.latest(), first);
+    health.stop();
+
+    // Stopped for good: nothing is published any more
+    auto last = health.latest();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(health.latest(), last);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <json/json.h>
+#include <string>
+
+// Request body for TaskManager::createTask and updateTask
+inline Json::Value makeTask(const std::string& title, const std::string& status = "pending",
+                            const std::string& priority = "medium") {
+    Json::Value data;
+    data["title"] = title;
+    data["status"] = status;
+    data["priority"] = priority;
+    return data;
+}
@@ -0,0 +1,608 @@
+#include <gtest/gtest.h>
+#include "../include/http_server.h"
+#include "../include/json_utils.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <string>
+
+#ifdef HTTP_SERVER_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace http_server;
+
+namespace {
+
+constexpr int kTestPort = 18765;
+
+struct HttpReply {
+    int status = 0;
+    std::string headers;
+    std::string body;
+};
+
+// Minimal blocking HTTP/1.1 client; one request per connection
+HttpReply sendRequest(const std::string& method, const std::string& path,
+                      const std::string& body = "", const std::string& extra_headers = "",
+                      int port = kTestPort) {
+    HttpReply reply;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return reply;
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return reply;
+    }
+
+    std::string request = method + " " + path + " HTTP/1.1\r\n"
+                          "Host: localhost\r\n"
+                          "Connection: close\r\n"
+                          "Content-Type: application/json\r\n" + extra_headers +
+                          "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    send(fd, request.data(), request.size(), 0);
+
+    std::string raw;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        raw.append(buffer, static_cast<size_t>(n));
+    }
+    close(fd);
+
+    if (raw.size() > 12) {
+        reply.status = std::stoi(raw.substr(9, 3));
+    }
+    size_t header_end = raw.find("\r\n\r\n");
+    if (header_end != std::string::npos) {
+        reply.headers = raw.substr(0, header_end);
+        reply.body = raw.substr(header_end + 4);
+    }
+    return reply;
+}
+
+int connectToServer() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kTestPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+class HttpServerTest : public ::testing::TestWithParam<ThreadingMode> {
+protected:
+    void SetUp() override {
+        ServerConfig config;
+        config.port = kTestPort;
+        config.threading_mode = GetParam();
+        config.thread_pool_size = 2;
+        server_ = std::make_unique<HttpServer>(config);
+        ASSERT_TRUE(server_->start());
+    }
+
+    void TearDown() override {
+        server_->stop();
+    }
+
+    std::unique_ptr<HttpServer> server_;
+};
+
+} // namespace
+
+TEST_P(HttpServerTest, HealthCheck) {
+    auto reply = sendRequest("GET", "/health");
+    EXPECT_EQ(reply.status, 200);
+    EXPECT_EQ(json_utils::parseJson(reply.body)["status"].asString(), "healthy");
+}
+
+TEST_P(HttpServerTest, TaskCrudRoundTrip) {
+    auto created = sendRequest("POST", "/api/v1/tasks", R"({"title":"HTTP Task","priority":"high"})");
+    ASSERT_EQ(created.status, 201);
+    uint64_t id = json_utils::parseJson(created.body)["id"].asUInt64();
+
+    auto fetched = sendRequest("GET", "/api/v1/tasks/" + std::to_string(id));
+    EXPECT_EQ(fetched.status, 200);
+    EXPECT_EQ(json_utils::parseJson(fetched.body)["title"].asString(), "HTTP Task");
+
+    auto updated = sendRequest("PUT", "/api/v1/tasks/" + std::to_string(id), R"({"status":"completed"})");
+    EXPECT_EQ(updated.status, 200);
+    EXPECT_EQ(json_utils::parseJson(updated.body)["status"].asString(), "completed");
+
+    auto listed = sendRequest("GET", "/api/v1/tasks?status=completed&limit=5");
+    EXPECT_EQ(listed.status, 200);
+    EXPECT_EQ(json_utils::parseJson(listed.body)["count"].asUInt(), 1u);
+    EXPECT_TRUE(json_utils::parseJson(listed.body)["next_cursor"].isNull());
+
+    auto after = sendRequest("GET", "/api/v1/tasks?after=" + std::to_string(id));
+    EXPECT_EQ(after.status, 200);
+    EXPECT_EQ(json_utils::parseJson(after.body)["count"].asUInt(), 0u);
+
+    EXPECT_EQ(sendRequest("DELETE", "/api/v1/tasks/" + std::to_string(id)).status, 200);
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks/" + std::to_string(id)).status, 404);
+}
+
+TEST_P(HttpServerTest, BatchReportsPerItemStatus) {
+    auto created = sendRequest("POST", "/api/v1/tasks:batch",
+                               R"({"create":[{"title":"a"},{"title":""},{"title":"b"}]})");
+    ASSERT_EQ(created.status, 200);
+    Json::Value body = json_utils::parseJson(created.body);
+    ASSERT_EQ(body["create"].size(), 3u);
+    EXPECT_EQ(body["create"][0]["status"].asInt(), 201);
+    EXPECT_EQ(body["create"][1]["status"].asInt(), 400);
+    EXPECT_EQ(body["create"][1]["field"].asString(), "title");
+    uint64_t first = body["create"][0]["task"]["id"].asUInt64();
+    uint64_t second = body["create"][2]["task"]["id"].asUInt64();
+
+    auto mixed = sendRequest("POST", "/api/v1/tasks:batch",
+                             R"({"update":[{"id":)" + std::to_string(first) +
+                             R"(,"status":"completed"},{"id":0}],"delete":[)" +
+                             std::to_string(second) + ",999999,\"x\"]}");
+    ASSERT_EQ(mixed.status, 200);
+    body = json_utils::parseJson(mixed.body);
+    EXPECT_EQ(body["update"][0]["task"]["status"].asString(), "completed");
+    EXPECT_EQ(body["update"][1]["status"].asInt(), 400);
+    EXPECT_EQ(body["delete"][0]["status"].asInt(), 200);
+    EXPECT_EQ(body["delete"][1]["status"].asInt(), 404);
+    EXPECT_EQ(body["delete"][2]["status"].asInt(), 400);
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks/" + std::to_string(second)).status, 404);
+
+    EXPECT_EQ(sendRequest("POST", "/api/v1/tasks:batch", R"({"create":{}})").status, 400);
+}
+
+TEST_P(HttpServerTest, ExportThenImport) {
+    for (const char* title : {"one", "two", "three"}) {
+        sendRequest("POST", "/api/v1/tasks", std::string(R"({"title":")") + title + "\"}");
+    }
+
+    auto exported = sendRequest("GET", "/api/v1/tasks:export");
+    ASSERT_EQ(exported.status, 200);
+    // Chunked transfer encoding; the NDJSON lines are in the body verbatim
+    EXPECT_NE(exported.body.find(R"("title":"two")"), std::string::npos);
+    EXPECT_NE(exported.body.find(R"({"count":3,"end":true,"seq":)"), std::string::npos);
+
+    auto imported = sendRequest("POST", "/api/v1/tasks:import",
+                                "{\"title\":\"restored\",\"id\":500}\n{bad}\n");
+    ASSERT_EQ(imported.status, 200);
+    Json::Value body = json_utils::parseJson(imported.body);
+    EXPECT_EQ(body["imported"].asUInt(), 1u);
+    EXPECT_EQ(body["failed"].asUInt(), 1u);
+    EXPECT_EQ(body["errors"][0]["line"].asUInt(), 2u);
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks/500").status, 200);
+}
+
+TEST_P(HttpServerTest, RejectsInvalidInput) {
+    EXPECT_EQ(sendRequest("POST", "/api/v1/tasks", "{not json").status, 400);
+    EXPECT_EQ(sendRequest("POST", "/api/v1/tasks", R"({"description":"no title"})").status, 400);
+
+    auto rejected = sendRequest("POST", "/api/v1/tasks", R"({"title":"t","status":"done"})");
+    EXPECT_EQ(rejected.status, 400);
+    EXPECT_EQ(json_utils::parseJson(rejected.body)["field"].asString(), "status");
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks/abc").status, 400);
+    EXPECT_EQ(sendRequest("GET", "/nope").status, 404);
+}
+
+TEST_P(HttpServerTest, MetricsCountRequestsByRoute) {
+    sendRequest("POST", "/api/v1/tasks", R"({"title":"measured"})");
+    sendRequest("GET", "/api/v1/tasks/1");
+    sendRequest("GET", "/api/v1/tasks/999");
+
+    auto reply = sendRequest("GET", "/metrics");
+    ASSERT_EQ(reply.status, 200);
+    EXPECT_NE(reply.body.find("http_requests_total{route=\"/api/v1/tasks\",method=\"POST\",code=\"2xx\"} 1\n"),
+              std::string::npos);
+    EXPECT_NE(reply.body.find("http_requests_total{route=\"/api/v1/tasks/{id}\",method=\"GET\",code=\"4xx\"} 1\n"),
+              std::string::npos);
+    EXPECT_NE(reply.body.find("task_store_lock_hold_seconds_count{mode=\"write\"} 1\n"), std::string::npos);
+    EXPECT_NE(reply.body.find("task_store_tasks 1\n"), std::string::npos);
+    EXPECT_EQ(server_->getRequestMetrics().requests(metrics::Route::TASK, metrics::Method::GET), 2u);
+}
+
+TEST(ConnectionInfoTest, ResetRewindsArena) {
+    ConnectionInfo info;
+    info.post_data.append(ConnectionInfo::kInlineArenaSize / 2, 'x');
+    info.data_size = info.post_data.size();
+    const char* inline_data = info.post_data.data();
+    info.reset();
+    EXPECT_TRUE(info.post_data.empty());
+    EXPECT_EQ(info.data_size, 0u);
+
+    // The same inline storage serves the next request
+    info.post_data.append(ConnectionInfo::kInlineArenaSize / 2, 'y');
+    EXPECT_EQ(info.post_data.data(), inline_data);
+}
+
+// Bodies past the inline arena still arrive intact, and recycled
+// connection state does not leak into the next request
+TEST_P(HttpServerTest, BodiesLargerThanInlineArena) {
+    Json::Value data;
+    data["title"] = "large";
+    data["description"] = std::string(3 * ConnectionInfo::kInlineArenaSize, 'd');
+    for (int i = 0; i < 3; ++i) {
+        auto created = sendRequest("POST", "/api/v1/tasks", json_utils::jsonToString(data));
+        ASSERT_EQ(created.status, 201);
+        EXPECT_EQ(json_utils::parseJson(created.body)["description"].asString().size(),
+                  data["description"].asString().size());
+        EXPECT_EQ(sendRequest("POST", "/api/v1/tasks", R"({"title":"small"})").status, 201);
+    }
+}
+
+// Several requests written back to back on one connection are answered
+// in order, and the connection stays usable afterwards
+TEST_P(HttpServerTest, PipelinedRequestsOnOneConnection) {
+    int fd = connectToServer();
+    ASSERT_GE(fd, 0);
+    const std::string create = R"({"title":"pipelined"})";
+    std::string requests;
+    for (int i = 0; i < 3; ++i) {
+        requests += "POST /api/v1/tasks HTTP/1.1\r\nHost: localhost\r\n"
+                    "Content-Type: application/json\r\nContent-Length: " +
+                    std::to_string(create.size()) + "\r\n\r\n" + create;
+    }
+    requests += "GET /api/v1/tasks/2 HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    send(fd, requests.data(), requests.size(), 0);
+
+    std::string raw;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        raw.append(buffer, static_cast<size_t>(n));
+    }
+    close(fd);
+
+    size_t responses = 0;
+    for (size_t pos = raw.find("HTTP/1.1 "); pos != std::string::npos; pos = raw.find("HTTP/1.1 ", pos + 1)) {
+        EXPECT_EQ(raw.substr(pos + 9, 3), responses < 3 ? "201" : "200");
+        ++responses;
+    }
+    EXPECT_EQ(responses, 4u);
+    EXPECT_NE(raw.find("\"id\":3"), std::string::npos);
+    EXPECT_EQ(server_->getTaskManager().getTaskCount(), 3u);
+}
+
+#ifdef HTTP_SERVER_WITH_ZLIB
+TEST_P(HttpServerTest, CompressesLargeResponsesWhenAccepted) {
+    Json::Value data;
+    data["title"] = "compressible";
+    data["description"] = std::string(2000, 'c');
+    ASSERT_EQ(sendRequest("POST", "/api/v1/tasks", json_utils::jsonToString(data)).status, 201);
+
+    auto plain = sendRequest("GET", "/api/v1/tasks/1");
+    EXPECT_EQ(plain.headers.find("Content-Encoding"), std::string::npos);
+
+    // Twice, so the second response comes from the version's cached copy
+    for (int i = 0; i < 2; ++i) {
+        auto gzipped = sendRequest("GET", "/api/v1/tasks/1", "", "Accept-Encoding: gzip\r\n");
+        ASSERT_EQ(gzipped.status, 200);
+        EXPECT_NE(gzipped.headers.find("Content-Encoding: gzip"), std::string::npos);
+        EXPECT_LT(gzipped.body.size(), plain.body.size() / 4);
+
+        std::string inflated(plain.body.size(), '\0');
+        uLongf inflated_size = inflated.size();
+        z_stream z{};
+        inflateInit2(&z, 15 + 16);
+        z.next_in = reinterpret_cast<Bytef*>(gzipped.body.data());
+        z.avail_in = static_cast<uInt>(gzipped.body.size());
+        z.next_out = reinterpret_cast<Bytef*>(inflated.data());
+        z.avail_out = static_cast<uInt>(inflated_size);
+        EXPECT_EQ(inflate(&z, Z_FINISH), Z_STREAM_END);
+        inflateEnd(&z);
+        EXPECT_EQ(inflated, plain.body);
+    }
+
+    // Small bodies stay uncompressed whatever the client accepts
+    auto health = sendRequest("GET", "/health", "", "Accept-Encoding: gzip, br\r\n");
+    EXPECT_EQ(health.headers.find("Content-Encoding"), std::string::npos);
+    EXPECT_NE(health.headers.find("Vary: Accept-Encoding"), std::string::npos);
+}
+#endif
+
+namespace {
+
+std::string headerValue(const std::string& headers, const std::string& name) {
+    size_t pos = headers.find("\r\n" + name + ": ");
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos += name.size() + 4;
+    return headers.substr(pos, headers.find("\r\n", pos) - pos);
+}
+
+} // namespace
+
+TEST_P(HttpServerTest, ConditionalGetsAnswerNotModified) {
+    ASSERT_EQ(sendRequest("POST", "/api/v1/tasks", R"({"title":"polled"})").status, 201);
+
+    auto first = sendRequest("GET", "/api/v1/tasks/1");
+    std::string etag = headerValue(first.headers, "ETag");
+    ASSERT_FALSE(etag.empty());
+    auto again = sendRequest("GET", "/api/v1/tasks/1", "", "If-None-Match: " + etag + "\r\n");
+    EXPECT_EQ(again.status, 304);
+    EXPECT_TRUE(again.body.empty());
+    EXPECT_EQ(headerValue(again.headers, "ETag"), etag);
+
+    auto list = sendRequest("GET", "/api/v1/tasks?limit=5");
+    std::string list_etag = headerValue(list.headers, "ETag");
+    ASSERT_FALSE(list_etag.empty());
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks?limit=5", "", "If-None-Match: " + list_etag + "\r\n").status,
+              304);
+
+    // The update gives the task a new tag, and any write retires list tags
+    ASSERT_EQ(sendRequest("PUT", "/api/v1/tasks/1", R"({"status":"completed"})").status, 200);
+    auto changed = sendRequest("GET", "/api/v1/tasks/1", "", "If-None-Match: " + etag + "\r\n");
+    EXPECT_EQ(changed.status, 200);
+    EXPECT_NE(headerValue(changed.headers, "ETag"), etag);
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks?limit=5", "", "If-None-Match: " + list_etag + "\r\n").status,
+              200);
+}
+
+TEST_P(HttpServerTest, ListsDueDateRangesInDueOrder) {
+    ASSERT_EQ(sendRequest("POST", "/api/v1/tasks", R"({"title":"later","due_date":"2030-03-01"})").status, 201);
+    ASSERT_EQ(sendRequest("POST", "/api/v1/tasks", R"({"title":"sooner","due_date":"2030-02-01"})").status, 201);
+    ASSERT_EQ(sendRequest("POST", "/api/v1/tasks", R"({"title":"undated"})").status, 201);
+
+    auto sorted = sendRequest("GET", "/api/v1/tasks?sort=due_date&due_after=2030-01-01&due_before=2030-12-31");
+    ASSERT_EQ(sorted.status, 200);
+    Json::Value body = json_utils::parseJson(sorted.body);
+    ASSERT_EQ(body["count"].asUInt(), 2u);
+    EXPECT_EQ(body["tasks"][0]["title"].asString(), "sooner");
+    EXPECT_EQ(body["tasks"][1]["title"].asString(), "later");
+
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks?due_before=soon").status, 400);
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks?sort=title").status, 400);
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks?sort=due_date&after=1").status, 400);
+}
+
+TEST_P(HttpServerTest, StreamsChangesAsServerSentEvents) {
+    int fd = connectToServer();
+    ASSERT_GE(fd, 0);
+    timeval timeout{5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    const std::string since = std::to_string(server_->getChangeFeed().latest());
+    const std::string request = "GET /api/v1/tasks/events?since=" + since + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    send(fd, request.data(), request.size(), 0);
+
+    std::string raw;
+    auto readUntil = [&](const std::string& marker) {
+        char buffer[4096];
+        while (raw.find(marker) == std::string::npos) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                return false;
+            }
+            raw.append(buffer, static_cast<size_t>(n));
+        }
+        return true;
+    };
+    ASSERT_TRUE(readUntil("retry: 3000"));
+    EXPECT_NE(raw.find("text/event-stream"), std::string::npos);
+
+    ASSERT_EQ(sendRequest("POST", "/api/v1/tasks", R"({"title":"followed"})").status, 201);
+    ASSERT_EQ(sendRequest("DELETE", "/api/v1/tasks/1").status, 200);
+    ASSERT_TRUE(readUntil("event: delete"));
+    size_t put = raw.find("event: put");
+    ASSERT_NE(put, std::string::npos);
+    EXPECT_NE(raw.find("\"title\":\"followed\"", put), std::string::npos);
+    EXPECT_LT(put, raw.find("event: delete"));
+    close(fd);
+}
+
+// Over its rate a client gets 429 with Retry-After before any body is read,
+// while health checks keep working
+TEST(HttpAdmissionTest, RejectsClientsOverTheirRate) {
+    ServerConfig config;
+    config.port = kTestPort;
+    config.admission.per_client = {0.5, 2};
+    HttpServer server(config);
+    ASSERT_TRUE(server.start());
+
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks").status, 200);
+    EXPECT_EQ(sendRequest("POST", "/api/v1/tasks", R"({"title":"admitted"})").status, 201);
+    auto rejected = sendRequest("POST", "/api/v1/tasks", R"({"title":"turned away"})");
+    EXPECT_EQ(rejected.status, 429);
+    EXPECT_EQ(headerValue(rejected.headers, "Retry-After"), "2");
+    EXPECT_EQ(server.getTaskManager().getTaskCount(), 1u);
+    EXPECT_EQ(sendRequest("GET", "/health").status, 200);
+
+    auto metrics = sendRequest("GET", "/metrics");
+    EXPECT_NE(metrics.body.find("http_admission_rejected_total{reason=\"client_rate\"} 1"), std::string::npos);
+    server.stop();
+}
+
+TEST_P(HttpServerTest, AnswersProbesFromTheSampledSnapshot) {
+    auto live = sendRequest("GET", "/health/live");
+    EXPECT_EQ(live.status, 200);
+    EXPECT_EQ(json_utils::parseJson(live.body)["status"].asString(), "alive");
+
+    auto ready = sendRequest("GET", "/health/ready");
+    EXPECT_EQ(ready.status, 200);
+    EXPECT_EQ(json_utils::parseJson(ready.body)["status"].asString(), "ready");
+
+    auto system = json_utils::parseJson(sendRequest("GET", "/health/metrics").body);
+    EXPECT_GT(system["memory"]["rss_bytes"].asUInt64(), 0u);
+    EXPECT_GT(system["cpu"]["threads"].asUInt(), 0u);
+    EXPECT_NE(sendRequest("GET", "/metrics").body.find("process_resident_memory_bytes "), std::string::npos);
+}
+
+// A persisted store is replayed after the server starts listening; it is
+// ready, and serves tasks, once the replay is done
+TEST(HttpRecoveryTest, BecomesReadyOnceTheStoreIsRecovered) {
+    char pattern[] = "/tmp/http-recovery-XXXXXX";
+    ASSERT_NE(mkdtemp(pattern), nullptr);
+    ServerConfig config;
+    config.port = kTestPort;
+    config.data_dir = pattern;
+    {
+        HttpServer server(config);
+        ASSERT_TRUE(server.start());
+        for (int i = 0; i < 50 && server.isRecovering(); ++i) {
+            usleep(20000);
+        }
+        ASSERT_EQ(sendRequest("POST", "/api/v1/tasks", R"({"title":"kept"})").status, 201);
+        server.stop();
+    }
+
+    HttpServer server(config);
+    ASSERT_TRUE(server.isRecovering());
+    ASSERT_TRUE(server.start());
+    for (int i = 0; i < 50 && server.isRecovering(); ++i) {
+        EXPECT_EQ(sendRequest("GET", "/health/live").status, 200);
+        usleep(20000);
+    }
+    auto ready = sendRequest("GET", "/health/ready");
+    EXPECT_EQ(ready.status, 200);
+    EXPECT_EQ(server.getTaskManager().getTaskCount(), 1u);
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks").status, 200);
+    server.stop();
+    std::filesystem::remove_all(pattern);
+}
+
+// A request whose headers have arrived is in flight: shutdown() stops
+// accepting, lets it finish and only then stops the daemon
+TEST_P(HttpServerTest, ShutdownDrainsRequestsInFlight) {
+    int fd = connectToServer();
+    ASSERT_GE(fd, 0);
+    const std::string create = R"({"title":"in flight"})";
+    const std::string head = "POST /api/v1/tasks HTTP/1.1\r\nHost: localhost\r\n"
+                             "Content-Type: application/json\r\nContent-Length: " +
+                             std::to_string(create.size()) + "\r\n\r\n";
+    send(fd, head.data(), head.size(), 0);
+    for (int i = 0; i < 50 && server_->activeRequests() == 0; ++i) {
+        usleep(10000);
+    }
+    ASSERT_EQ(server_->activeRequests(), 1u);
+
+    auto drained = std::async(std::launch::async,
+                              [this] { return server_->shutdown(std::chrono::seconds(5)); });
+    for (int i = 0; i < 50 && !server_->isDraining(); ++i) {
+        usleep(10000);
+    }
+    ASSERT_TRUE(server_->isDraining());
+    EXPECT_EQ(server_->getHealthCheck().getReadinessStatus()["reason"].asString(), "draining");
+    EXPECT_TRUE(server_->getHealthCheck().isLive());
+    usleep(20000);
+    EXPECT_LT(connectToServer(), 0);
+
+    send(fd, create.data(), create.size(), 0);
+    std::string raw;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        raw.append(buffer, static_cast<size_t>(n));
+    }
+    close(fd);
+    EXPECT_EQ(raw.substr(9, 3), "201");
+    EXPECT_NE(raw.find("Connection: close"), std::string::npos);
+    EXPECT_TRUE(drained.get());
+    EXPECT_FALSE(server_->isRunning());
+    EXPECT_EQ(server_->getTaskManager().getTaskCount(), 1u);
+}
+
+TEST_P(HttpServerTest, ShutdownGivesUpAtTheDrainDeadline) {
+    int fd = connectToServer();
+    ASSERT_GE(fd, 0);
+    // The body never arrives
+    const std::string head = "POST /api/v1/tasks HTTP/1.1\r\nHost: localhost\r\n"
+                             "Content-Type: application/json\r\nContent-Length: 100\r\n\r\n{";
+    send(fd, head.data(), head.size(), 0);
+    for (int i = 0; i < 50 && server_->activeRequests() == 0; ++i) {
+        usleep(10000);
+    }
+    EXPECT_FALSE(server_->shutdown(std::chrono::milliseconds(50)));
+    EXPECT_FALSE(server_->isRunning());
+    close(fd);
+}
+
+// Every listener serves the whole store, whichever partition owns a task
+TEST(HttpListenerTest, PinnedListenersShareThePortAndTheStore) {
+    for (ListenerLayout layout : {ListenerLayout::PER_NODE, ListenerLayout::PER_CORE}) {
+        ServerConfig config;
+        config.port = kTestPort;
+        config.listener_layout = layout;
+        HttpServer server(config);
+        ASSERT_FALSE(server.getNodes().empty());
+        EXPECT_EQ(server.getTaskManager().getPartitionCount(), server.getNodes().size());
+        size_t cpus = 0;
+        for (const auto& node : server.getNodes()) {
+            cpus += node.cpus.size();
+        }
+        EXPECT_EQ(server.getListenerCount(), layout == ListenerLayout::PER_NODE ? server.getNodes().size() : cpus);
+        ASSERT_TRUE(server.start());
+
+        std::vector<uint64_t> ids;
+        for (int i = 0; i < 20; ++i) {
+            auto reply = sendRequest("POST", "/api/v1/tasks", R"({"title":"spread"})");
+            ASSERT_EQ(reply.status, 201);
+            ids.push_back(json_utils::parseJson(reply.body)["id"].asUInt64());
+        }
+        for (uint64_t id : ids) {
+            EXPECT_EQ(sendRequest("GET", "/api/v1/tasks/" + std::to_string(id)).status, 200);
+        }
+        auto list = json_utils::parseJson(sendRequest("GET", "/api/v1/tasks?limit=100").body);
+        EXPECT_EQ(list["count"].asUInt(), 20u);
+        server.stop();
+    }
+}
+
+// A replica loads the primary's store, follows its writes, answers reads
+// once caught up and sends writes to the primary
+TEST(HttpReplicationTest, ReplicaFollowsThePrimary) {
+    constexpr int kPrimaryPort = kTestPort + 1;
+    ServerConfig primary_config;
+    primary_config.port = kPrimaryPort;
+    HttpServer primary(primary_config);
+    ASSERT_TRUE(primary.start());
+    ASSERT_EQ(sendRequest("POST", "/api/v1/tasks", R"({"title":"before"})", "", kPrimaryPort).status, 201);
+
+    ServerConfig config;
+    config.port = kTestPort;
+    config.replication = {"127.0.0.1", static_cast<uint16_t>(kPrimaryPort), 50};
+    HttpServer replica(config);
+    ASSERT_TRUE(replica.isReplica());
+    ASSERT_TRUE(replica.start());
+    for (int i = 0; i < 100 && replica.isRecovering(); ++i) {
+        usleep(20000);
+    }
+    ASSERT_FALSE(replica.isRecovering());
+    EXPECT_EQ(sendRequest("GET", "/api/v1/tasks/1").status, 200);
+
+    auto created = sendRequest("POST", "/api/v1/tasks", R"({"title":"after"})", "", kPrimaryPort);
+    ASSERT_EQ(created.status, 201);
+    const std::string path = "/api/v1/tasks/" + std::to_string(json_utils::parseJson(created.body)["id"].asUInt64());
+    int status = 0;
+    for (int i = 0; i < 100 && (status = sendRequest("GET", path).status) != 200; ++i) {
+        usleep(20000);
+    }
+    EXPECT_EQ(status, 200);
+    EXPECT_EQ(json_utils::parseJson(sendRequest("GET", path).body)["title"].asString(), "after");
+
+    auto redirected = sendRequest("DELETE", path);
+    EXPECT_EQ(redirected.status, 307);
+    EXPECT_EQ(headerValue(redirected.headers, "Location"), "http://127.0.0.1:" + std::to_string(kPrimaryPort) + path);
+    EXPECT_EQ(replica.getTaskManager().getTaskCount(), 2u);
+
+    auto health = json_utils::parseJson(sendRequest("GET", "/health").body);
+    EXPECT_TRUE(health["replication"]["synced"].asBool());
+    EXPECT_NE(sendRequest("GET", "/metrics").body.find("replication_connected 1"), std::string::npos);
+    replica.stop();
+    primary.stop();
+}
+
+INSTANTIATE_TEST_SUITE_P(ThreadingModes, HttpServerTest,
+                         ::testing::Values(ThreadingMode::THREAD_POOL,
+                                           ThreadingMode::THREAD_PER_CONNECTION));
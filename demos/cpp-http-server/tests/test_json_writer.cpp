@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include "../include/json_writer.h"
+#include "../include/json_utils.h"
+#include "../include/task_manager.h"
+
+using namespace http_server;
+
+namespace {
+
+Task makeTask(const std::string& title, const std::string& description,
+              const std::string& due_date, int64_t epoch_seconds) {
+    Task task;
+    task.id = 18446744073709551615ULL;
+    task.title = title;
+    task.description = description;
+    task.setDueDate(DueDate::parse(due_date).value());
+    task.status = TaskStatus::IN_PROGRESS;
+    task.priority = TaskPriority::HIGH;
+    task.created_at = std::chrono::system_clock::time_point(std::chrono::seconds(epoch_seconds));
+    task.updated_at = task.created_at + std::chrono::milliseconds(1500);
+    return task;
+}
+
+std::string fastPath(const Task& task) {
+    std::string out;
+    json_writer::appendTask(out, task);
+    return out;
+}
+
+} // namespace
+
+// The direct writer must produce exactly what the Json::Value path produces
+TEST(JsonWriterTest, TaskMatchesJsonValuePath) {
+    const std::vector<Task> cases = {
+        makeTask("Plain", "", "", 0),
+        makeTask("Quotes \" and \\ slashes / here", "tab\there\nnewline\r\b\f", "2025-01-31", 1700000000),
+        makeTask("Control \x01\x1f and DEL \x7f", "caf\xc3\xa9 \xe2\x82\xac \xf0\x9d\x84\x9e", "", 253402300799),
+        makeTask("Broken \xff\xfe utf8 \xc3", "\x80" "A trailing \xe2\x82", "0999-12-31T23:59:59Z", 951782400),
+        makeTask("Leap day", "before epoch", "", -86401),
+    };
+
+    for (const auto& task : cases) {
+        EXPECT_EQ(fastPath(task), json_utils::jsonToString(task.toJson())) << task.title;
+    }
+}
+
+TEST(JsonWriterTest, TaskStatesAndPriorities) {
+    Task task = makeTask("t", "d", "", 1);
+    for (auto status : {TaskStatus::PENDING, TaskStatus::IN_PROGRESS, TaskStatus::COMPLETED}) {
+        for (auto priority : {TaskPriority::LOW, TaskPriority::MEDIUM, TaskPriority::HIGH}) {
+            task.status = status;
+            task.priority = priority;
+            EXPECT_EQ(fastPath(task), json_utils::jsonToString(task.toJson()));
+        }
+    }
+}
+
+TEST(JsonWriterTest, Timestamps) {
+    std::string out;
+    json_writer::appendTimestamp(out, std::chrono::system_clock::time_point(std::chrono::seconds(951868799)));
+    EXPECT_EQ(out, "\"2000-02-29T23:59:59Z\"");
+}
+
+// Each published version carries its own rendering; old snapshots keep theirs
+TEST(JsonWriterTest, CachedJsonFollowsVersions) {
+    TaskManager manager;
+    Json::Value data;
+    data["title"] = "cached";
+    TaskPtr created = manager.createTask(data);
+    ASSERT_FALSE(created->cached_json.empty());
+    EXPECT_EQ(created->version, 1u);
+    EXPECT_EQ(created->cached_json, json_utils::jsonToString(created->toJson()));
+
+    Json::Value update;
+    update["title"] = "cached v2";
+    TaskPtr updated = manager.updateTask(created->id, update);
+    ASSERT_NE(updated, nullptr);
+    EXPECT_EQ(updated->version, 2u);
+    EXPECT_EQ(updated->cached_json, json_utils::jsonToString(updated->toJson()));
+    EXPECT_EQ(created->cached_json, json_utils::jsonToString(created->toJson()));
+    EXPECT_EQ(cachedJson(manager.getTask(created->id)).get(), &updated->cached_json);
+}
+
+// Cached per-thread readers parse slices of a larger buffer without copying
+TEST(JsonUtilsTest, ParsesBufferSlices) {
+    const std::string buffer = R"({"title":"a"}{"title":"b"})";
+    Json::Value first = json_utils::parseJson(buffer.data(), 13);
+    Json::Value second = json_utils::parseJson(std::string_view(buffer).substr(13));
+    EXPECT_EQ(first["title"].asString(), "a");
+    EXPECT_EQ(second["title"].asString(), "b");
+
+    EXPECT_TRUE(json_utils::isValidJson(R"({"ok":true})"));
+    EXPECT_FALSE(json_utils::isValidJson("{not json"));
+
+    // Alternating modes must not leak settings between the cached writers
+    EXPECT_EQ(json_utils::jsonToString(first), R"({"title":"a"})");
+    EXPECT_EQ(json_utils::jsonToString(first, true), "{\n  \"title\" : \"a\"\n}");
+    EXPECT_EQ(json_utils::jsonToString(second), R"({"title":"b"})");
+}
+
+// Due dates are stored parsed but render back exactly as they were written
+TEST(JsonWriterTest, DueDatesRoundTrip) {
+    for (const char* text : {"2025-01-31", "2024-02-29", "0001-01-01", "1969-12-31T23:59:59Z",
+                             "9999-12-31T00:00:00Z"}) {
+        auto due = DueDate::parse(text);
+        ASSERT_TRUE(due.has_value()) << text;
+        std::string out;
+        json_writer::appendDueDateText(out, *due);
+        EXPECT_EQ(out, text);
+    }
+    EXPECT_EQ(DueDate::parse("")->kind, DueDateKind::NONE);
+    EXPECT_EQ(DueDate::parse("2025-01-31")->seconds, 1738281600);
+
+    for (const char* text : {"tomorrow", "2025-02-29", "2025-13-01", "2025-1-31", "2025-01-31T24:00:00Z",
+                             "2025-01-31T08:00:00", "+025-01-31"}) {
+        EXPECT_FALSE(DueDate::parse(text).has_value()) << text;
+    }
+
+    TaskManager manager;
+    Json::Value data;
+    data["title"] = "due";
+    data["due_date"] = "2025-02-30";
+    ValidationError error;
+    EXPECT_EQ(Task::fromJson(data, &error), nullptr);
+    EXPECT_EQ(error.field, "due_date");
+
+    data["due_date"] = "2025-03-01T12:00:00Z";
+    TaskPtr task = manager.createTask(data);
+    ASSERT_NE(task, nullptr);
+    EXPECT_EQ(task->toJson()["due_date"].asString(), "2025-03-01T12:00:00Z");
+
+    Json::Value clear;
+    clear["due_date"] = "";
+    TaskPtr cleared = manager.updateTask(task->id, clear);
+    ASSERT_NE(cleared, nullptr);
+    EXPECT_TRUE(cleared->toJson()["due_date"].isNull());
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include "../include/metrics.h"
+#include "../include/task_manager.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace http_server;
+using namespace http_server::metrics;
+
+TEST(MetricsTest, BucketBounds) {
+    EXPECT_EQ(Buckets::indexFor(0), 0u);
+    EXPECT_EQ(Buckets::indexFor(1023), 0u);
+    EXPECT_EQ(Buckets::indexFor(1024), 1u);
+    EXPECT_EQ(Buckets::indexFor(1279), 1u);
+    EXPECT_EQ(Buckets::indexFor(1280), 2u);
+    EXPECT_EQ(Buckets::indexFor((1ULL << 33) - 1), Buckets::kCount - 1);
+    EXPECT_EQ(Buckets::indexFor(1ULL << 33), Buckets::kOverflow);
+    EXPECT_EQ(Buckets::upperBound(Buckets::kCount - 1), 1ULL << 33);
+
+    // Every value falls below its bucket's bound and at or above the previous one
+    for (uint64_t v : {1500ULL, 4095ULL, 4096ULL, 999999ULL, 123456789ULL}) {
+        size_t i = Buckets::indexFor(v);
+        EXPECT_LT(v, Buckets::upperBound(i));
+        EXPECT_GE(v, Buckets::upperBound(i - 1));
+    }
+}
+
+TEST(MetricsTest, HistogramSumsAcrossThreads) {
+    Histogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; ++i) {
+                histogram.record(2000);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    HistogramSnapshot snapshot = histogram.snapshot();
+    EXPECT_EQ(snapshot.count, 4000u);
+    EXPECT_EQ(snapshot.sum_nanos, 8000000u);
+    EXPECT_EQ(snapshot.counts[Buckets::indexFor(2000)], 4000u);
+}
+
+TEST(MetricsTest, PrometheusExposition) {
+    RequestMetrics requests;
+    requests.record(Route::TASK, Method::GET, 200, std::chrono::microseconds(3));
+    requests.record(Route::TASK, Method::GET, 404, std::chrono::seconds(20));
+    EXPECT_EQ(requests.requests(Route::TASK, Method::GET), 2u);
+    EXPECT_EQ(requests.requests(Route::TASKS, Method::POST), 0u);
+
+    std::string out;
+    requests.appendPrometheus(out);
+    EXPECT_NE(out.find("# TYPE http_requests_total counter\n"), std::string::npos);
+    EXPECT_NE(out.find("http_requests_total{route=\"/api/v1/tasks/{id}\",method=\"GET\",code=\"2xx\"} 1\n"),
+              std::string::npos);
+    EXPECT_NE(out.find("code=\"4xx\"} 1\n"), std::string::npos);
+    EXPECT_EQ(out.find("method=\"POST\""), std::string::npos);
+    // The 20 s sample overflows every finite bucket
+    EXPECT_NE(out.find("method=\"GET\",le=\"8.589934592\"} 1\n"), std::string::npos);
+    EXPECT_NE(out.find("method=\"GET\",le=\"+Inf\"} 2\n"), std::string::npos);
+    EXPECT_NE(out.find("http_request_duration_seconds_count{route=\"/api/v1/tasks/{id}\",method=\"GET\"} 2\n"),
+              std::string::npos);
+}
+
+TEST(MetricsTest, TaskManagerRecordsLockTimes) {
+    TaskManager manager(2);
+    Json::Value data;
+    data["title"] = "locked";
+    manager.createTask(data);
+    manager.deleteTask(1);
+    manager.getAllTasks();
+
+    const LockMetrics& locks = manager.lockMetrics();
+    EXPECT_EQ(locks.write_wait.snapshot().count, 2u);
+    EXPECT_EQ(locks.write_hold.snapshot().count, 2u);
+    EXPECT_EQ(locks.read_wait.snapshot().count, 1u);
+}
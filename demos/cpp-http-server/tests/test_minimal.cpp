@@ -42,6 +42,40 @@ TEST(MinimalTest, TaskValidation) {
     EXPECT_FALSE(Task::isValidTask(emptyTitleTask));
 }
 
+// Validation reports the first offending field
+TEST(MinimalTest, StructuredValidationErrors) {
+    Json::Value data;
+    data["title"] = "Task";
+    data["priority"] = "urgent";
+
+    ValidationError error;
+    EXPECT_EQ(Task::fromJson(data, &error), nullptr);
+    EXPECT_EQ(error.field, "priority");
+
+    data["priority"] = 3;
+    EXPECT_EQ(Task::fromJson(data, &error), nullptr);
+    EXPECT_EQ(error.field, "priority");
+
+    Json::Value untitled;
+    untitled["status"] = "completed";
+    EXPECT_EQ(Task::fromJson(untitled, &error), nullptr);
+    EXPECT_EQ(error.field, "title");
+
+    EXPECT_FALSE(TaskPatch::fromJson(Json::Value("not an object"), &error));
+    EXPECT_TRUE(error.field.empty());
+
+    // Updates need no title, but an empty one is still rejected
+    auto patch = TaskPatch::fromJson(untitled);
+    ASSERT_TRUE(patch);
+    EXPECT_EQ(patch->status, TaskStatus::COMPLETED);
+    EXPECT_FALSE(patch->title);
+
+    Json::Value blank;
+    blank["title"] = "";
+    EXPECT_FALSE(TaskPatch::fromJson(blank, &error));
+    EXPECT_EQ(error.field, "title");
+}
+
 // Test JSON serialization
 TEST(MinimalTest, TaskJsonSerialization) {
     TaskManager task_manager;
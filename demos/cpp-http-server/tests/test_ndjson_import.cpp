@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include "../include/ndjson_import.h"
+#include "../include/json_utils.h"
+#include "../include/task_manager.h"
+#include <string>
+
+using namespace http_server;
+
+namespace {
+
+// The same lines /api/v1/tasks:export would write
+std::string dump(const TaskManager& manager) {
+    std::string out;
+    uint64_t cursor = 0;
+    do {
+        TaskPage page = manager.getTasksAfter(cursor, 7);
+        for (const auto& task : page.tasks) {
+            out.append(task->cached_json);
+            out.push_back('\n');
+        }
+        cursor = page.next_cursor;
+    } while (cursor != 0);
+    return out;
+}
+
+} // namespace
+
+TEST(NdjsonImportTest, RoundTripsThroughByteSizedChunks) {
+    TaskManager source(4);
+    for (int i = 0; i < 30; ++i) {
+        Json::Value data;
+        data["title"] = "task " + std::to_string(i);
+        data["priority"] = i % 2 ? "high" : "low";
+        source.createTask(data);
+    }
+    source.deleteTask(4);
+    std::string lines = dump(source);
+
+    TaskManager target(3);
+    NdjsonImporter importer(target, 4096);
+    for (char c : lines) {
+        importer.feed(&c, 1);
+    }
+    importer.finish();
+
+    EXPECT_EQ(importer.imported(), 29u);
+    EXPECT_EQ(importer.failed(), 0u);
+    EXPECT_EQ(dump(target), lines);
+    EXPECT_EQ(target.getTask(4), nullptr);
+
+    // New ids continue after the restored ones
+    Json::Value data;
+    data["title"] = "after import";
+    EXPECT_EQ(target.createTask(data)->id, 31u);
+}
+
+TEST(NdjsonImportTest, ReportsBadLinesAndKeepsGoing) {
+    TaskManager manager;
+    NdjsonImporter importer(manager, 80);
+
+    std::string body = "{\"title\":\"ok\"}\r\n"
+                       "\n"
+                       "{not json\n"
+                       "{\"title\":\"t\",\"id\":7,\"created_at\":\"yesterday\"}\n"
+                       "{\"title\":\"" + std::string(100, 'x') + "\"}\n"
+                       "{\"title\":\"no newline\",\"id\":9,\"created_at\":\"2024-02-29T12:34:56Z\"}";
+    importer.feed(body.data(), body.size());
+    importer.finish();
+
+    EXPECT_EQ(importer.imported(), 2u);
+    EXPECT_EQ(importer.failed(), 3u);
+    ASSERT_EQ(importer.errors().size(), 3u);
+    EXPECT_EQ(importer.errors()[0].line, 3u);
+    EXPECT_EQ(importer.errors()[1].field, "created_at");
+    EXPECT_EQ(importer.errors()[2].line, 5u);
+
+    TaskPtr restored = manager.getTask(9);
+    ASSERT_NE(restored, nullptr);
+    EXPECT_EQ(restored->toJson()["created_at"].asString(), "2024-02-29T12:34:56Z");
+}
+
+TEST(NdjsonImportTest, ReadsTheClosingLineOfAnExport) {
+    TaskManager manager;
+    NdjsonImporter importer(manager, 1024);
+    std::string body = "{\"title\":\"one\",\"id\":1}\n"
+                       "{\"count\":1,\"end\":true,\"seq\":12}\n";
+    importer.feed(body.data(), body.size());
+    importer.finish();
+
+    EXPECT_EQ(importer.imported(), 1u);
+    EXPECT_EQ(importer.failed(), 0u);
+    ASSERT_TRUE(importer.trailer());
+    EXPECT_EQ(importer.trailer()->count, 1u);
+    EXPECT_EQ(importer.trailer()->seq, 12u);
+
+    NdjsonImporter bad(manager, 1024);
+    body = "{\"count\":\"one\",\"end\":true}\n";
+    bad.feed(body.data(), body.size());
+    bad.finish();
+    EXPECT_EQ(bad.failed(), 1u);
+    EXPECT_FALSE(bad.trailer());
+}
@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include "../include/ndjson_import.h"
+#include "../include/persistence.h"
+#include "../include/task_manager.h"
+#include "test_helpers.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace http_server;
+
+namespace {
+
+// Rendered contents of the whole store, in id order
+std::string contents(const TaskManager& manager) {
+    std::string out;
+    for (const auto& task : manager.getTasksAfter(0, 100000).tasks) {
+        out += std::to_string(task->version) + ":" + task->cached_json + "\n";
+    }
+    return out;
+}
+
+class PersistenceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char pattern[] = "/tmp/task-persistence-XXXXXX";
+        ASSERT_NE(mkdtemp(pattern), nullptr);
+        config_.data_dir = pattern;
+        config_.sync_interval = std::chrono::milliseconds(1);
+        config_.snapshot_every = 0;
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(config_.data_dir);
+    }
+
+    size_t countFiles(const std::string& prefix) const {
+        size_t n = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(config_.data_dir)) {
+            n += entry.path().filename().string().rfind(prefix, 0) == 0 ? 1 : 0;
+        }
+        return n;
+    }
+
+    PersistenceConfig config_;
+};
+
+} // namespace
+
+TEST(TaskCodecTest, RoundTrip) {
+    Task task;
+    task.id = 42;
+    task.version = 7;
+    task.title = "title";
+    task.description = std::string("embedded\0nul", 12);
+    task.setDueDate(*DueDate::parse("2030-01-01T09:30:00Z"));
+    task.status = TaskStatus::IN_PROGRESS;
+    task.priority = TaskPriority::HIGH;
+    task.created_at = std::chrono::system_clock::time_point(std::chrono::nanoseconds(1234567890123));
+    task.updated_at = task.created_at + std::chrono::seconds(5);
+
+    std::string bytes;
+    task_codec::encode(bytes, task);
+    const char* pos = bytes.data();
+    auto decoded = task_codec::decode(pos, bytes.data() + bytes.size());
+    ASSERT_NE(decoded, nullptr);
+    EXPECT_EQ(pos, bytes.data() + bytes.size());
+    EXPECT_EQ(decoded->id, 42u);
+    EXPECT_EQ(decoded->version, 7u);
+    EXPECT_EQ(decoded->description, task.description);
+    EXPECT_EQ(decoded->status, TaskStatus::IN_PROGRESS);
+    EXPECT_EQ(decoded->due_at, task.due_at);
+    EXPECT_EQ(decoded->due_kind, DueDateKind::DATE_TIME);
+    EXPECT_EQ(decoded->created_at, task.created_at);
+
+    pos = bytes.data();
+    EXPECT_EQ(task_codec::decode(pos, bytes.data() + bytes.size() - 1), nullptr);
+    EXPECT_EQ(task_codec::crc32("123456789", 9), 0xCBF43926u);
+}
+
+TEST_F(PersistenceTest, ReplaysLogAfterRestart) {
+    std::string expected;
+    uint64_t next_id;
+    {
+        TaskManager manager(4);
+        Persistence persistence(config_);
+        persistence.recover(manager);
+        ASSERT_TRUE(persistence.start(manager));
+
+        for (int i = 0; i < 20; ++i) {
+            manager.createTask(makeTask("task " + std::to_string(i)));
+        }
+        Json::Value update;
+        update["status"] = "completed";
+        manager.updateTask(3, update);
+        manager.deleteTask(5);
+        // The newest id is gone, but must not be handed out again
+        manager.deleteTask(20);
+
+        persistence.stop();
+        expected = contents(manager);
+        next_id = manager.nextId();
+    }
+
+    TaskManager restored(2);
+    Persistence persistence(config_);
+    Persistence::RecoveryStats stats = persistence.recover(restored);
+    EXPECT_EQ(stats.replayed_records, 23u);
+    EXPECT_EQ(contents(restored), expected);
+    EXPECT_EQ(restored.getTaskCount(), 18u);
+    EXPECT_EQ(restored.getStatisticsSnapshot().by_status[static_cast<size_t>(TaskStatus::COMPLETED)], 1u);
+    EXPECT_EQ(restored.nextId(), next_id);
+}
+
+// A write the log cannot sync fails the request instead of being
+// acknowledged, and every write after it fails the same way
+TEST_F(PersistenceTest, FailedSyncIsStickyAndReported) {
+    TaskManager manager;
+    Persistence persistence(config_);
+    persistence.recover(manager);
+    // Every write to the segment fails with ENOSPC
+    std::filesystem::create_symlink("/dev/full", config_.data_dir + "/wal-00000000000000000001.log");
+    int failures = 0;
+    persistence.setFailureListener([&] { ++failures; });
+    ASSERT_TRUE(persistence.start(manager));
+
+    EXPECT_THROW(manager.createTask(makeTask("lost")), DurabilityError);
+    EXPECT_TRUE(persistence.failed());
+    EXPECT_EQ(failures, 1);
+    EXPECT_THROW(manager.deleteTask(1), DurabilityError);
+    EXPECT_FALSE(persistence.snapshot());
+    EXPECT_EQ(failures, 1);
+    // Imports run where nothing may throw; they report it instead
+    NdjsonImporter importer(manager, 1024);
+    const std::string line = "{\"title\":\"imported\"}\n";
+    importer.feed(line.data(), line.size());
+    importer.finish();
+    EXPECT_TRUE(importer.logFailed());
+    EXPECT_EQ(importer.imported(), 0u);
+    persistence.stop();
+    EXPECT_FALSE(persistence.start(manager));
+}
+
+TEST_F(PersistenceTest, SnapshotCompactsAndIgnoresTornTail) {
+    std::string expected;
+    {
+        TaskManager manager;
+        Persistence persistence(config_);
+        persistence.recover(manager);
+        ASSERT_TRUE(persistence.start(manager));
+
+        for (int i = 0; i < 10; ++i) {
+            manager.createTask(makeTask("before " + std::to_string(i)));
+        }
+        ASSERT_TRUE(persistence.snapshot());
+        EXPECT_EQ(countFiles("snapshot-"), 1u);
+        EXPECT_EQ(countFiles("wal-"), 1u);
+
+        manager.createTask(makeTask("after"));
+        manager.deleteTask(1);
+        persistence.stop();
+        expected = contents(manager);
+    }
+
+    // A crash mid-append leaves a partial frame at the end of the last segment
+    std::string last_segment;
+    for (const auto& entry : std::filesystem::directory_iterator(config_.data_dir)) {
+        if (entry.path().filename().string().rfind("wal-", 0) == 0) {
+            last_segment = std::max(last_segment, entry.path().string());
+        }
+    }
+    std::ofstream(last_segment, std::ios::app | std::ios::binary) << "\x20\x00\x00\x00garbage";
+
+    TaskManager restored;
+    Persistence persistence(config_);
+    Persistence::RecoveryStats stats = persistence.recover(restored);
+    EXPECT_EQ(stats.snapshot_tasks, 10u);
+    EXPECT_EQ(stats.replayed_records, 2u);
+    EXPECT_EQ(contents(restored), expected);
+
+    // Writes after recovery go to a fresh segment and survive another restart
+    ASSERT_TRUE(persistence.start(restored));
+    restored.createTask(makeTask("third run"));
+    persistence.stop();
+
+    TaskManager again;
+    Persistence(config_).recover(again);
+    EXPECT_EQ(again.getTaskCount(), 11u);
+    EXPECT_EQ(again.getTask(12)->title, "third run");
+}
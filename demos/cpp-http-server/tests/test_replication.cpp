@@ -0,0 +1,285 @@
+#include <gtest/gtest.h>
+#include "../include/replication.h"
+#include "../include/json_utils.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace http_server;
+using namespace http_server::replication;
+
+namespace {
+
+std::string taskLine(uint64_t id, const std::string& title) {
+    Json::Value data;
+    data["title"] = title;
+    auto task = Task::fromJson(data);
+    task->id = id;
+    return json_utils::jsonToString(task->toJson());
+}
+
+// Just enough of a primary: /api/v1/tasks:export from a fixed dump, and
+// event streams the test writes frames to
+class FakePrimary {
+public:
+    FakePrimary() {
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        socklen_t length = sizeof(addr);
+        getsockname(listener_, reinterpret_cast<sockaddr*>(&addr), &length);
+        port_ = ntohs(addr.sin_port);
+        listen(listener_, 16);
+        acceptor_ = std::thread([this] { acceptLoop(); });
+    }
+
+    ~FakePrimary() {
+        ::shutdown(listener_, SHUT_RDWR);
+        close(listener_);
+        acceptor_.join();
+        dropStreams();
+    }
+
+    uint16_t port() const { return port_; }
+    void setExport(const std::vector<std::string>& lines) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        export_.clear();
+        for (const auto& line : lines) {
+            export_ += line + "\n";
+        }
+        export_count_ = lines.size();
+    }
+    // Without the closing line, as if the primary went mid-export
+    void setExportCut(bool cut) { export_cut_ = cut; }
+    void setFeedSeq(uint64_t seq) { feed_seq_ = seq; }
+    size_t exports() const { return exports_; }
+    size_t streams() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return streams_.size();
+    }
+    std::string lastStreamPath() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_stream_path_;
+    }
+
+    // Writes frame to every open stream
+    void push(const std::string& frame) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int fd : streams_) {
+            send(fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+        }
+    }
+    void dropStreams() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int fd : streams_) {
+            close(fd);
+        }
+        streams_.clear();
+    }
+
+private:
+    void acceptLoop() {
+        for (;;) {
+            int fd = accept(listener_, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            std::string request;
+            char buffer[1024];
+            ssize_t n;
+            while (request.find("\r\n\r\n") == std::string::npos &&
+                   (n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+                request.append(buffer, static_cast<size_t>(n));
+            }
+            const std::string path = request.substr(4, request.find(' ', 4) - 4);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (path == "/api/v1/tasks:export") {
+                ++exports_;
+                std::string reply = "HTTP/1.0 200 OK\r\nContent-Type: application/x-ndjson\r\n\r\n" + export_;
+                if (!export_cut_) {
+                    reply += "{\"count\":" + std::to_string(export_count_) + ",\"end\":true,\"seq\":" +
+                             std::to_string(feed_seq_) + "}\n";
+                }
+                send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+                close(fd);
+            } else {
+                last_stream_path_ = path;
+                const std::string reply = "HTTP/1.0 200 OK\r\nx-feed-seq: " + std::to_string(feed_seq_) +
+                                          "\r\nContent-Type: text/event-stream\r\n\r\nretry: 3000\n\n";
+                send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+                streams_.push_back(fd);
+            }
+        }
+    }
+
+    int listener_;
+    uint16_t port_;
+    std::thread acceptor_;
+    std::mutex mutex_;
+    std::string export_;
+    size_t export_count_ = 0;
+    std::atomic<bool> export_cut_{false};
+    std::vector<int> streams_;
+    std::string last_stream_path_;
+    std::atomic<uint64_t> feed_seq_{100};
+    std::atomic<size_t> exports_{0};
+};
+
+std::string putFrame(uint64_t seq, uint64_t id, const std::string& title) {
+    return "id: " + std::to_string(seq) + "\nevent: put\ndata: {\"op\":\"put\",\"published_us\":1,\"seq\":" +
+           std::to_string(seq) + ",\"task\":" + taskLine(id, title) + "}\n\n";
+}
+
+std::string deleteFrame(uint64_t seq, uint64_t id) {
+    return "id: " + std::to_string(seq) + "\nevent: delete\ndata: {\"id\":" + std::to_string(id) +
+           ",\"op\":\"delete\",\"published_us\":1,\"seq\":" + std::to_string(seq) + "}\n\n";
+}
+
+template <typename Predicate>
+bool eventually(Predicate predicate) {
+    for (int i = 0; i < 200 && !predicate(); ++i) {
+        usleep(10000);
+    }
+    return predicate();
+}
+
+} // namespace
+
+TEST(EventParserTest, FramesSplitAnywhere) {
+    const std::string stream =
+        "retry: 3000\n\n"
+        "id: 5\nevent: put\ndata: {\"a\":1}\n\n"
+        ":\n\n"
+        "id: 6\r\nevent: delete\r\ndata: first\r\ndata: second\r\n\r\n"
+        "data: untyped\n\n";
+    for (size_t step : {size_t{1}, size_t{7}, stream.size()}) {
+        EventParser parser;
+        std::vector<Event> events;
+        for (size_t i = 0; i < stream.size(); i += step) {
+            parser.feed(std::string_view(stream).substr(i, step), [&](const Event& e) { events.push_back(e); });
+        }
+        ASSERT_EQ(events.size(), 3u);
+        EXPECT_EQ(events[0].id, "5");
+        EXPECT_EQ(events[0].type, "put");
+        EXPECT_EQ(events[0].data, "{\"a\":1}");
+        EXPECT_EQ(events[1].type, "delete");
+        EXPECT_EQ(events[1].data, "first\nsecond");
+        EXPECT_EQ(events[2].type, "message");
+        EXPECT_EQ(events[2].id, "6");
+    }
+}
+
+TEST(ReplicationSettingsTest, ParsesPrimaryAddresses) {
+    Settings settings;
+    ASSERT_TRUE(parseAddress("primary.local:8000", settings));
+    EXPECT_EQ(settings.host, "primary.local");
+    EXPECT_EQ(settings.port, 8000);
+    ASSERT_TRUE(parseAddress("[::1]:9", settings));
+    EXPECT_EQ(settings.host, "::1");
+    EXPECT_FALSE(parseAddress("primary", settings));
+    EXPECT_FALSE(parseAddress(":8000", settings));
+    EXPECT_FALSE(parseAddress("primary:0", settings));
+    EXPECT_FALSE(parseAddress("primary:70000", settings));
+}
+
+TEST(FollowerTest, LoadsTheExportThenAppliesTheStream) {
+    FakePrimary primary;
+    primary.setExport({taskLine(1, "one"), taskLine(2, "two")});
+    primary.setFeedSeq(100);
+
+    TaskManager store;
+    Follower follower(store, Settings{"127.0.0.1", primary.port(), 20});
+    std::atomic<int> syncs{0};
+    follower.setSyncListener([&](bool synced) { syncs += synced ? 1 : 0; });
+    follower.start();
+
+    ASSERT_TRUE(eventually([&] { return follower.synced(); }));
+    EXPECT_EQ(syncs, 1);
+    EXPECT_TRUE(follower.connected());
+    EXPECT_EQ(follower.position(), 100u);
+    EXPECT_EQ(store.getTaskCount(), 2u);
+    EXPECT_EQ(store.getTask(2)->title, "two");
+
+    primary.push(putFrame(101, 3, "three") + deleteFrame(102, 1) + putFrame(103, 2, "two, renamed"));
+    ASSERT_TRUE(eventually([&] { return follower.position() == 103; }));
+    EXPECT_EQ(store.getTask(1), nullptr);
+    EXPECT_EQ(store.getTask(3)->title, "three");
+    EXPECT_EQ(store.getTask(2)->title, "two, renamed");
+    EXPECT_EQ(follower.applied(), 3u);
+    ASSERT_TRUE(eventually([&] { return follower.lagSeconds() == 0; }));
+
+    Json::Value status = follower.getStatus();
+    EXPECT_TRUE(status["synced"].asBool());
+    EXPECT_EQ(status["position"].asUInt64(), 103u);
+
+    // A dropped stream resumes where it was, without reloading
+    primary.dropStreams();
+    ASSERT_TRUE(eventually([&] { return primary.streams() == 1; }));
+    EXPECT_EQ(primary.lastStreamPath(), "/api/v1/tasks/events?since=103");
+    EXPECT_EQ(primary.exports(), 1u);
+    EXPECT_TRUE(follower.synced());
+    follower.stop();
+    EXPECT_FALSE(follower.connected());
+}
+
+TEST(FollowerTest, StaysUnsyncedUntilAnExportArrivesWhole) {
+    FakePrimary primary;
+    primary.setExport({taskLine(1, "one"), taskLine(2, "two")});
+    primary.setExportCut(true);
+
+    TaskManager store;
+    Follower follower(store, Settings{"127.0.0.1", primary.port(), 20});
+    follower.start();
+    ASSERT_TRUE(eventually([&] { return primary.exports() >= 2; }));
+    EXPECT_FALSE(follower.synced());
+
+    primary.setExportCut(false);
+    ASSERT_TRUE(eventually([&] { return follower.synced(); }));
+    EXPECT_EQ(follower.position(), 100u);
+    EXPECT_EQ(store.getTaskCount(), 2u);
+    follower.stop();
+}
+
+TEST(FollowerTest, ReloadsWhenThePrimaryAsksForAResync) {
+    FakePrimary primary;
+    primary.setExport({taskLine(1, "one"), taskLine(2, "two")});
+    primary.setFeedSeq(10);
+
+    TaskManager store;
+    Follower follower(store, Settings{"127.0.0.1", primary.port(), 20});
+    std::vector<bool> transitions;
+    std::mutex transitions_mutex;
+    follower.setSyncListener([&](bool synced) {
+        std::lock_guard<std::mutex> lock(transitions_mutex);
+        transitions.push_back(synced);
+    });
+    follower.start();
+    ASSERT_TRUE(eventually([&] { return follower.synced(); }));
+
+    // Task 1 went while the follower was too far behind to be told
+    primary.setExport({taskLine(2, "two, later"), taskLine(5, "five")});
+    primary.setFeedSeq(500);
+    primary.push("id: 400\nevent: resync\ndata: {\"latest_seq\":400,\"op\":\"resync\"}\n\n");
+    ASSERT_TRUE(eventually([&] { return primary.exports() == 2; }));
+    // The export is newer than 400, so synced waits for the stream to get there
+    ASSERT_TRUE(eventually([&] { return follower.position() == 400; }));
+    usleep(50000);
+    EXPECT_FALSE(follower.synced());
+    EXPECT_EQ(store.getTask(1), nullptr);
+    EXPECT_EQ(store.getTask(2)->title, "two, later");
+    EXPECT_EQ(store.getTaskCount(), 2u);
+
+    primary.push(putFrame(500, 5, "five"));
+    ASSERT_TRUE(eventually([&] { return follower.synced(); }));
+    EXPECT_EQ(follower.reloads(), 2u);
+    follower.stop();
+    std::lock_guard<std::mutex> lock(transitions_mutex);
+    EXPECT_EQ(transitions, (std::vector<bool>{true, false, true}));
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include "../include/routing.h"
+
+using namespace http_server;
+using namespace http_server::routing;
+using metrics::Method;
+using metrics::Route;
+
+TEST(RoutingTest, ResolvesEveryRoute) {
+    struct Case {
+        Method method;
+        const char* path;
+        Handler handler;
+        Route route;
+        uint64_t task_id;
+    } cases[] = {
+        {Method::GET, "/health", Handler::HEALTH, Route::HEALTH, 0},
+        {Method::GET, "/health/ready", Handler::HEALTH, Route::HEALTH, 0},
+        {Method::GET, "/metrics", Handler::METRICS, Route::METRICS, 0},
+        {Method::GET, "/api/v1/tasks", Handler::LIST_TASKS, Route::TASKS, 0},
+        {Method::GET, "/api/v1/tasks/", Handler::LIST_TASKS, Route::TASKS, 0},
+        {Method::POST, "/api/v1/tasks", Handler::CREATE_TASK, Route::TASKS, 0},
+        {Method::GET, "/api/v1/tasks/stats/summary", Handler::STATISTICS, Route::STATISTICS, 0},
+        {Method::POST, "/api/v1/tasks:batch", Handler::BATCH, Route::BATCH, 0},
+        {Method::GET, "/api/v1/tasks:export", Handler::EXPORT, Route::EXPORT, 0},
+        {Method::POST, "/api/v1/tasks:import", Handler::IMPORT, Route::IMPORT, 0},
+        {Method::GET, "/api/v1/tasks/events", Handler::EVENTS, Route::EVENTS, 0},
+        {Method::GET, "/api/v1/tasks/42", Handler::GET_TASK, Route::TASK, 42},
+        {Method::PUT, "/api/v1/tasks/7", Handler::UPDATE_TASK, Route::TASK, 7},
+        {Method::DELETE, "/api/v1/tasks/18446744073709551615", Handler::DELETE_TASK, Route::TASK,
+         UINT64_MAX},
+    };
+    for (const Case& c : cases) {
+        Target target = resolve(c.method, c.path);
+        EXPECT_EQ(target.handler, c.handler) << c.path;
+        EXPECT_EQ(target.route, c.route) << c.path;
+        EXPECT_EQ(target.task_id, c.task_id) << c.path;
+    }
+}
+
+// Same answers as the per-method dispatch they replace
+TEST(RoutingTest, RejectsWhatTheHandlersRejected) {
+    EXPECT_EQ(resolve(Method::GET, "/nowhere").handler, Handler::NOT_FOUND);
+    EXPECT_EQ(resolve(Method::GET, "/nowhere").route, Route::OTHER);
+    EXPECT_EQ(resolve(Method::POST, "/api/v1/tasks/7").handler, Handler::NOT_FOUND);
+    EXPECT_EQ(resolve(Method::POST, "/api/v1/tasks/stats/summary").handler, Handler::NOT_FOUND);
+    EXPECT_EQ(resolve(Method::POST, "/api/v1/tasks/stats/summary").route, Route::STATISTICS);
+    EXPECT_EQ(resolve(Method::PUT, "/metrics").handler, Handler::NOT_FOUND);
+    EXPECT_EQ(resolve(Method::OTHER, "/api/v1/tasks").handler, Handler::METHOD_NOT_ALLOWED);
+    EXPECT_EQ(resolve(Method::OTHER, "/api/v1/tasks").route, Route::TASKS);
+
+    for (const char* path : {"/api/v1/tasks/0", "/api/v1/tasks/abc", "/api/v1/tasks/12x", "/api/v1/tasks/-1",
+                             "/api/v1/tasks/+1", "/api/v1/tasks/18446744073709551616", "/api/v1/tasks:batch",
+                             "/api/v1/tasksfoo", "/api/v1/tasks//1"}) {
+        EXPECT_EQ(resolve(Method::GET, path).handler, Handler::INVALID_TASK_ID) << path;
+    }
+    EXPECT_EQ(resolve(Method::PUT, "/api/v1/tasks").handler, Handler::INVALID_TASK_ID);
+    EXPECT_EQ(resolve(Method::PUT, "/api/v1/tasks").route, Route::TASKS);
+    EXPECT_EQ(resolve(Method::DELETE, "/api/v1/tasks/stats/summary").handler, Handler::INVALID_TASK_ID);
+}
+
+TEST(RoutingTest, ParsesWholeUnsignedNumbersOnly) {
+    uint64_t value = 5;
+    EXPECT_TRUE(parseUInt("0", value));
+    EXPECT_EQ(value, 0u);
+    EXPECT_TRUE(parseUInt("1000", value));
+    EXPECT_EQ(value, 1000u);
+    for (std::string_view text : {"", " 1", "1 ", "-1", "+1", "1.5", "0x10", "99999999999999999999"}) {
+        EXPECT_FALSE(parseUInt(text, value)) << text;
+    }
+    EXPECT_EQ(methodOf("DELETE"), Method::DELETE);
+    EXPECT_EQ(methodOf("HEAD"), Method::OTHER);
+}
+
+TEST(QueryParamsTest, ViewsKnownParametersInPlace) {
+    const std::string limit = "25";
+    QueryParams query;
+    query.set("limit", limit);
+    query.set("limit", "50");
+    query.set("status", "");
+    query.set("status", "pending");
+    query.set("unknown", "ignored");
+
+    EXPECT_EQ(query.get(Param::LIMIT).data(), limit.data());
+    EXPECT_EQ(query.get(Param::STATUS), "pending");
+    EXPECT_TRUE(query.has(Param::STATUS));
+    EXPECT_FALSE(query.has(Param::SORT));
+    EXPECT_EQ(query.get(Param::SORT), "");
+    EXPECT_EQ(paramOf("created_after"), Param::CREATED_AFTER);
+    EXPECT_EQ(paramOf("unknown"), std::nullopt);
+}
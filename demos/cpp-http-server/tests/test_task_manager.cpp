@@ -0,0 +1,443 @@
+#include <gtest/gtest.h>
+#include "../include/task_manager.h"
+#include "test_helpers.h"
+#include <json/json.h>
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace http_server;
+
+namespace {
+
+// Every store test runs against the single-map layout and a sharded one
+class TaskManagerTest : public ::testing::TestWithParam<size_t> {
+protected:
+    TaskManager manager_{GetParam()};
+};
+
+} // namespace
+
+TEST_P(TaskManagerTest, CrudAcrossShards) {
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 50; ++i) {
+        auto task = manager_.createTask(makeTask("Task " + std::to_string(i)));
+        ASSERT_NE(task, nullptr);
+        ids.push_back(task->id);
+    }
+    EXPECT_EQ(manager_.getTaskCount(), 50u);
+    EXPECT_EQ(manager_.getShardCount(), GetParam());
+
+    for (uint64_t id : ids) {
+        auto task = manager_.getTask(id);
+        ASSERT_NE(task, nullptr);
+        EXPECT_EQ(task->id, id);
+    }
+
+    Json::Value update;
+    update["status"] = "completed";
+    auto updated = manager_.updateTask(ids[7], update);
+    ASSERT_NE(updated, nullptr);
+    EXPECT_EQ(updated->status, TaskStatus::COMPLETED);
+
+    EXPECT_TRUE(manager_.deleteTask(ids[3]));
+    EXPECT_FALSE(manager_.deleteTask(ids[3]));
+    EXPECT_EQ(manager_.getTask(ids[3]), nullptr);
+    EXPECT_EQ(manager_.getTaskCount(), 49u);
+}
+
+TEST_P(TaskManagerTest, PaginationVisitsEveryTaskOnce) {
+    for (int i = 0; i < 37; ++i) {
+        manager_.createTask(makeTask("Task " + std::to_string(i)));
+    }
+
+    std::set<uint64_t> seen;
+    for (size_t offset = 0; offset < 40; offset += 10) {
+        for (const auto& task : manager_.getAllTasks({}, 10, offset)) {
+            EXPECT_TRUE(seen.insert(task->id).second);
+        }
+    }
+    EXPECT_EQ(seen.size(), 37u);
+}
+
+TEST_P(TaskManagerTest, FiltersAndStatistics) {
+    manager_.createTask(makeTask("a", "pending", "high"));
+    manager_.createTask(makeTask("b", "completed", "high"));
+    manager_.createTask(makeTask("c", "completed", "low"));
+
+    EXPECT_EQ(manager_.getAllTasks({TaskStatus::COMPLETED, {}}, 10, 0).size(), 2u);
+    EXPECT_EQ(manager_.getAllTasks({TaskStatus::COMPLETED, TaskPriority::HIGH}, 10, 0).size(), 1u);
+    EXPECT_EQ(manager_.getAllTasks({{}, TaskPriority::MEDIUM}, 10, 0).size(), 0u);
+
+    Json::Value stats = manager_.getStatistics();
+    EXPECT_EQ(stats["total"].asUInt(), 3u);
+    EXPECT_EQ(stats["by_status"]["completed"].asUInt(), 2u);
+    EXPECT_EQ(stats["by_priority"]["high"].asUInt(), 2u);
+}
+
+TEST_P(TaskManagerTest, SearchCombinesTermsWithFilters) {
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 40; ++i) {
+        Json::Value data = makeTask(i % 2 == 0 ? "Deploy service" : "Write docs", i % 4 == 0 ? "completed" : "pending");
+        data["description"] = i % 3 == 0 ? "Needs review" : "";
+        ids.push_back(manager_.createTask(data)->id);
+    }
+
+    TaskFilter filter;
+    filter.setQuery("DEPLOY review");
+    auto found = manager_.getAllTasks(filter, 100, 0);
+    ASSERT_EQ(found.size(), 7u);  // Even i that are multiples of 3
+    for (size_t k = 0; k < found.size(); ++k) {
+        EXPECT_EQ(found[k]->id, ids[k * 6]);
+    }
+
+    filter.status = TaskStatus::COMPLETED;  // Multiples of 12
+    found = manager_.getAllTasks(filter, 100, 0);
+    ASSERT_EQ(found.size(), 4u);
+    EXPECT_EQ(found[1]->id, ids[12]);
+
+    // Pages and keyset cursors work as without a query
+    filter.status.reset();
+    auto page = manager_.getTasksAfter(0, 3, filter);
+    ASSERT_EQ(page.tasks.size(), 3u);
+    EXPECT_EQ(page.next_cursor, ids[12]);
+    page = manager_.getTasksAfter(page.next_cursor, 10, filter);
+    ASSERT_EQ(page.tasks.size(), 4u);
+    EXPECT_EQ(page.next_cursor, 0u);
+    EXPECT_EQ(manager_.getAllTasks(filter, 2, 5).front()->id, ids[30]);
+
+    // Updates and deletes keep the index current
+    Json::Value update;
+    update["title"] = "Write docs";
+    manager_.updateTask(ids[0], update);
+    manager_.deleteTask(ids[6]);
+    found = manager_.getAllTasks(filter, 100, 0);
+    ASSERT_EQ(found.size(), 5u);
+    EXPECT_EQ(found[0]->id, ids[12]);
+
+    filter.setQuery("docs");
+    EXPECT_EQ(manager_.getAllTasks(filter, 100, 0).size(), 21u);
+    filter.setQuery("--");
+    EXPECT_TRUE(manager_.getAllTasks(filter, 100, 0).empty());
+}
+
+TEST_P(TaskManagerTest, TimeRangesAndSortedLists) {
+    // Due on day 30 - i, so due order is the reverse of id order; every
+    // fifth task has no due date
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 25; ++i) {
+        Json::Value data = makeTask("t", i % 2 == 0 ? "pending" : "completed");
+        if (i % 5 != 4) {
+            data["due_date"] = "2030-01-" + std::string(30 - i < 10 ? "0" : "") + std::to_string(30 - i);
+        }
+        ids.push_back(manager_.createTask(data)->id);
+    }
+    auto day = [](int d) { return DueDate::parse("2030-01-" + std::string(d < 10 ? "0" : "") + std::to_string(d))->seconds; };
+
+    TaskFilter filter;
+    filter.sort = TaskTimeField::DUE_DATE;
+    auto sorted = manager_.getAllTasks(filter, 100, 0);
+    ASSERT_EQ(sorted.size(), 20u);  // Tasks without a due date are not listed
+    EXPECT_EQ(sorted.front()->id, ids[23]);
+    for (size_t k = 1; k < sorted.size(); ++k) {
+        EXPECT_LT(sorted[k - 1]->due_at, sorted[k]->due_at);
+    }
+
+    // [due_after, due_before), combined with a status filter and offset
+    filter.range(TaskTimeField::DUE_DATE) = {day(10), day(20)};
+    filter.status = TaskStatus::PENDING;
+    auto page = manager_.getAllTasks(filter, 2, 1);
+    ASSERT_EQ(page.size(), 2u);
+    EXPECT_EQ(page[0]->id, ids[18]);  // Day 12; day 10 (i = 20) was skipped
+    EXPECT_EQ(page[1]->id, ids[16]);
+
+    // The same range in id order, paged with a cursor
+    filter.sort.reset();
+    auto first = manager_.getTasksAfter(0, 2, filter);
+    ASSERT_EQ(first.tasks.size(), 2u);
+    EXPECT_EQ(first.tasks[0]->id, ids[12]);  // Day 18
+    auto rest = manager_.getTasksAfter(first.next_cursor, 10, filter);
+    EXPECT_EQ(rest.tasks.size(), 2u);
+    EXPECT_EQ(rest.next_cursor, 0u);
+
+    // Moving a due date moves the task within the index
+    Json::Value update;
+    update["due_date"] = "2030-01-01";
+    manager_.updateTask(ids[0], update);
+    filter = {};
+    filter.sort = TaskTimeField::DUE_DATE;
+    EXPECT_EQ(manager_.getAllTasks(filter, 1, 0).front()->id, ids[0]);
+    filter.range(TaskTimeField::DUE_DATE).until = day(2);
+    EXPECT_EQ(manager_.getAllTasks(filter, 10, 0).size(), 1u);
+
+    // Restored timestamps are indexed as given
+    Json::Value old = makeTask("restored");
+    old["created_at"] = "2001-02-03T04:05:06Z";
+    old["updated_at"] = "2001-02-03T04:05:06Z";
+    auto restored = manager_.restoreTasks(std::vector{Task::restoreFromJson(old)});
+    filter = {};
+    filter.sort = TaskTimeField::CREATED_AT;
+    EXPECT_EQ(manager_.getAllTasks(filter, 1, 0).front()->id, restored[0]->id);
+    filter.range(TaskTimeField::UPDATED_AT).until = DueDate::parse("2002-01-01")->seconds;
+    EXPECT_EQ(manager_.getAllTasks(filter, 10, 0).size(), 1u);
+}
+
+// A range without a matching sort is walked from the time index, so an
+// "overdue" view looks at the overdue tasks rather than the whole store
+TEST_P(TaskManagerTest, RangesInIdOrderWalkTheTimeIndex) {
+    std::vector<uint64_t> overdue;
+    for (int i = 0; i < 500; ++i) {
+        Json::Value data = makeTask("t", i % 2 == 0 ? "pending" : "completed");
+        data["due_date"] = i % 100 == 7 ? "2020-01-01" : "2040-01-01";
+        auto task = manager_.createTask(data);
+        if (i % 100 == 7) {
+            overdue.push_back(task->id);
+        }
+    }
+    for (int i = 0; i < 200; ++i) {
+        manager_.createTask(makeTask("no due date"));
+    }
+
+    TaskFilter filter;
+    filter.range(TaskTimeField::DUE_DATE).until = DueDate::parse("2030-01-01")->seconds;
+    TaskPage first = manager_.getTasksAfter(0, 3, filter);
+    EXPECT_EQ(first.examined, overdue.size());
+    ASSERT_EQ(first.tasks.size(), 3u);
+    for (size_t k = 0; k < 3; ++k) {
+        EXPECT_EQ(first.tasks[k]->id, overdue[k]);
+    }
+    TaskPage rest = manager_.getTasksAfter(first.next_cursor, 3, filter);
+    ASSERT_EQ(rest.tasks.size(), 2u);
+    EXPECT_EQ(rest.tasks[1]->id, overdue[4]);
+    EXPECT_EQ(rest.next_cursor, 0u);
+    EXPECT_EQ(rest.examined, 2u);
+
+    // With two ranges the narrower one drives the walk
+    filter.range(TaskTimeField::CREATED_AT).from = 0;
+    EXPECT_EQ(manager_.getTasksAfter(0, 10, filter).examined, overdue.size());
+    filter.status = TaskStatus::PENDING;  // Every overdue task is completed
+    EXPECT_TRUE(manager_.getAllTasks(filter, 10, 0).empty());
+}
+
+TEST_P(TaskManagerTest, IndexesFollowUpdatesAndDeletes) {
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 30; ++i) {
+        ids.push_back(manager_.createTask(makeTask("t", i % 3 == 0 ? "completed" : "pending"))->id);
+    }
+
+    // Pages come back in id order across all shards
+    auto page = manager_.getAllTasks({TaskStatus::COMPLETED, {}}, 4, 2);
+    ASSERT_EQ(page.size(), 4u);
+    for (size_t i = 0; i < page.size(); ++i) {
+        EXPECT_EQ(page[i]->id, ids[(i + 2) * 3]);
+    }
+
+    Json::Value update;
+    update["status"] = "completed";
+    update["priority"] = "high";
+    manager_.updateTask(ids[1], update);
+    manager_.deleteTask(ids[0]);
+
+    EXPECT_EQ(manager_.getAllTasks({TaskStatus::COMPLETED, {}}, 100, 0).size(), 10u);
+    auto high = manager_.getAllTasks({{}, TaskPriority::HIGH}, 100, 0);
+    ASSERT_EQ(high.size(), 1u);
+    EXPECT_EQ(high[0]->id, ids[1]);
+    EXPECT_EQ(manager_.getAllTasks({TaskStatus::PENDING, {}}, 100, 0).size(), 19u);
+
+    // Counters track the same transitions
+    TaskStatistics stats = manager_.getStatisticsSnapshot();
+    EXPECT_EQ(stats.total, 29u);
+    EXPECT_EQ(stats.by_status[static_cast<size_t>(TaskStatus::COMPLETED)], 10u);
+    EXPECT_EQ(stats.by_status[static_cast<size_t>(TaskStatus::PENDING)], 19u);
+    EXPECT_EQ(stats.by_priority[static_cast<size_t>(TaskPriority::HIGH)], 1u);
+    EXPECT_EQ(stats.by_priority[static_cast<size_t>(TaskPriority::MEDIUM)], 28u);
+}
+
+TEST_P(TaskManagerTest, KeysetPaginationWalksInIdOrder) {
+    for (int i = 0; i < 25; ++i) {
+        manager_.createTask(makeTask("t", i % 2 == 0 ? "pending" : "completed"));
+    }
+    manager_.deleteTask(5);
+
+    std::vector<uint64_t> walked;
+    uint64_t cursor = 0;
+    do {
+        TaskPage page = manager_.getTasksAfter(cursor, 7);
+        for (const auto& task : page.tasks) {
+            walked.push_back(task->id);
+        }
+        cursor = page.next_cursor;
+    } while (cursor != 0);
+
+    ASSERT_EQ(walked.size(), 24u);
+    EXPECT_TRUE(std::is_sorted(walked.begin(), walked.end()));
+    EXPECT_EQ(std::count(walked.begin(), walked.end(), 5u), 0);
+
+    // Filtered walk, and a page that ends exactly at the last match
+    TaskPage pending = manager_.getTasksAfter(20, 10, {TaskStatus::PENDING, {}});
+    ASSERT_EQ(pending.tasks.size(), 3u);
+    EXPECT_EQ(pending.tasks.front()->id, 21u);
+    EXPECT_EQ(pending.next_cursor, 0u);
+    EXPECT_EQ(manager_.getTasksAfter(24, 1, {TaskStatus::PENDING, {}}).next_cursor, 0u);
+    EXPECT_EQ(manager_.getTasksAfter(20, 1, {TaskStatus::PENDING, {}}).next_cursor, 21u);
+}
+
+TEST_P(TaskManagerTest, BatchOperationsReportPerItem) {
+    std::vector<Json::Value> items;
+    for (int i = 0; i < 40; ++i) {
+        items.push_back(makeTask("batch " + std::to_string(i)));
+    }
+    items[5] = makeTask("bad", "unknown");
+
+    std::vector<TaskPtr> created = manager_.createTasks(items);
+    ASSERT_EQ(created.size(), 40u);
+    EXPECT_EQ(created[5], nullptr);
+    EXPECT_EQ(manager_.getTaskCount(), 39u);
+    // Ids are handed out contiguously in input order
+    EXPECT_EQ(created[0]->id, 1u);
+    EXPECT_EQ(created[39]->id, 39u);
+    EXPECT_EQ(manager_.getTask(created[20]->id)->title, "batch 20");
+
+    TaskPatch done;
+    done.status = TaskStatus::COMPLETED;
+    TaskPatch renamed;
+    renamed.title = "renamed";
+    std::vector<TaskUpdate> updates = {{1, done}, {2, done}, {1, renamed}, {999, done}};
+    std::vector<TaskPtr> patched = manager_.updateTasks(updates);
+    ASSERT_EQ(patched.size(), 4u);
+    EXPECT_EQ(patched[3], nullptr);
+    // Repeated ids apply in order on top of each other
+    EXPECT_EQ(patched[2]->title, "renamed");
+    EXPECT_EQ(patched[2]->status, TaskStatus::COMPLETED);
+    EXPECT_EQ(patched[2]->version, 3u);
+    EXPECT_EQ(manager_.getAllTasks({TaskStatus::COMPLETED, {}}, 10, 0).size(), 2u);
+
+    std::vector<uint64_t> ids = {3, 4, 3, 999};
+    std::vector<bool> removed = manager_.deleteTasks(ids);
+    EXPECT_EQ(removed, (std::vector<bool>{true, true, false, false}));
+    EXPECT_EQ(manager_.getTaskCount(), 37u);
+    EXPECT_EQ(manager_.getStatisticsSnapshot().total, 37u);
+}
+
+TEST_P(TaskManagerTest, ConcurrentWritersAndReaders) {
+    constexpr int kThreads = 4;
+    constexpr int kPerThread = 200;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([this] {
+            for (int i = 0; i < kPerThread; ++i) {
+                auto task = manager_.createTask(makeTask("concurrent"));
+                ASSERT_NE(task, nullptr);
+                EXPECT_NE(manager_.getTask(task->id), nullptr);
+                if (i % 4 == 0) {
+                    manager_.deleteTask(task->id);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(manager_.getTaskCount(), static_cast<size_t>(kThreads * kPerThread * 3 / 4));
+}
+
+// Conditional list requests rely on this: every published write changes
+// the generation, reads and writes that find nothing leave it alone
+TEST_P(TaskManagerTest, GenerationChangesOnEveryWrite) {
+    uint64_t generation = manager_.generation();
+    auto task = manager_.createTask(makeTask("tracked"));
+    EXPECT_GT(manager_.generation(), generation);
+
+    generation = manager_.generation();
+    manager_.getTask(task->id);
+    manager_.getAllTasks({}, 10, 0);
+    EXPECT_FALSE(manager_.deleteTask(999));
+    EXPECT_EQ(manager_.updateTask(999, makeTask("missing")), nullptr);
+    EXPECT_EQ(manager_.generation(), generation);
+
+    EXPECT_NE(manager_.updateTask(task->id, makeTask("renamed")), nullptr);
+    EXPECT_GT(manager_.generation(), generation);
+    generation = manager_.generation();
+
+    manager_.createTasks(std::vector<Json::Value>{makeTask("a"), makeTask("b")});
+    EXPECT_GT(manager_.generation(), generation);
+    generation = manager_.generation();
+
+    EXPECT_TRUE(manager_.deleteTask(task->id));
+    EXPECT_GT(manager_.generation(), generation);
+
+    // A new store does not restart from the old one's values
+    EXPECT_GT(TaskManager(GetParam()).generation(), generation);
+}
+
+INSTANTIATE_TEST_SUITE_P(ShardCounts, TaskManagerTest, ::testing::Values(1, 8));
+
+// Partitions own ids by residue, so each one's creates stay in its shards
+TEST(PartitionedTaskManagerTest, CreatesFillTheHomePartition) {
+    TaskManager manager(6, 4);
+    EXPECT_EQ(manager.getPartitionCount(), 4u);
+    EXPECT_EQ(manager.getShardCount(), 8u);  // Rounded up to a multiple
+
+    std::vector<std::vector<uint64_t>> ids(4);
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < 4; ++p) {
+        threads.emplace_back([&, p] {
+            TaskManager::setHomePartition(p);
+            for (int i = 0; i < 10; ++i) {
+                ids[p].push_back(manager.createTask(makeTask("single"))->id);
+            }
+            Json::Value items[] = {makeTask("batch"), makeTask("batch")};
+            for (const auto& task : manager.createTasks(items)) {
+                ids[p].push_back(task->id);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::set<uint64_t> all;
+    for (size_t p = 0; p < 4; ++p) {
+        ASSERT_EQ(ids[p].size(), 12u);
+        EXPECT_TRUE(std::is_sorted(ids[p].begin(), ids[p].end()));
+        for (uint64_t id : ids[p]) {
+            EXPECT_NE(id, 0u);
+            EXPECT_EQ(manager.partitionOf(id), p);
+            all.insert(id);
+        }
+    }
+    EXPECT_EQ(all.size(), 48u);
+    EXPECT_EQ(manager.getTaskCount(), 48u);
+    EXPECT_GT(manager.nextId(), *all.rbegin());
+    // Lists still see every partition, in id order
+    auto listed = manager.getAllTasks({}, 100, 0);
+    ASSERT_EQ(listed.size(), 48u);
+    EXPECT_EQ(listed.front()->id, *all.begin());
+    EXPECT_EQ(listed.back()->id, *all.rbegin());
+}
+
+TEST(PartitionedTaskManagerTest, NewIdsClearEverythingRestored) {
+    TaskManager manager(4, 2);
+    auto restored = Task::fromJson(makeTask("restored"));
+    restored->id = 41;
+    manager.restoreTasks(std::span<const std::shared_ptr<Task>>(&restored, 1));
+    EXPECT_GE(manager.nextId(), 42u);
+
+    for (size_t p = 0; p < 2; ++p) {
+        std::thread([&, p] {
+            TaskManager::setHomePartition(p);
+            auto task = manager.createTask(makeTask("after"));
+            EXPECT_GT(task->id, 41u);
+            EXPECT_EQ(manager.partitionOf(task->id), p);
+        }).join();
+    }
+
+    // A store of one partition behaves as before
+    TaskManager single;
+    EXPECT_EQ(single.getPartitionCount(), 1u);
+    EXPECT_EQ(single.createTask(makeTask("first"))->id, 1u);
+    EXPECT_EQ(single.createTask(makeTask("second"))->id, 2u);
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include "../include/text_index.h"
+#include <algorithm>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace http_server::text_index;
+
+namespace {
+
+std::vector<uint64_t> contents(const PostingList& list) {
+    std::vector<uint64_t> ids;
+    uint64_t block[PostingList::kBlockSize];
+    for (size_t b = 0; b < list.blockCount(); ++b) {
+        size_t n = list.decode(b, block);
+        ids.insert(ids.end(), block, block + n);
+    }
+    return ids;
+}
+
+std::vector<uint64_t> sortedSample(std::mt19937_64& rng, size_t count, uint64_t range) {
+    std::set<uint64_t> ids;
+    std::uniform_int_distribution<uint64_t> dist(1, range);
+    while (ids.size() < count) {
+        ids.insert(dist(rng));
+    }
+    return {ids.begin(), ids.end()};
+}
+
+} // namespace
+
+TEST(TextIndexTest, TokenizesIntoDistinctLowercaseTerms) {
+    std::vector<std::string> tokens;
+    tokenize("Fix the  login-page, then FIX tests (v2)", tokens);
+    EXPECT_EQ(tokens, (std::vector<std::string>{"fix", "login", "page", "tests", "the", "then", "v2"}));
+
+    // UTF-8 stays inside a term; over-long runs are cut
+    tokens.clear();
+    tokenize("caf\xc3\xa9 " + std::string(100, 'x'), tokens);
+    ASSERT_EQ(tokens.size(), 2u);
+    EXPECT_EQ(tokens[0], "caf\xc3\xa9");
+    EXPECT_EQ(tokens[1].size(), kMaxTokenLength);
+}
+
+TEST(TextIndexTest, PostingListMatchesSetUnderRandomEdits) {
+    std::mt19937_64 rng(7);
+    std::uniform_int_distribution<uint64_t> id_dist(1, 5000);
+    PostingList list;
+    std::set<uint64_t> expected;
+
+    // Appends in order first, the way fresh ids arrive, then random churn
+    for (uint64_t id = 1; id <= 1000; id += 3) {
+        list.insert(id);
+        expected.insert(id);
+    }
+    for (int i = 0; i < 20000; ++i) {
+        uint64_t id = id_dist(rng);
+        if (rng() % 3 == 0) {
+            list.erase(id);
+            expected.erase(id);
+        } else {
+            list.insert(id);
+            expected.insert(id);
+        }
+    }
+
+    EXPECT_EQ(list.size(), expected.size());
+    EXPECT_EQ(contents(list), std::vector<uint64_t>(expected.begin(), expected.end()));
+    EXPECT_EQ(list.firstBlockAfter(UINT64_MAX), list.blockCount());
+}
+
+TEST(TextIndexTest, IntersectMatchesScalarMerge) {
+    std::mt19937_64 rng(11);
+    for (int round = 0; round < 200; ++round) {
+        auto a = sortedSample(rng, 1 + rng() % 130, 400);
+        auto b = sortedSample(rng, 1 + rng() % 130, 400);
+        std::vector<uint64_t> expected;
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+
+        std::vector<uint64_t> out(std::min(a.size(), b.size()));
+        out.resize(intersect(a.data(), a.size(), b.data(), b.size(), out.data()));
+        EXPECT_EQ(out, expected);
+    }
+}
+
+TEST(TextIndexTest, SearchIntersectsTermsInIdOrder) {
+    TextIndex index;
+    for (uint64_t id = 1; id <= 1000; ++id) {
+        std::string title = id % 2 == 0 ? "even report" : "odd report";
+        index.add(id, title, id % 5 == 0 ? "quarterly" : "");
+    }
+
+    std::vector<std::string> terms{"even", "quarterly"};
+    std::vector<uint64_t> found;
+    index.search(terms, 0, [&](uint64_t id) {
+        found.push_back(id);
+        return true;
+    });
+    ASSERT_EQ(found.size(), 100u);
+    for (size_t i = 0; i < found.size(); ++i) {
+        EXPECT_EQ(found[i], (i + 1) * 10);
+    }
+
+    // Resumes after a cursor and stops when asked
+    found.clear();
+    index.search(terms, 500, [&](uint64_t id) {
+        found.push_back(id);
+        return found.size() < 3;
+    });
+    EXPECT_EQ(found, (std::vector<uint64_t>{510, 520, 530}));
+
+    // Changing the text moves only the terms that differ
+    index.replace(10, "even report", "quarterly", "even report", "");
+    index.remove(20, "even report", "quarterly");
+    found.clear();
+    index.search(terms, 0, [&](uint64_t id) {
+        found.push_back(id);
+        return false;
+    });
+    EXPECT_EQ(found, (std::vector<uint64_t>{30}));
+    EXPECT_EQ(index.find("missing"), nullptr);
+    EXPECT_EQ(index.find("report")->size(), 999u);
+}
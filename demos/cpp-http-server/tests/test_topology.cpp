@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include "../include/topology.h"
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace http_server::topology;
+
+TEST(TopologyTest, ParsesKernelCpuLists) {
+    std::vector<int> cpus;
+    ASSERT_TRUE(parseCpuList("0-3,8,10-11\n", cpus));
+    EXPECT_EQ(cpus, (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    ASSERT_TRUE(parseCpuList("\n", cpus));
+    EXPECT_TRUE(cpus.empty());
+    EXPECT_FALSE(parseCpuList("3-1", cpus));
+    EXPECT_FALSE(parseCpuList("0,x", cpus));
+    EXPECT_FALSE(parseCpuList("-2", cpus));
+}
+
+TEST(TopologyTest, ReadsNodesWithAllowedCpus) {
+    char pattern[] = "/tmp/task-topology-XXXXXX";
+    ASSERT_NE(mkdtemp(pattern), nullptr);
+    const std::filesystem::path root(pattern);
+    auto node = [&](const std::string& name, const std::string& cpulist) {
+        std::filesystem::create_directories(root / name);
+        std::ofstream(root / name / "cpulist") << cpulist;
+    };
+    node("node1", "4-7\n");
+    node("node0", "0-3\n");
+    node("node2", "\n");        // Memory only
+    node("possible", "0-2\n");  // Not a node directory
+
+    // A cpuset that leaves node 1 a single CPU
+    auto nodes = discoverNodes(root.string(), {0, 1, 2, 3, 6});
+    ASSERT_EQ(nodes.size(), 2u);
+    EXPECT_EQ(nodes[0].id, 0);
+    EXPECT_EQ(nodes[0].cpus, (std::vector<int>{0, 1, 2, 3}));
+    EXPECT_EQ(nodes[1].id, 1);
+    EXPECT_EQ(nodes[1].cpus, (std::vector<int>{6}));
+
+    // Without sysfs, one node of everything allowed
+    nodes = discoverNodes((root / "missing").string(), {0, 2});
+    ASSERT_EQ(nodes.size(), 1u);
+    EXPECT_EQ(nodes[0].cpus, (std::vector<int>{0, 2}));
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(TopologyTest, PinnedThreadsPassTheMaskOn) {
+    const std::vector<int> allowed = allowedCpus();
+    ASSERT_FALSE(allowed.empty());
+    EXPECT_FALSE(discoverNodes().empty());
+
+    const std::vector<int> one{allowed.back()};
+    {
+        ScopedAffinity pinned(one);
+        ASSERT_TRUE(pinned.pinned());
+        EXPECT_EQ(allowedCpus(), one);
+        std::vector<int> inherited;
+        std::thread([&] { inherited = allowedCpus(); }).join();
+        EXPECT_EQ(inherited, one);
+    }
+    EXPECT_EQ(allowedCpus(), allowed);
+}
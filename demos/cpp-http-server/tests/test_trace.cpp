@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include "../include/trace.h"
+#include "../include/json_utils.h"
+#include "../include/task_manager.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace http_server;
+using namespace http_server::trace;
+
+namespace {
+
+using std::chrono::milliseconds;
+
+size_t spansOf(const RequestTrace& trace, Phase phase) {
+    return static_cast<size_t>(std::count_if(trace.spans().begin(), trace.spans().end(),
+                                             [phase](const auto& span) { return span.phase == phase; }));
+}
+
+} // namespace
+
+TEST(TraceTest, RecordsHotPathPhasesOfTheActiveRequestOnly) {
+    if (!kEnabled) {
+        GTEST_SKIP() << "built without ENABLE_TRACING";
+    }
+    TaskManager manager;
+    const std::string body = R"({"title":"Write report","priority":"high"})";
+
+    // Outside a sampled request the timers have nowhere to record
+    ASSERT_EQ(t_current, nullptr);
+    manager.createTask(json_utils::parseJson(body));
+
+    RequestTrace trace;
+    trace.begin(Clock::now());
+    {
+        Activation active(&trace);
+        manager.createTask(json_utils::parseJson(body));
+        manager.getAllTasks(TaskFilter{}, 10, 0);
+    }
+    EXPECT_EQ(t_current, nullptr);
+
+    EXPECT_EQ(spansOf(trace, Phase::PARSE), 1u);
+    EXPECT_EQ(spansOf(trace, Phase::VALIDATE), 1u);
+    EXPECT_EQ(spansOf(trace, Phase::SERIALIZE), 1u);
+    // The create's write lock and the list's read locks
+    EXPECT_EQ(spansOf(trace, Phase::LOCK_WAIT), 2u);
+    EXPECT_EQ(spansOf(trace, Phase::LOCK_HOLD), 2u);
+    for (const auto& span : trace.spans()) {
+        EXPECT_LE(trace.started(), span.begin);
+        EXPECT_LE(span.begin, span.end);
+    }
+
+    // An inactive trace is never made current
+    trace.end();
+    Activation ended(&trace);
+    EXPECT_EQ(t_current, nullptr);
+}
+
+TEST(TraceTest, KeepsTotalsPastTheSpanLimit) {
+    RequestTrace trace;
+    const auto start = Clock::now();
+    trace.begin(start);
+    for (size_t i = 0; i < RequestTrace::kMaxSpans + 5; ++i) {
+        trace.add(Phase::PARSE, start, start + milliseconds(1));
+    }
+    EXPECT_EQ(trace.spans().size(), RequestTrace::kMaxSpans);
+    EXPECT_EQ(trace.dropped(), 5u);
+    EXPECT_EQ(trace.total(Phase::PARSE), milliseconds(RequestTrace::kMaxSpans + 5));
+
+    // begin() starts over
+    trace.begin(start);
+    EXPECT_TRUE(trace.spans().empty());
+    EXPECT_EQ(trace.total(Phase::PARSE), Clock::duration::zero());
+}
+
+TEST(TraceTest, SamplesOneRequestInNPerThread) {
+    Tracer off(Settings{});
+    EXPECT_FALSE(off.enabled());
+    EXPECT_FALSE(off.sample());
+    if (!kEnabled) {
+        GTEST_SKIP() << "built without ENABLE_TRACING";
+    }
+
+    Tracer tracer(Settings{4, 0, {}});
+    // A fresh thread, so no other test's countdown carries over
+    size_t sampled = 0;
+    std::thread([&] {
+        for (int i = 0; i < 40; ++i) {
+            sampled += tracer.sample() ? 1 : 0;
+        }
+    }).join();
+    EXPECT_EQ(sampled, 10u);
+}
+
+TEST(TraceTest, LogsSlowRequestsWithTheirBreakdown) {
+    if (!kEnabled) {
+        GTEST_SKIP() << "built without ENABLE_TRACING";
+    }
+    std::ostringstream log;
+    Tracer tracer(Settings{1, 10, {}}, &log);
+
+    const auto start = Clock::now();
+    RequestTrace fast;
+    fast.begin(start);
+    fast.responded(200, start + milliseconds(1));
+    tracer.finish(fast, metrics::Route::TASK, metrics::Method::GET, start + milliseconds(2));
+    EXPECT_FALSE(fast.active());
+    EXPECT_TRUE(log.str().empty());
+
+    RequestTrace slow;
+    slow.begin(start);
+    slow.add(Phase::PARSE, start, start + milliseconds(3));
+    slow.add(Phase::LOCK_WAIT, start + milliseconds(3), start + milliseconds(15));
+    slow.responded(201, start + milliseconds(16));
+    tracer.finish(slow, metrics::Route::TASKS, metrics::Method::POST, start + milliseconds(20));
+    EXPECT_EQ(log.str(),
+              "Slow request: POST /api/v1/tasks 201 20.000 ms "
+              "(parse 3.000 ms, lock_wait 12.000 ms, send 4.000 ms)\n");
+
+    EXPECT_EQ(tracer.traced(), 2u);
+    EXPECT_EQ(tracer.slow(), 1u);
+    std::string prometheus;
+    tracer.appendPrometheus(prometheus);
+    EXPECT_NE(prometheus.find("http_slow_requests_total 1\n"), std::string::npos);
+    EXPECT_NE(prometheus.find("http_request_phase_seconds_count{phase=\"send\"} 2\n"), std::string::npos);
+    EXPECT_NE(prometheus.find("http_request_phase_seconds_count{phase=\"lock_wait\"} 1\n"), std::string::npos);
+    EXPECT_EQ(prometheus.find("phase=\"validate\""), std::string::npos);
+}
+
+TEST(TraceTest, WritesTracedRequestsAsChromeTraceEvents) {
+    if (!kEnabled) {
+        GTEST_SKIP() << "built without ENABLE_TRACING";
+    }
+    char pattern[] = "/tmp/task-trace-XXXXXX";
+    ASSERT_NE(mkdtemp(pattern), nullptr);
+    const std::string path = std::string(pattern) + "/trace.json";
+
+    const auto start = Clock::now();
+    {
+        Tracer tracer(Settings{1, 0, path});
+        for (int i = 0; i < 2; ++i) {
+            RequestTrace trace;
+            trace.begin(start);
+            trace.add(Phase::VALIDATE, start, start + milliseconds(1));
+            trace.responded(200, start + milliseconds(2));
+            tracer.finish(trace, metrics::Route::TASK, metrics::Method::PUT, start + milliseconds(3));
+        }
+    }
+
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    Json::Value events = json_utils::parseJson(contents.str());
+    ASSERT_TRUE(events.isArray());
+    ASSERT_EQ(events.size(), 6u);  // Per request: itself, validate, send
+
+    const Json::Value& request = events[0];
+    EXPECT_EQ(request["name"].asString(), "PUT /api/v1/tasks/{id}");
+    EXPECT_EQ(request["ph"].asString(), "X");
+    EXPECT_NEAR(request["dur"].asDouble(), 3000.0, 0.001);
+    EXPECT_EQ(request["args"]["status"].asInt(), 200);
+    EXPECT_EQ(events[1]["name"].asString(), "validate");
+    EXPECT_NEAR(events[1]["dur"].asDouble(), 1000.0, 0.001);
+    EXPECT_EQ(events[1]["ts"].asDouble(), request["ts"].asDouble());
+    EXPECT_EQ(events[2]["name"].asString(), "send");
+    EXPECT_EQ(events[1]["tid"].asUInt(), request["tid"].asUInt());
+
+    std::filesystem::remove_all(pattern);
+}